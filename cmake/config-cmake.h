@@ -90,6 +90,15 @@
 /* Define to 1 if you have the 'flock' function. */
 #cmakedefine HAVE_FLOCK 1
 
+/* Define to 1 if you have the 'mmap' function. */
+#cmakedefine HAVE_MMAP 1
+
+/* Define to 1 if you have the 'pread' and 'pwrite' functions. */
+#cmakedefine HAVE_PREAD 1
+
+/* Define to 1 if you have the 'posix_fadvise' function. */
+#cmakedefine HAVE_POSIX_FADVISE 1
+
 /* Define to 1 if you have the 'strlcpy' function. */
 #cmakedefine HAVE_LIBC_STRLCPY 1
 
@@ -0,0 +1,530 @@
+/*
+  Hatari - asyncWriter.c
+
+  This file is distributed under the GNU General Public License, version 2
+  or at your option any later version. Read the file gpl.txt for details.
+
+  Asynchronous file output, used by the WAV, YM and AVI recorders.
+
+  Data written from the emulation thread is copied into a bounded queue
+  and a single writer thread does the actual fwrite/fseeko calls, so that
+  latency spikes of the output device (e.g. network storage) don't stall
+  the emulation. Consecutive appends to the same file are merged into
+  bigger chunks before they are handed to the writer thread. Only when
+  more than ASYNCWRITER_MAX_PENDING bytes are waiting (the disk can't keep
+  up on average) does the caller block until some data has been written.
+
+  Each ASYNC_FILE tracks its own logical write position, so callers never
+  need to query the real file position, and header fields can be patched
+  later with AsyncWriter_WriteAt() without moving that position.
+
+  Write errors are detected by the writer thread and reported to the
+  caller by the next AsyncWriter_Write() / AsyncWriter_Close() call for
+  that file. If the writer thread can't be created, all requests are
+  processed synchronously in the caller's thread.
+
+  Whole files can also be saved in the writer thread, optionally with
+  a caller supplied save function (e.g. to compress a floppy image).
+  AsyncWriter_WaitForFile() can be used before reading such a file back.
+*/
+const char AsyncWriter_fileid[] = "Hatari asyncWriter.c";
+
+#include <SDL.h>
+#include <SDL_thread.h>
+#include <errno.h>
+
+#include "main.h"
+#include "asyncWriter.h"
+#include "file.h"
+#include "log.h"
+
+
+#define ASYNCWRITER_CHUNK_SIZE	(256*1024)		/* appends are merged up to this size */
+#define ASYNCWRITER_MAX_PENDING	(32*1024*1024)		/* caller blocks above this amount */
+
+typedef enum
+{
+	ASYNCWRITER_WRITE,
+	ASYNCWRITER_CLOSE,
+	ASYNCWRITER_SAVE
+} asyncwriter_op_t;
+
+struct asyncwriter_file_s
+{
+	FILE *fp;
+	char *pszName;
+	off_t nPos;		/* logical position, as seen by the caller */
+	off_t nFilePos;		/* real position of fp, writer thread only */
+	bool bError;		/* set by the writer thread on failure */
+};
+
+typedef struct asyncwriter_req_s
+{
+	struct asyncwriter_req_s *next;
+	asyncwriter_op_t op;
+	ASYNC_FILE *af;
+	char *pszName;		/* file name for ASYNCWRITER_SAVE */
+	ASYNC_SAVE_FUNC saver;	/* save function for ASYNCWRITER_SAVE, or NULL */
+	off_t nOffset;		/* file offset for ASYNCWRITER_WRITE */
+	size_t nLen;		/* bytes used in pData */
+	size_t nSize;		/* bytes allocated for pData */
+	Uint8 *pData;
+} ASYNCWRITER_REQ;
+
+static struct
+{
+	SDL_mutex *lock;
+	SDL_cond *work;		/* signaled when a request is queued */
+	SDL_cond *space;	/* signaled when a request is done */
+	SDL_Thread *thread;
+	ASYNCWRITER_REQ *head;
+	ASYNCWRITER_REQ *tail;
+	ASYNCWRITER_REQ *current;	/* request being processed by the thread */
+	size_t nPending;	/* bytes queued or being written */
+	bool bQuit;
+	bool bInited;
+} AsyncWriter;
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Mark given file as failed, so that its next write/close returns false
+ */
+static void AsyncWriter_SetError(ASYNC_FILE *af)
+{
+	if (AsyncWriter.lock)
+		SDL_LockMutex(AsyncWriter.lock);
+	af->bError = true;
+	if (AsyncWriter.lock)
+		SDL_UnlockMutex(AsyncWriter.lock);
+}
+
+/**
+ * Return true if a write to given file has failed
+ */
+static bool AsyncWriter_HasError(ASYNC_FILE *af)
+{
+	bool bError;
+
+	if (AsyncWriter.lock)
+		SDL_LockMutex(AsyncWriter.lock);
+	bError = af->bError;
+	if (AsyncWriter.lock)
+		SDL_UnlockMutex(AsyncWriter.lock);
+	return bError;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Do the actual file operation for given request and free it.
+ * Called from the writer thread (or from the caller in synchronous mode).
+ */
+static void AsyncWriter_Process(ASYNCWRITER_REQ *req)
+{
+	ASYNC_FILE *af = req->af;
+
+	switch (req->op)
+	{
+	 case ASYNCWRITER_WRITE:
+		if (af->bError)
+			break;
+		if (af->nFilePos != req->nOffset
+		    && fseeko(af->fp, req->nOffset, SEEK_SET) != 0)
+		{
+			Log_Printf(LOG_ERROR, "Failed to seek in '%s': %s\n",
+			           af->pszName, strerror(errno));
+			AsyncWriter_SetError(af);
+			break;
+		}
+		if (fwrite(req->pData, 1, req->nLen, af->fp) != req->nLen)
+		{
+			Log_Printf(LOG_ERROR, "Failed to write to '%s': %s\n",
+			           af->pszName, strerror(errno));
+			AsyncWriter_SetError(af);
+			break;
+		}
+		af->nFilePos = req->nOffset + req->nLen;
+		break;
+
+	 case ASYNCWRITER_CLOSE:
+		if (fclose(af->fp) != 0 && !af->bError)
+			Log_Printf(LOG_ERROR, "Failed to close '%s': %s\n",
+			           af->pszName, strerror(errno));
+		free(af->pszName);
+		free(af);
+		break;
+
+	 case ASYNCWRITER_SAVE:
+		/* custom save functions report their result themselves */
+		if (req->saver)
+			req->saver(req->pszName, req->pData, req->nLen);
+		else if (!File_Save(req->pszName, req->pData, req->nLen, false))
+			Log_Printf(LOG_ERROR, "Failed to save '%s'\n", req->pszName);
+		free(req->pszName);
+		break;
+	}
+
+	free(req->pData);
+	free(req);
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Writer thread: process queued requests in order until asked to quit
+ * and the queue is empty.
+ */
+static int AsyncWriter_Thread(void *unused)
+{
+	ASYNCWRITER_REQ *req;
+	size_t nLen;
+
+	SDL_LockMutex(AsyncWriter.lock);
+	for (;;)
+	{
+		while (!AsyncWriter.head && !AsyncWriter.bQuit)
+			SDL_CondWait(AsyncWriter.work, AsyncWriter.lock);
+		if (!AsyncWriter.head)
+			break;
+
+		req = AsyncWriter.head;
+		AsyncWriter.head = req->next;
+		if (!AsyncWriter.head)
+			AsyncWriter.tail = NULL;
+		nLen = req->nLen;
+		AsyncWriter.current = req;
+
+		SDL_UnlockMutex(AsyncWriter.lock);
+		AsyncWriter_Process(req);
+		SDL_LockMutex(AsyncWriter.lock);
+
+		AsyncWriter.current = NULL;
+		AsyncWriter.nPending -= nLen;
+		SDL_CondBroadcast(AsyncWriter.space);
+	}
+	SDL_UnlockMutex(AsyncWriter.lock);
+
+	return 0;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Create the writer thread on first use.
+ * Return true if it's running, false if requests need to be
+ * processed synchronously.
+ */
+static bool AsyncWriter_Init(void)
+{
+	if (AsyncWriter.bInited)
+		return AsyncWriter.thread != NULL;
+	AsyncWriter.bInited = true;
+
+	AsyncWriter.lock = SDL_CreateMutex();
+	AsyncWriter.work = SDL_CreateCond();
+	AsyncWriter.space = SDL_CreateCond();
+	if (AsyncWriter.lock && AsyncWriter.work && AsyncWriter.space)
+		AsyncWriter.thread = SDL_CreateThread(AsyncWriter_Thread,
+		                                      "hatari-writer", NULL);
+	if (!AsyncWriter.thread)
+	{
+		Log_Printf(LOG_WARN, "Failed to create file writer thread (%s), "
+		           "writing files synchronously.\n", SDL_GetError());
+		return false;
+	}
+	return true;
+}
+
+
+/**
+ * Hand given request to the writer thread, waiting first if too
+ * much data is already pending.
+ */
+static void AsyncWriter_Enqueue(ASYNCWRITER_REQ *req)
+{
+	if (!AsyncWriter_Init())
+	{
+		AsyncWriter_Process(req);
+		return;
+	}
+
+	SDL_LockMutex(AsyncWriter.lock);
+	while (AsyncWriter.nPending > 0
+	       && AsyncWriter.nPending + req->nLen > ASYNCWRITER_MAX_PENDING)
+		SDL_CondWait(AsyncWriter.space, AsyncWriter.lock);
+
+	req->next = NULL;
+	if (AsyncWriter.tail)
+		AsyncWriter.tail->next = req;
+	else
+		AsyncWriter.head = req;
+	AsyncWriter.tail = req;
+	AsyncWriter.nPending += req->nLen;
+
+	SDL_CondSignal(AsyncWriter.work);
+	SDL_UnlockMutex(AsyncWriter.lock);
+}
+
+
+/**
+ * Allocate a new request, with room for at least nSize bytes of data
+ */
+static ASYNCWRITER_REQ *AsyncWriter_NewReq(asyncwriter_op_t op, ASYNC_FILE *af, size_t nSize)
+{
+	ASYNCWRITER_REQ *req;
+
+	req = calloc(1, sizeof(*req));
+	if (!req)
+		return NULL;
+	if (nSize)
+	{
+		req->pData = malloc(nSize);
+		if (!req->pData)
+		{
+			free(req);
+			return NULL;
+		}
+		req->nSize = nSize;
+	}
+	req->op = op;
+	req->af = af;
+	return req;
+}
+
+
+/**
+ * Queue nLen bytes to be written at given offset. If the last queued
+ * request is an append to the same file ending at that offset, and
+ * hasn't been picked up by the writer thread yet, data is merged into it.
+ */
+static bool AsyncWriter_Queue(ASYNC_FILE *af, off_t nOffset, const void *pData, size_t nLen)
+{
+	ASYNCWRITER_REQ *req;
+
+	if (AsyncWriter_HasError(af))
+		return false;
+	if (!nLen)
+		return true;
+
+	if (AsyncWriter_Init())
+	{
+		SDL_LockMutex(AsyncWriter.lock);
+		req = AsyncWriter.tail;
+		if (req && req->op == ASYNCWRITER_WRITE && req->af == af
+		    && req->nOffset + (off_t)req->nLen == nOffset
+		    && req->nLen + nLen <= req->nSize)
+		{
+			memcpy(req->pData + req->nLen, pData, nLen);
+			req->nLen += nLen;
+			AsyncWriter.nPending += nLen;
+			SDL_UnlockMutex(AsyncWriter.lock);
+			return true;
+		}
+		SDL_UnlockMutex(AsyncWriter.lock);
+	}
+
+	req = AsyncWriter_NewReq(ASYNCWRITER_WRITE, af,
+	                         nLen > ASYNCWRITER_CHUNK_SIZE ? nLen : ASYNCWRITER_CHUNK_SIZE);
+	if (!req)
+	{
+		Log_Printf(LOG_ERROR, "Out of memory while writing '%s'\n", af->pszName);
+		AsyncWriter_SetError(af);
+		return false;
+	}
+	req->nOffset = nOffset;
+	req->nLen = nLen;
+	memcpy(req->pData, pData, nLen);
+
+	AsyncWriter_Enqueue(req);
+	return true;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Create (truncate) given file for asynchronous writing.
+ * Return handle, or NULL if the file couldn't be opened.
+ */
+ASYNC_FILE *AsyncWriter_Open(const char *pszFileName)
+{
+	ASYNC_FILE *af;
+
+	af = calloc(1, sizeof(*af));
+	if (!af)
+		return NULL;
+
+	af->pszName = strdup(pszFileName);
+	af->fp = fopen(pszFileName, "wb");
+	if (!af->fp || !af->pszName)
+	{
+		if (af->fp)
+			fclose(af->fp);
+		free(af->pszName);
+		free(af);
+		return NULL;
+	}
+	return af;
+}
+
+
+/**
+ * Append data at current (logical) position of given file.
+ * Return false if this or an earlier write failed.
+ */
+bool AsyncWriter_Write(ASYNC_FILE *af, const void *pData, size_t nLen)
+{
+	if (!AsyncWriter_Queue(af, af->nPos, pData, nLen))
+		return false;
+	af->nPos += nLen;
+	return true;
+}
+
+
+/**
+ * Write data at given offset (e.g. to patch a header) without
+ * changing the current position of given file.
+ * Return false if this or an earlier write failed.
+ */
+bool AsyncWriter_WriteAt(ASYNC_FILE *af, off_t nOffset, const void *pData, size_t nLen)
+{
+	return AsyncWriter_Queue(af, nOffset, pData, nLen);
+}
+
+
+/**
+ * Return current (logical) write position of given file
+ */
+off_t AsyncWriter_Tell(ASYNC_FILE *af)
+{
+	return af->nPos;
+}
+
+
+/**
+ * Queue closing of given file after all pending writes. The handle
+ * can't be used anymore after this call.
+ * Return false if a write to it had already failed.
+ */
+bool AsyncWriter_Close(ASYNC_FILE *af)
+{
+	ASYNCWRITER_REQ *req;
+	bool bOk;
+
+	bOk = !AsyncWriter_HasError(af);
+
+	req = AsyncWriter_NewReq(ASYNCWRITER_CLOSE, af, 0);
+	if (!req)
+	{
+		/* no memory, make sure file is still closed */
+		AsyncWriter_UnInit();
+		fclose(af->fp);
+		free(af->pszName);
+		free(af);
+		return false;
+	}
+	AsyncWriter_Enqueue(req);
+	return bOk;
+}
+
+
+/**
+ * Save given buffer in the writer thread with the given save function,
+ * or with File_Save() if that is NULL. Buffer must have been allocated
+ * with malloc() and is freed once it has been written.
+ * Return true when save was queued.  Save function should itself tell
+ * user whether saving succeeded, File_Save() failures are logged.
+ */
+bool AsyncWriter_SaveFileWith(const char *pszFileName, Uint8 *pData, size_t nLen,
+                              ASYNC_SAVE_FUNC saver)
+{
+	ASYNCWRITER_REQ *req;
+
+	req = AsyncWriter_NewReq(ASYNCWRITER_SAVE, NULL, 0);
+	if (req)
+		req->pszName = strdup(pszFileName);
+	if (!req || !req->pszName)
+	{
+		free(req);
+		free(pData);
+		return false;
+	}
+	req->pData = pData;
+	req->nLen = req->nSize = nLen;
+	req->saver = saver;
+
+	AsyncWriter_Enqueue(req);
+	return true;
+}
+
+
+/**
+ * Save given buffer with File_Save() in the writer thread.
+ * Buffer must have been allocated with malloc() and is freed
+ * once it has been written.
+ */
+bool AsyncWriter_SaveFile(const char *pszFileName, Uint8 *pData, size_t nLen)
+{
+	return AsyncWriter_SaveFileWith(pszFileName, pData, nLen, NULL);
+}
+
+
+/**
+ * Return true if the given file is still to be saved by the writer thread.
+ * Must be called with the lock held.
+ */
+static bool AsyncWriter_IsSaving(const char *pszFileName)
+{
+	ASYNCWRITER_REQ *req;
+
+	req = AsyncWriter.current;
+	if (req && req->op == ASYNCWRITER_SAVE && strcmp(req->pszName, pszFileName) == 0)
+		return true;
+	for (req = AsyncWriter.head; req; req = req->next)
+	{
+		if (req->op == ASYNCWRITER_SAVE && strcmp(req->pszName, pszFileName) == 0)
+			return true;
+	}
+	return false;
+}
+
+
+/**
+ * Wait until all queued saves of the given file have been done,
+ * so that it can be read again.
+ */
+void AsyncWriter_WaitForFile(const char *pszFileName)
+{
+	if (!AsyncWriter.thread)
+		return;
+
+	SDL_LockMutex(AsyncWriter.lock);
+	while (AsyncWriter_IsSaving(pszFileName))
+		SDL_CondWait(AsyncWriter.space, AsyncWriter.lock);
+	SDL_UnlockMutex(AsyncWriter.lock);
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Wait until all queued requests are done and stop the writer thread.
+ * It's started again if new writes are queued.
+ */
+void AsyncWriter_UnInit(void)
+{
+	if (AsyncWriter.thread)
+	{
+		SDL_LockMutex(AsyncWriter.lock);
+		AsyncWriter.bQuit = true;
+		SDL_CondSignal(AsyncWriter.work);
+		SDL_UnlockMutex(AsyncWriter.lock);
+		SDL_WaitThread(AsyncWriter.thread, NULL);
+	}
+	if (AsyncWriter.space)
+		SDL_DestroyCond(AsyncWriter.space);
+	if (AsyncWriter.work)
+		SDL_DestroyCond(AsyncWriter.work);
+	if (AsyncWriter.lock)
+		SDL_DestroyMutex(AsyncWriter.lock);
+	memset(&AsyncWriter, 0, sizeof(AsyncWriter));
+}
@@ -27,8 +27,110 @@ bool bSoundWorking = false;			/* Is sound OK */
 static volatile bool bPlayingBuffer = false;	/* Is playing buffer? */
 int SoundBufferSize = 1024 / 4;			/* Size of sound buffer (in samples) */
 int SdlAudioBufferSize = 0;			/* in ms (0 = use default) */
-int pulse_swallowing_count = 0;			/* Sound disciplined emulation rate controlled by  */
-						/*  window comparator and pulse swallowing counter */
+
+/* Sound synchronization : the emulation rate is never altered, instead the
+ * samples are resampled by a small ratio when they are passed to the audio
+ * system, so that the number of buffered samples stays constant.
+ * The ratio is computed by a PI controller on the (low pass filtered)
+ * buffer fill level. It's limited to +/- 0.58% (10 cents).
+ */
+#define AUDIO_SYNC_MAX_ADJUST	0.0058	/* (2^(10cents/(12semitones*100cents)) - 1) */
+#define AUDIO_SYNC_KP		0.03	/* proportional gain */
+#define AUDIO_SYNC_KI		0.00015	/* integral gain (per callback) */
+#define AUDIO_SYNC_FILL_SHIFT	4	/* low pass filter on the fill level : 1/16 */
+
+static Uint32 nResamplePhase;		/* fractional read position in AudioMixBuffer (0.32 fixed point) */
+static double SyncFillLevel;		/* filtered number of buffered samples */
+static double SyncIntegral;		/* integral term of the PI controller */
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Reset the sound synchronization controller, for example when the
+ * sound buffer indexes are reset.
+ */
+void Audio_ResetSync(void)
+{
+	nResamplePhase = 0;
+	SyncFillLevel = 0;
+	SyncIntegral = 0;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Compute the resampling step (32.32 fixed point) to use for the next
+ * 'len' samples, depending on how far the number of buffered samples
+ * is from the target level.
+ */
+static Uint64 Audio_SyncStep(int len)
+{
+	int nSamplesPerFrame, window, target;
+	double error, adjust;
+
+	/* Keep enough samples to cover the irregular sample generation
+	 * (once per emulated VBL) and the audio system's buffer size */
+	nSamplesPerFrame = nAudioFrequency/nScreenRefreshRate;
+	window = (nSamplesPerFrame > SoundBufferSize) ? nSamplesPerFrame : SoundBufferSize;
+	if (window < len)
+		window = len;
+	target = window + (window >> 1) + (window >> 2);
+
+	/* The fill level has a saw tooth shape, as samples are generated
+	 * once per VBL and consumed once per callback => filter it */
+	if (SyncFillLevel == 0)
+		SyncFillLevel = nGeneratedSamples;
+	else
+		SyncFillLevel += (nGeneratedSamples - SyncFillLevel) / (1 << AUDIO_SYNC_FILL_SHIFT);
+
+	error = (SyncFillLevel - target) / target;
+
+	SyncIntegral += AUDIO_SYNC_KI * error;
+	if (SyncIntegral > AUDIO_SYNC_MAX_ADJUST)
+		SyncIntegral = AUDIO_SYNC_MAX_ADJUST;
+	else if (SyncIntegral < -AUDIO_SYNC_MAX_ADJUST)
+		SyncIntegral = -AUDIO_SYNC_MAX_ADJUST;
+
+	adjust = AUDIO_SYNC_KP * error + SyncIntegral;
+	if (adjust > AUDIO_SYNC_MAX_ADJUST)
+		adjust = AUDIO_SYNC_MAX_ADJUST;
+	else if (adjust < -AUDIO_SYNC_MAX_ADJUST)
+		adjust = -AUDIO_SYNC_MAX_ADJUST;
+
+	return (Uint64)((1.0 + adjust) * 4294967296.0);
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Copy 'len' samples from AudioMixBuffer to the audio stream, reading
+ * the source samples with a 'step' increment (32.32 fixed point) and
+ * linear interpolation. Return the number of consumed source samples.
+ */
+static int Audio_Resample(Sint16 *pBuffer, int len, Uint64 step)
+{
+	Uint64 pos = nResamplePhase;
+	int i, c, idx, nConsumed;
+	Sint32 frac;
+
+	for (i = 0; i < len; i++)
+	{
+		idx = AudioMixBuffer_pos_read + (int)(pos >> 32);
+		frac = (pos >> 17) & 0x7fff;
+		for (c = 0; c < 2; c++)
+		{
+			Sint32 a = AudioMixBuffer[idx & AUDIOMIXBUFFER_SIZE_MASK][c];
+			Sint32 b = AudioMixBuffer[(idx + 1) & AUDIOMIXBUFFER_SIZE_MASK][c];
+			*pBuffer++ = a + (((b - a) * frac) >> 15);
+		}
+		pos += step;
+	}
+
+	nConsumed = pos >> 32;
+	nResamplePhase = pos & 0xffffffff;
+	return nConsumed;
+}
+
 
 /*-----------------------------------------------------------------------*/
 /**
@@ -37,41 +139,28 @@ int pulse_swallowing_count = 0;			/* Sound disciplined emulation rate controlled
 static void Audio_CallBack(void *userdata, Uint8 *stream, int len)
 {
 	Sint16 *pBuffer;
-	int i, window, nSamplesPerFrame;
+	int i, nConsumed;
+	Uint64 step;
 
 	pBuffer = (Sint16 *)stream;
 	len = len / 4;  // Use length in samples (16 bit stereo), not in bytes
 
-	/* Adjust emulation rate within +/- 0.58% (10 cents) occasionally,
-	 * to synchronize sound. Note that an octave (frequency doubling)
-	 * has 12 semitones (12th root of two for a semitone), and that
-	 * one semitone has 100 cents (1200th root of two for one cent).
-	 * Ten cents are desired, thus, the 120th root of two minus one is
-	 * multiplied by 1,000,000 to convert to microseconds, and divided
-	 * by nScreenRefreshRate=60 to get a 96 microseconds swallow size.
-	 * (2^(10cents/(12semitones*100cents)) - 1) * 10^6 / nScreenRefreshRate
-	 * See: main.c - Main_WaitOnVbl()
-	 */
-
 //fprintf ( stderr , "audio cb in len=%d gensmpl=%d idx=%d\n" , len , nGeneratedSamples , AudioMixBuffer_pos_read );
-	pulse_swallowing_count = 0;	/* 0 = Unaltered emulation rate */
-
 	if (ConfigureParams.Sound.bEnableSoundSync)
 	{
-		/* Sound synchronized emulation */
-		nSamplesPerFrame = nAudioFrequency/nScreenRefreshRate;
-		window = (nSamplesPerFrame > SoundBufferSize) ? nSamplesPerFrame : SoundBufferSize;
-
-		/* Window Comparator for SoundBufferSize */
-		if (nGeneratedSamples < window + (window >> 1))
-		/* Increase emulation rate to maintain sound synchronization */
-			pulse_swallowing_count = -5793 / nScreenRefreshRate;
-		else
-		if (nGeneratedSamples > (window << 1) + (window >> 2))
-		/* Decrease emulation rate to maintain sound synchronization */
-			pulse_swallowing_count = 5793 / nScreenRefreshRate;
-
-		/* Otherwise emulation rate is unaltered. */
+		/* Sound synchronized emulation : resample with a ratio that
+		 * keeps the number of buffered samples constant. We need one
+		 * more sample than consumed for the interpolation. */
+		step = Audio_SyncStep(len);
+		if (nGeneratedSamples > (int)((nResamplePhase + step * len) >> 32) + 1)
+		{
+			nConsumed = Audio_Resample(pBuffer, len, step);
+			AudioMixBuffer_pos_read = (AudioMixBuffer_pos_read + nConsumed) & AUDIOMIXBUFFER_SIZE_MASK;
+			nGeneratedSamples -= nConsumed;
+			return;
+		}
+		/* Not enough samples, restart from a whole sample */
+		nResamplePhase = 0;
 	}
 
 	if (nGeneratedSamples >= len)
@@ -24,6 +24,10 @@
   PNG compression will often give a x20 ratio when compared to BMP and should
   be used if you have a powerful enough cpu.
 
+  File output is done through the asynchronous writer (asyncWriter.c) : the
+  frames are queued in memory and written to disk by a separate thread, so a
+  slow disk doesn't stall the emulation.
+
   Sound is saved as 16 bits pcm stereo, using the current Hatari sound output
   frequency. For best accuracy, sound frequency should be a multiple of the
   video frequency (to get an integer number of samples per frame) ; this means
@@ -86,6 +90,7 @@ const char AVIRecord_fileid[] = "Hatari avi_record.c";
 
 #include "main.h"
 #include "version.h"
+#include "asyncWriter.h"
 #include "audio.h"
 #include "configuration.h"
 #include "file.h"
@@ -392,12 +397,12 @@ typedef struct {
   int		Width;
   int		Height;
   int		BitCount;
-  FILE		*FileOut;				/* file to write to */
+  ASYNC_FILE	*FileOut;				/* file to write to */
   int		TotalVideoFrames;			/* number of recorded video frames */
   int		TotalAudioFrames;			/* number of recorded audio frames */
   int		TotalAudioSamples;			/* number of recorded audio samples */
 
-  off_t		RiffChunkPosStart;			/* as returned by ftello() */
+  off_t		RiffChunkPosStart;			/* as returned by AsyncWriter_Tell() */
   off_t		MoviChunkPosStart;
 
   int		MoviChunkCount;				/* current 'movi' chunk nbr (0..n) */
@@ -632,7 +637,7 @@ static	bool	Avi_WriteMoviIndex ( RECORD_AVI_PARAMS *pAviParams , AVI_FILE_HEADER
 //fprintf ( stderr , "avi_write_index type=%d count=%d %d %d\n" , type , pAviParams->AviFrameIndex_Count , pAviParams->TotalVideoFrames , pAviParams->TotalAudioFrames );
 	memset ( &IndexChunk , 0 , sizeof ( IndexChunk ) );
 
-	*pPosition = ftello ( pAviParams->FileOut );
+	*pPosition = AsyncWriter_Tell ( pAviParams->FileOut );
 
 	/* Write the 'ix0#' chunk header */
 	if ( type == 0 )							/* Video index */
@@ -664,7 +669,7 @@ static	bool	Avi_WriteMoviIndex ( RECORD_AVI_PARAMS *pAviParams , AVI_FILE_HEADER
 	Avi_StoreU32 ( IndexChunk.entries_in_use , pAviParams->AviFrameIndex_Count );
 
 	/* Write the header */
-	if ( fwrite ( &IndexChunk , sizeof ( AVI_STREAM_INDEX ) , 1 , pAviParams->FileOut ) != 1 )
+	if ( !AsyncWriter_Write ( pAviParams->FileOut , &IndexChunk , sizeof ( AVI_STREAM_INDEX ) ) )
 	{
 		perror ( "Avi_WriteMoviIndex" );
 		Log_AlertDlg ( LOG_ERROR, "AVI recording : failed to write index header" );
@@ -686,7 +691,7 @@ static	bool	Avi_WriteMoviIndex ( RECORD_AVI_PARAMS *pAviParams , AVI_FILE_HEADER
 			*pDuration += pAviParams->pAviFrameIndex[ i ].AudioFrame_Length;	/* For audio super index, duration=sum of all audio frames length */
 		}
 
-		if ( fwrite ( &IndexEntry , sizeof ( IndexEntry ) , 1 , pAviParams->FileOut ) != 1 )
+		if ( !AsyncWriter_Write ( pAviParams->FileOut , &IndexEntry , sizeof ( IndexEntry ) ) )
 		{
 			perror ( "Avi_WriteMoviIndex" );
 			Log_AlertDlg ( LOG_ERROR, "AVI recording : failed to write index entry" );
@@ -756,17 +761,11 @@ static	bool	Avi_CloseMoviChunk ( RECORD_AVI_PARAMS *pAviParams , AVI_FILE_HEADER
 	}
 
 
-	Pos_End = ftello ( pAviParams->FileOut );
+	Pos_End = AsyncWriter_Tell ( pAviParams->FileOut );
 
 	/* Update the size of the 'movi' chunk (including the indexes) */
 	Avi_StoreU32 ( TempSize , Pos_End - pAviParams->MoviChunkPosStart - 8 );
-	if ( fseeko ( pAviParams->FileOut , pAviParams->MoviChunkPosStart+4 , SEEK_SET ) != 0 )
-	{
-		perror ( "Avi_CloseMoviChunk" );
-		Log_AlertDlg ( LOG_ERROR, "AVI recording : failed to seek to movi start" );
-		return false;
-	}
-	if ( fwrite ( TempSize , sizeof ( TempSize ) , 1 , pAviParams->FileOut ) != 1 )
+	if ( !AsyncWriter_WriteAt ( pAviParams->FileOut , pAviParams->MoviChunkPosStart+4 , TempSize , sizeof ( TempSize ) ) )
 	{
 		perror ( "Avi_CloseMoviChunk" );
 		Log_AlertDlg ( LOG_ERROR, "AVI recording : failed to write movi size" );
@@ -790,13 +789,7 @@ static	bool	Avi_CloseMoviChunk ( RECORD_AVI_PARAMS *pAviParams , AVI_FILE_HEADER
 	else
 	{
 		Avi_StoreU32 ( TempSize , (Uint32)(Pos_End - pAviParams->RiffChunkPosStart - 8 ) );
-		if ( fseeko ( pAviParams->FileOut , pAviParams->RiffChunkPosStart+4 , SEEK_SET ) != 0 )
-		{
-			perror ( "Avi_CloseMoviChunk" );
-			Log_AlertDlg ( LOG_ERROR, "AVI recording : failed to seek to riff start" );
-			return false;
-		}
-		if ( fwrite ( TempSize , sizeof ( TempSize ) , 1 , pAviParams->FileOut ) != 1 )
+		if ( !AsyncWriter_WriteAt ( pAviParams->FileOut , pAviParams->RiffChunkPosStart+4 , TempSize , sizeof ( TempSize ) ) )
 		{
 			perror ( "Avi_CloseMoviChunk" );
 			Log_AlertDlg ( LOG_ERROR, "AVI recording : failed to write riff size" );
@@ -804,14 +797,6 @@ static	bool	Avi_CloseMoviChunk ( RECORD_AVI_PARAMS *pAviParams , AVI_FILE_HEADER
 		}
 	}
 
-
-	if ( fseeko ( pAviParams->FileOut , 0 , SEEK_END ) != 0 )
-	{
-		perror ( "Avi_CloseMoviChunk" );
-		Log_AlertDlg ( LOG_ERROR, "AVI recording : failed to seek to end of file" );
-		return false;
-	}
-
 	return true;
 }
 
@@ -844,8 +829,8 @@ static	bool	Avi_CreateNewMoviChunk ( RECORD_AVI_PARAMS *pAviParams , AVI_FILE_HE
 	Avi_Store4cc ( RiffHeader.signature , "RIFF" );
 	Avi_StoreU32 ( RiffHeader.filesize , 0 );				/* completed when closing this chunk */
 	Avi_Store4cc ( RiffHeader.type , "AVIX" );
-	pAviParams->RiffChunkPosStart = ftello ( pAviParams->FileOut );
-	if ( fwrite ( &RiffHeader , sizeof ( RiffHeader ) , 1 , pAviParams->FileOut ) != 1 )
+	pAviParams->RiffChunkPosStart = AsyncWriter_Tell ( pAviParams->FileOut );
+	if ( !AsyncWriter_Write ( pAviParams->FileOut , &RiffHeader , sizeof ( RiffHeader ) ) )
 	{
 		perror ( "Avi_CreateNewMoviChunk" );
 		Log_AlertDlg ( LOG_ERROR, "AVI recording : failed to write next riff header" );
@@ -856,8 +841,8 @@ static	bool	Avi_CreateNewMoviChunk ( RECORD_AVI_PARAMS *pAviParams , AVI_FILE_HE
 	Avi_Store4cc ( ListMovi.ChunkName , "LIST" );
 	Avi_StoreU32 ( ListMovi.ChunkSize , 0 );				/* completed when closing this chunk */
 	Avi_Store4cc ( ListMovi.Name , "movi" );
-	pAviParams->MoviChunkPosStart = ftello ( pAviParams->FileOut );
-	if ( fwrite ( &ListMovi , sizeof ( ListMovi ) , 1 , pAviParams->FileOut ) != 1 )
+	pAviParams->MoviChunkPosStart = AsyncWriter_Tell ( pAviParams->FileOut );
+	if ( !AsyncWriter_Write ( pAviParams->FileOut , &ListMovi , sizeof ( ListMovi ) ) )
 	{
 		perror ( "Avi_CreateNewMoviChunk" );
 		Log_AlertDlg ( LOG_ERROR, "AVI recording : failed to write next movi header" );
@@ -891,7 +876,7 @@ static bool	Avi_RecordVideoStream_BMP ( RECORD_AVI_PARAMS *pAviParams )
 	/* Write the video frame header */
 	Avi_Store4cc ( Chunk.ChunkName , "00db" );				/* stream 0, uncompressed DIB bytes */
 	Avi_StoreU32 ( Chunk.ChunkSize , SizeImage );				/* max size of RGB image */
-	if ( fwrite ( &Chunk , sizeof ( Chunk ) , 1 , pAviParams->FileOut ) != 1 )
+	if ( !AsyncWriter_Write ( pAviParams->FileOut , &Chunk , sizeof ( Chunk ) ) )
 	{
 		perror ( "Avi_RecordVideoStream_BMP" );
 		Log_AlertDlg ( LOG_ERROR, "AVI recording : failed to write bmp frame header" );
@@ -931,7 +916,7 @@ static bool	Avi_RecordVideoStream_BMP ( RECORD_AVI_PARAMS *pAviParams )
 		if ( NeedLock )
 			SDL_UnlockSurface ( pAviParams->Surface );
 
-		if ( (int)fwrite ( pBitmapOut , 1 , pAviParams->Width*3 , pAviParams->FileOut ) != pAviParams->Width*3 )
+		if ( !AsyncWriter_Write ( pAviParams->FileOut , pBitmapOut , pAviParams->Width*3 ) )
 		{
 			perror ( "Avi_RecordVideoStream_BMP" );
 			Log_AlertDlg ( LOG_ERROR, "AVI recording : failed to write bmp video frame" );
@@ -954,14 +939,14 @@ static bool	Avi_RecordVideoStream_PNG ( RECORD_AVI_PARAMS *pAviParams )
 	
 
 	/* Write the video frame header */
-	ChunkPos = ftello ( pAviParams->FileOut );
+	ChunkPos = AsyncWriter_Tell ( pAviParams->FileOut );
 	Avi_Store4cc ( Chunk.ChunkName , "00dc" );				/* stream 0, compressed DIB bytes */
 	Avi_StoreU32 ( Chunk.ChunkSize , 0 );					/* size of PNG image (-> completed later) */
-	if ( fwrite ( &Chunk , sizeof ( Chunk ) , 1 , pAviParams->FileOut ) != 1 )
+	if ( !AsyncWriter_Write ( pAviParams->FileOut , &Chunk , sizeof ( Chunk ) ) )
 		goto png_error;
 
 	/* Write the video frame data */
-	SizeImage = ScreenSnapShot_SavePNG_ToFile(pAviParams->Surface,
+	SizeImage = ScreenSnapShot_SavePNG_ToAsyncFile(pAviParams->Surface,
 		pAviParams->Width, pAviParams->Height, pAviParams->FileOut,
 		pAviParams->VideoCodecCompressionLevel , PNG_FILTER_NONE ,
 		pAviParams->CropLeft , pAviParams->CropRight , pAviParams->CropTop , pAviParams->CropBottom );
@@ -970,13 +955,7 @@ static bool	Avi_RecordVideoStream_PNG ( RECORD_AVI_PARAMS *pAviParams )
 
 	/* Update the size of the video chunk */
 	Avi_StoreU32 ( TempSize , SizeImage );
-	if ( fseeko ( pAviParams->FileOut , ChunkPos+4 , SEEK_SET ) != 0 )
-		goto png_error;
-	if ( fwrite ( TempSize , sizeof ( TempSize ) , 1 , pAviParams->FileOut ) != 1 )
-		goto png_error;
-
-	/* Go to the end of the video frame data */
-	if ( fseeko ( pAviParams->FileOut , 0 , SEEK_END ) != 0 )
+	if ( !AsyncWriter_WriteAt ( pAviParams->FileOut , ChunkPos+4 , TempSize , sizeof ( TempSize ) ) )
 		goto png_error;
 	return true;
 
@@ -993,7 +972,7 @@ bool	Avi_RecordVideoStream ( void )
 {
 	off_t		Pos_Start , Pos_End;
 
-	Pos_Start = ftello ( AviParams.FileOut );
+	Pos_Start = AsyncWriter_Tell ( AviParams.FileOut );
 
 	if ( AviParams.VideoCodec == AVI_RECORD_VIDEO_CODEC_BMP )
 	{
@@ -1016,7 +995,7 @@ bool	Avi_RecordVideoStream ( void )
 		return false;
 	}
 
-	Pos_End = ftello ( AviParams.FileOut );
+	Pos_End = AsyncWriter_Tell ( AviParams.FileOut );
 	AviParams.TotalVideoFrames++;
 
 	/* Store index for this video frame */
@@ -1044,30 +1023,32 @@ bool	Avi_RecordVideoStream ( void )
 static bool	Avi_RecordAudioStream_PCM ( RECORD_AVI_PARAMS *pAviParams , Sint16 pSamples[][2] , int SampleIndex , int SampleLength )
 {
 	AVI_CHUNK	Chunk;
-	Sint16		sample[2];
-	int		i;
+	Sint16		samples[256][2];
+	int		i , n;
 	int		idx;
 
 	/* Write the audio frame header */
 	Avi_Store4cc ( Chunk.ChunkName , "01wb" );				/* stream 1, wave bytes */
 	Avi_StoreU32 ( Chunk.ChunkSize , SampleLength * 4 );			/* 16 bits, stereo -> 4 bytes */
-	if ( fwrite ( &Chunk , sizeof ( Chunk ) , 1 , pAviParams->FileOut ) != 1 )
+	if ( !AsyncWriter_Write ( pAviParams->FileOut , &Chunk , sizeof ( Chunk ) ) )
 	{
 		perror ( "Avi_RecordAudioStream_PCM" );
 		Log_AlertDlg ( LOG_ERROR, "AVI recording : failed to write pcm frame header" );
 		return false;
 	}
 
-	/* Write the audio frame data */
+	/* Write the audio frame data, converted to little endian in blocks of 'samples' size */
 	idx = SampleIndex & AUDIOMIXBUFFER_SIZE_MASK;
-	for ( i = 0 ; i < SampleLength; i++ )
+	for ( i = 0 ; i < SampleLength ; i += n )
 	{
-		/* Convert sample to little endian */
-		sample[0] = SDL_SwapLE16 ( pSamples[ idx ][0]);
-		sample[1] = SDL_SwapLE16 ( pSamples[ idx ][1]);
-		idx = ( idx+1 ) & AUDIOMIXBUFFER_SIZE_MASK;
+		for ( n = 0 ; n < ARRAY_SIZE ( samples ) && i + n < SampleLength ; n++ )
+		{
+			samples[n][0] = SDL_SwapLE16 ( pSamples[ idx ][0]);
+			samples[n][1] = SDL_SwapLE16 ( pSamples[ idx ][1]);
+			idx = ( idx+1 ) & AUDIOMIXBUFFER_SIZE_MASK;
+		}
 		/* And store */
-		if ( fwrite ( &sample , sizeof ( sample ) , 1 , pAviParams->FileOut ) != 1 )
+		if ( !AsyncWriter_Write ( pAviParams->FileOut , samples , n * sizeof ( samples[0] ) ) )
 		{
 			perror ( "Avi_RecordAudioStream_PCM" );
 			Log_AlertDlg ( LOG_ERROR, "AVI recording : failed to write pcm frame" );
@@ -1084,7 +1065,7 @@ bool	Avi_RecordAudioStream ( Sint16 pSamples[][2] , int SampleIndex , int Sample
 {
 	off_t		Pos_Start , Pos_End;
 
-	Pos_Start = ftello ( AviParams.FileOut );
+	Pos_Start = AsyncWriter_Tell ( AviParams.FileOut );
 
 	if ( AviParams.AudioCodec == AVI_RECORD_AUDIO_CODEC_PCM )
 	{
@@ -1098,7 +1079,7 @@ bool	Avi_RecordAudioStream ( Sint16 pSamples[][2] , int SampleIndex , int Sample
 		return false;
 	}
 
-	Pos_End = ftello ( AviParams.FileOut );
+	Pos_End = AsyncWriter_Tell ( AviParams.FileOut );
 	AviParams.TotalAudioFrames++;
 	AviParams.TotalAudioSamples += SampleLength;
 
@@ -1321,7 +1302,7 @@ static bool	Avi_StartRecording_WithParams ( RECORD_AVI_PARAMS *pAviParams , char
 #endif
 
 	/* Open the file */
-	pAviParams->FileOut = fopen ( AviFileName , "wb+" );
+	pAviParams->FileOut = AsyncWriter_Open ( AviFileName );
 	if ( !pAviParams->FileOut )
 	{
 		perror ( "AviStartRecording" );
@@ -1341,7 +1322,7 @@ static bool	Avi_StartRecording_WithParams ( RECORD_AVI_PARAMS *pAviParams , char
 	Avi_BuildFileHeader ( pAviParams , &AviFileHeader );
 	
 	/* Write the AVI header */
-	if ( fwrite ( &AviFileHeader , sizeof ( AviFileHeader ) , 1 , pAviParams->FileOut ) != 1 )
+	if ( !AsyncWriter_Write ( pAviParams->FileOut , &AviFileHeader , sizeof ( AviFileHeader ) ) )
 	{
 		perror ( "AviStartRecording" );
 		Log_AlertDlg ( LOG_ERROR, "AVI recording : failed to write avi header" );
@@ -1357,14 +1338,14 @@ static bool	Avi_StartRecording_WithParams ( RECORD_AVI_PARAMS *pAviParams , char
 	Avi_Store4cc ( ListInfo.Name , "INFO" );
 	Avi_Store4cc ( ListInfo.Info.ChunkName , "ISFT" );
 	Avi_StoreU32 ( ListInfo.Info.ChunkSize , Len );
-	if ( fwrite ( &ListInfo , sizeof ( ListInfo ) , 1 , pAviParams->FileOut ) != 1 )
+	if ( !AsyncWriter_Write ( pAviParams->FileOut , &ListInfo , sizeof ( ListInfo ) ) )
 	{
 		perror ( "AviStartRecording" );
 		Log_AlertDlg ( LOG_ERROR, "AVI recording : failed to write info header" );
 		return false;
 	}
 	/* Write the info string + '\0' and write an optional extra '\0' byte to get a total multiple of 2 */
-	if ( fwrite ( InfoString , Len_rounded , 1 , pAviParams->FileOut ) != 1 )
+	if ( !AsyncWriter_Write ( pAviParams->FileOut , InfoString , Len_rounded ) )
 	{
 		perror ( "AviStartRecording" );
 		Log_AlertDlg ( LOG_ERROR, "AVI recording : failed to write info header" );
@@ -1375,8 +1356,8 @@ static bool	Avi_StartRecording_WithParams ( RECORD_AVI_PARAMS *pAviParams , char
 	Avi_Store4cc ( ListMovi.ChunkName , "LIST" );
 	Avi_StoreU32 ( ListMovi.ChunkSize , 0 );				/* completed when recording stops */
 	Avi_Store4cc ( ListMovi.Name , "movi" );
-	pAviParams->MoviChunkPosStart = ftello ( pAviParams->FileOut );
-	if ( fwrite ( &ListMovi , sizeof ( ListMovi ) , 1 , pAviParams->FileOut ) != 1 )
+	pAviParams->MoviChunkPosStart = AsyncWriter_Tell ( pAviParams->FileOut );
+	if ( !AsyncWriter_Write ( pAviParams->FileOut , &ListMovi , sizeof ( ListMovi ) ) )
 	{
 		perror ( "AviStartRecording" );
 		Log_AlertDlg ( LOG_ERROR, "AVI recording : failed to write movi header" );
@@ -1404,13 +1385,15 @@ static bool	Avi_StopRecording_WithParams ( RECORD_AVI_PARAMS *pAviParams )
 		goto stoprec_error;
 
 	/* Write the updated AVI header */
-	if ( fseeko ( pAviParams->FileOut , 0 , SEEK_SET ) != 0 )
-		goto stoprec_error;
-	if ( fwrite ( &AviFileHeader , sizeof ( AviFileHeader ) , 1 , pAviParams->FileOut ) != 1 )
+	if ( !AsyncWriter_WriteAt ( pAviParams->FileOut , 0 , &AviFileHeader , sizeof ( AviFileHeader ) ) )
 		goto stoprec_error;
 
-	/* Close the file */
-	fclose ( pAviParams->FileOut );
+	/* Close the file (once all pending data has been written) */
+	if ( !AsyncWriter_Close ( pAviParams->FileOut ) )
+	{
+		pAviParams->FileOut = NULL;
+		goto stoprec_error;
+	}
 
 	/* Free index' memory */
 	Avi_FrameIndex_Free ( pAviParams );
@@ -1421,7 +1404,8 @@ static bool	Avi_StopRecording_WithParams ( RECORD_AVI_PARAMS *pAviParams )
 	return true;
 
 stoprec_error:
-	fclose (pAviParams->FileOut);
+	if ( pAviParams->FileOut )
+		AsyncWriter_Close ( pAviParams->FileOut );
 	Avi_FrameIndex_Free ( pAviParams );
 	perror("AviStopRecording");
 	Log_AlertDlg(LOG_ERROR, "AVI recording : failed to update header");
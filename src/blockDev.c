@@ -0,0 +1,971 @@
+/*
+  Hatari - blockDev.c
+
+  This file is distributed under the GNU General Public License, version 2
+  or at your option any later version. Read the file gpl.txt for details.
+
+  Hard disk image access shared by the ACSI, SCSI and IDE emulation.
+
+  When possible, the whole image is memory mapped, so that sector reads
+  and writes are plain memory copies and DMA transfers can copy straight
+  between the mapping and the emulated RAM (see BlockDev_GetReadPtr()).
+  If the image can't be mapped (e.g. no mmap() on the host, or not enough
+  address space on 32-bit hosts for a big image), pread()/pwrite() are
+  used instead, one call per transfer, and as last resort stdio.
+
+  If an overlay directory is configured (--hd-overlay), the images are
+  only opened for reading and all writes go to a per-image copy-on-write
+  overlay file in that directory instead. The overlay file has a header,
+  a bitmap with one bit for each BLOCKDEV_OVL_BLOCK sized block of the
+  image telling whether the block has been written, and a data area
+  where written blocks are stored at the same offset as in the image,
+  so the file is sparse and only the written blocks take disk space.
+  Reads of unwritten blocks fall through to the image. The overlay is
+  kept when Hatari exits and reused if it still matches the image; it
+  can be merged into the image or thrown away with the debugger
+  "hdoverlay" command.
+
+  When the image isn't mapped, a read-ahead buffer can be enabled for
+  the device (used by IDE, whose drivers often read one sector at a
+  time). Each buffer miss reads a whole buffer worth of data starting
+  at the requested offset, so that sequential reads are then served
+  from memory. Writes update the buffered data.
+
+  Every device keeps read/write statistics, which can be shown with the
+  debugger "info harddisk" command.
+*/
+const char BlockDev_fileid[] = "Hatari blockDev.c";
+
+#include "main.h"
+#include <SDL_endian.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <inttypes.h>
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
+#if HAVE_PREAD
+#include <unistd.h>
+#endif
+
+#include "blockDev.h"
+#include "configuration.h"
+#include "file.h"
+#include "log.h"
+#include "str.h"
+
+
+#define BLOCKDEV_OVL_MAGIC	"HATARIOV"
+#define BLOCKDEV_OVL_VERSION	1
+#define BLOCKDEV_OVL_HDRSIZE	32
+#define BLOCKDEV_OVL_BLOCK	512		/* smallest HD sector size */
+#define BLOCKDEV_OVL_BITMAP	4096		/* offset of the block bitmap */
+#define BLOCKDEV_OVL_ALIGN	65536		/* data area alignment, for mmap() */
+
+static BLOCK_DEV *pOpenDevs;		/* for BlockDev_Info() & overlay commands */
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Map the whole image file into memory. Returns false if that's
+ * not possible, in which case normal file I/O has to be used.
+ */
+static Uint8 *BlockDev_Map(BLOCK_DEV *bd, FILE *fp, off_t nFileOffset, bool bWritable)
+{
+#if HAVE_MMAP
+	void *map;
+	int prot = PROT_READ;
+
+	if (bd->size <= 0 || (Uint64)bd->size > SIZE_MAX)
+		return NULL;
+	if (bWritable)
+		prot |= PROT_WRITE;
+
+	map = mmap(NULL, bd->size, prot, MAP_SHARED, fileno(fp), nFileOffset);
+	if (map == MAP_FAILED)
+	{
+		Log_Printf(LOG_DEBUG, "Mapping %s HD image failed (%s), using file I/O.\n",
+			   bd->pszType, strerror(errno));
+		return NULL;
+	}
+	return map;
+#else
+	return NULL;
+#endif
+}
+
+/**
+ * Unmap a mapping done with BlockDev_Map()
+ */
+static void BlockDev_Unmap(BLOCK_DEV *bd, Uint8 *map)
+{
+#if HAVE_MMAP
+	if (map)
+		munmap(map, bd->size);
+#endif
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Read nLen bytes at nOffset from given file, without using the mapping.
+ * Returns true on success.
+ */
+static bool BlockDev_FileRead(FILE *fp, off_t nOffset, void *pData, size_t nLen)
+{
+#if HAVE_PREAD
+	Uint8 *pBuf = pData;
+	size_t nDone = 0;
+	ssize_t ret;
+
+	while (nDone < nLen)
+	{
+		ret = pread(fileno(fp), pBuf + nDone, nLen - nDone, nOffset + nDone);
+		if (ret <= 0)
+		{
+			if (ret < 0 && errno == EINTR)
+				continue;
+			return false;
+		}
+		nDone += ret;
+	}
+	return true;
+#else
+	return fseeko(fp, nOffset, SEEK_SET) == 0
+	       && fread(pData, 1, nLen, fp) == nLen;
+#endif
+}
+
+/**
+ * Write nLen bytes to given file at nOffset, without using the mapping.
+ * Returns true on success.
+ */
+static bool BlockDev_FileWrite(FILE *fp, off_t nOffset, const void *pData, size_t nLen)
+{
+#if HAVE_PREAD
+	const Uint8 *pBuf = pData;
+	size_t nDone = 0;
+	ssize_t ret;
+
+	while (nDone < nLen)
+	{
+		ret = pwrite(fileno(fp), pBuf + nDone, nLen - nDone, nOffset + nDone);
+		if (ret <= 0)
+		{
+			if (ret < 0 && errno == EINTR)
+				continue;
+			return false;
+		}
+		nDone += ret;
+	}
+	return true;
+#else
+	return fseeko(fp, nOffset, SEEK_SET) == 0
+	       && fwrite(pData, 1, nLen, fp) == nLen;
+#endif
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Read/write the image itself or the overlay data area
+ */
+static bool BlockDev_BaseRead(BLOCK_DEV *bd, off_t nOffset, void *pData, size_t nLen)
+{
+	if (bd->map)
+	{
+		memcpy(pData, bd->map + nOffset, nLen);
+		return true;
+	}
+	return BlockDev_FileRead(bd->fp, nOffset, pData, nLen);
+}
+
+static bool BlockDev_BaseWrite(BLOCK_DEV *bd, off_t nOffset, const void *pData, size_t nLen)
+{
+	if (bd->map)
+	{
+		memcpy(bd->map + nOffset, pData, nLen);
+		return true;
+	}
+	return BlockDev_FileWrite(bd->fp, nOffset, pData, nLen);
+}
+
+static bool BlockDev_OvlRead(BLOCK_DEV *bd, off_t nOffset, void *pData, size_t nLen)
+{
+	if (bd->ovlmap)
+	{
+		memcpy(pData, bd->ovlmap + nOffset, nLen);
+		return true;
+	}
+	return BlockDev_FileRead(bd->ovlfp, bd->ovldata + nOffset, pData, nLen);
+}
+
+static bool BlockDev_OvlWrite(BLOCK_DEV *bd, off_t nOffset, const void *pData, size_t nLen)
+{
+	if (bd->ovlmap)
+	{
+		memcpy(bd->ovlmap + nOffset, pData, nLen);
+		return true;
+	}
+	return BlockDev_FileWrite(bd->ovlfp, bd->ovldata + nOffset, pData, nLen);
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Return whether given overlay block has been written
+ */
+static inline bool BlockDev_OvlIsDirty(BLOCK_DEV *bd, Uint32 nBlock)
+{
+	return bd->ovlbitmap[nBlock >> 3] & (1 << (nBlock & 7));
+}
+
+static inline Uint32 BlockDev_OvlBlocks(BLOCK_DEV *bd)
+{
+	return (bd->size + BLOCKDEV_OVL_BLOCK - 1) / BLOCKDEV_OVL_BLOCK;
+}
+
+/**
+ * Fill the overlay file header for the current image
+ */
+static void BlockDev_OvlHeader(BLOCK_DEV *bd, Uint8 *hdr)
+{
+	struct stat st;
+	Uint32 val32;
+	Uint64 val64;
+
+	memset(hdr, 0, BLOCKDEV_OVL_HDRSIZE);
+	memcpy(hdr, BLOCKDEV_OVL_MAGIC, 8);
+	val32 = SDL_SwapBE32(BLOCKDEV_OVL_VERSION);
+	memcpy(hdr + 8, &val32, 4);
+	val32 = SDL_SwapBE32(BLOCKDEV_OVL_BLOCK);
+	memcpy(hdr + 12, &val32, 4);
+	val64 = SDL_SwapBE64(bd->size);
+	memcpy(hdr + 16, &val64, 8);
+	val64 = SDL_SwapBE64(stat(bd->pszName, &st) == 0 ? (Uint64)st.st_mtime : 0);
+	memcpy(hdr + 24, &val64, 8);
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Open the overlay file for the image, or create a new one if there's
+ * none.  If existing one doesn't match the image (size or modification
+ * time), it's renamed with ".old" suffix, or if that's not possible,
+ * overlay isn't opened.
+ * Returns file handle on success, otherwise NULL with *pErr set to
+ * a negative errno value.
+ */
+static FILE *BlockDev_OvlOpenFile(BLOCK_DEV *bd, size_t nBitmapSize, int *pErr)
+{
+	Uint8 hdr[BLOCKDEV_OVL_HDRSIZE], filehdr[BLOCKDEV_OVL_HDRSIZE];
+	Uint32 i;
+	FILE *fp;
+
+	BlockDev_OvlHeader(bd, hdr);
+
+	fp = fopen(bd->pszOvlName, "rb+");
+	if (fp)
+	{
+		if (!File_Lock(fp))
+		{
+			Log_AlertDlg(LOG_ERROR, "%s HD overlay file is in use, by another Hatari instance?\n"
+				     "Each instance needs its own overlay directory.\n'%s'\n",
+				     bd->pszType, bd->pszOvlName);
+			fclose(fp);
+			*pErr = -ENOLCK;
+			return NULL;
+		}
+		if (BlockDev_FileRead(fp, 0, filehdr, sizeof(filehdr))
+		    && memcmp(hdr, filehdr, sizeof(hdr)) == 0
+		    && BlockDev_FileRead(fp, BLOCKDEV_OVL_BITMAP, bd->ovlbitmap, nBitmapSize))
+		{
+			for (i = 0; i < BlockDev_OvlBlocks(bd); i++)
+				bd->nOvlDirty += BlockDev_OvlIsDirty(bd, i);
+			Log_Printf(LOG_INFO, "Using existing %s HD overlay '%s' (%u blocks written).\n",
+				   bd->pszType, bd->pszOvlName, bd->nOvlDirty);
+		}
+		else
+		{
+			/* never throw away writes, move the old overlay aside */
+			size_t nLen = strlen(bd->pszOvlName) + sizeof(".old");
+			char *pszOldName = malloc(nLen);
+
+			File_UnLock(fp);
+			fclose(fp);
+			fp = NULL;
+			if (pszOldName)
+				snprintf(pszOldName, nLen, "%s.old", bd->pszOvlName);
+			if (!pszOldName || File_Exists(pszOldName)
+			    || rename(bd->pszOvlName, pszOldName) != 0)
+			{
+				Log_AlertDlg(LOG_ERROR, "%s HD overlay file doesn't match the image, and it can't be moved aside\n'%s'!\n",
+					     bd->pszType, bd->pszOvlName);
+				free(pszOldName);
+				*pErr = -EEXIST;
+				return NULL;
+			}
+			Log_AlertDlg(LOG_WARN, "%s HD overlay file doesn't match the image, moved it to\n'%s'.\n",
+				     bd->pszType, pszOldName);
+			free(pszOldName);
+			memset(bd->ovlbitmap, 0, nBitmapSize);
+		}
+	}
+	if (!fp)
+	{
+		static const Uint8 zero = 0;
+
+		fp = fopen(bd->pszOvlName, "wb+");
+		if (!fp)
+		{
+			*pErr = -errno;
+			Log_AlertDlg(LOG_ERROR, "Cannot create %s HD overlay file (%s)\n'%s'!\n",
+				     bd->pszType, strerror(-*pErr), bd->pszOvlName);
+			return NULL;
+		}
+		if (!File_Lock(fp))
+		{
+			Log_AlertDlg(LOG_ERROR, "%s HD overlay file is in use, by another Hatari instance?\n"
+				     "Each instance needs its own overlay directory.\n'%s'\n",
+				     bd->pszType, bd->pszOvlName);
+			fclose(fp);
+			*pErr = -ENOLCK;
+			return NULL;
+		}
+		/* header, empty bitmap, and the last data byte to get
+		 * a sparse file of the full size */
+		if (!BlockDev_FileWrite(fp, 0, hdr, sizeof(hdr))
+		    || !BlockDev_FileWrite(fp, BLOCKDEV_OVL_BITMAP, bd->ovlbitmap, nBitmapSize)
+		    || !BlockDev_FileWrite(fp, bd->ovldata + bd->size - 1, &zero, 1))
+		{
+			Log_AlertDlg(LOG_ERROR, "Cannot write %s HD overlay file\n'%s'!\n",
+				     bd->pszType, bd->pszOvlName);
+			File_UnLock(fp);
+			fclose(fp);
+			*pErr = -EIO;
+			return NULL;
+		}
+		Log_Printf(LOG_INFO, "Created %s HD overlay '%s'.\n", bd->pszType, bd->pszOvlName);
+	}
+	return fp;
+}
+
+/**
+ * Return overlay file name for the image: image name with hash of
+ * its full path, so that same named images in different directories
+ * get separate overlays.  Returned string needs to be freed.
+ */
+static char *BlockDev_OvlName(const char *filename)
+{
+	char path[FILENAME_MAX], name[FILENAME_MAX];
+	const char *basename, *s;
+	Uint32 hash = 2166136261u;	/* FNV-1a */
+
+	basename = strrchr(filename, PATHSEP);
+	basename = basename ? basename + 1 : filename;
+
+	strlcpy(path, filename, sizeof(path));
+	File_MakeAbsoluteName(path);
+	for (s = path; *s; s++)
+		hash = (hash ^ (Uint8)*s) * 16777619u;
+
+	snprintf(name, sizeof(name), "%s-%08x", basename, hash);
+	return File_MakePath(ConfigureParams.HardDisk.szOverlayDirectory, name, ".ovl");
+}
+
+/**
+ * Set up the overlay for the image.
+ * Returns zero on success, otherwise a negative errno value.
+ */
+static int BlockDev_OvlOpen(BLOCK_DEV *bd)
+{
+	size_t nBitmapSize;
+	int err = 0;
+	FILE *fp;
+
+	nBitmapSize = (BlockDev_OvlBlocks(bd) + 7) / 8;
+	bd->ovldata = (BLOCKDEV_OVL_BITMAP + nBitmapSize + BLOCKDEV_OVL_ALIGN - 1)
+	              & ~(off_t)(BLOCKDEV_OVL_ALIGN - 1);
+	bd->ovlbitmap = calloc(1, nBitmapSize);
+	if (!bd->ovlbitmap)
+		return -ENOMEM;
+	bd->nOvlDirty = 0;
+
+	fp = BlockDev_OvlOpenFile(bd, nBitmapSize, &err);
+	if (!fp)
+	{
+		free(bd->ovlbitmap);
+		bd->ovlbitmap = NULL;
+		return err;
+	}
+
+	bd->ovlfp = fp;
+	bd->ovlmap = BlockDev_Map(bd, fp, bd->ovldata, true);
+	return 0;
+}
+
+/**
+ * Unmap, unlock and close the overlay file
+ */
+static void BlockDev_OvlClose(BLOCK_DEV *bd)
+{
+	if (!bd->ovlfp)
+		return;
+	BlockDev_Unmap(bd, bd->ovlmap);
+	bd->ovlmap = NULL;
+	File_UnLock(bd->ovlfp);
+	fclose(bd->ovlfp);
+	bd->ovlfp = NULL;
+	free(bd->ovlbitmap);
+	bd->ovlbitmap = NULL;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Read from an image with overlay: split the request into runs of blocks
+ * which are all either written (in the overlay) or not (in the image).
+ */
+static bool BlockDev_OvlReadRuns(BLOCK_DEV *bd, off_t nOffset, Uint8 *pData, size_t nLen)
+{
+	off_t nEnd = nOffset + nLen, nRunEnd;
+	bool bDirty, ok;
+	size_t n;
+
+	while (nOffset < nEnd)
+	{
+		bDirty = BlockDev_OvlIsDirty(bd, nOffset / BLOCKDEV_OVL_BLOCK);
+		nRunEnd = (nOffset / BLOCKDEV_OVL_BLOCK + 1) * BLOCKDEV_OVL_BLOCK;
+		while (nRunEnd < nEnd
+		       && BlockDev_OvlIsDirty(bd, nRunEnd / BLOCKDEV_OVL_BLOCK) == bDirty)
+			nRunEnd += BLOCKDEV_OVL_BLOCK;
+		if (nRunEnd > nEnd)
+			nRunEnd = nEnd;
+
+		n = nRunEnd - nOffset;
+		if (bDirty)
+			ok = BlockDev_OvlRead(bd, nOffset, pData, n);
+		else
+			ok = BlockDev_BaseRead(bd, nOffset, pData, n);
+		if (!ok)
+			return false;
+		pData += n;
+		nOffset += n;
+	}
+	return true;
+}
+
+/**
+ * Copy a not yet written block from the image to the overlay,
+ * before it's partially overwritten.
+ */
+static bool BlockDev_OvlCopyBlock(BLOCK_DEV *bd, Uint32 nBlock)
+{
+	Uint8 buf[BLOCKDEV_OVL_BLOCK];
+	off_t nOffset = (off_t)nBlock * BLOCKDEV_OVL_BLOCK;
+	size_t n = BLOCKDEV_OVL_BLOCK;
+
+	if (BlockDev_OvlIsDirty(bd, nBlock))
+		return true;
+	if (nOffset + (off_t)n > bd->size)
+		n = bd->size - nOffset;
+	return BlockDev_BaseRead(bd, nOffset, buf, n)
+	       && BlockDev_OvlWrite(bd, nOffset, buf, n);
+}
+
+/**
+ * Write to the overlay and mark the written blocks in its bitmap.
+ * The data is written before the bitmap, so an interrupted write
+ * never exposes unwritten overlay blocks.
+ */
+static bool BlockDev_OvlWriteBlocks(BLOCK_DEV *bd, off_t nOffset, const Uint8 *pData, size_t nLen)
+{
+	Uint32 nFirst = nOffset / BLOCKDEV_OVL_BLOCK;
+	Uint32 nLast = (nOffset + nLen - 1) / BLOCKDEV_OVL_BLOCK;
+	Uint32 i;
+
+	if (nOffset % BLOCKDEV_OVL_BLOCK && !BlockDev_OvlCopyBlock(bd, nFirst))
+		return false;
+	if ((nOffset + nLen) % BLOCKDEV_OVL_BLOCK
+	    && (nLast != nFirst || nOffset % BLOCKDEV_OVL_BLOCK == 0)
+	    && !BlockDev_OvlCopyBlock(bd, nLast))
+		return false;
+
+	if (!BlockDev_OvlWrite(bd, nOffset, pData, nLen))
+		return false;
+
+	for (i = nFirst; i <= nLast; i++)
+	{
+		if (!BlockDev_OvlIsDirty(bd, i))
+		{
+			bd->ovlbitmap[i >> 3] |= 1 << (i & 7);
+			bd->nOvlDirty++;
+		}
+	}
+	return BlockDev_FileWrite(bd->ovlfp, BLOCKDEV_OVL_BITMAP + nFirst / 8,
+				  &bd->ovlbitmap[nFirst / 8], nLast / 8 - nFirst / 8 + 1);
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Open (and lock) the hard disk image file 'filename' of given size.
+ * If the file can't be opened for writing, it's opened read-only.
+ * Returns zero on success, otherwise a negative errno value.
+ */
+int BlockDev_Open(BLOCK_DEV *bd, const char *hdtype, const char *filename, off_t size)
+{
+	bool bOverlay = ConfigureParams.HardDisk.bUseOverlay;
+	FILE *fp;
+	int ret;
+
+	memset(bd, 0, sizeof(*bd));
+
+	/* with overlay, the image itself is never written */
+	if (bOverlay)
+	{
+		if (!(fp = fopen(filename, "rb")))
+		{
+			Log_AlertDlg(LOG_ERROR, "Cannot open %s HD file for reading\n'%s'!\n",
+				     hdtype, filename);
+			return -ENOENT;
+		}
+	}
+	else if (!(fp = fopen(filename, "rb+")))
+	{
+		if (!(fp = fopen(filename, "rb")))
+		{
+			Log_AlertDlg(LOG_ERROR, "Cannot open %s HD file for reading\n'%s'!\n",
+				     hdtype, filename);
+			return -ENOENT;
+		}
+		Log_AlertDlg(LOG_WARN, "%s HD file is read-only, no writes will go through\n'%s'.\n",
+			     hdtype, filename);
+		bd->bReadOnly = true;
+	}
+	else if (!File_Lock(fp))
+	{
+		Log_AlertDlg(LOG_ERROR, "Locking %s HD file for writing failed\n'%s'!\n",
+			     hdtype, filename);
+		fclose(fp);
+		return -ENOLCK;
+	}
+
+	bd->fp = fp;
+	bd->size = size;
+	bd->pszType = hdtype;
+	bd->pszName = strdup(filename);
+
+	if (bOverlay)
+	{
+		bd->pszOvlName = BlockDev_OvlName(filename);
+		ret = bd->pszOvlName ? BlockDev_OvlOpen(bd) : -ENOMEM;
+		if (ret < 0)
+		{
+			free(bd->pszOvlName);
+			free(bd->pszName);
+			fclose(fp);
+			memset(bd, 0, sizeof(*bd));
+			return ret;
+		}
+	}
+
+	bd->map = BlockDev_Map(bd, fp, 0, !bd->bReadOnly && !bOverlay);
+	if (bd->map)
+		LOG_TRACE(TRACE_SCSI_CMD, "%s HD image '%s' mapped to memory\n", hdtype, filename);
+
+	bd->next = pOpenDevs;
+	pOpenDevs = bd;
+
+	return 0;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Unmap, unlock and close the image file
+ */
+void BlockDev_Close(BLOCK_DEV *bd)
+{
+	BLOCK_DEV **pp;
+
+	if (!bd->fp)
+		return;
+
+	for (pp = &pOpenDevs; *pp; pp = &(*pp)->next)
+	{
+		if (*pp == bd)
+		{
+			*pp = bd->next;
+			break;
+		}
+	}
+
+	BlockDev_OvlClose(bd);
+	free(bd->pszOvlName);
+	bd->pszOvlName = NULL;
+
+	BlockDev_Unmap(bd, bd->map);
+	bd->map = NULL;
+
+	BlockDev_SetReadAhead(bd, 0);
+
+	if (!bd->bReadOnly)
+		File_UnLock(bd->fp);
+	fclose(bd->fp);
+	bd->fp = NULL;
+
+	free(bd->pszName);
+	bd->pszName = NULL;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Return true if the image file is open
+ */
+bool BlockDev_IsOpen(BLOCK_DEV *bd)
+{
+	return bd->fp != NULL;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Check that the given range is inside the image
+ */
+static inline bool BlockDev_CheckRange(BLOCK_DEV *bd, off_t nOffset, size_t nLen)
+{
+	return bd->fp && nOffset >= 0 && nOffset <= bd->size
+	       && (Uint64)nLen <= (Uint64)(bd->size - nOffset);
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Set size of the read-ahead buffer, 0 disables read-ahead.
+ * Memory mapped images don't need (and won't use) it.
+ */
+void BlockDev_SetReadAhead(BLOCK_DEV *bd, size_t nSize)
+{
+	free(bd->rabuf);
+	bd->rabuf = NULL;
+	bd->nRaSize = bd->nRaLen = 0;
+	if (!nSize || bd->map)
+		return;
+
+	bd->rabuf = malloc(nSize);
+	if (bd->rabuf)
+		bd->nRaSize = nSize;
+	else
+		Log_Printf(LOG_WARN, "No memory for %s HD read-ahead buffer.\n", bd->pszType);
+}
+
+/**
+ * Return pointer to nLen bytes of image data at nOffset in the read-ahead
+ * buffer, filling the buffer from nOffset onwards if they aren't there.
+ * Returns NULL if there's no read-ahead or reading the image failed.
+ */
+static const Uint8 *BlockDev_RaGet(BLOCK_DEV *bd, off_t nOffset, size_t nLen)
+{
+	size_t n;
+	bool ok;
+
+	if (!bd->rabuf || nLen > bd->nRaSize)
+		return NULL;
+
+	if (nOffset >= bd->nRaOffset
+	    && (Uint64)(nOffset - bd->nRaOffset) + nLen <= bd->nRaLen)
+	{
+		bd->nRaHits++;
+		return bd->rabuf + (nOffset - bd->nRaOffset);
+	}
+
+	n = bd->nRaSize;
+	if ((Uint64)n > (Uint64)(bd->size - nOffset))
+		n = bd->size - nOffset;
+	if (bd->ovlfp)
+		ok = BlockDev_OvlReadRuns(bd, nOffset, bd->rabuf, n);
+	else
+		ok = BlockDev_BaseRead(bd, nOffset, bd->rabuf, n);
+	bd->nRaMisses++;
+	if (!ok)
+	{
+		bd->nRaLen = 0;
+		return NULL;
+	}
+	bd->nRaOffset = nOffset;
+	bd->nRaLen = n;
+	return bd->rabuf;
+}
+
+/**
+ * Update the part of the read-ahead buffer overlapping with written data
+ */
+static void BlockDev_RaUpdate(BLOCK_DEV *bd, off_t nOffset, const Uint8 *pData, size_t nLen)
+{
+	off_t nStart, nEnd;
+
+	if (!bd->nRaLen)
+		return;
+	nStart = nOffset > bd->nRaOffset ? nOffset : bd->nRaOffset;
+	nEnd = nOffset + (off_t)nLen;
+	if (nEnd > bd->nRaOffset + (off_t)bd->nRaLen)
+		nEnd = bd->nRaOffset + bd->nRaLen;
+	if (nStart < nEnd)
+		memcpy(bd->rabuf + (nStart - bd->nRaOffset), pData + (nStart - nOffset), nEnd - nStart);
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Return a pointer to nLen bytes of the mapped image (or the read-ahead
+ * buffer) at nOffset, so that the data can be copied to emulated memory
+ * directly. Returns NULL if that's not possible (e.g. the image isn't mapped
+ * and there's no read-ahead, the range is invalid or it's only partially
+ * written to the overlay); BlockDev_Read() needs to be used then. A successful
+ * call is counted as read. The pointer is valid until the next access.
+ */
+const Uint8 *BlockDev_GetReadPtr(BLOCK_DEV *bd, off_t nOffset, size_t nLen)
+{
+	const Uint8 *ptr;
+	Uint32 i, nFirst, nLast;
+	bool bDirty;
+
+	if (!nLen || !BlockDev_CheckRange(bd, nOffset, nLen))
+		return NULL;
+
+	if (!bd->map)
+	{
+		ptr = BlockDev_RaGet(bd, nOffset, nLen);
+		if (!ptr)
+			return NULL;
+		bd->nReadOps++;
+		bd->nReadBytes += nLen;
+		return ptr;
+	}
+
+	ptr = bd->map;
+	if (bd->ovlfp)
+	{
+		nFirst = nOffset / BLOCKDEV_OVL_BLOCK;
+		nLast = (nOffset + nLen - 1) / BLOCKDEV_OVL_BLOCK;
+		bDirty = BlockDev_OvlIsDirty(bd, nFirst);
+		for (i = nFirst + 1; i <= nLast; i++)
+		{
+			if (BlockDev_OvlIsDirty(bd, i) != bDirty)
+				return NULL;
+		}
+		if (bDirty)
+			ptr = bd->ovlmap;
+	}
+	if (!ptr)
+		return NULL;
+
+	bd->nReadOps++;
+	bd->nReadBytes += nLen;
+	return ptr + nOffset;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Read nLen bytes at nOffset from the image to pData.
+ * Returns true on success.
+ */
+bool BlockDev_Read(BLOCK_DEV *bd, off_t nOffset, void *pData, size_t nLen)
+{
+	const Uint8 *ptr;
+	bool ok;
+
+	if (!BlockDev_CheckRange(bd, nOffset, nLen))
+		return false;
+
+	if (!bd->map && nLen && (ptr = BlockDev_RaGet(bd, nOffset, nLen)))
+	{
+		memcpy(pData, ptr, nLen);
+		ok = true;
+	}
+	else if (bd->ovlfp)
+		ok = BlockDev_OvlReadRuns(bd, nOffset, pData, nLen);
+	else
+		ok = BlockDev_BaseRead(bd, nOffset, pData, nLen);
+	if (!ok)
+		return false;
+
+	bd->nReadOps++;
+	bd->nReadBytes += nLen;
+	return true;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Write nLen bytes from pData to the image at nOffset.
+ * Returns true on success, false on error or if the image is read-only.
+ */
+bool BlockDev_Write(BLOCK_DEV *bd, off_t nOffset, const void *pData, size_t nLen)
+{
+	bool ok;
+
+	if (!nLen || !BlockDev_CheckRange(bd, nOffset, nLen))
+		return false;
+
+	if (bd->ovlfp)
+		ok = BlockDev_OvlWriteBlocks(bd, nOffset, pData, nLen);
+	else if (bd->bReadOnly)
+		ok = false;
+	else
+		ok = BlockDev_BaseWrite(bd, nOffset, pData, nLen);
+	if (!ok)
+		return false;
+	BlockDev_RaUpdate(bd, nOffset, pData, nLen);
+
+	bd->nWriteOps++;
+	bd->nWriteBytes += nLen;
+	return true;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Hand written data over to the host OS
+ */
+void BlockDev_Flush(BLOCK_DEV *bd)
+{
+	if (!bd->fp)
+		return;
+#if HAVE_MMAP
+	if (bd->ovlmap)
+		msync(bd->ovlmap, bd->size, MS_ASYNC);
+	if (bd->map && !bd->bReadOnly && !bd->ovlfp)
+		msync(bd->map, bd->size, MS_ASYNC);
+#endif
+	fflush(bd->ovlfp ? bd->ovlfp : bd->fp);
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Write the blocks stored in the overlay back to the image
+ * and start a new, empty overlay. Returns true on success.
+ */
+static bool BlockDev_OvlCommit(BLOCK_DEV *bd)
+{
+	Uint8 buf[BLOCKDEV_OVL_BLOCK];
+	Uint32 i, nBlocks = BlockDev_OvlBlocks(bd);
+	off_t nOffset;
+	size_t n;
+	FILE *fp;
+	bool ok = true;
+
+	fp = fopen(bd->pszName, "rb+");
+	if (!fp || !File_Lock(fp))
+	{
+		Log_Printf(LOG_ERROR, "Cannot open %s HD image '%s' for writing!\n",
+			   bd->pszType, bd->pszName);
+		if (fp)
+			fclose(fp);
+		return false;
+	}
+
+	for (i = 0; ok && i < nBlocks; i++)
+	{
+		if (!BlockDev_OvlIsDirty(bd, i))
+			continue;
+		nOffset = (off_t)i * BLOCKDEV_OVL_BLOCK;
+		n = BLOCKDEV_OVL_BLOCK;
+		if (nOffset + (off_t)n > bd->size)
+			n = bd->size - nOffset;
+		ok = BlockDev_OvlRead(bd, nOffset, buf, n)
+		     && BlockDev_FileWrite(fp, nOffset, buf, n);
+	}
+
+	File_UnLock(fp);
+	if (fclose(fp) != 0)
+		ok = false;
+	if (!ok)
+	{
+		Log_Printf(LOG_ERROR, "Writing %s HD overlay to image '%s' failed!\n",
+			   bd->pszType, bd->pszName);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Replace the overlay with a new empty one (which also frees its disk space)
+ */
+static bool BlockDev_OvlDiscard(BLOCK_DEV *bd)
+{
+	bd->nRaLen = 0;
+	BlockDev_OvlClose(bd);
+	remove(bd->pszOvlName);
+	return BlockDev_OvlOpen(bd) == 0;
+}
+
+/**
+ * Commit (bCommit = true) or discard the overlays of all open images.
+ * Overlays which can't be reopened afterwards are disabled and
+ * their images become read-only.
+ * Returns number of handled overlays, or -1 on error.
+ */
+int BlockDev_OverlayAction(bool bCommit)
+{
+	BLOCK_DEV *bd;
+	int count = 0;
+
+	for (bd = pOpenDevs; bd; bd = bd->next)
+	{
+		if (!bd->ovlfp)
+			continue;
+		if (bCommit)
+		{
+			if (!BlockDev_OvlCommit(bd))
+				return -1;
+			Log_Printf(LOG_INFO, "Wrote %u blocks of %s HD overlay to '%s'.\n",
+				   bd->nOvlDirty, bd->pszType, bd->pszName);
+		}
+		if (!BlockDev_OvlDiscard(bd))
+		{
+			bd->bReadOnly = true;
+			return -1;
+		}
+		count++;
+	}
+	return count;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Show the open hard disk images and their I/O statistics
+ */
+void BlockDev_Info(FILE *fp, Uint32 arg)
+{
+	BLOCK_DEV *bd;
+
+	if (!pOpenDevs)
+	{
+		fprintf(fp, "No hard disk images in use.\n");
+		return;
+	}
+
+	for (bd = pOpenDevs; bd; bd = bd->next)
+	{
+		fprintf(fp, "%s: %s\n", bd->pszType, bd->pszName);
+		fprintf(fp, "  size: %"PRId64" bytes, %s, %s\n", (int64_t)bd->size,
+			bd->bReadOnly ? "read-only" : "read/write",
+			bd->map ? "memory mapped" : "file I/O");
+		if (bd->ovlfp)
+			fprintf(fp, "  overlay: %s, %u/%u blocks written\n", bd->pszOvlName,
+				bd->nOvlDirty, BlockDev_OvlBlocks(bd));
+		fprintf(fp, "  reads:  %"PRIu64" ops, %"PRIu64" bytes\n",
+			bd->nReadOps, bd->nReadBytes);
+		if (bd->rabuf)
+			fprintf(fp, "  read-ahead: %u KB, %"PRIu64" hits, %"PRIu64" misses\n",
+				(unsigned)(bd->nRaSize / 1024), bd->nRaHits, bd->nRaMisses);
+		fprintf(fp, "  writes: %"PRIu64" ops, %"PRIu64" bytes\n",
+			bd->nWriteOps, bd->nWriteBytes);
+	}
+}
@@ -52,6 +52,17 @@ const char Change_fileid[] = "Hatari change.c";
 #define Dprintf(...)
 #endif
 
+/*-----------------------------------------------------------------------*/
+/**
+ * Return true if the ACSI/SCSI/IDE image overlay setting changed
+ */
+static bool Change_DidOverlayChange(CNF_PARAMS *current, CNF_PARAMS *changed)
+{
+	return changed->HardDisk.bUseOverlay != current->HardDisk.bUseOverlay
+	       || (strcmp(changed->HardDisk.szOverlayDirectory, current->HardDisk.szOverlayDirectory)
+	           && changed->HardDisk.bUseOverlay);
+}
+
 /*-----------------------------------------------------------------------*/
 /**
  * Check if user needs to be warned that changes will take place after reset.
@@ -83,6 +94,10 @@ bool Change_DoNeedReset(CNF_PARAMS *current, CNF_PARAMS *changed)
 	if (strcmp(changed->Rom.szTosImageFileName, current->Rom.szTosImageFileName))
 		return true;
 
+	/* Did change hard disk image overlay? */
+	if (Change_DidOverlayChange(current, changed))
+		return true;
+
 	/* Did change ACSI hard disk image? */
 	for (i = 0; i < MAX_ACSI_DEVS; i++)
 	{
@@ -292,6 +307,13 @@ void Change_CopyChangedParamsToConfiguration(CNF_PARAMS *current, CNF_PARAMS *ch
 		bReInitGemdosDrive = true;
 	}
 
+	/* Did change image overlay? All HD images need to be reopened then */
+	if (Change_DidOverlayChange(current, changed))
+	{
+		Dprintf("- HD image overlay>\n");
+		bReInitHdcEmu = bReInitScsiEmu = bReInitIDEEmu = true;
+	}
+
 	/* Did change ACSI images? */
 	for (i = 0; i < MAX_ACSI_DEVS; i++)
 	{
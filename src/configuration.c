@@ -269,6 +269,7 @@ static const struct Config_Tag configs_Sound[] =
 	{ "bEnableMicrophone", Bool_Tag, &ConfigureParams.Sound.bEnableMicrophone },
 	{ "bEnableSound", Bool_Tag, &ConfigureParams.Sound.bEnableSound },
 	{ "bEnableSoundSync", Bool_Tag, &ConfigureParams.Sound.bEnableSoundSync },
+	{ "bSkipInFastForward", Bool_Tag, &ConfigureParams.Sound.bSkipInFastForward },
 	{ "nPlaybackFreq", Int_Tag, &ConfigureParams.Sound.nPlaybackFreq },
 	{ "nSdlAudioBufferSize", Int_Tag, &ConfigureParams.Sound.SdlAudioBufferSize },
 	{ "szYMCaptureFileName", String_Tag, ConfigureParams.Sound.szYMCaptureFileName },
@@ -293,6 +294,7 @@ static const struct Config_Tag configs_Floppy[] =
 {
 	{ "bAutoInsertDiskB", Bool_Tag, &ConfigureParams.DiskImage.bAutoInsertDiskB },
 	{ "FastFloppy", Bool_Tag, &ConfigureParams.DiskImage.FastFloppy },
+	{ "bTurboFloppy", Bool_Tag, &ConfigureParams.DiskImage.bTurboFloppy },
 	{ "EnableDriveA", Bool_Tag, &ConfigureParams.DiskImage.EnableDriveA },
 	{ "DriveA_NumberOfHeads", Int_Tag, &ConfigureParams.DiskImage.DriveA_NumberOfHeads },
 	{ "EnableDriveB", Bool_Tag, &ConfigureParams.DiskImage.EnableDriveB },
@@ -303,6 +305,9 @@ static const struct Config_Tag configs_Floppy[] =
 	{ "szDiskBZipPath", String_Tag, ConfigureParams.DiskImage.szDiskZipPath[1] },
 	{ "szDiskBFileName", String_Tag, ConfigureParams.DiskImage.szDiskFileName[1] },
 	{ "szDiskImageDirectory", String_Tag, ConfigureParams.DiskImage.szDiskImageDirectory },
+	{ "bUseDiskCache", Bool_Tag, &ConfigureParams.DiskImage.bUseDiskCache },
+	{ "nDiskCacheSize", Int_Tag, &ConfigureParams.DiskImage.nDiskCacheSize },
+	{ "szDiskCacheDirectory", String_Tag, ConfigureParams.DiskImage.szDiskCacheDirectory },
 	{ NULL , Error_Tag, NULL }
 };
 
@@ -317,6 +322,8 @@ static const struct Config_Tag configs_HardDisk[] =
 	{ "nWriteProtection", Int_Tag, &ConfigureParams.HardDisk.nWriteProtection },
 	{ "bFilenameConversion", Bool_Tag, &ConfigureParams.HardDisk.bFilenameConversion },
 	{ "bGemdosHostTime", Bool_Tag, &ConfigureParams.HardDisk.bGemdosHostTime },
+	{ "bUseOverlay", Bool_Tag, &ConfigureParams.HardDisk.bUseOverlay },
+	{ "szOverlayDirectory", String_Tag, ConfigureParams.HardDisk.szOverlayDirectory },
 	{ NULL , Error_Tag, NULL }
 };
 
@@ -399,11 +406,13 @@ static const struct Config_Tag configs_Ide[] =
 	{ "sDeviceFile0", String_Tag, ConfigureParams.Ide[0].sDeviceFile },
 	{ "nBlockSize0", Int_Tag, &ConfigureParams.Ide[0].nBlockSize },
 	{ "nDeviceType0", Int_Tag, &ConfigureParams.Ide[0].nDeviceType },
+	{ "nReadAhead0", Int_Tag, &ConfigureParams.Ide[0].nReadAhead },
 	{ "bUseDevice1", Bool_Tag, &ConfigureParams.Ide[1].bUseDevice },
 	{ "nByteSwap1", Int_Tag, &ConfigureParams.Ide[1].nByteSwap },
 	{ "sDeviceFile1", String_Tag, ConfigureParams.Ide[1].sDeviceFile },
 	{ "nBlockSize1", Int_Tag, &ConfigureParams.Ide[1].nBlockSize },
 	{ "nDeviceType1", Int_Tag, &ConfigureParams.Ide[1].nDeviceType },
+	{ "nReadAhead1", Int_Tag, &ConfigureParams.Ide[1].nReadAhead },
 	{ NULL , Error_Tag, NULL }
 };
 
@@ -545,6 +554,7 @@ void Configuration_SetDefault(void)
 	/* Set defaults for floppy disk images */
 	ConfigureParams.DiskImage.bAutoInsertDiskB = true;
 	ConfigureParams.DiskImage.FastFloppy = false;
+	ConfigureParams.DiskImage.bTurboFloppy = false;
 	ConfigureParams.DiskImage.nWriteProtection = WRITEPROT_OFF;
 
 	ConfigureParams.DiskImage.EnableDriveA = true;
@@ -564,6 +574,9 @@ void Configuration_SetDefault(void)
 	}
 	strcpy(ConfigureParams.DiskImage.szDiskImageDirectory, psWorkingDir);
 	File_AddSlashToEndFileName(ConfigureParams.DiskImage.szDiskImageDirectory);
+	ConfigureParams.DiskImage.bUseDiskCache = false;
+	ConfigureParams.DiskImage.nDiskCacheSize = 256;
+	ConfigureParams.DiskImage.szDiskCacheDirectory[0] = '\0';
 
 	/* Set defaults for hard disks */
 	ConfigureParams.HardDisk.bBootFromHardDisk = false;
@@ -573,6 +586,8 @@ void Configuration_SetDefault(void)
 	ConfigureParams.HardDisk.nWriteProtection = WRITEPROT_OFF;
 	ConfigureParams.HardDisk.nGemdosDrive = DRIVE_C;
 	ConfigureParams.HardDisk.bUseHardDiskDirectories = false;
+	ConfigureParams.HardDisk.bUseOverlay = false;
+	ConfigureParams.HardDisk.szOverlayDirectory[0] = '\0';
 	for (i = 0; i < MAX_HARDDRIVES; i++)
 	{
 		strcpy(ConfigureParams.HardDisk.szHardDiskDirectories[i], psWorkingDir);
@@ -600,6 +615,7 @@ void Configuration_SetDefault(void)
 		ConfigureParams.Ide[i].nByteSwap = BYTESWAP_AUTO;
 		strcpy(ConfigureParams.Ide[i].sDeviceFile, psWorkingDir);
 		ConfigureParams.Ide[i].nBlockSize = 512;
+		ConfigureParams.Ide[i].nReadAhead = 64;
 	}
 
 	/* Set defaults for Joysticks */
@@ -727,6 +743,7 @@ void Configuration_SetDefault(void)
 	ConfigureParams.Sound.bEnableMicrophone = true;
 	ConfigureParams.Sound.bEnableSound = true;
 	ConfigureParams.Sound.bEnableSoundSync = false;
+	ConfigureParams.Sound.bSkipInFastForward = false;
 	ConfigureParams.Sound.nPlaybackFreq = 44100;
 	File_MakePathBuf(ConfigureParams.Sound.szYMCaptureFileName,
 	                 sizeof(ConfigureParams.Sound.szYMCaptureFileName),
@@ -892,6 +909,16 @@ void Configuration_Apply(bool bReset)
 		File_MakeAbsoluteName(ConfigureParams.Lilo.szRamdiskFileName);
 	File_CleanFileName(ConfigureParams.HardDisk.szHardDiskDirectories[0]);
 	File_MakeAbsoluteName(ConfigureParams.HardDisk.szHardDiskDirectories[0]);
+	if (strlen(ConfigureParams.DiskImage.szDiskCacheDirectory) > 0)
+	{
+		File_CleanFileName(ConfigureParams.DiskImage.szDiskCacheDirectory);
+		File_MakeAbsoluteName(ConfigureParams.DiskImage.szDiskCacheDirectory);
+	}
+	if (strlen(ConfigureParams.HardDisk.szOverlayDirectory) > 0)
+	{
+		File_CleanFileName(ConfigureParams.HardDisk.szOverlayDirectory);
+		File_MakeAbsoluteName(ConfigureParams.HardDisk.szOverlayDirectory);
+	}
 	File_MakeAbsoluteName(ConfigureParams.Memory.szMemoryCaptureFileName);
 	File_MakeAbsoluteName(ConfigureParams.Sound.szYMCaptureFileName);
 	if (strlen(ConfigureParams.Keyboard.szMappingFileName) > 0)
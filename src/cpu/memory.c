@@ -27,6 +27,7 @@ const char Memory_fileid[] = "Hatari memory.c";
 #include "stMemory.h"
 #include "m68000.h"
 #include "configuration.h"
+#include "memwatch.h"
 
 #include "newcpu.h"
 
@@ -1511,7 +1512,7 @@ static void init_bank (addrbank *ab , uae_u32 size)
  */
 bool memory_region_bus_error ( uaecptr addr )
 {
-	return mem_banks[bankindex(addr)] == &BusErrMem_bank;
+	return memory_watch_get_bank(addr) == &BusErrMem_bank;
 }
 
 /*
@@ -1520,7 +1521,238 @@ bool memory_region_bus_error ( uaecptr addr )
  */
 bool memory_region_iomem ( uaecptr addr )
 {
-	return mem_banks[bankindex(addr)] == &IOmem_bank;
+	return memory_watch_get_bank(addr) == &IOmem_bank;
+}
+
+
+/*
+ * Debugger memory watchpoints (see debug/memwatch.c)
+ * The 64 KB banks containing watched addresses are replaced by copies
+ * of their addrbank, with data access functions that report accesses
+ * to MemWatch_Access() and then call the original bank functions.
+ * Instruction fetches, xlate and check are kept as in the original bank.
+ * Other banks are left untouched, so watchpoints cost nothing outside
+ * of the watched banks.
+ *
+ * For tracking all memory writes (detailed CPU history), every bank
+ * can be replaced with a copy where only the write functions are
+ * wrapped, so that reads still use the direct memory access.
+ */
+#define WATCH_MAX_BANKS 64
+
+typedef struct {
+	addrbank bank;		/* needs to be first, see watch_orig() */
+	addrbank *orig;		/* replaced bank */
+	bool reads;		/* whether reads are watched too */
+} watch_bank_t;
+
+static watch_bank_t watch_banks[WATCH_MAX_BANKS];
+static int watch_banks_count;
+
+/* watched 64 KB banks */
+static int watch_banknr[WATCH_MAX_BANKS];
+static int watch_banknr_count;
+
+static bool watch_writes;
+
+static inline addrbank *watch_orig(uaecptr addr)
+{
+	return ((watch_bank_t *)mem_banks[bankindex(addr)])->orig;
+}
+
+static uae_u32 REGPARAM3 watch_lget(uaecptr addr)
+{
+	uae_u32 l = call_mem_get_func(watch_orig(addr)->lget, addr);
+	MemWatch_Access(addr, 4, l, false);
+	return l;
+}
+
+static uae_u32 REGPARAM3 watch_wget(uaecptr addr)
+{
+	uae_u32 w = call_mem_get_func(watch_orig(addr)->wget, addr);
+	MemWatch_Access(addr, 2, w, false);
+	return w;
+}
+
+static uae_u32 REGPARAM3 watch_bget(uaecptr addr)
+{
+	uae_u32 b = call_mem_get_func(watch_orig(addr)->bget, addr);
+	MemWatch_Access(addr, 1, b, false);
+	return b;
+}
+
+static void REGPARAM3 watch_lput(uaecptr addr, uae_u32 l)
+{
+	MemWatch_Access(addr, 4, l, true);
+	call_mem_put_func(watch_orig(addr)->lput, addr, l);
+}
+
+static void REGPARAM3 watch_wput(uaecptr addr, uae_u32 w)
+{
+	MemWatch_Access(addr, 2, w & 0xffff, true);
+	call_mem_put_func(watch_orig(addr)->wput, addr, w);
+}
+
+static void REGPARAM3 watch_bput(uaecptr addr, uae_u32 b)
+{
+	MemWatch_Access(addr, 1, b & 0xff, true);
+	call_mem_put_func(watch_orig(addr)->bput, addr, b);
+}
+
+/*
+ * Return the bank used for an address, ignoring watchpoints
+ */
+addrbank *memory_watch_get_bank ( uaecptr addr )
+{
+	addrbank *ab = mem_banks[bankindex(addr)];
+
+	if ( ab->lput == watch_lput )
+		return ((watch_bank_t *)ab)->orig;
+	return ab;
+}
+
+/*
+ * Return watch bank copy of given bank (for reads & writes, or
+ * just writes), or NULL if there are too many banks to watch
+ */
+static addrbank *memory_watch_copy ( addrbank *orig , bool reads )
+{
+	watch_bank_t *wb;
+
+	for ( wb = watch_banks ; wb < watch_banks + watch_banks_count ; wb++ )
+		if ( wb->orig == orig && wb->reads == reads )
+			return &wb->bank;
+	if ( watch_banks_count >= WATCH_MAX_BANKS )
+		return NULL;
+
+	wb = &watch_banks[watch_banks_count++];
+	wb->orig = orig;
+	wb->reads = reads;
+	wb->bank = *orig;
+	wb->bank.lput = watch_lput;
+	wb->bank.wput = watch_wput;
+	wb->bank.bput = watch_bput;
+	/* accesses need to go through the watch functions */
+	wb->bank.baseaddr_direct_w = NULL;
+	if ( reads )
+	{
+		wb->bank.lget = watch_lget;
+		wb->bank.wget = watch_wget;
+		wb->bank.bget = watch_bget;
+		wb->bank.baseaddr_direct_r = NULL;
+	}
+	return &wb->bank;
+}
+
+/*
+ * Replace given bank with its watch bank, also in the mirrors
+ * of the bank (24-bit address space and 0xff000000 TT mirror)
+ */
+static bool memory_watch_map ( int banknr )
+{
+	addrbank *orig, *ab;
+	int i, step;
+
+	orig = memory_watch_get_bank ( banknr << 16 );
+	ab = memory_watch_copy ( orig , true );
+	if ( !ab )
+		return false;
+
+	step = banknr < 0x100 ? 0x100 : MEMORY_BANKS;
+	for ( i = banknr & ( step - 1 ) ; i < MEMORY_BANKS ; i += step )
+	{
+		if ( memory_watch_get_bank ( i << 16 ) == orig )
+			put_mem_bank ( i << 16 , ab , 0 );
+	}
+	return true;
+}
+
+/*
+ * Put original banks back and install watch banks for the current
+ * watched banks and write tracking. Called also when the banks have
+ * been re-mapped (on reset or when changing the MMU configuration).
+ * Return false if there were too many banks to watch.
+ */
+static bool memory_watch_apply ( void )
+{
+	addrbank *ab;
+	bool ok = true;
+	int i;
+
+	for ( i = 0 ; i < MEMORY_BANKS ; i++ )
+	{
+		ab = mem_banks[i];
+		if ( ab->lput == watch_lput )
+			put_mem_bank ( i << 16 , ((watch_bank_t *)ab)->orig , 0 );
+	}
+	watch_banks_count = 0;
+
+	if ( watch_writes )
+	{
+		for ( i = 0 ; i < MEMORY_BANKS ; i++ )
+		{
+			ab = memory_watch_copy ( mem_banks[i] , false );
+			if ( !ab )
+			{
+				ok = false;
+				break;
+			}
+			put_mem_bank ( i << 16 , ab , 0 );
+		}
+	}
+	for ( i = 0 ; i < watch_banknr_count ; i++ )
+		ok &= memory_watch_map ( watch_banknr[i] );
+	return ok;
+}
+
+/*
+ * Start watching data accesses to given 64 KB bank.
+ * Return false if there are too many watched banks.
+ */
+bool memory_watch_bank ( int banknr )
+{
+	int i;
+
+	for ( i = 0 ; i < watch_banknr_count ; i++ )
+		if ( watch_banknr[i] == banknr )
+			return true;
+	if ( watch_banknr_count >= WATCH_MAX_BANKS )
+		return false;
+
+	watch_banknr[watch_banknr_count++] = banknr;
+	return memory_watch_map ( banknr );
+}
+
+/*
+ * Stop watching all banks (except for write tracking)
+ */
+void memory_unwatch_all ( void )
+{
+	watch_banknr_count = 0;
+	memory_watch_apply ();
+}
+
+/*
+ * Enable/disable reporting of all memory writes to MemWatch_Access().
+ * Return false if there were too many banks to watch, write tracking
+ * is then left disabled.
+ */
+bool memory_watch_writes ( bool enable )
+{
+	if ( enable == watch_writes )
+		return true;
+	watch_writes = enable;
+	if ( memory_watch_apply () || !enable )
+		return true;
+	watch_writes = false;
+	memory_watch_apply ();
+	return false;
+}
+
+static void memory_watch_remap ( void )
+{
+	if ( ( watch_banknr_count || watch_writes ) && !memory_watch_apply () )
+		Log_Printf(LOG_WARN, "Too many memory banks to watch after re-mapping, debugger watchpoints / write tracking miss some accesses\n");
 }
 #endif
 
@@ -1633,6 +1865,8 @@ void memory_map_Standard_RAM ( Uint32 MMU_Bank0_Size , Uint32 MMU_Bank1_Size )
 		map_banks_ce(&SysMem_bank, 0x00, 0x10000 >> 16, 0, CE_MEMBANK_CHIP16, CACHE_ENABLE_BOTH);
 		map_banks_ce(&STmem_bank, 0x10000 >> 16, ( STmem_size - 0x10000 ) >> 16, 0, CE_MEMBANK_CHIP16, CACHE_ENABLE_BOTH);
 	}
+
+	memory_watch_remap();
 }
 
 
@@ -1845,6 +2079,7 @@ void memory_init(uae_u32 NewSTMemSize, uae_u32 NewTTMemSize, uae_u32 NewRomMemSt
 		}
 	}
 
+	memory_watch_remap();
 	illegal_count = 0;
 }
 
@@ -515,6 +515,10 @@ extern addrbank *get_mem_bank_real(uaecptr);
 #ifdef WINUAE_FOR_HATARI
 extern bool memory_region_bus_error ( uaecptr addr );
 extern bool memory_region_iomem ( uaecptr addr );
+extern addrbank *memory_watch_get_bank ( uaecptr addr );
+extern bool memory_watch_bank ( int banknr );
+extern void memory_unwatch_all ( void );
+extern bool memory_watch_writes ( bool enable );
 extern void memory_map_Standard_RAM ( Uint32 MMU_Bank0_Size , Uint32 MMU_Bank1_Size );
 #endif
 extern void memory_init(uae_u32 NewSTMemSize, uae_u32 NewTTMemSize, uae_u32 NewRomMemStart);
@@ -63,6 +63,7 @@ const char CycInt_fileid[] = "Hatari cycInt.c";
 #include "m68000.h"
 #include "mfp.h"
 #include "midi.h"
+#include "profile.h"
 #include "memorySnapShot.h"
 #include "sound.h"
 #include "screen.h"
@@ -104,6 +105,7 @@ static void (* const pIntHandlerFunctions[MAX_INTERRUPTS])(void) =
 	FDC_InterruptHandler_Update,
 	Blitter_InterruptHandler,
 	Midi_InterruptHandler_Update,
+	Profile_CpuSampleHandler,
 
 };
 
@@ -45,6 +45,10 @@ const char BreakCond_fileid[] = "Hatari breakcond.c";
 
 #define BC_DEFAULT_DSP_SPACE 'P'
 
+/* PC prefilter bitmap size, one bit per (even) address, aliased */
+#define BC_PCBITMAP_BITS (1<<18)
+#define BC_PCBITMAP_BIT(pc) (((pc) >> 1) & (BC_PCBITMAP_BITS-1))
+
 typedef struct {
 	bool is_indirect;
 	char dsp_space;	/* DSP has P, X, Y address spaces, zero if not DSP */
@@ -60,9 +64,16 @@ typedef struct {
 	Uint32 mask;	/* <width mask> && <value mask> */
 } bc_value_t;
 
+typedef Uint32 (*bc_getter_t)(const bc_value_t *bc_value);
+
 typedef struct {
 	bc_value_t lvalue;
 	bc_value_t rvalue;
+	/* compiled form of above values, see BreakCond_Compile() */
+	bc_getter_t lget;	/* NULL if lvalue is constant */
+	bc_getter_t rget;	/* NULL if rvalue is constant */
+	Uint32 lconst;	/* masked constant values */
+	Uint32 rconst;
 	char comparison;
 	bool track;	/* track value changes */
 } bc_condition_t;
@@ -85,6 +96,8 @@ typedef struct {
 	bc_condition_t *conditions;
 	int ccount;	/* condition count */
 	int hits;	/* how many times breakpoint hit */
+	bool has_pc;	/* conditions include "pc = <pc>" */
+	Uint32 pc;
 } bc_breakpoint_t;
 
 typedef struct {
@@ -95,11 +108,18 @@ typedef struct {
 	int allocated;
 	bool delayed_change;
 	const debug_reason_t reason;
+	/* PC prefilter, see BreakCond_UpdatePcFilter() */
+	Uint32 (*const get_pc)(void);	/* NULL if list has no prefilter */
+	int unfiltered;	/* breakpoints without PC condition */
+	Uint32 pcbitmap[BC_PCBITMAP_BITS/32];
 } bc_breakpoints_t;
 
+static Uint32 GetCpuPC(void);
+
 static bc_breakpoints_t CpuBreakPoints = {
 	.name = "CPU",
-	.reason = REASON_CPU_BREAKPOINT
+	.reason = REASON_CPU_BREAKPOINT,
+	.get_pc = GetCpuPC
 };
 static bc_breakpoints_t DspBreakPoints = {
 	.name = "DSP",
@@ -236,6 +256,173 @@ static Uint32 BreakCond_GetValue(const bc_value_t *bc_value)
 }
 
 
+/* Specialized getters for the most common condition value types,
+ * to avoid going through all the BreakCond_GetValue() checks on
+ * every instruction.
+ */
+static Uint32 BreakCond_GetReg16(const bc_value_t *bc_value)
+{
+	return *(bc_value->value.reg16) & bc_value->mask;
+}
+static Uint32 BreakCond_GetReg32(const bc_value_t *bc_value)
+{
+	return *(bc_value->value.reg32) & bc_value->mask;
+}
+static Uint32 BreakCond_GetFunc32(const bc_value_t *bc_value)
+{
+	return bc_value->value.func32() & bc_value->mask;
+}
+static Uint32 BreakCond_GetSTByte(const bc_value_t *bc_value)
+{
+	return STMemory_ReadByte(bc_value->value.number) & bc_value->mask;
+}
+static Uint32 BreakCond_GetSTWord(const bc_value_t *bc_value)
+{
+	return STMemory_ReadWord(bc_value->value.number) & bc_value->mask;
+}
+static Uint32 BreakCond_GetSTLong(const bc_value_t *bc_value)
+{
+	return STMemory_ReadLong(bc_value->value.number) & bc_value->mask;
+}
+static Uint32 BreakCond_GetSTByteReg(const bc_value_t *bc_value)
+{
+	return STMemory_ReadByte(*(bc_value->value.reg32)) & bc_value->mask;
+}
+static Uint32 BreakCond_GetSTWordReg(const bc_value_t *bc_value)
+{
+	return STMemory_ReadWord(*(bc_value->value.reg32)) & bc_value->mask;
+}
+static Uint32 BreakCond_GetSTLongReg(const bc_value_t *bc_value)
+{
+	return STMemory_ReadLong(*(bc_value->value.reg32)) & bc_value->mask;
+}
+
+/**
+ * Return getter function for given value, or NULL if value is
+ * a constant, in which case its (masked) value is stored to 'constant'.
+ */
+static bc_getter_t BreakCond_CompileValue(const bc_value_t *bc_value, Uint32 *constant)
+{
+	*constant = 0;
+	if (!bc_value->is_indirect) {
+		switch (bc_value->valuetype) {
+		case VALUE_TYPE_NUMBER:
+			*constant = bc_value->value.number & bc_value->mask;
+			return NULL;
+		case VALUE_TYPE_FUNCTION32:
+			return BreakCond_GetFunc32;
+		case VALUE_TYPE_REG16:
+			return BreakCond_GetReg16;
+		case VALUE_TYPE_VAR32:
+		case VALUE_TYPE_REG32:
+			return BreakCond_GetReg32;
+		default:
+			return BreakCond_GetValue;
+		}
+	}
+	/* DSP memory accesses go through the generic getter */
+	if (bc_value->dsp_space) {
+		return BreakCond_GetValue;
+	}
+	if (bc_value->valuetype == VALUE_TYPE_NUMBER) {
+		switch (bc_value->bits) {
+		case 8:
+			return BreakCond_GetSTByte;
+		case 16:
+			return BreakCond_GetSTWord;
+		case 32:
+			return BreakCond_GetSTLong;
+		}
+	} else if (bc_value->valuetype == VALUE_TYPE_REG32) {
+		switch (bc_value->bits) {
+		case 8:
+			return BreakCond_GetSTByteReg;
+		case 16:
+			return BreakCond_GetSTWordReg;
+		case 32:
+			return BreakCond_GetSTLongReg;
+		}
+	}
+	return BreakCond_GetValue;
+}
+
+/**
+ * Return true if given value is the full CPU PC register value
+ */
+static bool BreakCond_IsCpuPC(const bc_value_t *bc_value)
+{
+	return !bc_value->is_indirect && !bc_value->dsp_space &&
+		bc_value->valuetype == VALUE_TYPE_FUNCTION32 &&
+		bc_value->value.func32 == GetCpuPC &&
+		bc_value->mask == BITMASK(32);
+}
+
+/**
+ * Compile given breakpoint's conditions values into getter functions
+ * and constants, so that matching them needs to do only minimal work
+ */
+static void BreakCond_Compile(bc_breakpoint_t *bp)
+{
+	bc_condition_t *condition;
+	bool tracked = false;
+	int i;
+
+	bp->has_pc = false;
+	condition = bp->conditions;
+	for (i = 0; i < bp->ccount; condition++, i++) {
+		condition->lget = BreakCond_CompileValue(&(condition->lvalue), &(condition->lconst));
+		condition->rget = BreakCond_CompileValue(&(condition->rvalue), &(condition->rconst));
+
+		/* value tracked before PC condition needs to be
+		 * updated regardless of PC, so no PC prefiltering
+		 */
+		if (condition->track) {
+			tracked = true;
+		}
+		/* breakpoint can match only at given address? */
+		if (condition->comparison != '=' || bp->has_pc || tracked) {
+			continue;
+		}
+		if (BreakCond_IsCpuPC(&(condition->lvalue)) && !condition->rget) {
+			bp->pc = condition->rconst;
+			bp->has_pc = true;
+		} else if (BreakCond_IsCpuPC(&(condition->rvalue)) && !condition->lget) {
+			bp->pc = condition->lconst;
+			bp->has_pc = true;
+		}
+	}
+}
+
+/**
+ * Update PC prefilter bitmap for given breakpoint list. When all
+ * the breakpoints have a PC condition, BreakCond_MatchBreakPoints()
+ * needs to go through the list only when the bitmap bit for current
+ * PC is set, i.e. just a single bit check for most instructions,
+ * regardless of how many address breakpoints there are.
+ */
+static void BreakCond_UpdatePcFilter(bc_breakpoints_t *bps)
+{
+	bc_breakpoint_t *bp;
+	Uint32 bit;
+	int i;
+
+	if (!bps->get_pc) {
+		return;
+	}
+	memset(bps->pcbitmap, 0, sizeof(bps->pcbitmap));
+	bps->unfiltered = 0;
+	bp = bps->breakpoint;
+	for (i = 0; i < bps->count; bp++, i++) {
+		if (bp->has_pc) {
+			bit = BC_PCBITMAP_BIT(bp->pc);
+			bps->pcbitmap[bit >> 5] |= 1U << (bit & 31);
+		} else {
+			bps->unfiltered++;
+		}
+	}
+}
+
+
 /**
  * Show & update rvalue for a tracked breakpoint condition to lvalue
  */
@@ -245,6 +432,7 @@ static void BreakCond_UpdateTracked(bc_condition_t *condition, Uint32 value)
 
 	/* next monitor changes to this new value */
 	condition->rvalue.value.number = value;
+	condition->rconst = value & condition->rvalue.mask;
 
 	if (condition->lvalue.is_indirect &&
 	    condition->lvalue.valuetype == VALUE_TYPE_NUMBER) {
@@ -259,9 +447,10 @@ static void BreakCond_UpdateTracked(bc_condition_t *condition, Uint32 value)
 
 
 /**
- * Return true if all of the given breakpoint's conditions match
+ * Return true if all of the given breakpoint's conditions match.
+ * If 'update' is set, tracked condition values are updated.
  */
-static bool BreakCond_MatchConditions(bc_condition_t *condition, int count)
+static bool BreakCond_MatchConditions(bc_condition_t *condition, int count, bool update)
 {
 	Uint32 lvalue, rvalue;
 	bool hit = false;
@@ -269,8 +458,16 @@ static bool BreakCond_MatchConditions(bc_condition_t *condition, int count)
 
 	for (i = 0; i < count; condition++, i++) {
 
-		lvalue = BreakCond_GetValue(&(condition->lvalue));
-		rvalue = BreakCond_GetValue(&(condition->rvalue));
+		if (condition->lget) {
+			lvalue = condition->lget(&(condition->lvalue));
+		} else {
+			lvalue = condition->lconst;
+		}
+		if (condition->rget) {
+			rvalue = condition->rget(&(condition->rvalue));
+		} else {
+			rvalue = condition->rconst;
+		}
 
 		switch (condition->comparison) {
 		case '<':
@@ -293,7 +490,7 @@ static bool BreakCond_MatchConditions(bc_condition_t *condition, int count)
 		if (likely(!hit)) {
 			return false;
 		}
-		if (condition->track) {
+		if (condition->track && update) {
 			BreakCond_UpdateTracked(condition, lvalue);
 		}
 	}
@@ -312,8 +509,20 @@ static bool BreakCond_MatchBreakPoints(bc_breakpoints_t *bps)
 	bc_breakpoint_t *bp;
 	bool changes = false;
 	bool hit = false;
+	Uint32 pc = 0;
 	int i;
 
+	/* when all breakpoints are for specific PC values, check
+	 * the PC bitmap before going through the breakpoints
+	 */
+	if (bps->get_pc) {
+		pc = bps->get_pc();
+		if (likely(!bps->unfiltered) &&
+		    !(bps->pcbitmap[BC_PCBITMAP_BIT(pc) >> 5] & (1U << (BC_PCBITMAP_BIT(pc) & 31)))) {
+			return false;
+		}
+	}
+
 	/* array should not be changed while it's being traversed */
 	assert(likely(!bps->delayed_change));
 	bps->delayed_change = true;
@@ -321,7 +530,10 @@ static bool BreakCond_MatchBreakPoints(bc_breakpoints_t *bps)
 	bp = bps->breakpoint;
 	for (i = 0; i < bps->count; bp++, i++) {
 
-		if (BreakCond_MatchConditions(bp->conditions, bp->ccount)) {
+		if (bp->has_pc && bp->pc != pc) {
+			continue;
+		}
+		if (BreakCond_MatchConditions(bp->conditions, bp->ccount, true)) {
 			bp->hits++;
 			if (bp->options.skip) {
 				if (bp->hits % bp->options.skip) {
@@ -372,6 +584,44 @@ static bool BreakCond_MatchBreakPoints(bc_breakpoints_t *bps)
 	return hit;
 }
 
+/**
+ * Check breakpoints without side-effects: hit counts and tracked
+ * values are not updated, and breakpoint options are ignored, except
+ * that tracing breakpoints and ones tracking value changes are skipped.
+ * @return	index (starting from 1) of first matching breakpoint,
+ *		or zero if none matched
+ */
+static int BreakCond_MatchBreakPointsQuiet(bc_breakpoints_t *bps)
+{
+	bc_breakpoint_t *bp;
+	Uint32 pc = 0;
+	int i, j;
+
+	if (bps->get_pc) {
+		pc = bps->get_pc();
+		if (likely(!bps->unfiltered) &&
+		    !(bps->pcbitmap[BC_PCBITMAP_BIT(pc) >> 5] & (1U << (BC_PCBITMAP_BIT(pc) & 31)))) {
+			return 0;
+		}
+	}
+	bp = bps->breakpoint;
+	for (i = 0; i < bps->count; bp++, i++) {
+
+		if ((bp->has_pc && bp->pc != pc) || bp->options.trace) {
+			continue;
+		}
+		for (j = 0; j < bp->ccount; j++) {
+			if (bp->conditions[j].track) {
+				break;
+			}
+		}
+		if (j == bp->ccount && BreakCond_MatchConditions(bp->conditions, bp->ccount, false)) {
+			return i+1;
+		}
+	}
+	return 0;
+}
+
 /* ------------- breakpoint condition checking, public API ------------- */
 
 /**
@@ -382,6 +632,15 @@ bool BreakCond_MatchCpu(void)
 	return BreakCond_MatchBreakPoints(&CpuBreakPoints);
 }
 
+/**
+ * Return index of first matching CPU breakpoint without doing
+ * any of the hit actions (for reverse debugging), or zero.
+ */
+int BreakCond_MatchCpuQuiet(void)
+{
+	return BreakCond_MatchBreakPointsQuiet(&CpuBreakPoints);
+}
+
 /**
  * Return true if there were DSP breakpoint hits, false otherwise.
  */
@@ -1235,6 +1494,8 @@ static bool BreakCond_Parse(const char *expression, bc_options_t *options, bool
 			}
 		}
 		BreakCond_CheckTracking(bp);
+		BreakCond_Compile(bp);
+		BreakCond_UpdatePcFilter(bps);
 
 		bp->options.quiet = options->quiet;
 		bp->options.skip = options->skip;
@@ -1368,6 +1629,7 @@ static bool BreakCond_Remove(bc_breakpoints_t *bps, int position)
 		memmove(bp, bp + 1, (bps->count - position) * sizeof(bc_breakpoint_t));
 	}
 	bps->count--;
+	BreakCond_UpdatePcFilter(bps);
 	return true;
 }
 
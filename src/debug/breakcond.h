@@ -17,6 +17,7 @@ extern const char BreakAddr_Description[];
 
 extern bool BreakCond_MatchCpu(void);
 extern bool BreakCond_MatchDsp(void);
+extern int BreakCond_MatchCpuQuiet(void);
 extern int BreakCond_CpuBreakPointCount(void);
 extern int BreakCond_DspBreakPointCount(void);
 extern bool BreakCond_Command(const char *expression, bool bForDsp);
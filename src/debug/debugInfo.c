@@ -17,6 +17,7 @@ const char DebugInfo_fileid[] = "Hatari debuginfo.c";
 #include "acia.h"
 #include "bios.h"
 #include "blitter.h"
+#include "blockDev.h"
 #include "configuration.h"
 #include "crossbar.h"
 #include "debugInfo.h"
@@ -671,6 +672,7 @@ static const struct {
 	{ false, "dta",      DebugInfo_DTA,        NULL, "Show current [or given] DTA information" },
 	{ true, "file",      DebugInfo_FileParse, DebugInfo_FileArgs, "Parse commands from given debugger input <file>" },
 	{ false,"gemdos",    GemDOS_Info,          NULL, "Show GEMDOS HDD emu information (with <value>, show opcodes)" },
+	{ false,"harddisk",  BlockDev_Info,        NULL, "Show ACSI/SCSI/IDE hard disk image I/O statistics" },
 	{ true, "history",   History_Show,         NULL, "Show history of last <count> instructions" },
 	{ false,"ikbd",      IKBD_Info,            NULL, "Show IKBD (SCI) register contents" },
 	{ true, "memdump",   DebugInfo_CpuMemDump, NULL, "Dump CPU memory from given <address>" },
@@ -27,7 +27,9 @@ const char DebugCpu_fileid[] = "Hatari debugcpu.c";
 #include "log.h"
 #include "m68000.h"
 #include "memorySnapShot.h"
+#include "memwatch.h"
 #include "profile.h"
+#include "reverse.h"
 #include "stMemory.h"
 #include "str.h"
 #include "symbols.h"
@@ -893,6 +895,10 @@ Uint32 DebugCpu_InstrCount(void)
  */
 void DebugCpu_Check(void)
 {
+	if (ReverseTracking && Reverse_Check())
+	{
+		return;
+	}
 	nCpuInstructions++;
 	if (bCpuProfiling)
 	{
@@ -914,6 +920,12 @@ void DebugCpu_Check(void)
 		uaecptr nextpc;
 		m68k_dumpstate_file(TraceFile, &nextpc, 0xffffffff);
 	}
+	if (MemWatch_CheckHit())
+	{
+		DebugUI(REASON_CPU_WATCHPOINT);
+		if (nCpuSteps)
+			nCpuSteps++;
+	}
 	if (nCpuActiveCBs)
 	{
 		if (BreakCond_MatchCpu())
@@ -936,6 +948,10 @@ void DebugCpu_Check(void)
 	{
 		History_AddCpu();
 	}
+	else if (History_TrackCpuDetail())
+	{
+		History_AddCpuDetail();
+	}
 	if (ConOutDevices)
 	{
 		Console_Check();
@@ -952,7 +968,8 @@ void DebugCpu_SetDebugging(void)
 	bCpuProfiling = Profile_CpuStart();
 	nCpuActiveCBs = BreakCond_CpuBreakPointCount();
 
-	if (nCpuActiveCBs || nCpuSteps || bCpuProfiling || History_TrackCpu()
+	if (nCpuActiveCBs || nCpuSteps || bCpuProfiling
+	    || History_TrackCpu() || History_TrackCpuDetail() || ReverseTracking
 	    || LOG_TRACE_LEVEL((TRACE_CPU_DISASM|TRACE_CPU_SYMBOLS|TRACE_CPU_REGS))
 	    || ConOutDevices)
 	{
@@ -978,6 +995,11 @@ static const dbgcommand_t cpucommands[] =
 	  "set/remove/list conditional CPU breakpoints",
 	  BreakCond_Description,
 	  true },
+	{ MemWatch_Command, Symbols_MatchCpuDataAddress,
+	  "watch", "",
+	  "set/remove/list CPU memory read/write watchpoints",
+	  MemWatch_Description,
+	  false },
 	{ DebugCpu_DisAsm, Symbols_MatchCpuCodeAddress,
 	  "disasm", "d",
 	  "disassemble from PC, or given address",
@@ -1053,6 +1075,21 @@ static const dbgcommand_t cpucommands[] =
 	  "[steps]\n"
 	  "\tLeave debugger and continue emulation for <steps> CPU instructions\n"
 	  "\tor forever if no steps have been specified.",
+	  false },
+	{ Reverse_Command, Reverse_Match,
+	  "reverse", "",
+	  "enable/disable/show reverse debugging checkpoints",
+	  Reverse_Description,
+	  false },
+	{ Reverse_Step, NULL,
+	  "rstep", "",
+	  "single-step CPU backwards",
+	  Reverse_StepDescription,
+	  false },
+	{ Reverse_Continue, NULL,
+	  "rcont", "",
+	  "continue CPU backwards to previous breakpoint hit",
+	  Reverse_ContinueDescription,
 	  false }
 };
 
@@ -23,6 +23,7 @@ const char DebugUI_fileid[] = "Hatari debugui.c";
 #endif
 
 #include "main.h"
+#include "blockDev.h"
 #include "change.h"
 #include "configuration.h"
 #include "file.h"
@@ -472,6 +473,31 @@ static int DebugUI_Reset(int argc, char *argv[])
 }
 
 
+/**
+ * Command: Commit or discard hard disk image overlays
+ */
+static char *DebugUI_MatchHdOverlay(const char *text, int state)
+{
+	static const char* actions[] = { "commit", "discard" };
+	return DebugUI_MatchHelper(actions, ARRAY_SIZE(actions), text, state);
+}
+static int DebugUI_HdOverlay(int argc, char *argv[])
+{
+	int count;
+
+	if (argc != 2 || (strcmp(argv[1], "commit") && strcmp(argv[1], "discard")))
+		return DebugUI_PrintCmdHelp(argv[0]);
+
+	count = BlockDev_OverlayAction(strcmp(argv[1], "commit") == 0);
+	if (count < 0)
+		fprintf(stderr, "ERROR: HD image overlay %s failed!\n", argv[1]);
+	else
+		fprintf(stderr, "%s %d HD image overlay(s).\n",
+			strcmp(argv[1], "commit") == 0 ? "Committed" : "Discarded", count);
+	return DEBUGGER_CMDDONE;
+}
+
+
 /**
  * Command: Read debugger commands from a file
  */
@@ -961,6 +987,16 @@ static const dbgcommand_t uicommand[] =
 	  "\tResult value is shown as binary, decimal and hexadecimal.\n"
 	  "\tAfter this, '$' will TAB-complete to last result value.",
 	  true },
+	{ DebugUI_HdOverlay, DebugUI_MatchHdOverlay,
+	  "hdoverlay", "",
+	  "commit or discard hard disk image overlays",
+	  "<commit|discard>\n"
+	  "\tWith 'commit', write the ACSI/SCSI/IDE image changes stored in\n"
+	  "\tthe overlay files (see --hd-overlay option) to the images,\n"
+	  "\twith 'discard' throw them away. Both leave the overlays empty.\n"
+	  "\tAs the emulated OS may have cached the discarded data, reset\n"
+	  "\tthe emulation after discarding.",
+	  false },
 	{ DebugUI_Help, DebugUI_MatchCommand,
 	  "help", "h",
 	  "print help",
@@ -970,12 +1006,17 @@ static const dbgcommand_t uicommand[] =
 	{ History_Parse, History_Match,
 	  "history", "hi",
 	  "show last CPU/DSP PC values & executed instructions",
-	  "cpu|dsp|on|off|<count> [limit]|save <file>\n"
+	  "cpu|dsp|on|off|detail|<count> [limit]|save <file>|export <file>\n"
 	  "\t'cpu' and 'dsp' enable instruction history tracking for just given\n"
 	  "\tprocessor, 'on' tracks them both, 'off' will disable history.\n"
 	  "\tOptional 'limit' will set how many past instructions are tracked.\n"
 	  "\tGiving just count will show (at max) given number of last saved PC\n"
-	  "\tvalues and instructions currently at corresponding RAM addresses.",
+	  "\tvalues and instructions currently at corresponding RAM addresses.\n"
+	  "\n"
+	  "\t'detail' tracks instead of CPU PC values also the changed registers\n"
+	  "\tand memory writes, 'limit' being the buffer size in MBs (default 16).\n"
+	  "\t'export' saves the detailed history in binary format, to be viewed\n"
+	  "\twith the hatari_history tool.",
 	  false },
 	{ DebugInfo_Command, DebugInfo_MatchInfo,
 	  "info", "i",
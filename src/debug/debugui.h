@@ -27,7 +27,8 @@ typedef enum {
 	REASON_CPU_STEPS,
 	REASON_DSP_STEPS,
 	REASON_PROGRAM,
-	REASON_USER        // e.g. keyboard shortcut
+	REASON_USER,       // e.g. keyboard shortcut
+	REASON_CPU_WATCHPOINT
 } debug_reason_t;
 
 /* Callback type to register if remote debugging is enabled */
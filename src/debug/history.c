@@ -7,6 +7,12 @@
  * or at your option any later version. Read the file gpl.txt for details.
  *
  * history.c - functions for debugger entry & breakpoint history
+ *
+ * Besides the PC values, detailed CPU history can be collected.  It
+ * records for every executed instruction its address, opcode, SR and
+ * changed registers, and memory writes done by it.  Items are delta
+ * encoded to a binary ring-buffer, which can be exported to a file
+ * for post-mortem analysis with tools/debugger/hatari_history.py.
  */
 const char History_fileid[] = "Hatari history.c";
 
@@ -21,10 +27,31 @@ const char History_fileid[] = "Hatari history.c";
 #include "file.h"
 #include "history.h"
 #include "m68000.h"
+#include "memwatch.h"
 #include "68kDisass.h"
 
 #define HISTORY_ITEMS_MIN 64
 
+/* detailed CPU history ring-buffer consists of fixed size chunks,
+ * each of which starts with a keyframe item having full register
+ * state, so that oldest chunks can be overwritten with new ones
+ */
+#define DETAIL_CHUNK_SIZE	0x10000
+#define DETAIL_MB_DEFAULT	16
+#define DETAIL_MB_MAX		1024
+#define DETAIL_MAX_WRITES	31
+/* max. item size: tag, PC, opcode, SR, register mask, registers, writes */
+#define DETAIL_ITEM_MAX	(1 + 5 + 2 + 2 + 2 + 16*5 + DETAIL_MAX_WRITES*(5+4))
+
+/* detailed item tag byte */
+#define DTAG_KEYFRAME	0x80	/* full register state instead of changes */
+#define DTAG_SR		0x40	/* SR changed */
+#define DTAG_LOST	0x20	/* more memory writes than could be stored */
+#define DTAG_WRITES	0x1f	/* number of stored memory writes */
+
+#define DETAIL_FILE_MAGIC	"HHIS"
+#define DETAIL_FILE_VERSION	1
+
 history_type_t HistoryTracking;
 
 typedef struct {
@@ -46,6 +73,44 @@ static struct {
 	hist_item_t *item; /* ring-buffer */
 } History;
 
+typedef struct {
+	Uint32 seq;        /* chunk sequence number, zero if unused */
+	Uint32 used;       /* bytes used in chunk, including this header */
+	Uint32 items;      /* number of items in chunk */
+} detail_chunk_t;
+
+typedef struct {
+	Uint32 addr;
+	Uint32 value;
+	int size;
+} detail_write_t;
+
+static struct {
+	Uint8 *buf;        /* ring-buffer of chunks */
+	unsigned chunks;   /* ring-buffer size in chunks */
+	unsigned chunk;    /* current chunk */
+	Uint32 seq;        /* sequence number of current chunk */
+	bool valid;        /* whether values below are valid for deltas */
+	Uint32 pc;
+	Uint16 sr;
+	Uint32 regs[16];
+	/* memory writes done by current instruction */
+	int writes;
+	bool lost;
+	detail_write_t write[DETAIL_MAX_WRITES];
+} Detail;
+
+/* decoded detailed history item */
+typedef struct {
+	Uint32 pc;
+	Uint16 opcode;
+	Uint16 sr;
+	Uint32 regs[16];
+	Uint16 changed;    /* mask of changed registers */
+	Uint8 tag;
+	detail_write_t write[DETAIL_MAX_WRITES];
+} detail_item_t;
+
 
 /**
  * Convert debugger entry/breakpoint entry reason to a string
@@ -67,29 +132,107 @@ static const char* History_ReasonStr(debug_reason_t reason)
 		return "Program break";
 	case REASON_USER:
 		return "User break";
+	case REASON_CPU_WATCHPOINT:
+		return "CPU watchpoint";
 	default:
 		return "Unknown reason";
 	}
 }
 
 
+/**
+ * Change history ring-buffer size, keeping the latest items
+ */
+static void History_Resize(unsigned limit)
+{
+	hist_item_t *item;
+	unsigned i, count;
+
+	item = calloc(limit, sizeof(History.item[0]));
+	if (!item) {
+		perror("History_Resize");
+		return;
+	}
+	count = History.count;
+	if (count > History.limit) {
+		count = History.limit;
+	}
+	if (count > limit) {
+		count = limit;
+	}
+	for (i = 0; i < count; i++) {
+		item[i] = History.item[(History.idx + History.limit - count + 1 + i) % History.limit];
+	}
+	free(History.item);
+	History.item = item;
+	History.limit = limit;
+	History.count = count;
+	History.idx = count ? count - 1 : 0;
+}
+
+/**
+ * Free detailed history ring-buffer
+ */
+static void History_DetailFree(void)
+{
+	free(Detail.buf);
+	memset(&Detail, 0, sizeof(Detail));
+}
+
+/**
+ * (Re-)allocate and clear detailed history ring-buffer
+ * if its size changes.  Return false on failure.
+ */
+static bool History_DetailAlloc(unsigned mb)
+{
+	unsigned chunks = mb * (0x100000 / DETAIL_CHUNK_SIZE);
+
+	if (Detail.buf && chunks == Detail.chunks) {
+		return true;
+	}
+	History_DetailFree();
+	Detail.buf = calloc(chunks, DETAIL_CHUNK_SIZE);
+	if (!Detail.buf) {
+		fprintf(stderr, "ERROR: allocating %d MB for detailed history failed!\n", mb);
+		return false;
+	}
+	Detail.chunks = chunks;
+	/* so that first item goes to first chunk */
+	Detail.chunk = chunks - 1;
+	return true;
+}
+
 /**
  * Set what kind of history is collected.
- * Clear history if tracking type changes as rest of
- * data wouldn't then be anymore valid.
+ * Items already collected are kept, only ring-buffer
+ * size change drops the oldest items (if needed).
+ * For detailed CPU history, limit is buffer size in MBs.
  */
 static void History_Enable(history_type_t track, unsigned limit)
 {
 	const char *msg;
-	if (track != HistoryTracking || limit != History.limit) {
-		fprintf(stderr, "Re-allocating & zeroing history due to type/limit change.\n");
-		if (History.item) {
-			free(History.item);
+
+	if (track & HISTORY_TRACK_CPU_DETAIL) {
+		if (!History_DetailAlloc(limit)) {
+			return;
+		}
+		/* next item should be keyframe */
+		Detail.valid = false;
+		Detail.writes = 0;
+		Detail.lost = false;
+	} else {
+		History_DetailFree();
+		if (limit != History.limit) {
+			History_Resize(limit);
 		}
-		memset(&History, 0, sizeof(History));
-		History.item = calloc(limit, sizeof(History.item[0]));
-		History.limit = limit;
 	}
+	if (!MemWatch_TrackWrites(track & HISTORY_TRACK_CPU_DETAIL)) {
+		fprintf(stderr, "ERROR: too many memory banks to track all CPU writes, detailed history not enabled!\n");
+		History_DetailFree();
+		track &= ~HISTORY_TRACK_CPU_DETAIL;
+		limit = History.limit;
+	}
+
 	switch (track) {
 	case HISTORY_TRACK_NONE:
 		msg = "disabled";
@@ -103,11 +246,22 @@ static void History_Enable(history_type_t track, unsigned limit)
 	case HISTORY_TRACK_ALL:
 		msg = "enabled for CPU & DSP";
 		break;
+	case HISTORY_TRACK_CPU_DETAIL:
+		msg = "enabled for CPU (detailed)";
+		break;
 	default:
+		if (track == (HISTORY_TRACK_CPU_DETAIL|HISTORY_TRACK_DSP)) {
+			msg = "enabled for CPU (detailed) & DSP";
+			break;
+		}
 		msg = "error";
 	}
 	HistoryTracking = track;
-	fprintf(stderr, "History tracking %s (max. %d instructions).\n", msg, limit);
+	if (track & HISTORY_TRACK_CPU_DETAIL) {
+		fprintf(stderr, "History tracking %s (%d MB buffer).\n", msg, limit);
+	} else {
+		fprintf(stderr, "History tracking %s (max. %d instructions).\n", msg, limit);
+	}
 }
 
 /**
@@ -147,6 +301,163 @@ void History_AddDsp(void)
 	History.item[History.idx].pc.dsp = pc;
 }
 
+/* big endian & variable length (7 bits per byte) value encoding */
+static inline Uint8 *Detail_Put16(Uint8 *p, Uint16 v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+	return p + 2;
+}
+
+static inline Uint8 *Detail_Put32(Uint8 *p, Uint32 v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+	return p + 4;
+}
+
+static inline Uint8 *Detail_PutVar(Uint8 *p, Uint64 v)
+{
+	while (v >= 0x80) {
+		*p++ = v | 0x80;
+		v >>= 7;
+	}
+	*p++ = v;
+	return p;
+}
+
+/* map signed difference to unsigned so that small values stay small */
+static inline Uint32 Detail_ZigZag(Uint32 diff)
+{
+	return (diff << 1) ^ (0 - (diff >> 31));
+}
+
+/**
+ * Start new detailed history chunk, overwriting the oldest one
+ */
+static detail_chunk_t *History_DetailNewChunk(void)
+{
+	detail_chunk_t *chunk;
+
+	Detail.chunk = (Detail.chunk + 1) % Detail.chunks;
+	chunk = (detail_chunk_t *)(Detail.buf + Detail.chunk * DETAIL_CHUNK_SIZE);
+	chunk->seq = ++Detail.seq;
+	chunk->used = sizeof(detail_chunk_t);
+	chunk->items = 0;
+	return chunk;
+}
+
+/**
+ * Add item for last executed CPU instruction to detailed history:
+ * its address & opcode, resulting SR and register changes, and
+ * memory writes done by it.  Registers and SR are stored only when
+ * they change, and PC, register and memory address changes are stored
+ * as variable length deltas, so most items take only few bytes.
+ */
+void History_AddCpuDetail(void)
+{
+	detail_chunk_t *chunk;
+	Uint32 pc, *reg = Regs;
+	Uint16 sr, mask;
+	Uint32 waddr;
+	Uint8 tag, *item, *p;
+	int i;
+
+	pc = M68000_InstrPC;
+	sr = M68000_GetSR();
+
+	chunk = (detail_chunk_t *)(Detail.buf + Detail.chunk * DETAIL_CHUNK_SIZE);
+	if (!Detail.valid || chunk->used + DETAIL_ITEM_MAX > DETAIL_CHUNK_SIZE) {
+		chunk = History_DetailNewChunk();
+		Detail.valid = false;
+	}
+	item = (Uint8 *)chunk + chunk->used;
+	p = item + 1;
+	tag = Detail.writes | (Detail.lost ? DTAG_LOST : 0);
+
+	if (Detail.valid) {
+		p = Detail_PutVar(p, Detail_ZigZag(pc - Detail.pc));
+		p = Detail_Put16(p, M68000_CurrentOpcode);
+		if (sr != Detail.sr) {
+			tag |= DTAG_SR;
+			p = Detail_Put16(p, sr);
+		}
+		mask = 0;
+		for (i = 0; i < 16; i++) {
+			if (reg[i] != Detail.regs[i]) {
+				mask |= 1 << i;
+			}
+		}
+		p = Detail_Put16(p, mask);
+		for (i = 0; mask; i++, mask >>= 1) {
+			if (mask & 1) {
+				p = Detail_PutVar(p, Detail_ZigZag(reg[i] - Detail.regs[i]));
+			}
+		}
+	} else {
+		tag |= DTAG_KEYFRAME;
+		p = Detail_Put32(p, pc);
+		p = Detail_Put16(p, M68000_CurrentOpcode);
+		p = Detail_Put16(p, sr);
+		for (i = 0; i < 16; i++) {
+			p = Detail_Put32(p, reg[i]);
+		}
+		Detail.valid = true;
+	}
+	Detail.pc = pc;
+	Detail.sr = sr;
+	memcpy(Detail.regs, reg, sizeof(Detail.regs));
+
+	/* write addresses are deltas from previous write in same item,
+	 * access size (0-2 = byte/word/long) is in lowest 2 bits
+	 */
+	waddr = pc;
+	for (i = 0; i < Detail.writes; i++) {
+		detail_write_t *w = &Detail.write[i];
+		Uint64 code = (Uint64)Detail_ZigZag(w->addr - waddr) << 2;
+		waddr = w->addr;
+		switch (w->size) {
+		case 1:
+			p = Detail_PutVar(p, code);
+			*p++ = w->value;
+			break;
+		case 2:
+			p = Detail_PutVar(p, code | 1);
+			p = Detail_Put16(p, w->value);
+			break;
+		default:
+			p = Detail_PutVar(p, code | 2);
+			p = Detail_Put32(p, w->value);
+			break;
+		}
+	}
+	Detail.writes = 0;
+	Detail.lost = false;
+
+	*item = tag;
+	chunk->used = p - (Uint8 *)chunk;
+	chunk->items++;
+}
+
+/**
+ * Add memory write done by current CPU instruction to detailed history
+ */
+void History_AddCpuWrite(Uint32 addr, int size, Uint32 value)
+{
+	detail_write_t *w;
+
+	if (Detail.writes >= DETAIL_MAX_WRITES) {
+		Detail.lost = true;
+		return;
+	}
+	w = &Detail.write[Detail.writes++];
+	w->addr = addr;
+	w->size = size;
+	w->value = value;
+}
+
 /**
  * Flag last history entry as debugger entry point, with given reason
  */
@@ -216,10 +527,215 @@ static Uint32 History_Output(Uint32 count, FILE *fp)
 	return retval;
 }
 
+static inline const Uint8 *Detail_Get16(const Uint8 *p, Uint16 *v)
+{
+	*v = p[0] << 8 | p[1];
+	return p + 2;
+}
+
+static inline const Uint8 *Detail_Get32(const Uint8 *p, Uint32 *v)
+{
+	*v = (Uint32)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+	return p + 4;
+}
+
+static inline const Uint8 *Detail_GetVar(const Uint8 *p, Uint64 *v)
+{
+	int shift = 0;
+
+	*v = 0;
+	do {
+		*v |= (Uint64)(*p & 0x7f) << shift;
+		shift += 7;
+	} while (*p++ & 0x80);
+	return p;
+}
+
+static inline Uint32 Detail_UnZigZag(Uint32 v)
+{
+	return (v >> 1) ^ (0 - (v & 1));
+}
+
+/**
+ * Decode detailed history item at 'p' into 'it', which contains
+ * state from the previous item.  Return pointer to next item.
+ */
+static const Uint8 *History_DetailDecode(const Uint8 *p, detail_item_t *it)
+{
+	Uint32 waddr, value;
+	Uint64 v;
+	Uint16 mask;
+	int i;
+
+	it->tag = *p++;
+	if (it->tag & DTAG_KEYFRAME) {
+		Uint16 sr = it->sr;
+		Uint32 regs[16];
+		memcpy(regs, it->regs, sizeof(regs));
+		p = Detail_Get32(p, &it->pc);
+		p = Detail_Get16(p, &it->opcode);
+		p = Detail_Get16(p, &it->sr);
+		it->changed = 0;
+		for (i = 0; i < 16; i++) {
+			p = Detail_Get32(p, &it->regs[i]);
+			if (it->regs[i] != regs[i]) {
+				it->changed |= 1 << i;
+			}
+		}
+		if (sr != it->sr) {
+			it->tag |= DTAG_SR;
+		}
+	} else {
+		p = Detail_GetVar(p, &v);
+		it->pc += Detail_UnZigZag(v);
+		p = Detail_Get16(p, &it->opcode);
+		if (it->tag & DTAG_SR) {
+			p = Detail_Get16(p, &it->sr);
+		}
+		p = Detail_Get16(p, &mask);
+		it->changed = mask;
+		for (i = 0; mask; i++, mask >>= 1) {
+			if (mask & 1) {
+				p = Detail_GetVar(p, &v);
+				it->regs[i] += Detail_UnZigZag(v);
+			}
+		}
+	}
+	waddr = it->pc;
+	for (i = 0; i < (it->tag & DTAG_WRITES); i++) {
+		p = Detail_GetVar(p, &v);
+		waddr += Detail_UnZigZag(v >> 2);
+		it->write[i].addr = waddr;
+		switch (v & 3) {
+		case 0:
+			value = *p++;
+			it->write[i].size = 1;
+			break;
+		case 1:
+			p = Detail_Get16(p, &mask);
+			value = mask;
+			it->write[i].size = 2;
+			break;
+		default:
+			p = Detail_Get32(p, &value);
+			it->write[i].size = 4;
+			break;
+		}
+		it->write[i].value = value;
+	}
+	return p;
+}
+
+/**
+ * Return chunk with given index in detailed history ring-buffer
+ */
+static inline detail_chunk_t *History_DetailChunk(unsigned idx)
+{
+	return (detail_chunk_t *)(Detail.buf + (idx % Detail.chunks) * DETAIL_CHUNK_SIZE);
+}
+
+/**
+ * Find oldest chunk containing (at least) given number of latest
+ * detailed history items, set 'items' to number of items in chunks
+ * from that onwards, and return how many chunks there are.
+ */
+static unsigned History_DetailChunks(Uint32 count, Uint32 *items)
+{
+	detail_chunk_t *chunk;
+	unsigned n;
+
+	*items = 0;
+	for (n = 0; n < Detail.chunks; n++) {
+		chunk = History_DetailChunk(Detail.chunk + Detail.chunks - n);
+		if (!chunk->seq || chunk->seq != Detail.seq - n) {
+			break;
+		}
+		*items += chunk->items;
+		if (count && *items >= count) {
+			return n + 1;
+		}
+	}
+	return n;
+}
+
+/**
+ * Output (at max) given number of latest detailed CPU history
+ * items, or all of them if count is zero
+ */
+static Uint32 History_DetailOutput(Uint32 count, FILE *fp)
+{
+	static const char sizes[] = { ' ', 'b', 'w', ' ', 'l' };
+	const detail_chunk_t *chunk;
+	const Uint8 *p, *end;
+	detail_item_t it;
+	Uint32 items, skip, dummy;
+	unsigned n, first;
+	int i;
+
+	n = History_DetailChunks(count, &items);
+	if (!items) {
+		fprintf(stderr, "No history items to show.\n");
+		return 0;
+	}
+	if (!count || count > items) {
+		count = items;
+	}
+	skip = items - count;
+	first = Detail.chunk + Detail.chunks - n + 1;
+
+	memset(&it, 0, sizeof(it));
+	while (n-- > 0) {
+		chunk = History_DetailChunk(first++);
+		p = (const Uint8 *)chunk + sizeof(detail_chunk_t);
+		end = (const Uint8 *)chunk + chunk->used;
+		while (p < end) {
+			p = History_DetailDecode(p, &it);
+			if (skip) {
+				skip--;
+				continue;
+			}
+			Disasm(fp, it.pc, &dummy, 1);
+			if (!(it.changed || (it.tag & (DTAG_SR|DTAG_WRITES|DTAG_LOST)))) {
+				continue;
+			}
+			fputs("\t->", fp);
+			for (i = 0; i < 16; i++) {
+				if (it.changed & (1 << i)) {
+					fprintf(fp, " %c%d=$%x", i < 8 ? 'D' : 'A', i & 7, it.regs[i]);
+				}
+			}
+			if (it.tag & DTAG_SR) {
+				fprintf(fp, " SR=$%04x", it.sr);
+			}
+			for (i = 0; i < (it.tag & DTAG_WRITES); i++) {
+				fprintf(fp, " ($%x).%c=$%x", it.write[i].addr,
+					sizes[it.write[i].size], it.write[i].value);
+			}
+			if (it.tag & DTAG_LOST) {
+				fputs(" (more writes)", fp);
+			}
+			fputc('\n', fp);
+		}
+	}
+	return count;
+}
+
+/**
+ * Whether detailed CPU history is shown instead of the PC history
+ */
+static bool History_DetailShown(void)
+{
+	return Detail.seq && (History_TrackCpuDetail() || !History.count);
+}
+
 /* History_Output() helper for "info" & "lock" commands */
 void History_Show(FILE *fp, Uint32 count)
 {
-	History_Output(count, fp);
+	if (History_DetailShown()) {
+		History_DetailOutput(count, fp);
+	} else {
+		History_Output(count, fp);
+	}
 }
 
 /*
@@ -234,7 +750,11 @@ static void History_Save(const char *name)
 		fprintf(stderr, "ERROR: file '%s' already exists!\n", name);
 
 	} else if ((fp = fopen(name, "w"))) {
-		count = History_Output(0, fp);
+		if (History_DetailShown()) {
+			count = History_DetailOutput(0, fp);
+		} else {
+			count = History_Output(0, fp);
+		}
 		fprintf(stderr, "%d history items saved to '%s'.\n", count, name);
 		fclose(fp);
 	} else {
@@ -242,12 +762,61 @@ static void History_Save(const char *name)
 	}
 }
 
+/*
+ * export detailed CPU history in binary format to given file
+ */
+static void History_Export(const char *name)
+{
+	const detail_chunk_t *chunk;
+	Uint8 header[16], *p;
+	Uint32 items;
+	unsigned n, first;
+	FILE *fp;
+
+	n = History_DetailChunks(0, &items);
+	if (!items) {
+		fprintf(stderr, "No detailed history to export.\n");
+		return;
+	}
+	if (File_Exists(name)) {
+		fprintf(stderr, "ERROR: file '%s' already exists!\n", name);
+		return;
+	}
+	if (!(fp = fopen(name, "wb"))) {
+		fprintf(stderr, "ERROR: opening '%s' failed (%d).\n", name, errno);
+		return;
+	}
+	/* file header: magic, version, chunk count & number of items */
+	memcpy(header, DETAIL_FILE_MAGIC, 4);
+	p = Detail_Put32(header + 4, DETAIL_FILE_VERSION);
+	p = Detail_Put32(p, n);
+	Detail_Put32(p, items);
+	fwrite(header, sizeof(header), 1, fp);
+
+	/* chunks from oldest, header in big endian, then item data */
+	first = Detail.chunk + Detail.chunks - n + 1;
+	while (n-- > 0) {
+		chunk = History_DetailChunk(first++);
+		p = Detail_Put32(header, chunk->seq);
+		p = Detail_Put32(p, chunk->used);
+		Detail_Put32(p, chunk->items);
+		fwrite(header, sizeof(detail_chunk_t), 1, fp);
+		fwrite(chunk + 1, chunk->used - sizeof(detail_chunk_t), 1, fp);
+	}
+	if (ferror(fp)) {
+		fprintf(stderr, "ERROR: writing '%s' failed.\n", name);
+	} else {
+		fprintf(stderr, "%d detailed history items exported to '%s'.\n", items, name);
+	}
+	fclose(fp);
+}
+
 /*
  * Readline callback
  */
 char *History_Match(const char *text, int state)
 {
-	static const char* cmds[] = { "cpu", "dsp", "off", "save" };
+	static const char* cmds[] = { "cpu", "detail", "dsp", "export", "off", "on", "save" };
 	return DebugUI_MatchHelper(cmds, ARRAY_SIZE(cmds), text, state);
 }
 
@@ -264,6 +833,20 @@ int History_Parse(int nArgc, char *psArgs[])
 	if (nArgc > 2) {
 		limit = atoi(psArgs[2]);
 	}
+	if (strcmp(psArgs[1], "detail") == 0) {
+		if (limit <= 0) {
+			limit = Detail.chunks ? Detail.chunks / (0x100000 / DETAIL_CHUNK_SIZE) : DETAIL_MB_DEFAULT;
+		}
+		if (limit > DETAIL_MB_MAX) {
+			limit = DETAIL_MB_MAX;
+		}
+		History_Enable((HistoryTracking & HISTORY_TRACK_DSP) | HISTORY_TRACK_CPU_DETAIL, limit);
+		return DEBUGGER_CMDDONE;
+	}
+	if (nArgc == 3 && strcmp(psArgs[1], "export") == 0) {
+		History_Export(psArgs[2]);
+		return DEBUGGER_CMDDONE;
+	}
 	/* make sure value is valid & positive */
 	if (!limit) {
 		limit = History.limit;
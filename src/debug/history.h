@@ -13,7 +13,8 @@ typedef enum {
 	HISTORY_TRACK_NONE = 0,
 	HISTORY_TRACK_CPU = 1,
 	HISTORY_TRACK_DSP = 2,
-	HISTORY_TRACK_ALL = 3
+	HISTORY_TRACK_ALL = 3,
+	HISTORY_TRACK_CPU_DETAIL = 4	/* instead of CPU */
 } history_type_t;
 
 extern history_type_t HistoryTracking;
@@ -22,6 +23,10 @@ static inline bool History_TrackCpu(void)
 {
 	return HistoryTracking & HISTORY_TRACK_CPU;
 }
+static inline bool History_TrackCpuDetail(void)
+{
+	return HistoryTracking & HISTORY_TRACK_CPU_DETAIL;
+}
 static inline bool History_TrackDsp(void)
 {
 	return HistoryTracking & HISTORY_TRACK_DSP;
@@ -30,6 +35,10 @@ static inline bool History_TrackDsp(void)
 /* for debugcpu/dsp.c */
 extern void History_AddCpu(void);
 extern void History_AddDsp(void);
+extern void History_AddCpuDetail(void);
+
+/* for memwatch.c */
+extern void History_AddCpuWrite(Uint32 addr, int size, Uint32 value);
 
 /* for debugInfo.c */
 extern void History_Show(FILE *fp, Uint32 count);
@@ -0,0 +1,343 @@
+/*
+  Hatari - memwatch.c
+
+  This file is distributed under the GNU General Public License, version 2
+  or at your option any later version. Read the file gpl.txt for details.
+
+  memwatch.c - CPU memory read/write watchpoints.
+
+  Instead of checking memory contents after every instruction like
+  breakpoint conditions do, watchpoints hook the memory banks (see
+  memory_watch_bank() in cpu/memory.c) containing the watched address
+  ranges, so only accesses to those 64 KB banks are checked. Bulk DMA
+  transfers done with STMemory_SafeCopy() are checked as whole ranges.
+  On a hit, the access is recorded and the debugger is entered after
+  the current instruction has finished.
+
+  Same mechanism is used to pass all memory writes to the detailed
+  CPU history (see history.c).
+*/
+const char MemWatch_fileid[] = "Hatari memwatch.c";
+
+#include "main.h"
+#include "configuration.h"
+#include "debugui.h"
+#include "debug_priv.h"
+#include "evaluate.h"
+#include "history.h"
+#include "m68000.h"
+#include "memwatch.h"
+#include "stMemory.h"
+
+#define MEMWATCH_READ	1
+#define MEMWATCH_WRITE	2
+
+#define MEMWATCH_MAX	32
+
+typedef struct {
+	Uint32 start;	/* first watched address */
+	Uint32 end;	/* last watched address */
+	int flags;	/* MEMWATCH_READ / MEMWATCH_WRITE */
+	int hits;
+} memwatch_t;
+
+static memwatch_t Watches[MEMWATCH_MAX];
+static int nWatches;
+
+/* whether all writes are passed to history */
+static bool bTrackWrites;
+
+/* first watchpoint hit after previous check */
+static struct {
+	bool pending;
+	int index;	/* watchpoint index */
+	Uint32 addr;
+	Uint32 len;	/* access size, or DMA transfer length */
+	Uint32 value;
+	Uint32 pc;
+	bool write;
+	bool dma;
+} Hit;
+
+
+/**
+ * Map 24-bit address space mirrors & TT 0xff000000 mirror to
+ * the addresses used for the watch ranges
+ */
+static inline Uint32 MemWatch_Normalize(Uint32 addr)
+{
+	if (addr >= 0xff000000 || ConfigureParams.System.bAddressSpace24) {
+		return addr & 0xffffff;
+	}
+	return addr;
+}
+
+/**
+ * Record hit for given watchpoint & ask CPU core to call
+ * DebugCpu_Check() after the current instruction.
+ */
+static void MemWatch_Record(memwatch_t *w, Uint32 addr, Uint32 len,
+			    Uint32 value, bool bWrite, bool bDma)
+{
+	w->hits++;
+	if (Hit.pending) {
+		return;
+	}
+	Hit.pending = true;
+	Hit.index = w - Watches;
+	Hit.addr = addr;
+	Hit.len = len;
+	Hit.value = value;
+	Hit.pc = M68000_InstrPC;
+	Hit.write = bWrite;
+	Hit.dma = bDma;
+	M68000_SetSpecial(SPCFLAG_DEBUGGER);
+}
+
+/**
+ * Check CPU (or DMA word/byte) memory access, called from the
+ * access functions of the watched memory banks
+ */
+void MemWatch_Access(Uint32 addr, int size, Uint32 value, bool bWrite)
+{
+	int flag = bWrite ? MEMWATCH_WRITE : MEMWATCH_READ;
+	memwatch_t *w;
+
+	if (bWrite && bTrackWrites) {
+		History_AddCpuWrite(addr, size, value);
+	}
+	if (likely(!nWatches)) {
+		return;
+	}
+	addr = MemWatch_Normalize(addr);
+	for (w = Watches; w < Watches + nWatches; w++) {
+		if ((w->flags & flag) && addr <= w->end && addr + size - 1 >= w->start) {
+			MemWatch_Record(w, addr, size, value, bWrite, false);
+			return;
+		}
+	}
+}
+
+/**
+ * Enable/disable passing of all memory writes to History_AddCpuWrite().
+ * Return false if enabling failed.
+ */
+bool MemWatch_TrackWrites(bool bEnable)
+{
+	bTrackWrites = memory_watch_writes(bEnable) && bEnable;
+	return bTrackWrites == bEnable;
+}
+
+/**
+ * Check bulk memory transfer (e.g. DMA into RAM)
+ */
+void MemWatch_AccessRange(Uint32 addr, Uint32 len, bool bWrite)
+{
+	int flag = bWrite ? MEMWATCH_WRITE : MEMWATCH_READ;
+	memwatch_t *w;
+
+	if (likely(!nWatches) || !len) {
+		return;
+	}
+	addr = MemWatch_Normalize(addr);
+	for (w = Watches; w < Watches + nWatches; w++) {
+		if ((w->flags & flag) && addr <= w->end && addr + len - 1 >= w->start) {
+			MemWatch_Record(w, addr, len, 0, bWrite, true);
+			return;
+		}
+	}
+}
+
+
+/**
+ * Show pending watchpoint hit and return true, or false if there's none.
+ * Called by DebugCpu_Check() after each instruction.
+ */
+bool MemWatch_CheckHit(void)
+{
+	static const char *sizes[] = { "", "byte", "word", "", "long" };
+	memwatch_t *w;
+
+	if (likely(!Hit.pending)) {
+		return false;
+	}
+	Hit.pending = false;
+	w = &Watches[Hit.index];
+
+	if (Hit.dma) {
+		fprintf(stderr, "%d. CPU watchpoint hit by DMA %s of %d bytes at $%x (PC $%x), %d hits.\n",
+			Hit.index + 1, Hit.write ? "write" : "read",
+			Hit.len, Hit.addr, Hit.pc, w->hits);
+	} else {
+		fprintf(stderr, "%d. CPU watchpoint hit by %s %s of $%x at $%x (PC $%x), %d hits.\n",
+			Hit.index + 1, sizes[Hit.len], Hit.write ? "write" : "read",
+			Hit.value, Hit.addr, Hit.pc, w->hits);
+	}
+	return true;
+}
+
+/**
+ * Discard pending watchpoint hit (for reverse debugging replay)
+ */
+void MemWatch_ClearHit(void)
+{
+	Hit.pending = false;
+}
+
+
+/**
+ * Hook the memory banks for current watchpoints.
+ * Return false if there were too many banks to watch.
+ */
+static bool MemWatch_Update(void)
+{
+	Uint32 bank;
+	int i;
+
+	memory_unwatch_all();
+	for (i = 0; i < nWatches; i++) {
+		for (bank = Watches[i].start >> 16; bank <= Watches[i].end >> 16; bank++) {
+			if (!memory_watch_bank(bank)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * List watchpoints
+ */
+static void MemWatch_List(void)
+{
+	static const char *modes[] = { "", "r", "w", "rw" };
+	memwatch_t *w;
+
+	if (!nWatches) {
+		fprintf(stderr, "No CPU watchpoints.\n");
+		return;
+	}
+	fprintf(stderr, "%d CPU watchpoints:\n", nWatches);
+	for (w = Watches; w < Watches + nWatches; w++) {
+		fprintf(stderr, "%4d: $%x-$%x %s, %d hits\n", (int)(w - Watches) + 1,
+			w->start, w->end, modes[w->flags], w->hits);
+	}
+}
+
+/**
+ * Remove watchpoint with given index, or all of them if index is zero
+ */
+static void MemWatch_Remove(int index)
+{
+	if (!index) {
+		nWatches = 0;
+	} else if (index < 1 || index > nWatches) {
+		fprintf(stderr, "ERROR: No such CPU watchpoint.\n");
+		return;
+	} else {
+		memmove(&Watches[index-1], &Watches[index],
+			(nWatches - index) * sizeof(memwatch_t));
+		nWatches--;
+	}
+	MemWatch_Update();
+	Hit.pending = false;
+	fprintf(stderr, "CPU watchpoints: %d\n", nWatches);
+}
+
+/**
+ * Add watchpoint for given address range and access type
+ */
+static void MemWatch_Add(char *range, const char *mode)
+{
+	memwatch_t *w;
+	Uint32 start, end;
+	int flags;
+
+	switch (Eval_Range(range, &start, &end, false)) {
+	case -1:
+		return;
+	case 0:
+		end = start;
+		break;
+	}
+	start = MemWatch_Normalize(start);
+	end = MemWatch_Normalize(end);
+	if (end < start) {
+		fprintf(stderr, "ERROR: range crosses 24-bit address space end.\n");
+		return;
+	}
+
+	if (!mode || strcmp(mode, "rw") == 0) {
+		flags = MEMWATCH_READ | MEMWATCH_WRITE;
+	} else if (strcmp(mode, "r") == 0) {
+		flags = MEMWATCH_READ;
+	} else if (strcmp(mode, "w") == 0) {
+		flags = MEMWATCH_WRITE;
+	} else {
+		fprintf(stderr, "ERROR: invalid access type '%s' (should be r, w or rw).\n", mode);
+		return;
+	}
+	if (nWatches >= MEMWATCH_MAX) {
+		fprintf(stderr, "ERROR: too many CPU watchpoints (max %d).\n", MEMWATCH_MAX);
+		return;
+	}
+
+	w = &Watches[nWatches++];
+	w->start = start;
+	w->end = end;
+	w->flags = flags;
+	w->hits = 0;
+	if (!MemWatch_Update()) {
+		fprintf(stderr, "ERROR: too many 64 KB memory banks to watch.\n");
+		nWatches--;
+		MemWatch_Update();
+		return;
+	}
+	fprintf(stderr, "CPU watchpoint %d added for $%x-$%x.\n", nWatches, start, end);
+}
+
+
+const char MemWatch_Description[] =
+	"[<start>[-<end>] [r|w|rw]] | [remove <index>|all]\n"
+	"\tWithout arguments, list CPU memory watchpoints. Otherwise add\n"
+	"\ta watchpoint for reads, writes or both (default) to the given\n"
+	"\taddress range, or remove given or all watchpoints.\n"
+	"\n"
+	"\tDebugger is entered after the instruction accessing the watched\n"
+	"\tmemory, and accessing PC, address and value are shown. Besides\n"
+	"\tCPU data accesses, watchpoints catch also blitter, DMA sound and\n"
+	"\tfloppy/hard disk DMA transfers to RAM, but not instruction fetches\n"
+	"\tor memory accesses by the debugger itself.\n"
+	"\n"
+	"\tOnly the accesses to the 64 KB memory banks containing watched\n"
+	"\taddresses are checked, so watchpoints slow down emulation much\n"
+	"\tless than breakpoints checking memory contents.";
+
+/**
+ * Command: set/remove/list CPU memory watchpoints
+ */
+int MemWatch_Command(int nArgc, char *psArgs[])
+{
+	if (nArgc < 2) {
+		MemWatch_List();
+		return DEBUGGER_CMDDONE;
+	}
+	if (strcmp(psArgs[1], "remove") == 0) {
+		if (nArgc != 3) {
+			return DebugUI_PrintCmdHelp(psArgs[0]);
+		}
+		if (strcmp(psArgs[2], "all") == 0) {
+			MemWatch_Remove(0);
+		} else if (atoi(psArgs[2]) > 0) {
+			MemWatch_Remove(atoi(psArgs[2]));
+		} else {
+			fprintf(stderr, "ERROR: invalid watchpoint index '%s'.\n", psArgs[2]);
+		}
+		return DEBUGGER_CMDDONE;
+	}
+	if (nArgc > 3) {
+		return DebugUI_PrintCmdHelp(psArgs[0]);
+	}
+	MemWatch_Add(psArgs[1], nArgc > 2 ? psArgs[2] : NULL);
+	return DEBUGGER_CMDDONE;
+}
@@ -0,0 +1,26 @@
+/*
+  Hatari - memwatch.h
+
+  This file is distributed under the GNU General Public License, version 2
+  or at your option any later version. Read the file gpl.txt for details.
+*/
+
+#ifndef HATARI_MEMWATCH_H
+#define HATARI_MEMWATCH_H
+
+/* for memory.c & stMemory.c */
+extern void MemWatch_Access(Uint32 addr, int size, Uint32 value, bool bWrite);
+extern void MemWatch_AccessRange(Uint32 addr, Uint32 len, bool bWrite);
+
+/* for history.c */
+extern bool MemWatch_TrackWrites(bool bEnable);
+
+/* for debugcpu.c */
+extern const char MemWatch_Description[];
+extern int MemWatch_Command(int nArgc, char *psArgs[]);
+extern bool MemWatch_CheckHit(void);
+
+/* for reverse.c */
+extern void MemWatch_ClearHit(void);
+
+#endif
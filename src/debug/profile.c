@@ -114,9 +114,11 @@ static void output_caller_info(FILE *fp, caller_t *info, Uint32 *typeaddr)
 }
 
 /**
- * Show collected CPU/DSP callee/caller information
+ * Show collected CPU/DSP callee/caller information.  With check_counts,
+ * warn about call counts not matching callee's first instruction counts
+ * (they don't match for sampled profiles).
  */
-void Profile_ShowCallers(FILE *fp, int sites, callee_t *callsite, const char * (*addr2name)(Uint32, Uint64 *))
+void Profile_ShowCallers(FILE *fp, int sites, callee_t *callsite, const char * (*addr2name)(Uint32, Uint64 *), bool check_counts)
 {
 	int i, j, countissues, countdiff;
 	const char *name;
@@ -156,7 +158,7 @@ void Profile_ShowCallers(FILE *fp, int sites, callee_t *callsite, const char * (
 			fprintf(fp, "%s", name);
 		}
 		fputs("\n", fp);
-		if (total) {
+		if (total && check_counts) {
 #if DEBUG
 			fprintf(stderr, "WARNING: %llu differences in call and instruction counts for '%s'!\n", total, name);
 #endif
@@ -235,9 +237,10 @@ static void add_callee_cost(callee_t *callsite, callstack_t *stack)
 }
 
 /**
- * Add new caller or updated earlier caller stats for call site
+ * Add new caller or updated earlier caller stats for call site.
+ * Return caller info, or NULL if its allocation failed.
  */
-static void add_caller(callee_t *callsite, Uint32 pc, Uint32 prev_pc, calltype_t flag)
+static caller_t *add_caller(callee_t *callsite, Uint32 pc, Uint32 prev_pc, calltype_t flag)
 {
 	int i, count, oldcount;
 	caller_t *info;
@@ -250,7 +253,7 @@ static void add_caller(callee_t *callsite, Uint32 pc, Uint32 prev_pc, calltype_t
 		info = calloc(1, sizeof(*info));
 		if (!info) {
 			fprintf(stderr, "ERROR: caller info alloc failed!\n");
-			return;
+			return NULL;
 		}
 		/* first call to this address, save address */
 		callsite->addr = pc;
@@ -266,14 +269,14 @@ static void add_caller(callee_t *callsite, Uint32 pc, Uint32 prev_pc, calltype_t
 				/* increment caller */
 				info->flags |= flag;
 				info->calls++;
-				return;
+				return info;
 			}
 			if (!info->addr) {
 				/* add caller to empty slot */
 				info->addr = prev_pc;
 				info->flags |= flag;
 				info->calls = 1;
-				return;
+				return info;
 			}
 		}
 		oldcount = count;
@@ -282,7 +285,7 @@ static void add_caller(callee_t *callsite, Uint32 pc, Uint32 prev_pc, calltype_t
 		info = realloc(callsite->callers, count * sizeof(*info));
 		if (!info) {
 			fprintf(stderr, "ERROR: caller info alloc failed!\n");
-			return;
+			return NULL;
 		}
 		callsite->callers = info;
 		callsite->count = count;
@@ -291,6 +294,64 @@ static void add_caller(callee_t *callsite, Uint32 pc, Uint32 prev_pc, calltype_t
 	}
 }
 
+/**
+ * Return call stack tree node for given callee index under given parent
+ * node, add new node if needed.  Return 0 (= root) if allocation failed.
+ */
+static Uint32 get_callnode(callinfo_t *callinfo, Uint32 parent, int idx)
+{
+	Uint32 i, hash, count, *chains;
+	callnode_t *node;
+
+	if (callinfo->node_count) {
+		hash = (parent * 31 + idx) & (callinfo->node_count - 1);
+		for (i = callinfo->node_hash[hash]; i; i = node->next) {
+			node = callinfo->node + i;
+			if (node->parent == parent && node->callee_idx == idx) {
+				return i;
+			}
+		}
+	}
+	if (callinfo->nodes >= callinfo->node_count) {
+		/* need more nodes, double them and rehash */
+		count = callinfo->node_count ? 2 * callinfo->node_count : 256;
+		node = realloc(callinfo->node, count * sizeof(*node));
+		chains = calloc(count, sizeof(*chains));
+		if (!(node && chains)) {
+			fputs("ERROR: call stack tree alloc failed!\n", stderr);
+			if (node) {
+				callinfo->node = node;
+			}
+			free(chains);
+			return 0;
+		}
+		if (!callinfo->node_count) {
+			/* root node */
+			memset(node, 0, sizeof(*node));
+			callinfo->nodes = 1;
+		}
+		free(callinfo->node_hash);
+		callinfo->node = node;
+		callinfo->node_hash = chains;
+		callinfo->node_count = count;
+		for (i = 1; i < callinfo->nodes; i++) {
+			node = callinfo->node + i;
+			hash = (node->parent * 31 + node->callee_idx) & (count - 1);
+			node->next = chains[hash];
+			chains[hash] = i;
+		}
+	}
+	i = callinfo->nodes++;
+	node = callinfo->node + i;
+	node->parent = parent;
+	node->callee_idx = idx;
+	node->count = node->cycles = 0;
+	hash = (parent * 31 + idx) & (callinfo->node_count - 1);
+	node->next = callinfo->node_hash[hash];
+	callinfo->node_hash[hash] = i;
+	return i;
+}
+
 /**
  * Add information about the called symbol, and if it was a subroutine
  * call, add it to stack of functions which total costs are tracked.
@@ -355,6 +416,7 @@ void Profile_CallStart(int idx, callinfo_t *callinfo, Uint32 prev_pc, calltype_t
 	stack->callee_idx = idx;
 	stack->caller_addr = prev_pc;
 	stack->callee_addr = pc;
+	stack->node = get_callnode(callinfo, callinfo->depth > 1 ? stack[-1].node : 0, idx);
 
 	/* record call to this into costs... */
 	totalcost->calls++;
@@ -389,6 +451,11 @@ Uint32 Profile_CallEnd(callinfo_t *callinfo, counters_t *totalcost)
 		 */
 		set_counter_diff(&(stack->all), totalcost);
 		add_callee_cost(callinfo->site + stack->callee_idx, stack);
+		if (stack->node) {
+			callnode_t *node = callinfo->node + stack->node;
+			node->count += stack->all.count - stack->out.count;
+			node->cycles += stack->all.cycles - stack->out.cycles;
+		}
 	}
 
 	/* if current function had a parent:
@@ -407,6 +474,54 @@ Uint32 Profile_CallEnd(callinfo_t *callinfo, counters_t *totalcost)
 	return stack->caller_addr;
 }
 
+/**
+ * Add sampled call from given caller address to the called symbol
+ * at 'pc', with the sample cost.  Call is counted for each sample
+ * during which it was in the call stack, but 'own' cost only for
+ * the function that was executing when the sample was taken.
+ */
+void Profile_CallSample(int idx, callinfo_t *callinfo, Uint32 caller_addr, Uint32 pc, counters_t *cost, bool own)
+{
+	caller_t *info;
+
+	if (unlikely(idx >= callinfo->sites)) {
+		fprintf(stderr, "ERROR: number of symbols increased during profiling (%d > %d)!\n", idx, callinfo->sites);
+		return;
+	}
+	info = add_caller(callinfo->site + idx, pc, caller_addr, CALL_SUBROUTINE);
+	if (!info) {
+		return;
+	}
+	add_counter_costs(&(info->all), cost);
+	if (own) {
+		add_counter_costs(&(info->own), cost);
+	} else {
+		info->own.calls += cost->calls;
+	}
+}
+
+/**
+ * Add sample cost to the call stack tree node for given call stack.
+ * Call stack callee indexes are given from innermost call outwards.
+ */
+void Profile_StackSample(callinfo_t *callinfo, const int *idx, int count, counters_t *cost)
+{
+	Uint32 node = 0;
+
+	while (count-- > 0) {
+		if (unlikely(idx[count] >= callinfo->sites)) {
+			return;
+		}
+		node = get_callnode(callinfo, node, idx[count]);
+		if (!node) {
+			return;
+		}
+	}
+	if (node) {
+		callinfo->node[node].count += cost->count;
+		callinfo->node[node].cycles += cost->cycles;
+	}
+}
 
 /**
  * Add costs to all functions still in call stack and print their names
@@ -583,11 +698,142 @@ void Profile_FreeCallinfo(callinfo_t *callinfo)
 		if (callinfo->stack) {
 			free(callinfo->stack);
 		}
+		free(callinfo->node);
+		free(callinfo->node_hash);
 		memset(callinfo, 0, sizeof(*callinfo));
 	}
 }
 
 
+/* ------------------- standard format export ---------------------- */
+
+/**
+ * Save profile in Valgrind callgrind format, for KCachegrind etc:
+ * per-address instruction & cycle costs grouped by functions, and
+ * (subroutine) calls with their inclusive costs.
+ *
+ * next_addr() returns next profiled address and its costs, starting
+ * from zero iteration position, and false when there are no more.
+ * get_caller() returns symbol at or before given address, and
+ * updates the address to the symbol one.
+ */
+void Profile_SaveCallgrind(FILE *fp, const char *proc, callinfo_t *callinfo, counters_t *totalcost,
+			   bool (*next_addr)(Uint32 *, Uint32 *, Uint64 *, Uint64 *),
+			   const char* (*get_caller)(Uint32*))
+{
+	const char *name, *prev_name = NULL;
+	Uint32 pos, addr, prev_addr, sym_addr;
+	Uint64 count, cycles;
+	callee_t *callsite;
+	caller_t *info;
+	int i, j;
+
+	fprintf(fp, "# callgrind format\nversion: 1\ncreator: %s\n", PROG_NAME);
+	fprintf(fp, "cmd: %s\npositions: instr\nevents: Instructions Cycles\n", proc);
+	fprintf(fp, "summary: %"PRIu64" %"PRIu64"\n", totalcost->count, totalcost->cycles);
+
+	/* per address costs, grouped by functions */
+	pos = prev_addr = 0;
+	while (next_addr(&pos, &addr, &count, &cycles)) {
+		sym_addr = addr;
+		name = get_caller(&sym_addr);
+		if (name != prev_name || !name) {
+			fprintf(fp, "\nfn=%s\n0x%x", name ? name : "[unknown]", addr);
+			prev_name = name;
+		} else if (addr >= prev_addr) {
+			/* relative position compression */
+			fprintf(fp, "+%u", addr - prev_addr);
+		} else {
+			fprintf(fp, "-%u", prev_addr - addr);
+		}
+		fprintf(fp, " %"PRIu64" %"PRIu64"\n", count, cycles);
+		prev_addr = addr;
+	}
+
+	/* calls which have inclusive costs, i.e. subroutine calls */
+	callsite = callinfo->site;
+	for (i = 0; i < callinfo->sites; i++, callsite++) {
+		if (!callsite->addr) {
+			continue;
+		}
+		sym_addr = callsite->addr;
+		name = get_caller(&sym_addr);
+		info = callsite->callers;
+		for (j = 0; j < callsite->count; j++, info++) {
+			if (!(info->calls && info->all.count) || info->addr == PC_UNDEFINED) {
+				continue;
+			}
+			sym_addr = info->addr;
+			prev_name = get_caller(&sym_addr);
+			fprintf(fp, "\nfn=%s\ncfn=%s\ncalls=%u 0x%x\n0x%x %"PRIu64" %"PRIu64"\n",
+				prev_name ? prev_name : "[unknown]",
+				name ? name : "[unknown]",
+				info->calls, callsite->addr,
+				info->addr, info->all.count, info->all.cycles);
+		}
+	}
+}
+
+/**
+ * Save profile call stacks in the "folded" format used by flame graph
+ * tools: one line per call stack, with function names separated by
+ * semicolons, followed by cycles spent in the innermost function.
+ */
+void Profile_SaveFolded(FILE *fp, callinfo_t *callinfo, counters_t *totalcost,
+			const char* (*get_symbol)(Uint32, symtype_t))
+{
+	Uint32 i, n, *path = NULL;
+	int depth, maxdepth = 0;
+	const char *name;
+	callnode_t *node;
+	Uint64 cycles;
+	Uint32 addr;
+
+	cycles = totalcost->cycles;
+	for (i = 1; i < callinfo->nodes; i++) {
+		node = callinfo->node + i;
+		if (!node->cycles) {
+			continue;
+		}
+		cycles -= node->cycles;
+
+		/* collect call stack from innermost call outwards */
+		depth = 0;
+		for (n = i; n; n = callinfo->node[n].parent) {
+			if (depth >= maxdepth) {
+				Uint32 *tmp;
+				maxdepth = maxdepth ? 2 * maxdepth : 64;
+				tmp = realloc(path, maxdepth * sizeof(*path));
+				if (!tmp) {
+					fputs("ERROR: call stack alloc failed!\n", stderr);
+					free(path);
+					return;
+				}
+				path = tmp;
+			}
+			path[depth++] = n;
+		}
+		while (depth-- > 0) {
+			addr = callinfo->site[callinfo->node[path[depth]].callee_idx].addr;
+			name = get_symbol(addr, SYMTYPE_TEXT);
+			if (name) {
+				fputs(name, fp);
+			} else {
+				fprintf(fp, "0x%x", addr);
+			}
+			fputc(depth ? ';' : ' ', fp);
+		}
+		fprintf(fp, "%"PRIu64"\n", node->cycles);
+	}
+	free(path);
+
+	/* rest was spent outside of tracked calls */
+	if (cycles && cycles <= totalcost->cycles) {
+		fprintf(fp, "[unknown] %"PRIu64"\n", cycles);
+	}
+}
+
+
 /* ------------------- command parsing ---------------------- */
 
 /**
@@ -598,8 +844,8 @@ void Profile_FreeCallinfo(callinfo_t *callinfo)
 char *Profile_Match(const char *text, int state)
 {
 	static const char *names[] = {
-		"addresses", "callers", "caches", "counts", "cycles", "d-hits", "i-misses",
-		"loops", "off", "on", "save", "stack", "stats", "symbols"
+		"addresses", "atexit", "callers", "caches", "counts", "cycles", "d-hits",
+		"i-misses", "loops", "off", "on", "sample", "save", "stack", "stats", "symbols"
 	};
 	return DebugUI_MatchHelper(names, ARRAY_SIZE(names), text, state);
 }
@@ -610,6 +856,7 @@ const char Profile_Description[] =
 	"\tSubcommands:\n"
 	"\t- on\n"
 	"\t- off\n"
+	"\t- sample [cycles]\n"
 	"\t- counts [count]\n"
 	"\t- cycles [count]\n"
 	"\t- i-misses [count]\n"
@@ -620,13 +867,21 @@ const char Profile_Description[] =
 	"\t- caches\n"
 	"\t- stack\n"
 	"\t- stats\n"
-	"\t- save <file>\n"
+	"\t- save <file> [format]\n"
+	"\t- atexit [<file> [format]]\n"
 	"\t- loops <file> [CPU limit] [DSP limit]\n"
 	"\n"
 	"\t'on' & 'off' enable and disable profiling.  Data is collected\n"
 	"\tuntil debugger is entered again at which point you get profiling\n"
 	"\tstatistics ('stats') summary.\n"
 	"\n"
+	"\t'sample' with non-zero cycles value switches CPU profiling to\n"
+	"\tsampling mode.  Instead of tracking every instruction, PC and\n"
+	"\t(A6 frame pointer based) call stack are then sampled at given\n"
+	"\tcycle intervals, which slows emulation much less.  Counts are\n"
+	"\tthen sample counts, and cycles are sampled cycles.  Zero value\n"
+	"\tswitches back to tracking all instructions.\n"
+	"\n"
 	"\tThen you can ask for list of the PC addresses, sorted either by\n"
 	"\texecution 'counts', used 'cycles', i-cache misses or d-cache hits.\n"
 	"\tFirst can be limited just to named addresses with 'symbols'.\n"
@@ -644,7 +899,11 @@ const char Profile_Description[] =
 	"\tprofile stack (this is useful only with :noinit breakpoints).\n"
 	"\n"
 	"\tProfile address and callers information can be saved with\n"
-	"\t'save' command.\n"
+	"\t'save' command.  Default 'hatari' format is for the hatari_profile\n"
+	"\tpost-processor, 'callgrind' format is for KCachegrind & other\n"
+	"\tValgrind tools, and 'folded' call stack format for flame graph\n"
+	"\ttools.  'atexit' saves the profile to given file when Hatari\n"
+	"\texits, without file name it cancels that.\n"
 	"\n"
 	"\tDetailed (spin) looping information can be collected by\n"
 	"\tspecifying to which file it should be saved, with optional\n"
@@ -652,39 +911,144 @@ const char Profile_Description[] =
 	"\taddress of the loop can differ (0 = no limit).";
 
 
+typedef enum {
+	PROFILE_FORMAT_HATARI,
+	PROFILE_FORMAT_CALLGRIND,
+	PROFILE_FORMAT_FOLDED
+} profile_format_t;
+
+static const char *format_names[] = { "hatari", "callgrind", "folded" };
+
+/* CPU & DSP profile files to save at exit */
+static struct {
+	char *filename;
+	profile_format_t format;
+} profile_exit[2];
+
+/**
+ * Parse optional profile format name argument at given index.
+ * Return false for unrecognized format.
+ */
+static bool Profile_ParseFormat(int nArgc, char *psArgs[], int idx, profile_format_t *format)
+{
+	int i;
+
+	*format = PROFILE_FORMAT_HATARI;
+	if (nArgc <= idx) {
+		return true;
+	}
+	for (i = 0; i < ARRAY_SIZE(format_names); i++) {
+		if (strcmp(psArgs[idx], format_names[i]) == 0) {
+			*format = i;
+			return true;
+		}
+	}
+	fprintf(stderr, "ERROR: unknown profile format '%s'!\n", psArgs[idx]);
+	return false;
+}
+
 /**
- * Save profiling information for CPU or DSP.
+ * Save profiling information for CPU or DSP in given format.
  */
-static bool Profile_Save(const char *fname, bool bForDsp)
+static bool Profile_Save(const char *fname, bool bForDsp, profile_format_t format)
 {
 	FILE *out;
 	Uint32 freq;
 	const char *proc;
+	bool data;
 
-	if (!(out = fopen(fname, "w"))) {
-		fprintf(stderr, "ERROR: opening '%s' for writing failed!\n", fname);
-		perror(NULL);
-		return false;
-	}
 	if (bForDsp) {
 		freq = MachineClocks.DSP_Freq;
 		proc = "DSP";
+		data = Profile_DspHasData();
 	} else {
 		freq = MachineClocks.CPU_Freq_Emul;
 		proc = "CPU";
+		data = Profile_CpuHasData();
+	}
+	/* check before opening, to not truncate earlier profile file */
+	if (!data) {
+		fprintf(stderr, "ERROR: no %s profiling data available!\n", proc);
+		return false;
+	}
+	if (!(out = fopen(fname, "w"))) {
+		fprintf(stderr, "ERROR: opening '%s' for writing failed!\n", fname);
+		perror(NULL);
+		return false;
 	}
 
-	fprintf(out, "Hatari %s profile (%s)\n", proc, PROG_NAME);
-	fprintf(out, "Cycles/second:\t%u\n", freq);
-	if (bForDsp) {
-		Profile_DspSave(out);
-	} else {
-		Profile_CpuSave(out);
+	switch (format) {
+	case PROFILE_FORMAT_CALLGRIND:
+		if (bForDsp) {
+			Profile_DspSaveCallgrind(out);
+		} else {
+			Profile_CpuSaveCallgrind(out);
+		}
+		break;
+	case PROFILE_FORMAT_FOLDED:
+		if (bForDsp) {
+			Profile_DspSaveFolded(out);
+		} else {
+			Profile_CpuSaveFolded(out);
+		}
+		break;
+	default:
+		fprintf(out, "Hatari %s profile (%s)\n", proc, PROG_NAME);
+		fprintf(out, "Cycles/second:\t%u\n", freq);
+		if (bForDsp) {
+			Profile_DspSave(out);
+		} else {
+			Profile_CpuSave(out);
+		}
 	}
 	fclose(out);
+	fprintf(stderr, "%s profile saved to '%s' in %s format.\n",
+		proc, fname, format_names[format]);
 	return true;
 }
 
+/**
+ * Set or cancel CPU/DSP profile saving at exit.
+ */
+static void Profile_AtExit(int nArgc, char *psArgs[], bool bForDsp)
+{
+	profile_format_t format;
+
+	if (!Profile_ParseFormat(nArgc, psArgs, 3, &format)) {
+		return;
+	}
+	free(profile_exit[bForDsp].filename);
+	profile_exit[bForDsp].filename = NULL;
+	if (nArgc < 3) {
+		fprintf(stderr, "Profile won't be saved at exit.\n");
+		return;
+	}
+	profile_exit[bForDsp].filename = strdup(psArgs[2]);
+	profile_exit[bForDsp].format = format;
+	fprintf(stderr, "Profile will be saved at exit to '%s' in %s format.\n",
+		psArgs[2], format_names[format]);
+}
+
+/**
+ * Process and save CPU & DSP profiles for which that was requested
+ * with 'atexit' subcommand.  Called when Hatari exits.
+ */
+void Profile_SaveAtExit(void)
+{
+	if (profile_exit[0].filename) {
+		Profile_CpuStop();
+		Profile_Save(profile_exit[0].filename, false, profile_exit[0].format);
+		free(profile_exit[0].filename);
+		profile_exit[0].filename = NULL;
+	}
+	if (profile_exit[1].filename) {
+		Profile_DspStop();
+		Profile_Save(profile_exit[1].filename, true, profile_exit[1].format);
+		free(profile_exit[1].filename);
+		profile_exit[1].filename = NULL;
+	}
+}
+
 /**
  * function CPU & DSP profiling functionality can call to
  * reset loop information log by truncating it.  Only portable
@@ -790,6 +1154,25 @@ int Profile_Command(int nArgc, char *psArgs[], bool bForDsp)
 		*enabled = false;
 		fprintf(stderr, "Profiling disabled.\n");
 
+	} else if (strcmp(psArgs[1], "sample") == 0) {
+		if (bForDsp) {
+			fprintf(stderr, "Sampling mode is supported only for CPU, not DSP.\n");
+		} else {
+			if (nArgc > 2) {
+				Uint32 interval;
+				if (!Eval_Number(psArgs[2], &interval)) {
+					fprintf(stderr, "ERROR: invalid sampling interval '%s'!\n", psArgs[2]);
+					return DEBUGGER_CMDDONE;
+				}
+				Profile_CpuSetSampling(interval);
+			}
+			if (Profile_CpuGetSampling()) {
+				fprintf(stderr, "CPU profile samples taken every %u cycles.\n",
+					Profile_CpuGetSampling());
+			} else {
+				fprintf(stderr, "CPU profile tracks all instructions.\n");
+			}
+		}
 	} else if (strcmp(psArgs[1], "stats") == 0) {
 		if (bForDsp) {
 			Profile_DspShowStats();
@@ -842,7 +1225,14 @@ int Profile_Command(int nArgc, char *psArgs[], bool bForDsp)
 		Profile_ShowStack(bForDsp);
 
 	} else if (strcmp(psArgs[1], "save") == 0) {
-		Profile_Save(psArgs[2], bForDsp);
+		profile_format_t format;
+		if (nArgc < 3) {
+			DebugUI_PrintCmdHelp(psArgs[0]);
+		} else if (Profile_ParseFormat(nArgc, psArgs, 3, &format)) {
+			Profile_Save(psArgs[2], bForDsp, format);
+		}
+	} else if (strcmp(psArgs[1], "atexit") == 0) {
+		Profile_AtExit(nArgc, psArgs, bForDsp);
 
 	} else if (strcmp(psArgs[1], "loops") == 0) {
 		Profile_Loops(nArgc, psArgs);
@@ -35,11 +35,16 @@ extern void Profile_CpuUpdate(void);
 /* hrdb: Update the "previous instruction" state even when we are not accumulating counts */
 extern void Profile_CpuUpdateInactive(void);
 extern void Profile_CpuStop(void);
+/* CycInt handler for sampling CPU profile mode */
+extern void Profile_CpuSampleHandler(void);
 
 /* CPU profile results */
 extern bool Profile_CpuAddr_HasData(Uint32 addr);
 extern int Profile_CpuAddr_DataStr(char *buffer, int maxlen, Uint32 addr);
 
+/* for main.c, save profiles requested with 'profile atexit' */
+extern void Profile_SaveAtExit(void);
+
 /* DSP profile control */
 extern bool Profile_DspStart(void);
 extern void Profile_DspUpdate(void);
@@ -58,6 +63,7 @@ typedef struct ProfileLine
 	Uint32 addr;	/* CPU address of this entry */
 } ProfileLine;
 extern bool Profile_CpuQuery(Uint32 index, ProfileLine* result);
+extern bool Profile_CpuQueryNext(Uint32 *index, ProfileLine* result);
 extern bool Profile_CpuIsEnabled(void);
 
 #endif
@@ -28,6 +28,7 @@ typedef struct {
 	Uint32 ret_addr;	/* address after returning from call */
 	Uint32 caller_addr;	/* caller address for callstack printing */
 	Uint32 callee_addr;	/* callee address for callstack printing */
+	Uint32 node;		/* call stack tree node for this call */
 	counters_t all;		/* totals including everything called code does */
 	counters_t out;		/* totals for subcalls done from callee */
 } callstack_t;
@@ -47,6 +48,14 @@ typedef struct {
 	caller_t *callers;	/* who called this address */
 } callee_t;
 
+/* call stack tree node, for call stack specific (folded) costs */
+typedef struct {
+	Uint32 parent;		/* parent node, 0 = root */
+	Uint32 next;		/* next node in same hash chain, 0 = none */
+	int callee_idx;		/* index of called function */
+	Uint64 count, cycles;	/* costs excluding called code */
+} callnode_t;
+
 /* impossible PC value, for uninitialized PC values */
 #define PC_UNDEFINED 0xFFFFFFFF
 
@@ -58,6 +67,10 @@ typedef struct {
 	Uint32 return_pc;	/* address for last call return address (speedup) */
 	callee_t *site;		/* symbol specific caller information */
 	callstack_t *stack;	/* calls that will return */
+	callnode_t *node;	/* call stack tree, node 0 is root */
+	Uint32 *node_hash;	/* call stack tree node hash chains */
+	Uint32 nodes;		/* number of used tree nodes */
+	Uint32 node_count;	/* number of allocated tree nodes & hash chains */
 } callinfo_t;
 
 
@@ -71,11 +84,18 @@ typedef struct {
 
 
 /* generic profile caller/callee info functions */
-extern void Profile_ShowCallers(FILE *fp, int sites, callee_t *callsite, const char * (*addr2name)(Uint32, Uint64 *));
+extern void Profile_ShowCallers(FILE *fp, int sites, callee_t *callsite, const char * (*addr2name)(Uint32, Uint64 *), bool check_counts);
 extern void Profile_CallStart(int idx, callinfo_t *callinfo, Uint32 prev_pc, calltype_t flag, Uint32 pc, counters_t *totalcost);
 extern void Profile_FinalizeCalls(Uint32 pc, callinfo_t *callinfo, counters_t *totalcost,
 				  const char* (get_symbol)(Uint32, symtype_t), const char* (get_caller)(Uint32*));
 extern Uint32 Profile_CallEnd(callinfo_t *callinfo, counters_t *totalcost);
+extern void Profile_CallSample(int idx, callinfo_t *callinfo, Uint32 caller_addr, Uint32 pc, counters_t *cost, bool own);
+extern void Profile_StackSample(callinfo_t *callinfo, const int *idx, int count, counters_t *cost);
+extern void Profile_SaveCallgrind(FILE *fp, const char *proc, callinfo_t *callinfo, counters_t *totalcost,
+				  bool (*next_addr)(Uint32 *, Uint32 *, Uint64 *, Uint64 *),
+				  const char* (*get_caller)(Uint32*));
+extern void Profile_SaveFolded(FILE *fp, callinfo_t *callinfo, counters_t *totalcost,
+			       const char* (*get_symbol)(Uint32, symtype_t));
 extern int  Profile_AllocCallinfo(callinfo_t *callinfo, int count, const char *info);
 extern void Profile_FreeCallinfo(callinfo_t *callinfo);
 extern bool Profile_LoopReset(void);
@@ -83,6 +103,10 @@ extern bool Profile_LoopReset(void);
 /* parser helpers */
 extern void Profile_CpuGetPointers(bool **enabled, Uint32 **disasm_addr);
 extern void Profile_DspGetPointers(bool **enabled, Uint32 **disasm_addr);
+extern void Profile_CpuSetSampling(Uint32 interval);
+extern Uint32 Profile_CpuGetSampling(void);
+extern bool Profile_CpuHasData(void);
+extern bool Profile_DspHasData(void);
 extern void Profile_CpuGetCallinfo(callinfo_t **callinfo, const char* (**get_caller)(Uint32*), const char* (**get_symbol)(Uint32, symtype_t));
 extern void Profile_DspGetCallinfo(callinfo_t **callinfo, const char* (**get_caller)(Uint32*), const char* (**get_symbol)(Uint32, symtype_t));
 
@@ -101,6 +125,8 @@ extern void Profile_CpuShowCaches(void);
 extern void Profile_CpuShowStats(void);
 extern void Profile_CpuShowCallers(FILE *fp);
 extern void Profile_CpuSave(FILE *out);
+extern void Profile_CpuSaveCallgrind(FILE *out);
+extern void Profile_CpuSaveFolded(FILE *out);
 
 /* internal DSP profile results */
 extern Uint16 Profile_DspShowAddresses(Uint32 lower, Uint32 upper, FILE *out, paging_t use_paging);
@@ -109,5 +135,7 @@ extern void Profile_DspShowCycles(int show);
 extern void Profile_DspShowStats(void);
 extern void Profile_DspShowCallers(FILE *fp);
 extern void Profile_DspSave(FILE *out);
+extern void Profile_DspSaveCallgrind(FILE *out);
+extern void Profile_DspSaveFolded(FILE *out);
 
 #endif  /* HATARI_PROFILE_PRIV_H */
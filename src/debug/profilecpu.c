@@ -25,6 +25,7 @@ const char Profilecpu_fileid[] = "Hatari profilecpu.c";
 #include "profile_priv.h"
 #include "debug_priv.h"
 #include "stMemory.h"
+#include "cycInt.h"
 #include "tos.h"
 #include "screen.h"
 #include "video.h"
@@ -79,10 +80,17 @@ typedef struct {
 #define MAX_D_HITS   32
 #define MAX_D_MISSES 20
 
+/* profile data items are allocated on first use, in pages of this size */
+#define CPU_PAGE_SHIFT	12
+#define CPU_PAGE_ITEMS	(1 << CPU_PAGE_SHIFT)
+#define CPU_PAGE_MASK	(CPU_PAGE_ITEMS - 1)
+
 static struct {
 	counters_t all;       /* total counts for all areas */
-	cpu_profile_item_t *data; /* profile data items */
-	Uint32 size;          /* number of allocated profile data items */
+	cpu_profile_item_t **pages; /* profile data item pages, NULL if unused */
+	Uint32 *used_pages;   /* page numbers of allocated pages */
+	Uint32 used_count;    /* number of allocated pages */
+	Uint32 size;          /* number of profile data items */
 	profile_area_t ttram; /* TT-RAM stats */
 	profile_area_t ram;   /* normal RAM stats */
 	profile_area_t rom;   /* cartridge ROM stats */
@@ -105,6 +113,16 @@ static struct {
 	bool enabled;         /* true when profiling enabled */
 } cpu_profile;
 
+/* sampling mode, used instead of per-instruction updates when interval is set */
+#define MAX_SAMPLE_INTERVAL 1000000
+#define MAX_SAMPLE_FRAMES 64	/* max A6 frames followed for a sample */
+#define OPCODE_LINK_A6 0x4E56
+
+static struct {
+	Uint32 interval;      /* cycles between samples, zero = not sampling */
+	bool active;          /* true while sampling interrupt is running */
+} cpu_sampling;
+
 /* full counts for warnings that are printed without rate-limiting */
 typedef struct {
 	int odd;
@@ -216,6 +234,68 @@ static Uint32 index2address(Uint32 idx)
 	return idx + TTRAM_START;
 }
 
+/* ------------------ CPU profile data pages ----------------- */
+
+/**
+ * Return profile data item for given index, or NULL if
+ * nothing has been executed within the item's page.
+ */
+static inline cpu_profile_item_t *index2item(Uint32 idx)
+{
+	cpu_profile_item_t *page = cpu_profile.pages[idx >> CPU_PAGE_SHIFT];
+	if (!page) {
+		return NULL;
+	}
+	return page + (idx & CPU_PAGE_MASK);
+}
+
+/**
+ * Allocate profile data page for given item index.
+ * Return the item, or NULL if allocation failed.
+ */
+static cpu_profile_item_t *alloc_item(Uint32 idx)
+{
+	Uint32 page = idx >> CPU_PAGE_SHIFT;
+
+	cpu_profile.pages[page] = calloc(CPU_PAGE_ITEMS, sizeof(cpu_profile_item_t));
+	if (!cpu_profile.pages[page]) {
+		fprintf(stderr, "ERROR: CPU profile data page alloc failed!\n");
+		return NULL;
+	}
+	cpu_profile.used_pages[cpu_profile.used_count++] = page;
+	return cpu_profile.pages[page] + (idx & CPU_PAGE_MASK);
+}
+
+/**
+ * Free all CPU profile data pages
+ */
+static void free_pages(void)
+{
+	Uint32 i;
+
+	for (i = 0; i < cpu_profile.used_count; i++) {
+		free(cpu_profile.pages[cpu_profile.used_pages[i]]);
+	}
+	free(cpu_profile.pages);
+	free(cpu_profile.used_pages);
+	cpu_profile.pages = NULL;
+	cpu_profile.used_pages = NULL;
+	cpu_profile.used_count = 0;
+}
+
+/**
+ * compare function for qsort() to sort page numbers to address order.
+ */
+static int cmp_pages(const void *p1, const void *p2)
+{
+	Uint32 page1 = *(const Uint32*)p1;
+	Uint32 page2 = *(const Uint32*)p2;
+	if (page1 < page2) {
+		return -1;
+	}
+	return page1 > page2;
+}
+
 /* ------------------ CPU profile results ----------------- */
 
 /**
@@ -226,12 +306,12 @@ bool Profile_CpuAddr_HasData(Uint32 addr)
 	cpu_profile_item_t *item;
 	Uint32 idx;
 
-	if (!cpu_profile.data) {
+	if (!cpu_profile.pages) {
 		return false;
 	}
 	idx = address2index(addr);
-	item = &(cpu_profile.data[idx]);
-	if (!item->count) {
+	item = index2item(idx);
+	if (!(item && item->count)) {
 		return false;
 	}
 	return true;
@@ -252,12 +332,12 @@ int Profile_CpuAddr_DataStr(char *buffer, int maxlen, Uint32 addr)
 	int count;
 
 	assert(buffer && maxlen > 0);
-	if (!cpu_profile.data) {
+	if (!cpu_profile.pages) {
 		return 0;
 	}
 	idx = address2index(addr);
-	item = &(cpu_profile.data[idx]);
-	if (!item->count) {
+	item = index2item(idx);
+	if (!(item && item->count)) {
 		return 0;
 	}
 
@@ -379,6 +459,10 @@ void Profile_CpuShowStats(void)
 	}
 	fprintf(stderr, "\n= %.5fs\n",
 		(double)cpu_profile.all.cycles / MachineClocks.CPU_Freq_Emul);
+	if (cpu_sampling.interval) {
+		fprintf(stderr, "(instruction counts are samples, taken every %u cycles)\n",
+			cpu_sampling.interval);
+	}
 
 	show_cpu_warnings();
 }
@@ -442,12 +526,11 @@ Uint32 Profile_CpuShowAddresses(Uint32 lower, Uint32 upper, FILE *out, paging_t
 	int oldcols[DISASM_COLUMNS], newcols[DISASM_COLUMNS];
 	int show, shown, addrs, active;
 	const char *symbol;
-	cpu_profile_item_t *data;
+	cpu_profile_item_t *item;
 	Uint32 idx, end, size;
 	uaecptr nextpc, addr;
 
-	data = cpu_profile.data;
-	if (!data) {
+	if (!cpu_profile.pages) {
 		fprintf(stderr, "ERROR: no CPU profiling data available!\n");
 		return 0;
 	}
@@ -481,7 +564,13 @@ Uint32 Profile_CpuShowAddresses(Uint32 lower, Uint32 upper, FILE *out, paging_t
 	addrs = nextpc = 0;
 	idx = address2index(lower);
 	for (; shown < show && addrs < active && idx < end; idx++) {
-		if (!data[idx].count) {
+		item = index2item(idx);
+		if (!item) {
+			/* skip rest of the unused page */
+			idx |= CPU_PAGE_MASK;
+			continue;
+		}
+		if (!item->count) {
 			continue;
 		}
 		addr = index2address(idx);
@@ -536,8 +625,8 @@ static void leave_instruction_column(int *oldcols)
  */
 static int cmp_cpu_i_misses(const void *p1, const void *p2)
 {
-	Uint32 count1 = cpu_profile.data[*(const Uint32*)p1].i_misses;
-	Uint32 count2 = cpu_profile.data[*(const Uint32*)p2].i_misses;
+	Uint32 count1 = index2item(*(const Uint32*)p1)->i_misses;
+	Uint32 count2 = index2item(*(const Uint32*)p2)->i_misses;
 	if (count1 > count2) {
 		return -1;
 	}
@@ -555,7 +644,6 @@ void Profile_CpuShowInstrMisses(int show)
 	int active;
 	int oldcols[DISASM_COLUMNS];
 	Uint32 *sort_arr, *end, addr, nextpc;
-	cpu_profile_item_t *data = cpu_profile.data;
 	float percentage;
 	Uint32 count;
 
@@ -574,7 +662,7 @@ void Profile_CpuShowInstrMisses(int show)
 	show = (show < active ? show : active);
 	for (end = sort_arr + show; sort_arr < end; sort_arr++) {
 		addr = index2address(*sort_arr);
-		count = data[*sort_arr].i_misses;
+		count = index2item(*sort_arr)->i_misses;
 		percentage = 100.0*count/cpu_profile.all.i_misses;
 		fprintf(stderr, "0x%06x\t%5.2f%%\t%d%s\t", addr, percentage, count,
 		       count == MAX_CPU_PROFILE_VALUE ? " (OVERFLOW)" : "");
@@ -590,8 +678,8 @@ void Profile_CpuShowInstrMisses(int show)
  */
 static int cmp_cpu_d_hits(const void *p1, const void *p2)
 {
-	Uint32 count1 = cpu_profile.data[*(const Uint32*)p1].d_hits;
-	Uint32 count2 = cpu_profile.data[*(const Uint32*)p2].d_hits;
+	Uint32 count1 = index2item(*(const Uint32*)p1)->d_hits;
+	Uint32 count2 = index2item(*(const Uint32*)p2)->d_hits;
 	if (count1 > count2) {
 		return -1;
 	}
@@ -609,7 +697,6 @@ void Profile_CpuShowDataHits(int show)
 	int active;
 	int oldcols[DISASM_COLUMNS];
 	Uint32 *sort_arr, *end, addr, nextpc;
-	cpu_profile_item_t *data = cpu_profile.data;
 	float percentage;
 	Uint32 count;
 
@@ -628,7 +715,7 @@ void Profile_CpuShowDataHits(int show)
 	show = (show < active ? show : active);
 	for (end = sort_arr + show; sort_arr < end; sort_arr++) {
 		addr = index2address(*sort_arr);
-		count = data[*sort_arr].d_hits;
+		count = index2item(*sort_arr)->d_hits;
 		percentage = 100.0*count/cpu_profile.all.d_hits;
 		fprintf(stderr, "0x%06x\t%5.2f%%\t%d%s\t", addr, percentage, count,
 		       count == MAX_CPU_PROFILE_VALUE ? " (OVERFLOW)" : "");
@@ -645,8 +732,8 @@ void Profile_CpuShowDataHits(int show)
  */
 static int cmp_cpu_cycles(const void *p1, const void *p2)
 {
-	Uint32 count1 = cpu_profile.data[*(const Uint32*)p1].cycles;
-	Uint32 count2 = cpu_profile.data[*(const Uint32*)p2].cycles;
+	Uint32 count1 = index2item(*(const Uint32*)p1)->cycles;
+	Uint32 count2 = index2item(*(const Uint32*)p2)->cycles;
 	if (count1 > count2) {
 		return -1;
 	}
@@ -664,11 +751,10 @@ void Profile_CpuShowCycles(int show)
 	int active;
 	int oldcols[DISASM_COLUMNS];
 	Uint32 *sort_arr, *end, addr, nextpc;
-	cpu_profile_item_t *data = cpu_profile.data;
 	float percentage;
 	Uint32 count;
 
-	if (!data) {
+	if (!cpu_profile.pages) {
 		fprintf(stderr, "ERROR: no CPU profiling data available!\n");
 		return;
 	}
@@ -683,7 +769,7 @@ void Profile_CpuShowCycles(int show)
 	show = (show < active ? show : active);
 	for (end = sort_arr + show; sort_arr < end; sort_arr++) {
 		addr = index2address(*sort_arr);
-		count = data[*sort_arr].cycles;
+		count = index2item(*sort_arr)->cycles;
 		percentage = 100.0*count/cpu_profile.all.cycles;
 		fprintf(stderr, "0x%06x\t%5.2f%%\t%d%s\t", addr, percentage, count,
 		       count == MAX_CPU_PROFILE_VALUE ? " (OVERFLOW)" : "");
@@ -700,8 +786,8 @@ void Profile_CpuShowCycles(int show)
  */
 static int cmp_cpu_count(const void *p1, const void *p2)
 {
-	Uint32 count1 = cpu_profile.data[*(const Uint32*)p1].count;
-	Uint32 count2 = cpu_profile.data[*(const Uint32*)p2].count;
+	Uint32 count1 = index2item(*(const Uint32*)p1)->count;
+	Uint32 count2 = index2item(*(const Uint32*)p2)->count;
 	if (count1 > count2) {
 		return -1;
 	}
@@ -718,7 +804,6 @@ static int cmp_cpu_count(const void *p1, const void *p2)
  */
 void Profile_CpuShowCounts(int show, bool only_symbols)
 {
-	cpu_profile_item_t *data = cpu_profile.data;
 	int symbols, matched, active;
 	int oldcols[DISASM_COLUMNS];
 	Uint32 *sort_arr, *end, addr, nextpc;
@@ -726,7 +811,7 @@ void Profile_CpuShowCounts(int show, bool only_symbols)
 	float percentage;
 	Uint32 count;
 
-	if (!data) {
+	if (!cpu_profile.pages) {
 		fprintf(stderr, "ERROR: no CPU profiling data available!\n");
 		return;
 	}
@@ -741,7 +826,7 @@ void Profile_CpuShowCounts(int show, bool only_symbols)
 		fprintf(stderr, "addr:\t\tcount:\n");
 		for (end = sort_arr + show; sort_arr < end; sort_arr++) {
 			addr = index2address(*sort_arr);
-			count = data[*sort_arr].count;
+			count = index2item(*sort_arr)->count;
 			percentage = 100.0*count/cpu_profile.all.count;
 			fprintf(stderr, "0x%06x\t%5.2f%%\t%d%s\t",
 			       addr, percentage, count,
@@ -770,7 +855,7 @@ void Profile_CpuShowCounts(int show, bool only_symbols)
 		if (!name) {
 			continue;
 		}
-		count = data[*sort_arr].count;
+		count = index2item(*sort_arr)->count;
 		percentage = 100.0*count/cpu_profile.all.count;
 		fprintf(stderr, "0x%06x %6.2f %8d  %-26s %s",
 		       addr, percentage, count, name,
@@ -790,8 +875,8 @@ void Profile_CpuShowCounts(int show, bool only_symbols)
 
 static const char * addr2name(Uint32 addr, Uint64 *total)
 {
-	Uint32 idx = address2index(addr);
-	*total = cpu_profile.data[idx].count;
+	cpu_profile_item_t *item = index2item(address2index(addr));
+	*total = item ? item->count : 0;
 	return Symbols_GetByCpuAddress(addr, SYMTYPE_TEXT);
 }
 
@@ -800,7 +885,7 @@ static const char * addr2name(Uint32 addr, Uint64 *total)
  */
 void Profile_CpuShowCallers(FILE *fp)
 {
-	Profile_ShowCallers(fp, cpu_callinfo.sites, cpu_callinfo.site, addr2name);
+	Profile_ShowCallers(fp, cpu_callinfo.sites, cpu_callinfo.site, addr2name, !cpu_sampling.interval);
 }
 
 /**
@@ -809,7 +894,12 @@ void Profile_CpuShowCallers(FILE *fp)
 void Profile_CpuSave(FILE *out)
 {
 	Uint32 text, end;
-	fputs("Field names:\tExecuted instructions, Used cycles, Instruction cache misses, Data cache hits\n", out);
+	if (cpu_sampling.interval) {
+		/* same fields, so that post-processing works the same */
+		fputs("Field names:\tSamples, Sampled cycles, Instruction cache misses, Data cache hits\n", out);
+	} else {
+		fputs("Field names:\tExecuted instructions, Used cycles, Instruction cache misses, Data cache hits\n", out);
+	}
 
 	/* (Python) regexp that matches address & profiling data fields from the disassembly */
 	if (ConfigureParams.Debugger.bDisasmUAE) {
@@ -844,6 +934,51 @@ void Profile_CpuSave(FILE *out)
 	Profile_CpuShowCallers(out);
 }
 
+/**
+ * Iterator for callgrind output, return next profiled address
+ * after given item index position, and its costs.
+ */
+static bool next_cpu_address(Uint32 *pos, Uint32 *addr, Uint64 *count, Uint64 *cycles)
+{
+	cpu_profile_item_t *item;
+	Uint32 idx;
+
+	for (idx = *pos; idx < cpu_profile.size; idx++) {
+		item = index2item(idx);
+		if (!item) {
+			/* skip rest of the unused page */
+			idx |= CPU_PAGE_MASK;
+			continue;
+		}
+		if (item->count) {
+			*pos = idx + 1;
+			*addr = index2address(idx);
+			*count = item->count;
+			*cycles = item->cycles;
+			return true;
+		}
+	}
+	*pos = idx;
+	return false;
+}
+
+/**
+ * Save CPU profile information to given file in callgrind format.
+ */
+void Profile_CpuSaveCallgrind(FILE *out)
+{
+	Profile_SaveCallgrind(out, "CPU", &cpu_callinfo, &cpu_profile.all,
+			      next_cpu_address, Symbols_GetBeforeCpuAddress);
+}
+
+/**
+ * Save CPU profile call stacks to given file in folded format.
+ */
+void Profile_CpuSaveFolded(FILE *out)
+{
+	Profile_SaveFolded(out, &cpu_callinfo, &cpu_profile.all, Symbols_GetByCpuAddress);
+}
+
 /* ------------------ CPU profile control ----------------- */
 /**
  * Clear the values that are now not cleared in Profile_CpuStart().
@@ -858,22 +993,22 @@ void Profile_CpuInit(void)
 }
 
 /**
- * Initialize CPU profiling when necessary.  Return true if profiling.
+ * Initialize CPU profiling when necessary.  Return true if profiling
+ * needs to be updated after each instruction.
  */
 bool Profile_CpuStart(void)
 {
-	int size;
+	int size, pages;
 	Uint64 savePrevCycles;
 	int savePrevFamily;
 	Uint32 savePrevPC;
 
 	Profile_FreeCallinfo(&(cpu_callinfo));
-	if (cpu_profile.sort_arr) {
+	if (cpu_profile.pages) {
 		/* remove previous results */
 		free(cpu_profile.sort_arr);
-		free(cpu_profile.data);
+		free_pages();
 		cpu_profile.sort_arr = NULL;
-		cpu_profile.data = NULL;
 		fprintf(stderr, "Freed previous CPU profile buffers.\n");
 	}
 	if (!cpu_profile.enabled) {
@@ -905,14 +1040,21 @@ bool Profile_CpuStart(void)
 		size += ConfigureParams.Memory.TTRamSize_KB * 1024/2;
 	}
 
-	/* Add one entry for catching invalid PC values */
-	cpu_profile.data = calloc(size + 1, sizeof(*cpu_profile.data));
-	if (!cpu_profile.data) {
+	/* Add one entry for catching invalid PC values.
+	 * Only page table is allocated here, data pages
+	 * are allocated when their addresses get executed.
+	 */
+	pages = (size + 1 + CPU_PAGE_MASK) >> CPU_PAGE_SHIFT;
+	cpu_profile.pages = calloc(pages, sizeof(*cpu_profile.pages));
+	cpu_profile.used_pages = calloc(pages, sizeof(*cpu_profile.used_pages));
+	if (!(cpu_profile.pages && cpu_profile.used_pages)) {
 		perror("ERROR, new CPU profile buffer alloc failed");
+		free_pages();
 		return false;
 	}
-	fprintf(stderr, "Allocated CPU profile buffer (%d MB).\n",
-	       (int)sizeof(*cpu_profile.data)*size/(1024*1024));
+	fprintf(stderr, "Allocated CPU profile page table (%d KB) for %d MB of data.\n",
+		(int)(sizeof(*cpu_profile.pages) + sizeof(*cpu_profile.used_pages))*pages/1024,
+		(int)(sizeof(cpu_profile_item_t)*size/(1024*1024)));
 	cpu_profile.size = size;
 
 	Profile_AllocCallinfo(&(cpu_callinfo), Symbols_CpuCodeCount(), "CPU");
@@ -936,6 +1078,14 @@ bool Profile_CpuStart(void)
 	cpu_profile.disasm_addr = 0;
 	cpu_profile.processed = false;
 	cpu_profile.enabled = true;
+
+	if (cpu_sampling.interval) {
+		/* samples are taken from interrupt, not after each instruction */
+		CycInt_RemovePendingInterrupt(INTERRUPT_PROFILE_SAMPLE);
+		CycInt_AddRelativeInterrupt(cpu_sampling.interval, INT_CPU_CYCLE, INTERRUPT_PROFILE_SAMPLE);
+		cpu_sampling.active = true;
+		return false;
+	}
 	return cpu_profile.enabled;
 }
 
@@ -1200,7 +1350,15 @@ void Profile_CpuUpdate(void)
 
 	idx = address2index(prev_pc);
 	assert(idx <= cpu_profile.size);
-	prev = cpu_profile.data + idx;
+	prev = index2item(idx);
+	if (unlikely(!prev)) {
+		prev = alloc_item(idx);
+		if (!prev) {
+			/* instruction is lost from stats */
+			cpu_profile.prev_cycles = CyclesGlobalClockCounter;
+			return;
+		}
+	}
 
 	if (likely(prev->count < MAX_CPU_PROFILE_VALUE)) {
 		prev->count++;
@@ -1318,6 +1476,93 @@ void Profile_CpuUpdateInactive()
 	cpu_profile.prev_pc = M68000_GetPC();
 }
 
+/**
+ * Add call stack of the sample to caller information, by following
+ * the A6 frame pointer chain (set up by LINK A6 instructions).
+ * Walk stops at a function which hasn't (yet) set up its frame.
+ */
+static void sample_calls(Uint32 pc, counters_t *cost)
+{
+	int idx[MAX_SAMPLE_FRAMES];
+	Uint32 frame, caller, addr;
+	int frames;
+
+	frame = Regs[REG_A6];
+	for (frames = 0; frames < MAX_SAMPLE_FRAMES; frames++) {
+		/* function containing the address, with LINK A6 frame? */
+		addr = pc;
+		if (!Symbols_GetBeforeCpuAddress(&addr) || addr == pc ||
+		    STMemory_ReadWord(addr) != OPCODE_LINK_A6) {
+			break;
+		}
+		idx[frames] = Symbols_GetCpuCodeIndex(addr);
+		/* frames need to be within RAM and grow upwards */
+		if (idx[frames] < 0 || (frame & 1) || !STMemory_CheckAreaType(frame, 8, ABFLAG_RAM)) {
+			break;
+		}
+		caller = STMemory_ReadLong(frame + 4);
+		Profile_CallSample(idx[frames], &cpu_callinfo, caller, addr, cost, !frames);
+
+		addr = STMemory_ReadLong(frame);
+		if (addr <= frame) {
+			frames++;
+			break;
+		}
+		frame = addr;
+		pc = caller;
+	}
+	Profile_StackSample(&cpu_callinfo, idx, frames, cost);
+}
+
+/**
+ * CycInt handler for the sampling profile mode, records
+ * sample for current PC and its call stack.
+ */
+void Profile_CpuSampleHandler(void)
+{
+	cpu_profile_item_t *item;
+	counters_t cost;
+	Uint32 pc, idx;
+
+	CycInt_AcknowledgeInterrupt();
+	if (!(cpu_sampling.active && cpu_profile.enabled && cpu_profile.pages)) {
+		cpu_sampling.active = false;
+		return;
+	}
+	CycInt_AddRelativeInterrupt(cpu_sampling.interval, INT_CPU_CYCLE, INTERRUPT_PROFILE_SAMPLE);
+
+	pc = M68000_GetPC();
+	if (ConfigureParams.System.bAddressSpace24) {
+		pc &= 0xffffff;
+	}
+	idx = address2index(pc);
+	item = index2item(idx);
+	if (unlikely(!item)) {
+		item = alloc_item(idx);
+		if (!item) {
+			return;
+		}
+	}
+	if (likely(item->count < MAX_CPU_PROFILE_VALUE)) {
+		item->count++;
+	}
+	if (likely(item->cycles < MAX_CPU_PROFILE_VALUE - cpu_sampling.interval)) {
+		item->cycles += cpu_sampling.interval;
+	} else {
+		item->cycles = MAX_CPU_PROFILE_VALUE;
+	}
+
+	memset(&cost, 0, sizeof(cost));
+	cost.calls = 1;
+	cost.count = 1;
+	cost.cycles = cpu_sampling.interval;
+	if (cpu_callinfo.sites) {
+		sample_calls(pc, &cost);
+	}
+	cpu_profile.all.count++;
+	cpu_profile.all.cycles += cpu_sampling.interval;
+}
+
 /**
  * Helper for accounting CPU profile area item.
  */
@@ -1351,16 +1596,33 @@ static void update_area_item(profile_area_t *area, Uint32 addr, cpu_profile_item
 static Uint32 update_area(profile_area_t *area, Uint32 start, Uint32 end)
 {
 	cpu_profile_item_t *item;
-	Uint32 addr;
+	Uint32 i, addr, first, last;
 
 	memset(area, 0, sizeof(profile_area_t));
 	area->lowest = end;
 
-	item = &(cpu_profile.data[start]);
-	for (addr = start; addr < end; addr++, item++) {
-		update_area_item(area, addr, item);
+	/* go through (sorted) used pages within the area */
+	for (i = 0; i < cpu_profile.used_count; i++) {
+		first = cpu_profile.used_pages[i] << CPU_PAGE_SHIFT;
+		last = first + CPU_PAGE_ITEMS;
+		if (last <= start) {
+			continue;
+		}
+		if (first >= end) {
+			break;
+		}
+		if (first < start) {
+			first = start;
+		}
+		if (last > end) {
+			last = end;
+		}
+		item = index2item(first);
+		for (addr = first; addr < last; addr++, item++) {
+			update_area_item(area, addr, item);
+		}
 	}
-	return addr;
+	return end;
 }
 
 /**
@@ -1371,8 +1633,13 @@ static Uint32* index_area(profile_area_t *area, Uint32 *sort_arr)
 	cpu_profile_item_t *item;
 	Uint32 addr;
 
-	item = &(cpu_profile.data[area->lowest]);
-	for (addr = area->lowest; addr <= area->highest; addr++, item++) {
+	for (addr = area->lowest; addr <= area->highest; addr++) {
+		item = index2item(addr);
+		if (!item) {
+			/* skip rest of the unused page */
+			addr |= CPU_PAGE_MASK;
+			continue;
+		}
 		if (item->count) {
 			*sort_arr++ = addr;
 		}
@@ -1390,6 +1657,10 @@ void Profile_CpuStop(void)
 	unsigned int size, stsize;
 	int active;
 
+	if (cpu_sampling.active) {
+		CycInt_RemovePendingInterrupt(INTERRUPT_PROFILE_SAMPLE);
+		cpu_sampling.active = false;
+	}
 	if (cpu_profile.processed || !cpu_profile.enabled) {
 		return;
 	}
@@ -1412,6 +1683,12 @@ void Profile_CpuStop(void)
 			      Symbols_GetByCpuAddress,
 			      Symbols_GetBeforeCpuAddress);
 
+	/* sort used pages to address order for area processing */
+	qsort(cpu_profile.used_pages, cpu_profile.used_count,
+	      sizeof(*cpu_profile.used_pages), cmp_pages);
+	fprintf(stderr, "Used %d KB for CPU profile data pages.\n",
+		(int)(cpu_profile.used_count * sizeof(cpu_profile_item_t) * CPU_PAGE_ITEMS / 1024));
+
 	/* find lowest and highest addresses executed etc */
 	next = update_area(&cpu_profile.ram, 0, STRamEnd/2);
 	if (TosAddress < CART_START) {
@@ -1450,8 +1727,7 @@ void Profile_CpuStop(void)
 
 	if (!sort_arr) {
 		perror("ERROR: allocating CPU profile address data");
-		free(cpu_profile.data);
-		cpu_profile.data = NULL;
+		free_pages();
 		return;
 	}
 	fprintf(stderr, "Allocated CPU profile address buffer (%d KB).\n",
@@ -1481,6 +1757,35 @@ void Profile_CpuGetPointers(bool **enabled, Uint32 **disasm_addr)
 	*enabled = &cpu_profile.enabled;
 }
 
+/**
+ * Set CPU profile sampling interval in cycles, zero disables sampling.
+ * Takes effect when emulation is continued.
+ */
+void Profile_CpuSetSampling(Uint32 interval)
+{
+	if (interval > MAX_SAMPLE_INTERVAL) {
+		fprintf(stderr, "Sampling interval limited to %d cycles.\n", MAX_SAMPLE_INTERVAL);
+		interval = MAX_SAMPLE_INTERVAL;
+	}
+	cpu_sampling.interval = interval;
+}
+
+/**
+ * Return true if there's CPU profile data to show or save.
+ */
+bool Profile_CpuHasData(void)
+{
+	return cpu_profile.pages != NULL;
+}
+
+/**
+ * Return CPU profile sampling interval, zero if not sampling.
+ */
+Uint32 Profile_CpuGetSampling(void)
+{
+	return cpu_sampling.interval;
+}
+
 /**
  * Get callinfo & symbol search pointers for stack walking.
  */
@@ -1494,22 +1799,57 @@ void Profile_CpuGetCallinfo(callinfo_t **callinfo, const char* (**get_caller)(Ui
 
 bool Profile_CpuQuery(Uint32 index, ProfileLine* result)
 {
-	cpu_profile_item_t *data;
-	data = cpu_profile.data;
-	if (!data) {
+	cpu_profile_item_t *item;
+	if (!cpu_profile.pages) {
 		return false;
 	}
 
 	if (index >= cpu_profile.size)
 		return false;
 
-	result->count = data[index].count;
-	result->cycles = data[index].cycles;
+	item = index2item(index);
+	if (!item) {
+		result->count = result->cycles = 0;
+		return true;
+	}
+	result->count = item->count;
+	result->cycles = item->cycles;
 	if (result->count)
 		result->addr = index2address(index);
 	return true;
 }
 
+/**
+ * Find next entry with a non-zero count, starting from given index.
+ * Unallocated data pages are skipped, so this is much faster than
+ * calling Profile_CpuQuery() for each index. On success, index is
+ * set to that of the returned entry.
+ */
+bool Profile_CpuQueryNext(Uint32 *index, ProfileLine* result)
+{
+	cpu_profile_item_t *item;
+	Uint32 idx;
+
+	if (!cpu_profile.pages) {
+		return false;
+	}
+	for (idx = *index; idx < cpu_profile.size; idx++) {
+		item = index2item(idx);
+		if (!item) {
+			idx |= CPU_PAGE_MASK;
+			continue;
+		}
+		if (item->count) {
+			result->count = item->count;
+			result->cycles = item->cycles;
+			result->addr = index2address(idx);
+			*index = idx;
+			return true;
+		}
+	}
+	return false;
+}
+
 bool Profile_CpuIsEnabled(void)
 {
 	Uint32 *disasm_addr;
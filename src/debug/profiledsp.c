@@ -326,7 +326,7 @@ static const char * addr2name(Uint32 addr, Uint64 *total)
  */
 void Profile_DspShowCallers(FILE *fp)
 {
-	Profile_ShowCallers(fp, dsp_callinfo.sites, dsp_callinfo.site, addr2name);
+	Profile_ShowCallers(fp, dsp_callinfo.sites, dsp_callinfo.site, addr2name, true);
 }
 
 /**
@@ -347,6 +347,46 @@ void Profile_DspSave(FILE *out)
 	Profile_DspShowCallers(out);
 }
 
+/**
+ * Iterator for callgrind output, return next profiled address
+ * after given address position, and its costs.
+ */
+static bool next_dsp_address(Uint32 *pos, Uint32 *addr, Uint64 *count, Uint64 *cycles)
+{
+	dsp_profile_item_t *item;
+	Uint32 idx;
+
+	for (idx = *pos; idx < DSP_PROFILE_ARR_SIZE; idx++) {
+		item = dsp_profile.data + idx;
+		if (item->count) {
+			*pos = idx + 1;
+			*addr = idx;
+			*count = item->count;
+			*cycles = item->cycles;
+			return true;
+		}
+	}
+	*pos = idx;
+	return false;
+}
+
+/**
+ * Save DSP profile information to given file in callgrind format.
+ */
+void Profile_DspSaveCallgrind(FILE *out)
+{
+	Profile_SaveCallgrind(out, "DSP", &dsp_callinfo, &dsp_profile.ram.counters,
+			      next_dsp_address, Symbols_GetBeforeDspAddress);
+}
+
+/**
+ * Save DSP profile call stacks to given file in folded format.
+ */
+void Profile_DspSaveFolded(FILE *out)
+{
+	Profile_SaveFolded(out, &dsp_callinfo, &dsp_profile.ram.counters, Symbols_GetByDspAddress);
+}
+
 /* ------------------ DSP profile control ----------------- */
 
 /**
@@ -734,6 +774,14 @@ void Profile_DspGetPointers(bool **enabled, Uint32 **disasm_addr)
 	*enabled = &dsp_profile.enabled;
 }
 
+/**
+ * Return true if there's DSP profile data to show or save.
+ */
+bool Profile_DspHasData(void)
+{
+	return dsp_profile.data != NULL;
+}
+
 /**
  * Get callinfo & symbol search pointers for stack walking.
  */
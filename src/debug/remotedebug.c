@@ -21,11 +21,31 @@
 #include <sys/socket.h>
 #include <sys/fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#define GET_SOCKET_ERROR		errno
+#define SOCKET_WOULD_BLOCK(err)	((err) == EWOULDBLOCK || (err) == EAGAIN)
+#define RDB_CLOSE				close
+#define RDB_POLL				poll
 #endif
 
 #if HAVE_WINSOCK_SOCKETS
-#include <winsock.h>
+#include <winsock2.h>
+#define GET_SOCKET_ERROR		WSAGetLastError()
+#define SOCKET_WOULD_BLOCK(err)	((err) == WSAEWOULDBLOCK)
+#define RDB_CLOSE				closesocket
+#define RDB_POLL				WSAPoll
+#endif
+
+// Don't get killed by SIGPIPE when a client disappears while sending to it
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL			0
+#endif
+
+#if HAVE_ZLIB_H
+#include <zlib.h>
 #endif
 
 #include "main.h"		/* For ARRAY_SIZE, event handler */
@@ -66,12 +86,29 @@
 // How many bytes we collect to send chunks for the "mem" command
 #define RDB_MEM_BLOCK_SIZE         (2048)
 
-// How many bytes in the internal network send buffer
-#define RDB_SEND_BUFFER_SIZE       (512)
+// Largest memory area returned by a single "memb" command
+#define RDB_MEMB_MAX_SIZE          (16*1024*1024)
+
+// Limits for the block checksums returned by the "memsum" command
+#define RDB_MEMSUM_MIN_BLOCK_SIZE  (16)
+#define RDB_MEMSUM_MAX_BLOCKS      (65536)
+
+// How many clients can be connected at the same time
+#define RDB_MAX_CLIENTS            (4)
+
+// Streamed notifications are skipped for a client while it has
+// more than this many bytes of unsent output (backpressure)
+#define RDB_STREAM_QUEUE_LIMIT     (256*1024)
+
+// Client is disconnected if its unsent output grows over this
+#define RDB_MAX_QUEUE_SIZE         (64*1024*1024)
+
+// How many memory ranges each client can stream
+#define RDB_MAX_MEM_STREAMS        (4)
 
 // Network timeout when in break loop, to allow event handler update.
 // Currently 0.5sec
-#define RDB_SELECT_TIMEOUT_USEC   (500000)
+#define RDB_POLL_TIMEOUT_MSEC      (500)
 
 /* Remote debugging break command was sent from debugger */
 static bool bRemoteBreakRequest = false;
@@ -83,7 +120,9 @@ static bool bRemoteBreakIsActive = false;
 /* 0x1003 -- add reset commands */
 /* 0x1004    add ffwd command, and ffwd status in NotifyStatus() */
 /* 0x1005    add memfind command, add stramsize to $config notification */
-#define REMOTEDEBUG_PROTOCOL_ID	(0x1005)
+/* 0x1006    add memb (binary memory) and memsum (block checksum) commands */
+/* 0x1007    multiple clients, add subscribe and memstream commands */
+#define REMOTEDEBUG_PROTOCOL_ID	(0x1007)
 
 /* Char ID to denote terminator of a token. This is under the ASCII "normal"
 	character value range so that 32-255 can be used */
@@ -96,6 +135,18 @@ static bool bRemoteBreakIsActive = false;
 #define MEMFLAG_DATA            (1 << 3)
 #define MEMFLAG_PROGRAM         (1 << 4)
 
+/* "memb" options, and the payload encodings it replies with */
+#define MEMB_OPT_COMPRESS       (1 << 0)
+#define MEMB_ENCODING_RAW       0
+#define MEMB_ENCODING_ZLIB      1
+
+/* Notifications streamed to clients which "subscribe" to them */
+#define RDB_SUB_REGS            (1 << 0)	/* "!regs" while running */
+#define RDB_SUB_PROFILE         (1 << 1)	/* "!profile" deltas while running */
+#define RDB_SUB_LOG             (1 << 2)	/* "!log" lines, on by default */
+#define RDB_SUB_MEM             (1 << 3)	/* "!mem" deltas for "memstream" ranges */
+#define RDB_SUB_ALL             (RDB_SUB_REGS | RDB_SUB_PROFILE | RDB_SUB_LOG | RDB_SUB_MEM)
+
 // -----------------------------------------------------------------------------
 // Structure managing a resizeable buffer of uint8_t
 // This can be used to accumulate input commands, or sections of it
@@ -162,6 +213,36 @@ static Uint8 RemoteDebug_ReadByte(Uint32 flag, Uint32 addr)
     return STMemory_ReadByte(addr);
 }
 
+// -----------------------------------------------------------------------------
+// Copy a memory area to a host buffer. Physical addresses (and logical
+// ones without an MMU) are copied a bank at a time, translated logical
+// addresses byte by byte, since each page may map elsewhere.
+static void RemoteDebug_ReadBlock(Uint32 flag, Uint32 addr, Uint8* dst, Uint32 size)
+{
+	if ((flag & MEMFLAG_LOGICAL) && (currprefs.mmu_model >= 68030))
+	{
+		for (Uint32 i = 0; i < size; ++i)
+			dst[i] = RemoteDebug_ReadByte(flag, addr + i);
+	}
+	else
+	{
+		STMemory_ReadBlock(addr, dst, size);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// 32-bit FNV-1a hash, used for the "memsum" block checksums
+static Uint32 RemoteDebug_HashBlock(const Uint8* data, Uint32 size)
+{
+	Uint32 hash = 2166136261u;
+	for (Uint32 i = 0; i < size; ++i)
+	{
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
 // -----------------------------------------------------------------------------
 static void RemoteDebug_WriteByte(Uint32 flag, Uint32 addr, Uint8 val)
 {
@@ -178,8 +259,9 @@ static void RemoteDebugBuffer_Add(RemoteDebugBuffer* buf, const char* data, size
 	// Full buffer?
 	if (buf->write_pos + size > buf->size)
 	{
-		// Allocate a new buffer bigger than request
-		size_t new_size = buf->write_pos + size + 512;
+		// Allocate a new buffer bigger than request. Double the
+		// size so that output queues grow in amortized linear time.
+		size_t new_size = 2 * (buf->write_pos + size) + 512;
 		char* new_data = (char*)malloc(new_size);
 
 		// Copy across (valid) contents and release the original
@@ -213,15 +295,62 @@ static void RemoteDebugBuffer_RemoveStart(RemoteDebugBuffer* buf, size_t count)
 }
 
 // -----------------------------------------------------------------------------
-// Structure managing connection state
+// Memory range streamed to a client with "!mem" notifications
+typedef struct RemoteDebugMemStream
+{
+	Uint32 addr;
+	Uint32 size;						/* 0 if stream is not in use */
+	Uint32 flag;						/* MEMFLAG_* for address translation */
+	Uint32 block_size;					/* granularity of the changes sent */
+	Uint8* shadow;						/* memory contents as last sent to client,
+											NULL if nothing has been sent yet */
+	Uint8* current;						/* temp buffer for the current contents */
+} RemoteDebugMemStream;
+
+// -----------------------------------------------------------------------------
+// CPU profile counts already sent to a client (sorted by profile index)
+typedef struct RemoteDebugProfileSent
+{
+	Uint32 index;
+	Uint32 count;
+	Uint32 cycles;
+} RemoteDebugProfileSent;
+
+// -----------------------------------------------------------------------------
+// Structure managing the state of a single client connection
 typedef struct RemoteDebugState
 {
-	int SocketFD;						/* handle for the port/socket. -1 if not available */
 	int AcceptedFD;						/* handle for the accepted connection from client, or
-											-1 if not connected */
+											-1 if this client slot is free */
+	bool disconnect;					/* connection lost or client too slow,
+											close it at next opportunity */
 
 	/* Input (receive/command) buffer data */
 	RemoteDebugBuffer input_buf;
+
+	/* Output (send) queue. Sockets are non-blocking, so anything the
+	   kernel doesn't accept right away waits here */
+	RemoteDebugBuffer output_buf;
+	size_t output_pos;					/* start of unsent data in output_buf */
+
+	/* Streamed notifications */
+	Uint32 subscriptions;				/* RDB_SUB_* mask */
+	Uint32 interval;					/* send streams every Nth VBL */
+	Uint32 vbl_count;
+	RemoteDebugMemStream mem_streams[RDB_MAX_MEM_STREAMS];
+	RemoteDebugProfileSent* profile_sent;
+	Uint32 profile_sent_count;
+	Uint32 profile_sent_size;
+} RemoteDebugState;
+
+// -----------------------------------------------------------------------------
+// Structure managing the server socket and all client connections
+typedef struct RemoteDebugServer
+{
+	int SocketFD;						/* handle for the port/socket. -1 if not available */
+	RemoteDebugState clients[RDB_MAX_CLIENTS];
+	int client_count;					/* number of connected clients */
+
 	/* Temp data for network recv */
 	char cmd_buf[RDB_INPUT_TMP_SIZE];
 
@@ -229,31 +358,69 @@ typedef struct RemoteDebugState
 	int original_stdout;					/* original file pointers for redirecting output */
 	int original_stderr;
     int logpipe[2];
+} RemoteDebugServer;
 
-	/* Output (send) buffer data */
-	char sendBuffer[RDB_SEND_BUFFER_SIZE];	/* buffer for replies */
-	int sendBufferPos;					/* next byte to write into buffer */
-} RemoteDebugState;
+static RemoteDebugServer g_rdbServer;
 
 // -----------------------------------------------------------------------------
-// Force send of data in sendBuffer
+// Return number of bytes queued to the client but not yet sent
+static size_t pending_data(const RemoteDebugState* state)
+{
+	return state->output_buf.write_pos - state->output_pos;
+}
+
+// -----------------------------------------------------------------------------
+// Send as much of the queued data as the socket accepts without blocking
 static void flush_data(RemoteDebugState* state)
 {
-	// Flush existing data
-	send(state->AcceptedFD, state->sendBuffer, state->sendBufferPos, 0);
-	state->sendBufferPos = 0;
+	while (pending_data(state) > 0 && !state->disconnect)
+	{
+		int bytes = send(state->AcceptedFD,
+			state->output_buf.data + state->output_pos,
+			pending_data(state),
+			MSG_NOSIGNAL);
+		if (bytes > 0)
+		{
+			state->output_pos += bytes;
+		}
+		else if (bytes < 0 && SOCKET_WOULD_BLOCK(GET_SOCKET_ERROR))
+		{
+			break;
+		}
+		else
+		{
+			// Connection lost, it will be closed by the poll loop
+			state->disconnect = true;
+		}
+	}
+
+	if (state->output_pos == state->output_buf.write_pos)
+	{
+		state->output_buf.write_pos = 0;
+		state->output_pos = 0;
+	}
+	else if (state->output_pos > state->output_buf.write_pos / 2)
+	{
+		// Reclaim the sent part when it's the bigger one
+		RemoteDebugBuffer_RemoveStart(&state->output_buf, state->output_pos);
+		state->output_pos = 0;
+	}
 }
 
 // -----------------------------------------------------------------------------
-// Add data to sendBuffer, flush if necessary
+// Queue data for sending to the client
 static void add_data(RemoteDebugState* state, const char* data, size_t size)
 {
-	// Flush data if it won't fit
-	if (state->sendBufferPos + size > RDB_SEND_BUFFER_SIZE)
-		flush_data(state);
-
-	memcpy(state->sendBuffer + state->sendBufferPos, data, size);
-	state->sendBufferPos += size;
+	if (state->disconnect)
+		return;
+	if (pending_data(state) + size > RDB_MAX_QUEUE_SIZE)
+	{
+		// Client isn't reading what it asked for
+		fprintf(stderr, "Remote Debug client not responding, disconnecting\n");
+		state->disconnect = true;
+		return;
+	}
+	RemoteDebugBuffer_Add(&state->output_buf, data, size);
 }
 
 // -----------------------------------------------------------------------------
@@ -361,75 +528,147 @@ static int RemoteDebug_NotifyConfig(RemoteDebugState* state)
 	return 0;
 }
 
-static void RemoteDebug_NotifyProfile(RemoteDebugState* state)
+// -----------------------------------------------------------------------------
+// Format: "!profile <enabled> [<addr delta> <count> <cycles>]*"
+// Counts and cycles are increments since the previous "!profile"
+// notification to this client, or since profiling was (re)started.
+// With <changes_only>, nothing is sent if there are no increments.
+static void RemoteDebug_NotifyProfile(RemoteDebugState* state, bool changes_only)
 {
-	int index;
 	ProfileLine result;
-	Uint32 lastaddr;
+	Uint32 index, lastaddr, old;
+	RemoteDebugProfileSent *sent, *prev;
+	Uint32 sent_count, sent_size;
+	size_t start = state->output_buf.write_pos;
+	bool changed = false;
 
 	send_str(state, "!profile");
 	send_sep(state);
 	send_hex(state, Profile_CpuIsEnabled() ? 1 : 0);
 	send_sep(state);
-	
+
+	// Merge current counts with what was sent earlier into a new table
+	prev = state->profile_sent;
+	sent = NULL;
+	sent_count = sent_size = 0;
+	old = 0;
 	index = 0;
 	lastaddr = 0;
-	while (Profile_CpuQuery(index, &result))
+	while (Profile_CpuQueryNext(&index, &result))
 	{
-		if (result.count)
+		Uint32 count = 0, cycles = 0;
+
+		while (old < state->profile_sent_count && prev[old].index < index)
+			++old;
+		if (old < state->profile_sent_count && prev[old].index == index)
+		{
+			count = prev[old].count;
+			cycles = prev[old].cycles;
+			++old;
+		}
+		if (result.count != count || result.cycles != cycles)
 		{
 			// NOTE: address is encoded as delta from previous
 			// entry, starting from 0. This provides a very simple
 			// size reduction.
 			send_hex(state, result.addr - lastaddr);
 			send_sep(state);
-			send_hex(state, result.count);
+			send_hex(state, result.count - count);
 			send_sep(state);
-			send_hex(state, result.cycles);
+			send_hex(state, result.cycles - cycles);
 			send_sep(state);
 			lastaddr = result.addr;
+			changed = true;
 		}
+
+		if (sent_count == sent_size)
+		{
+			RemoteDebugProfileSent *bigger;
+			sent_size = sent_size ? 2 * sent_size : 1024;
+			bigger = realloc(sent, sent_size * sizeof(*sent));
+			if (!bigger)
+			{
+				// Client has already been sent deltas that
+				// can't be tracked, so it can't continue
+				fprintf(stderr, "Remote Debug profile table alloc failed, disconnecting\n");
+				free(sent);
+				state->disconnect = true;
+				return;
+			}
+			sent = bigger;
+		}
+		sent[sent_count].index = index;
+		sent[sent_count].count = result.count;
+		sent[sent_count].cycles = result.cycles;
+		++sent_count;
 		++index;
 	}
-	send_term(state);
+	if (changes_only && !changed && !state->disconnect)
+		state->output_buf.write_pos = start;	/* drop the header */
+	else
+		send_term(state);
+
+	free(prev);
+	state->profile_sent = sent;
+	state->profile_sent_count = sent_count;
+	state->profile_sent_size = sent_size;
 }
 
-static void RemoteDebug_NotifyLog(RemoteDebugState* state)
+// -----------------------------------------------------------------------------
+// Forget the profile counts sent to the client, when profiling restarts
+static void RemoteDebug_ResetProfileSent(RemoteDebugState* state)
+{
+	free(state->profile_sent);
+	state->profile_sent = NULL;
+	state->profile_sent_count = 0;
+	state->profile_sent_size = 0;
+}
+
+// -----------------------------------------------------------------------------
+// Pass any Hatari output collected to the log pipe, to clients
+// subscribed to it
+// Format: "!log <text>"
+static void RemoteDebug_NotifyLog(RemoteDebugServer* server)
 {
     while (1)
     {
         char buf[128];
-        int bytes = read(state->logpipe[0], buf, 127);
+        int bytes = read(server->logpipe[0], buf, 127);
         if (bytes <= 0)
             break;
 
         buf[bytes] = 0;
-        send_str(state, "!log");
-        send_sep(state);
-        send_str(state, buf);
-        send_term(state);
+        for (int i = 0; i < RDB_MAX_CLIENTS; ++i)
+        {
+            RemoteDebugState* state = &server->clients[i];
+            if (state->AcceptedFD == -1 || !(state->subscriptions & RDB_SUB_LOG))
+                continue;
+            send_str(state, "!log");
+            send_sep(state);
+            send_str(state, buf);
+            send_term(state);
+        }
     }
 }
 
 // -----------------------------------------------------------------------------
-static void RemoteDebug_OpenDebugOutput(RemoteDebugState* state)
+static void RemoteDebug_OpenDebugOutput(RemoteDebugServer* server)
 {
-    dup2(state->logpipe[1], STDOUT_FILENO);
-    dup2(state->logpipe[1], STDERR_FILENO);
+    dup2(server->logpipe[1], STDOUT_FILENO);
+    dup2(server->logpipe[1], STDERR_FILENO);
 }
 
 // -----------------------------------------------------------------------------
-static void RemoteDebug_CloseDebugOutput(RemoteDebugState* state)
+static void RemoteDebug_CloseDebugOutput(RemoteDebugServer* server)
 {
-    dup2(state->original_stdout, STDOUT_FILENO);
-    dup2(state->original_stderr, STDERR_FILENO);
+    dup2(server->original_stdout, STDOUT_FILENO);
+    dup2(server->original_stderr, STDERR_FILENO);
 }
 
-/* Call per-system methods to make sure that any state inspected
-   is in sync with what the user sees e.g. hardware registers look
-   correct when read, CPU registers are up-to-date.
+/* Update the stack pointer registers which are not stored
+   in their own fields while they are the active A7.
 */
-static void RemoteDebug_HardwareSync(void)
+static void RemoteDebug_CpuSync(void)
 {
 	/*
 	Workaround to match the behaviour in DebugCpu_Register().
@@ -443,6 +682,15 @@ static void RemoteDebug_HardwareSync(void)
 		regs.msp = regs.regs[REG_A7];
 	if (regs.s && regs.m == 0)
 		regs.isp = regs.regs[REG_A7];
+}
+
+/* Call per-system methods to make sure that any state inspected
+   is in sync with what the user sees e.g. hardware registers look
+   correct when read, CPU registers are up-to-date.
+*/
+static void RemoteDebug_HardwareSync(void)
+{
+	RemoteDebug_CpuSync();
 
 	DmaSnd_RemoteDebugSync();
 	Video_RemoteDebugSync();
@@ -503,14 +751,10 @@ static int RemoteDebug_run(int nArgc, char *psArgs[], RemoteDebugState* state)
 }
 
 /**
- * Dump register contents. 
+ * Send register contents as "<reg> <value>" pairs.
  * This also includes Hatari variables, which we treat as a subset of regs.
- * 
- * Input: "regs\n"
- * 
- * Output: "regs <reg:value>*N\n"
  */
-static int RemoteDebug_regs(int nArgc, char *psArgs[], RemoteDebugState* state)
+static void send_registers(RemoteDebugState* state)
 {
 	int regIdx;
 	Uint32 varIndex;
@@ -524,9 +768,6 @@ static int RemoteDebug_regs(int nArgc, char *psArgs[], RemoteDebugState* state)
 		"D0", "D1", "D2", "D3", "D4", "D5", "D6", "D7",
 		"A0", "A1", "A2", "A3", "A4", "A5", "A6", "A7" };
 
-	send_str(state, "OK");
-	send_sep(state);
-
 	// Normal regs
 	for (regIdx = 0; regIdx < ARRAY_SIZE(regIds); ++regIdx)
 		send_key_value(state, regNames[regIdx], Regs[regIds[regIdx]]);
@@ -590,7 +831,20 @@ static int RemoteDebug_regs(int nArgc, char *psArgs[], RemoteDebugState* state)
     {
         send_key_value(state, "BUSCR", regs.buscr);
     }    
+}
 
+/**
+ * Dump register contents. 
+ * 
+ * Input: "regs\n"
+ * 
+ * Output: "regs <reg:value>*N\n"
+ */
+static int RemoteDebug_regs(int nArgc, char *psArgs[], RemoteDebugState* state)
+{
+	send_str(state, "OK");
+	send_sep(state);
+	send_registers(state);
 	return 0;
 }
 
@@ -645,9 +899,6 @@ static int RemoteDebug_mem(int nArgc, char *psArgs[], RemoteDebugState* state)
 	send_hex(state, memdump_count);
 	send_sep(state);
 
-	// Need to flush here before we switch to our existing buffer system
-	flush_data(state);
-
 	// Send data in blocks of "buffer_size" memory bytes
 	// (We don't need a terminator when sending)
 	const uint32_t buffer_size = RDB_MEM_BLOCK_SIZE*4;
@@ -677,19 +928,158 @@ static int RemoteDebug_mem(int nArgc, char *psArgs[], RemoteDebugState* state)
 		// Flush?
 		if (write_pos == RDB_MEM_BLOCK_SIZE*4)
 		{
-			send(state->AcceptedFD, buffer, write_pos, 0);
+			add_data(state, buffer, write_pos);
 			write_pos = 0;
 		}
 	}
 
 	// Flush remainder
 	if (write_pos != 0)
-		send(state->AcceptedFD, buffer, write_pos, 0);
+		add_data(state, buffer, write_pos);
 
 	free(buffer);
 	return 0;
 }
 
+/**
+ * Parse the "<addr> <size> [<arg>...]" arguments shared by the
+ * binary memory commands into <values>. Missing optional arguments
+ * are left as they are. Returns false on errors.
+ */
+static bool RemoteDebug_ParseMemArgs(int nArgc, char *psArgs[], Uint32 *values, int count)
+{
+	int offset = 0;
+
+	if (nArgc < 1 + 2)
+		return false;
+	for (int arg = 1; arg < nArgc && arg <= count; ++arg)
+	{
+		if (Eval_Expression(psArgs[arg], &values[arg - 1], &offset, false))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Dump the requested area of ST memory as binary data.
+ *
+ * Input: "memb <start addr> <size in bytes> [<flag> [<options>]]\n"
+ *
+ * Output: "OK <address> <size> <encoding> <payload size> <payload>"
+ *
+ * Unlike the other replies, the payload is raw binary (which can
+ * contain zeroes) so clients need to read <payload size> bytes after
+ * the last separator before looking for the terminator.
+ * With MEMB_OPT_COMPRESS option the payload may be zlib compressed,
+ * <encoding> tells whether it was (MEMB_ENCODING_ZLIB) or not.
+ */
+static int RemoteDebug_memb(int nArgc, char *psArgs[], RemoteDebugState* state)
+{
+	/* address, size, flag, options */
+	Uint32 values[4] = { 0, 0, 0, 0 };
+	Uint32 encoding = MEMB_ENCODING_RAW;
+	Uint32 payload_size;
+	Uint8 *data, *payload;
+
+	if (!RemoteDebug_ParseMemArgs(nArgc, psArgs, values, ARRAY_SIZE(values)))
+		return 1;
+	if (values[1] > RDB_MEMB_MAX_SIZE)
+		return 1;
+
+	data = malloc(values[1] ? values[1] : 1);
+	if (!data)
+		return 1;
+	RemoteDebug_ReadBlock(values[2], values[0], data, values[1]);
+	payload = data;
+	payload_size = values[1];
+
+#if HAVE_ZLIB_H
+	Uint8 *packed = NULL;
+	if ((values[3] & MEMB_OPT_COMPRESS) && values[1] > 0)
+	{
+		uLongf packed_size = compressBound(values[1]);
+		packed = malloc(packed_size);
+		// Speed matters more than size for interactive views
+		if (packed && compress2(packed, &packed_size, data, values[1], Z_BEST_SPEED) == Z_OK
+		    && packed_size < values[1])
+		{
+			encoding = MEMB_ENCODING_ZLIB;
+			payload = packed;
+			payload_size = packed_size;
+		}
+	}
+#endif
+
+	send_str(state, "OK");
+	send_sep(state);
+	send_hex(state, values[0]);
+	send_sep(state);
+	send_hex(state, values[1]);
+	send_sep(state);
+	send_hex(state, encoding);
+	send_sep(state);
+	send_hex(state, payload_size);
+	send_sep(state);
+	add_data(state, (const char*)payload, payload_size);
+
+#if HAVE_ZLIB_H
+	free(packed);
+#endif
+	free(data);
+	return 0;
+}
+
+/**
+ * Return checksums for consecutive blocks of the requested memory area,
+ * so that clients can refetch (with "memb") only the blocks that changed.
+ * Last block can be shorter than the others.
+ *
+ * Input: "memsum <start addr> <size in bytes> <block size> [<flag>]\n"
+ *
+ * Output: "OK <address> <size> <block size> <checksum>..."
+ */
+static int RemoteDebug_memsum(int nArgc, char *psArgs[], RemoteDebugState* state)
+{
+	/* address, size, block size, flag */
+	Uint32 values[4] = { 0, 0, 0, 0 };
+	Uint32 addr, size, block_size, offset;
+	Uint8 *data;
+
+	if (!RemoteDebug_ParseMemArgs(nArgc, psArgs, values, ARRAY_SIZE(values)) || nArgc < 1 + 3)
+		return 1;
+	addr = values[0];
+	size = values[1];
+	block_size = values[2];
+	if (block_size < RDB_MEMSUM_MIN_BLOCK_SIZE || block_size > RDB_MEMB_MAX_SIZE
+	    || size > RDB_MEMB_MAX_SIZE
+	    || (size + block_size - 1) / block_size > RDB_MEMSUM_MAX_BLOCKS)
+		return 1;
+
+	data = malloc(block_size);
+	if (!data)
+		return 1;
+
+	send_str(state, "OK");
+	send_sep(state);
+	send_hex(state, addr);
+	send_sep(state);
+	send_hex(state, size);
+	send_sep(state);
+	send_hex(state, block_size);
+
+	for (offset = 0; offset < size; offset += block_size)
+	{
+		Uint32 count = size - offset;
+		if (count > block_size)
+			count = block_size;
+		RemoteDebug_ReadBlock(values[3], addr + offset, data, count);
+		send_sep(state);
+		send_hex(state, RemoteDebug_HashBlock(data, count));
+	}
+	free(data);
+	return 0;
+}
+
 /**
  * Write the requested area of ST memory.
  *
@@ -903,7 +1293,7 @@ static int RemoteDebug_console(int nArgc, char *psArgs[], RemoteDebugState* stat
 
 		// Insert an out-of-band notification, in case of restart
 		RemoteDebug_NotifyState(state);
-        RemoteDebug_NotifyLog(state);
+        RemoteDebug_NotifyLog(&g_rdbServer);
 	}
 	send_str(state, "OK");
 	return 0;
@@ -1081,6 +1471,193 @@ static int RemoteDebug_memfind(int nArgc, char *psArgs[], RemoteDebugState* stat
 	return 0;
 }
 
+// -----------------------------------------------------------------------------
+/* "subscribe <mask> [<interval>]" Select the notifications (RDB_SUB_* bits)
+   streamed to this client, and on every how many VBLs they are sent
+   while the emulation runs. */
+/* returns "OK <mask> <interval>" */
+static int RemoteDebug_subscribe(int nArgc, char *psArgs[], RemoteDebugState* state)
+{
+	/* mask, interval */
+	Uint32 values[2] = { 0, 1 };
+	int offset = 0;
+
+	if (nArgc < 2)
+		return 1;
+	for (int arg = 1; arg < nArgc && arg <= ARRAY_SIZE(values); ++arg)
+	{
+		if (Eval_Expression(psArgs[arg], &values[arg - 1], &offset, false))
+			return 1;
+	}
+	if ((values[0] & ~RDB_SUB_ALL) || values[1] == 0)
+		return 1;
+
+	state->subscriptions = values[0];
+	state->interval = values[1];
+	state->vbl_count = 0;
+
+	send_str(state, "OK");
+	send_sep(state);
+	send_hex(state, state->subscriptions);
+	send_sep(state);
+	send_hex(state, state->interval);
+	return 0;
+}
+
+// -----------------------------------------------------------------------------
+static void RemoteDebug_FreeMemStream(RemoteDebugMemStream* stream)
+{
+	free(stream->shadow);
+	free(stream->current);
+	memset(stream, 0, sizeof(*stream));
+}
+
+/**
+ * Set memory range streamed to the client with "!mem" notifications
+ * (when subscribed to RDB_SUB_MEM). Zero size removes the stream.
+ *
+ * Input: "memstream <id> <start addr> <size> [<flag> [<block size>]]\n"
+ *
+ * Output: "OK <id>"
+ */
+static int RemoteDebug_memstream(int nArgc, char *psArgs[], RemoteDebugState* state)
+{
+	/* id, address, size, flag, block size */
+	Uint32 values[5] = { 0, 0, 0, 0, 256 };
+	RemoteDebugMemStream* stream;
+	int offset = 0;
+
+	if (nArgc < 1 + 3)
+		return 1;
+	for (int arg = 1; arg < nArgc && arg <= ARRAY_SIZE(values); ++arg)
+	{
+		if (Eval_Expression(psArgs[arg], &values[arg - 1], &offset, false))
+			return 1;
+	}
+	if (values[0] >= RDB_MAX_MEM_STREAMS || values[2] > RDB_MEMB_MAX_SIZE
+	    || values[4] < RDB_MEMSUM_MIN_BLOCK_SIZE)
+		return 1;
+
+	stream = &state->mem_streams[values[0]];
+	RemoteDebug_FreeMemStream(stream);
+	if (values[2])
+	{
+		stream->current = malloc(values[2]);
+		if (!stream->current)
+			return 1;
+		stream->addr = values[1];
+		stream->size = values[2];
+		stream->flag = values[3];
+		stream->block_size = values[4];
+	}
+
+	send_str(state, "OK");
+	send_sep(state);
+	send_hex(state, values[0]);
+	return 0;
+}
+
+// -----------------------------------------------------------------------------
+// Format: "!mem <id> <address> <size> <payload size> <payload>"
+// where payload is the raw binary memory content, like with "memb"
+static void RemoteDebug_NotifyMemRange(RemoteDebugState* state, int id, Uint32 offset, Uint32 size)
+{
+	RemoteDebugMemStream* stream = &state->mem_streams[id];
+
+	send_str(state, "!mem");
+	send_sep(state);
+	send_hex(state, id);
+	send_sep(state);
+	send_hex(state, stream->addr + offset);
+	send_sep(state);
+	send_hex(state, size);
+	send_sep(state);
+	send_hex(state, size);
+	send_sep(state);
+	add_data(state, (const char*)stream->current + offset, size);
+	send_term(state);
+}
+
+// -----------------------------------------------------------------------------
+// Send blocks of a streamed memory range which changed since they were
+// last sent (adjacent ones in the same notification), or the whole
+// range when nothing has been sent yet.
+static void RemoteDebug_NotifyMemStream(RemoteDebugState* state, int id)
+{
+	RemoteDebugMemStream* stream = &state->mem_streams[id];
+	Uint32 offset, start, count;
+	Uint8* swap;
+
+	if (!stream->size)
+		return;
+
+	RemoteDebug_ReadBlock(stream->flag, stream->addr, stream->current, stream->size);
+	if (!stream->shadow)
+	{
+		stream->shadow = malloc(stream->size);
+		if (!stream->shadow)
+			return;
+		RemoteDebug_NotifyMemRange(state, id, 0, stream->size);
+	}
+	else
+	{
+		offset = 0;
+		while (offset < stream->size)
+		{
+			start = offset;
+			count = stream->block_size;
+			while (offset < stream->size)
+			{
+				count = stream->size - offset;
+				if (count > stream->block_size)
+					count = stream->block_size;
+				if (memcmp(stream->current + offset, stream->shadow + offset, count) == 0)
+					break;
+				offset += count;
+			}
+			if (offset > start)
+				RemoteDebug_NotifyMemRange(state, id, start, offset - start);
+			else
+				offset += count;
+		}
+	}
+
+	// Sent contents become the new shadow
+	swap = stream->shadow;
+	stream->shadow = stream->current;
+	stream->current = swap;
+}
+
+// -----------------------------------------------------------------------------
+// Send the notifications the client has subscribed to, unless it's still
+// busy receiving the previous ones. Profile counts and memory changes
+// accumulate meanwhile, so skipped updates are just delayed, not lost.
+static void RemoteDebug_NotifyStreams(RemoteDebugState* state)
+{
+	if (!(state->subscriptions & (RDB_SUB_REGS | RDB_SUB_PROFILE | RDB_SUB_MEM)))
+		return;
+	if (++state->vbl_count < state->interval)
+		return;
+	if (pending_data(state) > RDB_STREAM_QUEUE_LIMIT)
+		return;
+	state->vbl_count = 0;
+
+	if (state->subscriptions & RDB_SUB_REGS)
+	{
+		send_str(state, "!regs");
+		send_sep(state);
+		send_registers(state);
+		send_term(state);
+	}
+	if ((state->subscriptions & RDB_SUB_PROFILE) && Profile_CpuIsEnabled())
+		RemoteDebug_NotifyProfile(state, true);
+	if (state->subscriptions & RDB_SUB_MEM)
+	{
+		for (int id = 0; id < RDB_MAX_MEM_STREAMS; ++id)
+			RemoteDebug_NotifyMemStream(state, id);
+	}
+}
+
 // -----------------------------------------------------------------------------
 /* DebugUI command structure */
 typedef struct
@@ -1111,6 +1688,10 @@ static const rdbcommand_t remoteDebugCommandList[] = {
 	{ RemoteDebug_resetcold,"resetcold"	, true		},
 	{ RemoteDebug_ffwd,		"ffwd"		, true		},
 	{ RemoteDebug_memfind,	"memfind"	, true		},
+	{ RemoteDebug_memb,		"memb"		, true		},
+	{ RemoteDebug_memsum,	"memsum"	, true		},
+	{ RemoteDebug_subscribe,"subscribe"	, true		},
+	{ RemoteDebug_memstream,"memstream"	, true		},
 
 	/* Terminator */
 	{ NULL, NULL }
@@ -1191,9 +1772,6 @@ static void SetNonBlocking(SOCKET socket, u_long nonblock)
 	u_long mode = nonblock;  // 0 to enable blocking socket
 	ioctlsocket(socket, FIONBIO, &mode);
 }
-#define GET_SOCKET_ERROR		WSAGetLastError()
-#define RDB_CLOSE				closesocket
-
 #endif
 #if HAVE_UNIX_DOMAIN_SOCKETS
 static void SetNonBlocking(int socket, u_long nonblock)
@@ -1215,90 +1793,126 @@ static void SetReuseAddr(int fd)
 	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
 }
 
-#define GET_SOCKET_ERROR		errno
-#define RDB_CLOSE				close
 #endif
 
-static RemoteDebugState g_rdbState;
+// Send small notifications right away instead of waiting for
+// the acknowledgement of the previous ones (Nagle's algorithm)
+static void SetNoDelay(int fd)
+{
+	int val = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&val, sizeof(val));
+}
 
-static void RemoteDebugState_Init(RemoteDebugState* state)
+static void RemoteDebugServer_Init(RemoteDebugServer* server)
 {
-	state->SocketFD = -1;
-	state->AcceptedFD = -1;
-	RemoteDebugBuffer_Init(&state->input_buf, RDB_CMD_BUFFER_START_SIZE);
-	memset(state->cmd_buf, 0, sizeof(state->cmd_buf));
-	state->sendBufferPos = 0;
+	server->SocketFD = -1;
+	server->client_count = 0;
+	for (int i = 0; i < RDB_MAX_CLIENTS; ++i)
+		server->clients[i].AcceptedFD = -1;
+	memset(server->cmd_buf, 0, sizeof(server->cmd_buf));
+
+    server->original_stdout = dup(STDOUT_FILENO);
+    server->original_stderr = dup(STDERR_FILENO);
+    pipe(server->logpipe);
+    int flags = fcntl(server->logpipe[0], F_GETFL) | O_NONBLOCK;
+    fcntl(server->logpipe[0], F_SETFL, flags);
+}
 
-    state->original_stdout = dup(STDOUT_FILENO);
-    state->original_stderr = dup(STDERR_FILENO);
-    pipe(state->logpipe);
-    int flags = fcntl(state->logpipe[0], F_GETFL) | O_NONBLOCK;
-    fcntl(state->logpipe[0], F_SETFL, flags);
+static void RemoteDebugState_Init(RemoteDebugState* state, int fd)
+{
+	memset(state, 0, sizeof(*state));
+	state->AcceptedFD = fd;
+	RemoteDebugBuffer_Init(&state->input_buf, RDB_CMD_BUFFER_START_SIZE);
+	RemoteDebugBuffer_Init(&state->output_buf, RDB_CMD_BUFFER_START_SIZE);
+	state->subscriptions = RDB_SUB_LOG;
+	state->interval = 1;
 }
 
 static void RemoteDebugState_UnInit(RemoteDebugState* state)
 {
-	if (state->AcceptedFD != -1)
+	RDB_CLOSE(state->AcceptedFD);
+	state->AcceptedFD = -1;
+	state->disconnect = false;
+	RemoteDebugBuffer_UnInit(&state->input_buf);
+	RemoteDebugBuffer_UnInit(&state->output_buf);
+	for (int id = 0; id < RDB_MAX_MEM_STREAMS; ++id)
+		RemoteDebug_FreeMemStream(&state->mem_streams[id]);
+	RemoteDebug_ResetProfileSent(state);
+}
+
+static void RemoteDebugServer_CloseClient(RemoteDebugServer* server, RemoteDebugState* state)
+{
+	RemoteDebugState_UnInit(state);
+	if (--server->client_count == 0)
 	{
-		RDB_CLOSE(state->AcceptedFD);
+		// Last client gone, Hatari output goes to console again
+		RemoteDebug_CloseDebugOutput(server);
 	}
+	printf("Remote Debug connection closed\n");
+}
 
-	if (state->SocketFD != -1)
+static void RemoteDebugServer_UnInit(RemoteDebugServer* server)
+{
+	for (int i = 0; i < RDB_MAX_CLIENTS; ++i)
 	{
-		RDB_CLOSE(state->SocketFD);
+		if (server->clients[i].AcceptedFD != -1)
+			RemoteDebugServer_CloseClient(server, &server->clients[i]);
 	}
 
-	state->AcceptedFD = -1;
-	state->SocketFD = -1;
-	RemoteDebugBuffer_UnInit(&state->input_buf);
+	if (server->SocketFD != -1)
+	{
+		RDB_CLOSE(server->SocketFD);
+	}
+	server->SocketFD = -1;
 
-    close(state->logpipe[0]);
-    close(state->logpipe[1]);
+    close(server->logpipe[0]);
+    close(server->logpipe[1]);
 }
 
-static int RemoteDebugState_TryAccept(RemoteDebugState* state, bool blocking)
+/* Accept a pending connection. Returns false if there was none */
+static bool RemoteDebugServer_Accept(RemoteDebugServer* server)
 {
-	fd_set set;
-	struct timeval timeout;
+	RemoteDebugState* state = NULL;
+	int fd = accept(server->SocketFD, NULL, NULL);
+	if (fd == -1)
+		return false;
 
-	if (blocking)
+	for (int i = 0; i < RDB_MAX_CLIENTS; ++i)
 	{
-		// Connection active
-		// Check socket with timeout
-		FD_ZERO(&set);
-		FD_SET(state->SocketFD, &set);
-
-		// On Linux, need to reset the timeout on each loop
-		// see "select(2)"
-		timeout.tv_sec = 0;
-		timeout.tv_usec = RDB_SELECT_TIMEOUT_USEC;
-		int rv = select(state->SocketFD + 1, &set, NULL, NULL, &timeout);
-		if (rv <= 0)
-			return state->AcceptedFD;
+		if (server->clients[i].AcceptedFD == -1)
+		{
+			state = &server->clients[i];
+			break;
+		}
 	}
-
-	state->AcceptedFD = accept(state->SocketFD, NULL, NULL);
-	if (state->AcceptedFD != -1)
+	if (!state)
 	{
-		printf("Remote Debug connection accepted\n");
-		// reset send buffer
-		state->sendBufferPos = 0;
-		// Send connected handshake, so client can
-		// drop any subsequent commands
-		send_str(state, "!connected");
-		send_sep(state);
-		send_hex(state, REMOTEDEBUG_PROTOCOL_ID);
-		send_term(state);
-		flush_data(state);
-
-		// New connection, so do an initial report.
-        RemoteDebug_OpenDebugOutput(state);
-		RemoteDebug_NotifyConfig(state);
-		RemoteDebug_NotifyState(state);
-        RemoteDebug_NotifyLog(state);
-		flush_data(state);
+		fprintf(stderr, "Remote Debug connection refused, already %d clients\n", RDB_MAX_CLIENTS);
+		RDB_CLOSE(fd);
+		return true;
 	}
-	return state->AcceptedFD;
+
+	// Clients never block the emulation, whether it's running or not
+	SetNonBlocking(fd, 1);
+	SetNoDelay(fd);
+	RemoteDebugState_Init(state, fd);
+	printf("Remote Debug connection accepted\n");
+	if (server->client_count++ == 0)
+		RemoteDebug_OpenDebugOutput(server);
+
+	// Send connected handshake, so client can
+	// drop any subsequent commands
+	send_str(state, "!connected");
+	send_sep(state);
+	send_hex(state, REMOTEDEBUG_PROTOCOL_ID);
+	send_term(state);
+
+	// New connection, so do an initial report.
+	RemoteDebug_NotifyConfig(state);
+	RemoteDebug_NotifyState(state);
+	RemoteDebug_NotifyLog(server);
+	flush_data(state);
+	return true;
 }
 
 /* Process any command data that has been read into the pending
@@ -1336,89 +1950,123 @@ static void RemoteDebug_ProcessBuffer(RemoteDebugState* state)
 		flush_data(state);
 }
 
-/*	Handle activity from the accepted connection.
-	Disconnect if socket lost or other errors.
+/*	Read commands from the client and execute them.
+	Flag client for disconnection if socket is lost or on other errors.
 */
-static void RemoteDebugState_UpdateAccepted(RemoteDebugState* state)
+static void RemoteDebugServer_Receive(RemoteDebugServer* server, RemoteDebugState* state)
 {
-	int remaining;
-	fd_set set;
-	struct timeval timeout;
-#if HAVE_WINSOCK_SOCKETS
-	int winerr;
-#endif
-
-	// Connection active
-	// Check socket with timeout
-	FD_ZERO(&set);
-	FD_SET(state->AcceptedFD, &set);
-
-	// On Linux, need to reset the timeout on each loop
-	// see "select(2)"
-	timeout.tv_sec = 0;
-	timeout.tv_usec = RDB_SELECT_TIMEOUT_USEC;
-
-	int rv = select(state->AcceptedFD + 1, &set, NULL, NULL, &timeout);
-	if (rv < 0)
-	{
-		// select error, Lost connection?
-		return;
-	}
-	else if (rv == 0)
-	{
-		// timeout, socket does not have anything to read.
-		// Run event handler while we know nothing changes
-		Main_EventHandler(true);
-		return;
-	}
-
-	// Read input and accumulate a command (blocking)
-	remaining = sizeof(state->cmd_buf);
 	int bytes = recv(state->AcceptedFD, 
-		state->cmd_buf,
-		remaining,
+		server->cmd_buf,
+		sizeof(server->cmd_buf),
 		0);
 	if (bytes > 0)
 	{
 		// New data.
 		// Add to the resizeable buffer
-		RemoteDebugBuffer_Add(&state->input_buf, state->cmd_buf, bytes);
+		RemoteDebugBuffer_Add(&state->input_buf, server->cmd_buf, bytes);
 		// Check for completed commands
 		RemoteDebug_ProcessBuffer(state);
 	}
-	else if (bytes == 0)
+	else if (bytes == 0 || !SOCKET_WOULD_BLOCK(GET_SOCKET_ERROR))
 	{
-		// This represents an orderly EOF, even in Winsock
-		printf("Remote Debug connection closed\n");
-		RDB_CLOSE(state->AcceptedFD);
-		state->AcceptedFD = -1;
-
-        RemoteDebug_CloseDebugOutput(state);
+		// Orderly EOF (even in Winsock) or error
+		state->disconnect = true;
+	}
+}
 
-		// Bail out of the loop here so we don't just spin
-		return;
+/*	Wait up to <timeout> milliseconds for network activity, then accept
+	new clients, execute commands from the connected ones and send them
+	any queued output that the sockets accept.
+	Returns poll() result, i.e. zero on timeout.
+*/
+static int RemoteDebugServer_Poll(RemoteDebugServer* server, int timeout)
+{
+	struct pollfd fds[1 + RDB_MAX_CLIENTS];
+	RemoteDebugState* polled[1 + RDB_MAX_CLIENTS];
+	int count = 0;
+	int rv;
+
+	fds[count].fd = server->SocketFD;
+	fds[count].events = POLLIN;
+	fds[count].revents = 0;
+	polled[count++] = NULL;
+	for (int i = 0; i < RDB_MAX_CLIENTS; ++i)
+	{
+		RemoteDebugState* state = &server->clients[i];
+		if (state->AcceptedFD == -1)
+			continue;
+		fds[count].fd = state->AcceptedFD;
+		fds[count].events = POLLIN;
+		if (pending_data(state) > 0)
+			fds[count].events |= POLLOUT;
+		fds[count].revents = 0;
+		polled[count++] = state;
 	}
-	else
+
+	rv = RDB_POLL(fds, count, timeout);
+	if (rv > 0)
 	{
-		// On Windows -1 simply means a general error and might be OK.
-		// So we check for known errors that should cause us to exit.
-#if HAVE_WINSOCK_SOCKETS
-		winerr = WSAGetLastError();
-		if (winerr == WSAECONNRESET)
+		if (fds[0].revents & POLLIN)
 		{
-			printf("Remote Debug connection reset\n");
-			RDB_CLOSE(state->AcceptedFD);
-			state->AcceptedFD = -1;
+			while (RemoteDebugServer_Accept(server))
+				;
+		}
+
+		for (int i = 1; i < count; ++i)
+		{
+			RemoteDebugState* state = polled[i];
+			if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+				RemoteDebugServer_Receive(server, state);
+			if (fds[i].revents & POLLOUT)
+				flush_data(state);
 		}
-		printf("Unknown cmd %d\n", WSAGetLastError());
-#endif
 	}
+
+	for (int i = 1; i < count; ++i)
+	{
+		if (polled[i]->disconnect)
+			RemoteDebugServer_CloseClient(server, polled[i]);
+	}
+	return rv;
+}
+
+/* Send any pending log output and queued data to all clients */
+static void RemoteDebugServer_Flush(RemoteDebugServer* server)
+{
+	RemoteDebug_NotifyLog(server);
+	for (int i = 0; i < RDB_MAX_CLIENTS; ++i)
+	{
+		RemoteDebugState* state = &server->clients[i];
+		if (state->AcceptedFD == -1)
+			continue;
+		flush_data(state);
+		if (state->disconnect)
+			RemoteDebugServer_CloseClient(server, state);
+	}
+}
+
+/* Send the state change notifications to all clients */
+static void RemoteDebugServer_NotifyState(RemoteDebugServer* server, bool profile)
+{
+	for (int i = 0; i < RDB_MAX_CLIENTS; ++i)
+	{
+		RemoteDebugState* state = &server->clients[i];
+		if (state->AcceptedFD == -1)
+			continue;
+		RemoteDebug_NotifyConfig(state);
+		RemoteDebug_NotifyState(state);
+		if (profile)
+			RemoteDebug_NotifyProfile(state, false);
+	}
+	RemoteDebugServer_Flush(server);
 }
 
 /* Update with a suitable message, when we are in the break loop */
-static void SetStatusbarMessage(const RemoteDebugState* state)
+static void SetStatusbarMessage(const RemoteDebugServer* server)
 {
-	if (state->AcceptedFD != -1)
+	if (server->client_count > 1)
+		Statusbar_AddMessage("hrdb + other clients connected -- debugging", 100);
+	else if (server->client_count)
 		Statusbar_AddMessage("hrdb connected -- debugging", 100);
 	else
 		Statusbar_AddMessage("break -- waiting for hrdb", 100);
@@ -1438,82 +2086,52 @@ static void SetStatusbarMessage(const RemoteDebugState* state)
 */
 static bool RemoteDebug_BreakLoop(void)
 {
-	RemoteDebugState* state;
-	state = &g_rdbState;
+	RemoteDebugServer* server = &g_rdbServer;
+	int client_count;
 
 	// This is set to true to prevent re-entrancy in RemoteDebug_Update()
 	bRemoteBreakIsActive = true;
 
-	if (state->AcceptedFD != -1)
-	{
-		// Notify after state change happens
-		RemoteDebug_NotifyConfig(state);
-		RemoteDebug_NotifyState(state);
-		RemoteDebug_NotifyProfile(state);
-        RemoteDebug_NotifyLog(state);
-		flush_data(state);
-	}
+	// Notify after state change happens
+	RemoteDebugServer_NotifyState(server, true);
 
 	RemoteDebug_HardwareSync();
 
-	SetStatusbarMessage(state);
-
-	// Set the socket to blocking on the connection now, so we
-	// sleep until data is available.
-	SetNonBlocking(state->AcceptedFD, 0);
+	SetStatusbarMessage(server);
+	client_count = server->client_count;
 
 	while (bRemoteBreakIsActive)
 	{
 		// Handle main exit states
-		if (state->SocketFD == -1)
+		if (server->SocketFD == -1)
 			break;
 
 		if (bQuitProgram)
 			break;
 
-		// If we don't have a connection yet, we need to get one
-		if (state->AcceptedFD == -1)
-		{
-			// Try to reconnect (with select())
-			RemoteDebugState_TryAccept(state, true);
-			if (state->AcceptedFD != -1)
-			{
-				// Set the socket to blocking on the connection now, so we
-				// sleep until data is available.
-				SetNonBlocking(state->AcceptedFD, 0);
-				SetStatusbarMessage(state);
-			}
-			else
-			{
-				// No connection so update events
-				Main_EventHandler(true);
-			}
-		}
-		else
+		// Sleep until there's network activity, or timeout, in
+		// which case update events while we know nothing changes
+		if (RemoteDebugServer_Poll(server, RDB_POLL_TIMEOUT_MSEC) == 0)
+			Main_EventHandler(true);
+
+		if (server->client_count != client_count)
 		{
-			// Already connected, check for messages or disconnection
-			RemoteDebugState_UpdateAccepted(state);
-			if (state->AcceptedFD == -1)
-			{
-				// disconnected
-				SetStatusbarMessage(state);
-			}
+			// (dis)connected
+			client_count = server->client_count;
+			SetStatusbarMessage(server);
 		}
 	}
 	bRemoteBreakIsActive = false;
 	// Clear any break request that might have been set
 	bRemoteBreakRequest = false;
 
-	// Switch back to non-blocking for the update loop
-	if (state->AcceptedFD != -1)
+	// Profiling restarts from zero when emulation continues
+	for (int i = 0; i < RDB_MAX_CLIENTS; ++i)
 	{
-		RemoteDebug_NotifyConfig(state);
-		RemoteDebug_NotifyState(state);
-        RemoteDebug_NotifyLog(state);
-		flush_data(state);
-
-		SetNonBlocking(state->AcceptedFD, 1);
+		if (server->clients[i].AcceptedFD != -1)
+			RemoteDebug_ResetProfileSent(&server->clients[i]);
 	}
+	RemoteDebugServer_NotifyState(server, false);
 
 	// TODO: this return code no longer used
 	return true;
@@ -1522,41 +2140,39 @@ static bool RemoteDebug_BreakLoop(void)
 /*
 	Create a socket for the port and start to listen over TCP
 */
-static int RemoteDebugState_InitServer(RemoteDebugState* state)
+static int RemoteDebugServer_InitServer(RemoteDebugServer* server)
 {
-	state->AcceptedFD = -1;
-
 	// Create listening socket on port
 	struct sockaddr_in sa;
 
-	state->SocketFD = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
-	if (state->SocketFD == -1) {
+	server->SocketFD = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (server->SocketFD == -1) {
 		fprintf(stderr, "Failed to open socket\n");
 		return 1;
 	}
 #if HAVE_UNIX_DOMAIN_SOCKETS
-	SetReuseAddr(state->SocketFD);
+	SetReuseAddr(server->SocketFD);
 #endif
 
-	// Socket is non-blokcing to start with
-	SetNonBlocking(state->SocketFD, 1);
+	// Listening socket is always non-blocking
+	SetNonBlocking(server->SocketFD, 1);
 
 	memset(&sa, 0, sizeof sa);
 	sa.sin_family = AF_INET;
 	sa.sin_port = htons(RDB_PORT);
 	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
 
-	if (bind(state->SocketFD,(struct sockaddr *)&sa, sizeof sa) == -1) {
+	if (bind(server->SocketFD,(struct sockaddr *)&sa, sizeof sa) == -1) {
 		fprintf(stderr, "Failed to bind socket (%d)\n", GET_SOCKET_ERROR);
-		RDB_CLOSE(state->SocketFD);
-		state->SocketFD =-1;
+		RDB_CLOSE(server->SocketFD);
+		server->SocketFD =-1;
 		return 1;
 	}
   
-	if (listen(state->SocketFD, 1) == -1) {
+	if (listen(server->SocketFD, RDB_MAX_CLIENTS) == -1) {
 		fprintf(stderr, "Failed to listen() on socket\n");
-		RDB_CLOSE(state->SocketFD);
-		state->SocketFD =-1;
+		RDB_CLOSE(server->SocketFD);
+		server->SocketFD =-1;
 		return 1;
 	}
 
@@ -1565,76 +2181,17 @@ static int RemoteDebugState_InitServer(RemoteDebugState* state)
 	return 0;
 }
 
-// This is the per-frame update, to check for new connections
-// while Hatari is running at full speed
-static void RemoteDebugState_Update(RemoteDebugState* state)
-{
-	if (state->SocketFD == -1)
-	{
-		// TODO: we should try to re-init periodically
-		return;
-	}
-
-	int remaining;
-	if (state->AcceptedFD != -1)
-	{
-		// Connection is active
-		// Read input and accumulate a command
-		remaining = sizeof(state->cmd_buf);
-		
-#if HAVE_UNIX_DOMAIN_SOCKETS
-		int bytes = recv(state->AcceptedFD, 
-			state->cmd_buf,
-			remaining,
-			MSG_DONTWAIT);
-#endif
-#if HAVE_WINSOCK_SOCKETS
-		int bytes = recv(state->AcceptedFD, 
-			state->cmd_buf,
-			remaining,
-			0);
-#endif
-
-		if (bytes > 0)
-		{
-			// New data.
-			// Add to the resizeable buffer
-			RemoteDebugBuffer_Add(&state->input_buf, state->cmd_buf, bytes);
-			// Check for completed commands
-			RemoteDebug_ProcessBuffer(state);
-		}
-		else if (bytes == 0)
-		{
-			// This represents an orderly EOF
-			printf("Remote Debug connection closed\n");
-			RDB_CLOSE(state->AcceptedFD);
-			state->AcceptedFD = -1;
-			return;
-		}
-	}
-	else
-	{
-		if (RemoteDebugState_TryAccept(state, false) != -1)
-		{
-			// Set this connection to non-blocking since we are
-			// in "running" state and it will poll every VBL
-			SetNonBlocking(state->AcceptedFD, 1);
-			return;
-		}
-	}
-}
-
 void RemoteDebug_Init(void)
 {
 	printf("Starting remote debug\n");
-	RemoteDebugState_Init(&g_rdbState);
+	RemoteDebugServer_Init(&g_rdbServer);
 	
 #if HAVE_WINSOCK_SOCKETS
 	WORD wVersionRequested;
 	WSADATA wsaData;
 	int err;
 
-	wVersionRequested = MAKEWORD(1, 0);
+	wVersionRequested = MAKEWORD(2, 2);
 	err = WSAStartup(wVersionRequested, &wsaData);
 	if (err != 0)
 	{
@@ -1645,7 +2202,7 @@ void RemoteDebug_Init(void)
 	}
 #endif
 
-	if (RemoteDebugState_InitServer(&g_rdbState) == 0)
+	if (RemoteDebugServer_InitServer(&g_rdbServer) == 0)
 	{
 		// Socket created, so use our break loop
 		DebugUI_RegisterRemoteDebug(RemoteDebug_BreakLoop);
@@ -1657,7 +2214,7 @@ void RemoteDebug_UnInit()
 	printf("Stopping remote debug\n");
 	DebugUI_RegisterRemoteDebug(NULL);
 
-	RemoteDebugState_UnInit(&g_rdbState);
+	RemoteDebugServer_UnInit(&g_rdbServer);
 }
 
 bool RemoteDebug_Update(void)
@@ -1665,20 +2222,37 @@ bool RemoteDebug_Update(void)
 	// This function is called from the main event handler, which
 	// is also called while break is active. So protect against
 	// re-entrancy.
-	if (!bRemoteBreakIsActive)
+	if (!bRemoteBreakIsActive && g_rdbServer.SocketFD != -1)
 	{
-		RemoteDebugState_Update(&g_rdbState);
+		// Check for new connections and commands, without waiting
+		RemoteDebugServer_Poll(&g_rdbServer, 0);
 	}
 
-    if (g_rdbState.AcceptedFD != -1)
-    {
-        RemoteDebug_NotifyLog(&g_rdbState);
-        flush_data(&g_rdbState);
-    }
+	if (g_rdbServer.client_count)
+		RemoteDebugServer_Flush(&g_rdbServer);
 
 	return bRemoteBreakIsActive;
 }
 
+/**
+ * Send subscribed notifications to clients, called on each VBL
+ * while the emulation runs.
+ */
+void RemoteDebug_Vbl(void)
+{
+	if (!g_rdbServer.client_count || bRemoteBreakIsActive)
+		return;
+
+	RemoteDebug_CpuSync();
+	for (int i = 0; i < RDB_MAX_CLIENTS; ++i)
+	{
+		RemoteDebugState* state = &g_rdbServer.clients[i];
+		if (state->AcceptedFD != -1)
+			RemoteDebug_NotifyStreams(state);
+	}
+	RemoteDebugServer_Flush(&g_rdbServer);
+}
+
 /**
  * Debugger invocation if requested by remote debugger.
  * 
@@ -13,6 +13,8 @@
 extern void RemoteDebug_Init(void);
 extern void RemoteDebug_UnInit(void);
 extern bool RemoteDebug_Update(void);
+// Stream subscribed notifications to clients
+extern void RemoteDebug_Vbl(void);
 // Read the flag to see if remote break was requested
 extern void RemoteDebug_CheckRemoteBreak(void);
 #endif /* HATARI_REMOTE_H */
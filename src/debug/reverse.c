@@ -0,0 +1,687 @@
+/*
+  Hatari - reverse.c
+
+  This file is distributed under the GNU General Public License, version 2
+  or at your option any later version. Read the file gpl.txt for details.
+
+  reverse.c - CPU reverse stepping & continue for the debugger.
+
+  When enabled, an in-memory snapshot (checkpoint) of the whole emulation
+  state is taken every N frames, and the number of executed CPU
+  instructions is counted.  Going back is done by restoring the nearest
+  earlier checkpoint and re-executing instructions from it until the
+  target instruction count is reached.
+
+  For re-execution to reproduce what happened originally, host inputs
+  affecting emulation (keyboard, mouse, joysticks, host time and GEMDOS
+  HD file operation results) are recorded while emulation runs, and recorded
+  values are returned instead of host ones while replaying.  Inputs are
+  logged either as events (key presses etc.) replayed at the same
+  emulation clock cycle, or as samples of polled values (joystick
+  state etc.) of which only the changes are recorded.  Emulation code
+  random number generator is re-seeded at each checkpoint.
+*/
+const char Reverse_fileid[] = "Hatari reverse.c";
+
+#include <inttypes.h>
+
+#include "main.h"
+#include "configuration.h"
+#include "breakcond.h"
+#include "cycles.h"
+#include "debugui.h"
+#include "debug_priv.h"
+#include "memorySnapShot.h"
+#include "memwatch.h"
+#include "reverse.h"
+
+#define REVERSE_INTERVAL_DEFAULT	50	/* frames, 1s for PAL */
+#define REVERSE_CHECKPOINTS_DEFAULT	10
+#define REVERSE_CHECKPOINTS_MAX		100
+
+typedef struct {
+	Uint64 clock;	/* CyclesGlobalClockCounter when recorded */
+	Sint64 value;
+	Uint32 offset;	/* of associated data in Input.data */
+	Uint32 len;	/* of associated data */
+} input_item_t;
+
+typedef struct {
+	input_item_t *items;
+	int count;
+	int allocated;
+	int next;	/* next item to replay */
+} input_log_t;
+
+static struct {
+	input_log_t log[REVERSE_INPUT_TYPES];
+	Uint8 *data;
+	Uint32 size;
+	Uint32 allocated;
+} Input;
+
+typedef struct {
+	Uint8 *state;	/* emulation state snapshot */
+	size_t size;
+	Uint64 insn;	/* instruction count when taken */
+	Uint64 clock;	/* CyclesGlobalClockCounter when taken */
+	unsigned int seed;	/* rand() seed set when taken */
+	int counts[REVERSE_INPUT_TYPES];	/* input log item counts when taken */
+} checkpoint_t;
+
+typedef enum {
+	REVERSE_RUN,	/* normal execution */
+	REVERSE_SEEK,	/* replay until target instruction */
+	REVERSE_SEARCH	/* replay until target, look for breakpoint hits */
+} reverse_mode_t;
+
+bool ReverseTracking;
+
+static struct {
+	checkpoint_t cp[REVERSE_CHECKPOINTS_MAX];
+	int count;
+	int max;
+	int interval;	/* checkpoint interval in frames */
+	int frames;	/* since last checkpoint */
+	bool pending;	/* take checkpoint after next instruction */
+	bool restoring;	/* checkpoint restore requested */
+	int restored;	/* index of checkpoint being restored */
+	int verify;	/* index of next checkpoint to verify */
+	bool diverged;	/* replay divergence has been reported */
+	Uint64 insn;	/* instructions executed after enabling */
+	Uint64 horizon;	/* largest instruction count executed */
+	reverse_mode_t mode;
+	debug_reason_t reason;	/* for entering debugger at SEEK target */
+	Uint64 target;	/* SEEK/SEARCH end position */
+	Uint64 origin;	/* SEARCH start position */
+	Uint64 found;	/* SEARCH breakpoint hit position */
+	int foundbp;	/* index of the hit breakpoint */
+	int search;	/* index of checkpoint being searched */
+} Reverse;
+
+
+/* ------------------ input recording & replay ------------------- */
+
+/**
+ * Samples are (host) values polled by emulation, events are
+ * changes pushed to emulation
+ */
+static inline bool Reverse_IsSample(reverse_input_t type)
+{
+	return type >= REVERSE_INPUT_JOY && type <= REVERSE_INPUT_TIME;
+}
+
+/**
+ * Inputs are replayed (and not recorded) until execution reaches
+ * the furthest point executed earlier, or while state is restored
+ */
+bool Reverse_IsReplaying(void)
+{
+	return ReverseTracking && (Reverse.restoring || Reverse.insn < Reverse.horizon);
+}
+
+/**
+ * Append item with optional data to given input log
+ */
+static void Reverse_AddItem(input_log_t *log, Sint64 value, const void *data, Uint32 len)
+{
+	input_item_t *item;
+
+	if (log->count >= log->allocated) {
+		int allocated = log->allocated ? 2 * log->allocated : 64;
+		item = realloc(log->items, allocated * sizeof(*item));
+		if (!item) {
+			fprintf(stderr, "ERROR: no memory for reverse debugging input log!\n");
+			return;
+		}
+		log->items = item;
+		log->allocated = allocated;
+	}
+	if (Input.size + len > Input.allocated) {
+		Uint32 allocated = 2 * Input.allocated + len;
+		Uint8 *buf = realloc(Input.data, allocated);
+		if (!buf) {
+			fprintf(stderr, "ERROR: no memory for reverse debugging input data!\n");
+			return;
+		}
+		Input.data = buf;
+		Input.allocated = allocated;
+	}
+	item = &log->items[log->count++];
+	item->clock = CyclesGlobalClockCounter;
+	item->value = value;
+	item->offset = Input.size;
+	item->len = len;
+	if (len) {
+		memcpy(Input.data + Input.size, data, len);
+		Input.size += len;
+	}
+}
+
+/**
+ * Record host value change, or return recorded value when replaying
+ */
+Sint64 Reverse_SampleDo(reverse_input_t type, Sint64 value)
+{
+	input_log_t *log = &Input.log[type];
+
+	if (Reverse_IsReplaying()) {
+		while (log->next < log->count &&
+		       log->items[log->next].clock <= CyclesGlobalClockCounter) {
+			log->next++;
+		}
+		if (log->next) {
+			return log->items[log->next - 1].value;
+		}
+		return value;
+	}
+	if (!log->count || log->items[log->count - 1].value != value) {
+		Reverse_AddItem(log, value, NULL, 0);
+	}
+	return value;
+}
+
+/**
+ * Record host input event, unless replaying
+ */
+void Reverse_RecordEvent(reverse_input_t type, Sint64 value, const void *data, Uint32 len)
+{
+	if (!Reverse_IsReplaying()) {
+		Reverse_AddItem(&Input.log[type], value, data, len);
+	}
+}
+
+/**
+ * Get next recorded event of given type, if it happened at or before
+ * current emulation cycle.  Return false if there was no such event.
+ */
+bool Reverse_ReplayEvent(reverse_input_t type, Sint64 *value, void *data, Uint32 len)
+{
+	input_log_t *log = &Input.log[type];
+	input_item_t *item;
+
+	if (log->next >= log->count) {
+		return false;
+	}
+	item = &log->items[log->next];
+	if (item->clock > CyclesGlobalClockCounter) {
+		return false;
+	}
+	log->next++;
+	if (value) {
+		*value = item->value;
+	}
+	if (data) {
+		memcpy(data, Input.data + item->offset, item->len < len ? item->len : len);
+	}
+	return true;
+}
+
+/**
+ * Remove inputs preceding the oldest checkpoint, except for
+ * the last sample values before it
+ */
+static void Reverse_PruneInputs(void)
+{
+	Uint32 offset = Input.size;
+	input_log_t *log;
+	int i, t, drop;
+
+	for (t = 0; t < REVERSE_INPUT_TYPES; t++) {
+		log = &Input.log[t];
+		drop = Reverse.cp[0].counts[t];
+		if (drop && Reverse_IsSample(t)) {
+			drop--;
+		}
+		if (drop) {
+			log->count -= drop;
+			memmove(log->items, log->items + drop, log->count * sizeof(*log->items));
+			log->next = log->next > drop ? log->next - drop : 0;
+			for (i = 0; i < Reverse.count; i++) {
+				Reverse.cp[i].counts[t] -= drop;
+			}
+		}
+		for (i = 0; i < log->count; i++) {
+			if (log->items[i].len) {
+				if (log->items[i].offset < offset) {
+					offset = log->items[i].offset;
+				}
+				break;
+			}
+		}
+	}
+	if (!offset) {
+		return;
+	}
+	/* drop data no more referred by any of the items */
+	Input.size -= offset;
+	memmove(Input.data, Input.data + offset, Input.size);
+	for (t = 0; t < REVERSE_INPUT_TYPES; t++) {
+		log = &Input.log[t];
+		for (i = 0; i < log->count; i++) {
+			if (log->items[i].len) {
+				log->items[i].offset -= offset;
+			}
+		}
+	}
+}
+
+
+/* ------------------ checkpoints ------------------- */
+
+/**
+ * Free all checkpoints & inputs
+ */
+static void Reverse_Free(void)
+{
+	int i;
+
+	for (i = 0; i < Reverse.count; i++) {
+		free(Reverse.cp[i].state);
+	}
+	for (i = 0; i < REVERSE_INPUT_TYPES; i++) {
+		free(Input.log[i].items);
+	}
+	free(Input.data);
+	memset(&Input, 0, sizeof(Input));
+	Reverse.count = 0;
+}
+
+/**
+ * Disable reverse debugging and free its data
+ */
+static void Reverse_Disable(void)
+{
+	Reverse_Free();
+	Reverse.mode = REVERSE_RUN;
+	Reverse.restoring = false;
+	ReverseTracking = false;
+}
+
+/**
+ * Take a new checkpoint, drop the oldest one if there are too many
+ */
+static void Reverse_AddCheckpoint(void)
+{
+	checkpoint_t *cp;
+	unsigned int seed;
+	Uint8 *state;
+	size_t size;
+	int t;
+
+	if (Reverse.count >= Reverse.max) {
+		free(Reverse.cp[0].state);
+		Reverse.count--;
+		memmove(Reverse.cp, Reverse.cp + 1, Reverse.count * sizeof(checkpoint_t));
+		Reverse_PruneInputs();
+	}
+	/* make random numbers used by emulation repeatable on replay */
+	seed = rand();
+	srand(seed);
+
+	state = MemorySnapShot_CaptureMemory(&size);
+	if (!state) {
+		fprintf(stderr, "ERROR: saving reverse debugging checkpoint failed, reverse debugging disabled!\n");
+		Reverse_Disable();
+		return;
+	}
+	cp = &Reverse.cp[Reverse.count++];
+	cp->state = state;
+	cp->size = size;
+	cp->insn = Reverse.insn;
+	cp->clock = CyclesGlobalClockCounter;
+	cp->seed = seed;
+	for (t = 0; t < REVERSE_INPUT_TYPES; t++) {
+		cp->counts[t] = Input.log[t].count;
+	}
+}
+
+/**
+ * Request restoring of given checkpoint.  It's done when emulation
+ * continues, after which Reverse_Restored() is called.
+ */
+static void Reverse_RestoreCheckpoint(int index)
+{
+	Reverse.restoring = true;
+	Reverse.restored = index;
+	MemorySnapShot_RestoreMemory(Reverse.cp[index].state, Reverse.cp[index].size);
+}
+
+/**
+ * Called after checkpoint restore has been done, to reset
+ * instruction count and input replay positions to it
+ */
+void Reverse_Restored(bool bOk)
+{
+	checkpoint_t *cp = &Reverse.cp[Reverse.restored];
+	int t;
+
+	if (!bOk) {
+		fprintf(stderr, "ERROR: restoring reverse debugging checkpoint failed, reverse debugging disabled!\n");
+		Reverse_Disable();
+		return;
+	}
+	Reverse.restoring = false;
+	Reverse.insn = cp->insn;
+	Reverse.verify = Reverse.restored + 1;
+	srand(cp->seed);
+	for (t = 0; t < REVERSE_INPUT_TYPES; t++) {
+		Input.log[t].next = cp->counts[t];
+	}
+}
+
+/**
+ * Return index of latest checkpoint before given instruction count, or -1
+ */
+static int Reverse_FindCheckpoint(Uint64 insn)
+{
+	int i;
+
+	for (i = Reverse.count - 1; i >= 0; i--) {
+		if (Reverse.cp[i].insn < insn) {
+			break;
+		}
+	}
+	return i;
+}
+
+/**
+ * Restore checkpoint preceding given instruction count and replay
+ * to it, then enter debugger with given reason
+ */
+static void Reverse_Seek(Uint64 target, debug_reason_t reason)
+{
+	Reverse.mode = REVERSE_SEEK;
+	Reverse.target = target;
+	Reverse.reason = reason;
+	Reverse_RestoreCheckpoint(Reverse_FindCheckpoint(target));
+}
+
+/**
+ * Reverse continue reached end of the searched interval:
+ * go to the last hit in it, or search the previous interval
+ */
+static void Reverse_SearchNext(void)
+{
+	if (Reverse.found) {
+		fprintf(stderr, "%d. CPU breakpoint condition(s) matched %"PRIu64" instructions back.\n",
+			Reverse.foundbp, Reverse.origin - Reverse.found);
+		Reverse_Seek(Reverse.found, REASON_CPU_BREAKPOINT);
+		return;
+	}
+	if (Reverse.search > 0) {
+		Reverse.target = Reverse.cp[Reverse.search].insn + 1;
+		Reverse_RestoreCheckpoint(--Reverse.search);
+		return;
+	}
+	fprintf(stderr, "No CPU breakpoint hits since the oldest checkpoint, returning back.\n");
+	Reverse_Seek(Reverse.origin, REASON_CPU_STEPS);
+}
+
+/**
+ * Called at VBL to request checkpoints at given frame interval
+ */
+void Reverse_Vbl(void)
+{
+	if (!ReverseTracking || Reverse_IsReplaying()) {
+		return;
+	}
+	if (++Reverse.frames >= Reverse.interval) {
+		Reverse.frames = 0;
+		Reverse.pending = true;
+	}
+}
+
+/**
+ * Update instruction count, take pending checkpoint and handle
+ * replaying for reverse step/continue.  Called by DebugCpu_Check()
+ * after each instruction.
+ * Return true when replaying towards a reverse step/continue target
+ * i.e. when other debugger checks should be skipped.
+ */
+bool Reverse_Check(void)
+{
+	int bp;
+
+	if (unlikely(Reverse.restoring)) {
+		return true;
+	}
+	Reverse.insn++;
+	if (Reverse.insn > Reverse.horizon) {
+		Reverse.horizon = Reverse.insn;
+		if (Reverse.pending) {
+			Reverse.pending = false;
+			Reverse_AddCheckpoint();
+		}
+	} else if (Reverse.verify < Reverse.count &&
+		   Reverse.cp[Reverse.verify].insn == Reverse.insn) {
+		/* check that replay still matches the original execution */
+		if (Reverse.cp[Reverse.verify].clock != CyclesGlobalClockCounter && !Reverse.diverged) {
+			fprintf(stderr, "WARNING: replay diverged from recorded emulation at checkpoint %d!\n",
+				Reverse.verify + 1);
+			Reverse.diverged = true;
+		}
+		Reverse.verify++;
+	}
+
+	switch (Reverse.mode) {
+	case REVERSE_SEEK:
+		if (Reverse.insn < Reverse.target) {
+			return true;
+		}
+		Reverse.mode = REVERSE_RUN;
+		MemWatch_ClearHit();
+		DebugUI(Reverse.reason);
+		return true;
+	case REVERSE_SEARCH:
+		MemWatch_ClearHit();
+		if (Reverse.insn < Reverse.target) {
+			bp = BreakCond_MatchCpuQuiet();
+			if (bp) {
+				Reverse.found = Reverse.insn;
+				Reverse.foundbp = bp;
+			}
+			return true;
+		}
+		Reverse_SearchNext();
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+/* ------------------ debugger commands ------------------- */
+
+/**
+ * Enable reverse debugging with given interval & checkpoint count
+ */
+static void Reverse_Enable(int interval, int max)
+{
+	if (ReverseTracking) {
+		Reverse_Free();
+	}
+	memset(&Reverse, 0, sizeof(Reverse));
+	Reverse.interval = interval;
+	Reverse.max = max;
+	/* first checkpoint at next instruction */
+	Reverse.pending = true;
+	ReverseTracking = true;
+	fprintf(stderr, "Reverse debugging enabled: checkpoint every %d frames, at most %d of them.\n",
+		interval, max);
+}
+
+/**
+ * Show reverse debugging status
+ */
+static void Reverse_Info(void)
+{
+	size_t size = 0;
+	int i, items = 0;
+
+	if (!ReverseTracking) {
+		fprintf(stderr, "Reverse debugging is disabled.\n");
+		return;
+	}
+	fprintf(stderr, "Reverse debugging checkpoints (every %d frames, max %d):\n",
+		Reverse.interval, Reverse.max);
+	for (i = 0; i < Reverse.count; i++) {
+		fprintf(stderr, "%4d: instruction %"PRIu64", %zu KB\n",
+			i + 1, Reverse.cp[i].insn, Reverse.cp[i].size / 1024);
+		size += Reverse.cp[i].size;
+	}
+	for (i = 0; i < REVERSE_INPUT_TYPES; i++) {
+		items += Input.log[i].count;
+	}
+	fprintf(stderr, "Checkpoints take %zu KB, recorded inputs %d items + %u KB.\n",
+		size / 1024, items, Input.size / 1024);
+	fprintf(stderr, "Current position: instruction %"PRIu64", recorded up to %"PRIu64".\n",
+		Reverse.insn, Reverse.horizon);
+}
+
+/**
+ * Show error & return false if reverse execution is not possible
+ */
+static bool Reverse_Usable(void)
+{
+	if (!ReverseTracking) {
+		fprintf(stderr, "ERROR: reverse debugging is not enabled.\n");
+		return false;
+	}
+	if (Reverse_FindCheckpoint(Reverse.insn) < 0) {
+		fprintf(stderr, "ERROR: there are no checkpoints before current position.\n");
+		return false;
+	}
+	return true;
+}
+
+char *Reverse_Match(const char *text, int state)
+{
+	static const char* cmds[] = { "off", "on" };
+	return DebugUI_MatchHelper(cmds, ARRAY_SIZE(cmds), text, state);
+}
+
+const char Reverse_Description[] =
+	"[on [<frames> [<count>]] | off]\n"
+	"\tWithout arguments, show reverse debugging status.\n"
+	"\n"
+	"\t'on' enables taking in-memory emulation state checkpoints every\n"
+	"\t<frames> (default 50) frames, keeping <count> (default 10) latest\n"
+	"\tones, and recording host inputs (keyboard, mouse, joysticks, host\n"
+	"\ttime, GEMDOS HD file operations and queries) so that emulation\n"
+	"\tcan be replayed from them.  Each checkpoint takes a bit more memory\n"
+	"\tthan the emulated machine RAM.  'off' disables that and frees memory.";
+
+/**
+ * Command: enable/disable/show reverse debugging
+ */
+int Reverse_Command(int nArgc, char *psArgs[])
+{
+	int interval = REVERSE_INTERVAL_DEFAULT;
+	int max = REVERSE_CHECKPOINTS_DEFAULT;
+
+	if (nArgc < 2) {
+		Reverse_Info();
+		return DEBUGGER_CMDDONE;
+	}
+	if (nArgc == 2 && strcmp(psArgs[1], "off") == 0) {
+		if (ReverseTracking) {
+			Reverse_Disable();
+			fprintf(stderr, "Reverse debugging disabled.\n");
+		}
+		return DEBUGGER_CMDDONE;
+	}
+	if (nArgc > 4 || strcmp(psArgs[1], "on") != 0) {
+		return DebugUI_PrintCmdHelp(psArgs[0]);
+	}
+	if (nArgc > 2) {
+		interval = atoi(psArgs[2]);
+		if (interval <= 0) {
+			fprintf(stderr, "ERROR: invalid frame interval '%s'.\n", psArgs[2]);
+			return DEBUGGER_CMDDONE;
+		}
+	}
+	if (nArgc > 3) {
+		max = atoi(psArgs[3]);
+		if (max < 1 || max > REVERSE_CHECKPOINTS_MAX) {
+			fprintf(stderr, "ERROR: checkpoint count should be 1-%d.\n",
+				REVERSE_CHECKPOINTS_MAX);
+			return DEBUGGER_CMDDONE;
+		}
+	}
+	Reverse_Enable(interval, max);
+	return DEBUGGER_CMDDONE;
+}
+
+const char Reverse_StepDescription[] =
+	"[count]\n"
+	"\tStep given number (default 1) of CPU instructions backwards,\n"
+	"\tby restoring the nearest earlier checkpoint and replaying\n"
+	"\temulation from it.  Repeats on Enter.  Requires reverse\n"
+	"\tdebugging to be enabled with the 'reverse' command.";
+
+/**
+ * Command: step CPU backwards
+ */
+int Reverse_Step(int nArgc, char *psArgs[])
+{
+	Uint64 steps = 1, oldest;
+
+	if (nArgc > 2) {
+		return DebugUI_PrintCmdHelp(psArgs[0]);
+	}
+	if (nArgc == 2) {
+		int count = atoi(psArgs[1]);
+		if (count <= 0) {
+			fprintf(stderr, "ERROR: invalid step count '%s'.\n", psArgs[1]);
+			return DEBUGGER_CMDDONE;
+		}
+		steps = count;
+	}
+	if (!Reverse_Usable()) {
+		return DEBUGGER_CMDDONE;
+	}
+	/* replay needs to execute at least one instruction */
+	oldest = Reverse.cp[0].insn + 1;
+	if (Reverse.insn - oldest < steps) {
+		steps = Reverse.insn - oldest;
+		fprintf(stderr, "Oldest checkpoint limits stepping to %"PRIu64" instructions back.\n",
+			steps);
+		if (!steps) {
+			return DEBUGGER_CMDDONE;
+		}
+	}
+	Reverse_Seek(Reverse.insn - steps, REASON_CPU_STEPS);
+	return DEBUGGER_ENDCONT;
+}
+
+const char Reverse_ContinueDescription[] =
+	"\n"
+	"\tContinue CPU backwards to the previous point where any of the CPU\n"
+	"\tbreakpoints conditions matched, or if none matched since oldest\n"
+	"\tcheckpoint, stay at current position.  Tracing breakpoints and\n"
+	"\tones tracking value changes are ignored, as are breakpoint\n"
+	"\toptions and hit counts, and watchpoints.";
+
+/**
+ * Command: continue CPU backwards to previous breakpoint hit
+ */
+int Reverse_Continue(int nArgc, char *psArgs[])
+{
+	if (nArgc > 1) {
+		return DebugUI_PrintCmdHelp(psArgs[0]);
+	}
+	if (!Reverse_Usable()) {
+		return DEBUGGER_CMDDONE;
+	}
+	if (!BreakCond_CpuBreakPointCount()) {
+		fprintf(stderr, "ERROR: no CPU breakpoints set.\n");
+		return DEBUGGER_CMDDONE;
+	}
+	Reverse.mode = REVERSE_SEARCH;
+	Reverse.origin = Reverse.target = Reverse.insn;
+	Reverse.found = 0;
+	Reverse.search = Reverse_FindCheckpoint(Reverse.insn);
+	Reverse_RestoreCheckpoint(Reverse.search);
+	return DEBUGGER_END;
+}
@@ -0,0 +1,58 @@
+/*
+  Hatari - reverse.h
+
+  This file is distributed under the GNU General Public License, version 2
+  or at your option any later version. Read the file gpl.txt for details.
+*/
+
+#ifndef HATARI_REVERSE_H
+#define HATARI_REVERSE_H
+
+/* host inputs recorded for replay, JOYSTICK_COUNT is from configuration.h */
+typedef enum {
+	REVERSE_INPUT_KEY,	/* event: ST scancode, 0x80 bit set on release */
+	REVERSE_INPUT_MOUSE,	/* event: host mouse state data (ikbd.c) */
+	REVERSE_INPUT_JOY,	/* sample: joystick data, one per joystick */
+	REVERSE_INPUT_FIRE = REVERSE_INPUT_JOY + JOYSTICK_COUNT,  /* sample: joypad buttons */
+	REVERSE_INPUT_TIME = REVERSE_INPUT_FIRE + JOYSTICK_COUNT, /* sample: host time */
+	REVERSE_INPUT_FREAD,	/* event: GEMDOS file read result & data */
+	REVERSE_INPUT_FWRITE,	/* event: GEMDOS file write result */
+	REVERSE_INPUT_FHOST,	/* event: GEMDOS host file open/create/delete, Fsfirst etc result */
+	REVERSE_INPUT_TYPES
+} reverse_input_t;
+
+extern bool ReverseTracking;
+
+/* for input handling code */
+extern bool Reverse_IsReplaying(void);
+extern Sint64 Reverse_SampleDo(reverse_input_t type, Sint64 value);
+extern void Reverse_RecordEvent(reverse_input_t type, Sint64 value, const void *data, Uint32 len);
+extern bool Reverse_ReplayEvent(reverse_input_t type, Sint64 *value, void *data, Uint32 len);
+
+/**
+ * Return given host input value after recording it, or when
+ * replaying, the value that was recorded at this point
+ */
+static inline Sint64 Reverse_Sample(reverse_input_t type, Sint64 value)
+{
+	if (!ReverseTracking) {
+		return value;
+	}
+	return Reverse_SampleDo(type, value);
+}
+
+/* for video.c & memorySnapShot.c */
+extern void Reverse_Vbl(void);
+extern void Reverse_Restored(bool bOk);
+
+/* for debugcpu.c */
+extern bool Reverse_Check(void);
+extern const char Reverse_Description[];
+extern const char Reverse_StepDescription[];
+extern const char Reverse_ContinueDescription[];
+extern char *Reverse_Match(const char *text, int state);
+extern int Reverse_Command(int nArgc, char *psArgs[]);
+extern int Reverse_Step(int nArgc, char *psArgs[]);
+extern int Reverse_Continue(int nArgc, char *psArgs[]);
+
+#endif
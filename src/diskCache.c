@@ -0,0 +1,358 @@
+/*
+  Hatari - diskCache.c
+
+  This file is distributed under the GNU General Public License, version 2
+  or at your option any later version. Read the file gpl.txt for details.
+
+  Cache of unpacked floppy disk images.
+
+  Extracting disk images from ZIP archives or gzipped files (and decoding
+  MSA images inside them) is repeated each time such an image is inserted.
+  When a cache directory is configured (--disk-cache), the resulting disk
+  image is also saved there, and later inserts of the same image just read
+  it back. Cache file names are a hash of the image file path, its size and
+  modification time and the selected file inside a ZIP archive, so a
+  changed image gets a new cache entry. The whole key is also stored in the
+  cache file to detect hash collisions.
+
+  Cache files are touched when they're used, and the least recently used
+  ones are removed when the cache grows over its size limit. New cache
+  files are written under a temporary name and then renamed, so several
+  Hatari instances can share the same cache directory. Temporary files
+  left over from crashes are removed when the cache size is checked.
+*/
+const char DiskCache_fileid[] = "Hatari diskCache.c";
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "main.h"
+#if HAVE_UTIME_H
+#include <utime.h>
+#elif HAVE_SYS_UTIME_H
+#include <sys/utime.h>
+#endif
+
+#include "configuration.h"
+#include "diskCache.h"
+#include "file.h"
+#include "log.h"
+
+
+#define DISKCACHE_MAGIC		"HATARIDC"
+#define DISKCACHE_VERSION	1
+#define DISKCACHE_HEADER_SIZE	24	/* magic, version, image type, key length, reserved */
+#define DISKCACHE_EXT		".hdc"
+#define DISKCACHE_TMP_EXT	".tmp"
+#define DISKCACHE_TMP_MAX_AGE	(60*60)	/* secs, older temporary files are left from crashes */
+
+typedef struct
+{
+	char *pszName;
+	off_t nSize;
+	time_t nTime;
+} DISKCACHE_FILE;
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Create cache key for given image file and ZIP entry into pszKey.
+ * Return false if the image file doesn't exist.
+ */
+static bool DiskCache_MakeKey(const char *pszFileName, const char *pszZipPath,
+                              char *pszKey, size_t nKeyLen)
+{
+	struct stat st;
+
+	if (stat(pszFileName, &st) != 0)
+		return false;
+	snprintf(pszKey, nKeyLen, "%s\n%"PRId64"\n%"PRId64"\n%s", pszFileName,
+	         (int64_t)st.st_size, (int64_t)st.st_mtime, pszZipPath ? pszZipPath : "");
+	return true;
+}
+
+/**
+ * Return allocated cache file path for given key, or NULL on error
+ */
+static char *DiskCache_KeyToPath(const char *pszKey)
+{
+	Uint64 h1 = 14695981039346656037ULL, h2 = 5381;
+	char szName[40];
+
+	/* two independent 64-bit hashes, FNV-1a and djb2 */
+	for (; *pszKey; pszKey++)
+	{
+		h1 = (h1 ^ (Uint8)*pszKey) * 1099511628211ULL;
+		h2 = h2 * 33 + (Uint8)*pszKey;
+	}
+	snprintf(szName, sizeof(szName), "%016"PRIx64"%016"PRIx64, h1, h2);
+	return File_MakePath(ConfigureParams.DiskImage.szDiskCacheDirectory, szName, DISKCACHE_EXT);
+}
+
+static void DiskCache_PutLong(Uint8 *p, Uint32 val)
+{
+	p[0] = val >> 24;
+	p[1] = val >> 16;
+	p[2] = val >> 8;
+	p[3] = val;
+}
+
+static Uint32 DiskCache_GetLong(const Uint8 *p)
+{
+	return ((Uint32)p[0] << 24) | ((Uint32)p[1] << 16) | ((Uint32)p[2] << 8) | p[3];
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Return true if given disk image file is compressed, i.e. worth caching.
+ * Cache without a directory is treated as disabled, so that cache files
+ * don't end up in the current directory.
+ */
+bool DiskCache_IsCacheable(const char *pszFileName)
+{
+	return ConfigureParams.DiskImage.bUseDiskCache
+	       && ConfigureParams.DiskImage.szDiskCacheDirectory[0]
+	       && (File_DoesFileExtensionMatch(pszFileName, ".zip")
+	           || File_DoesFileExtensionMatch(pszFileName, ".gz"));
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Look up unpacked contents of given disk image (and file within a ZIP
+ * archive) from the cache. Return allocated buffer with the image and
+ * set its size and type, or return NULL if it's not in the cache.
+ */
+Uint8 *DiskCache_Load(const char *pszFileName, const char *pszZipPath,
+                      long *pImageSize, int *pImageType)
+{
+	char szKey[2*FILENAME_MAX + 64];
+	Uint8 header[DISKCACHE_HEADER_SIZE];
+	Uint8 *pBuffer = NULL;
+	char *pszPath, *pszStoredKey = NULL;
+	size_t nKeyLen;
+	off_t nFileSize;
+	long nSize;
+	FILE *fp;
+
+	if (!DiskCache_IsCacheable(pszFileName)
+	    || !DiskCache_MakeKey(pszFileName, pszZipPath, szKey, sizeof(szKey)))
+		return NULL;
+	pszPath = DiskCache_KeyToPath(szKey);
+	if (!pszPath)
+		return NULL;
+
+	nFileSize = File_Length(pszPath);
+	fp = nFileSize > 0 ? fopen(pszPath, "rb") : NULL;
+	if (!fp)
+	{
+		free(pszPath);
+		return NULL;
+	}
+
+	nKeyLen = strlen(szKey);
+	if (fread(header, sizeof(header), 1, fp) != 1
+	    || memcmp(header, DISKCACHE_MAGIC, 8) != 0
+	    || DiskCache_GetLong(header + 8) != DISKCACHE_VERSION
+	    || DiskCache_GetLong(header + 16) != nKeyLen)
+		goto out;
+
+	nSize = nFileSize - DISKCACHE_HEADER_SIZE - nKeyLen;
+	pszStoredKey = malloc(nKeyLen);
+	pBuffer = nSize > 0 ? malloc(nSize) : NULL;
+	if (!pszStoredKey || !pBuffer
+	    || fread(pszStoredKey, nKeyLen, 1, fp) != 1
+	    || memcmp(pszStoredKey, szKey, nKeyLen) != 0
+	    || fread(pBuffer, nSize, 1, fp) != 1)
+	{
+		free(pBuffer);
+		pBuffer = NULL;
+		goto out;
+	}
+
+	*pImageSize = nSize;
+	*pImageType = DiskCache_GetLong(header + 12);
+	/* mark as recently used */
+	utime(pszPath, NULL);
+	Log_Printf(LOG_DEBUG, "Disk image '%s' read from cache file '%s'.\n",
+	           pszFileName, pszPath);
+out:
+	fclose(fp);
+	free(pszStoredKey);
+	free(pszPath);
+	return pBuffer;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Sort cache files by last use, oldest first
+ */
+static int DiskCache_CompareTime(const void *a, const void *b)
+{
+	const DISKCACHE_FILE *fa = a, *fb = b;
+
+	if (fa->nTime != fb->nTime)
+		return fa->nTime < fb->nTime ? -1 : 1;
+	return strcmp(fa->pszName, fb->pszName);
+}
+
+/**
+ * Remove given temporary cache file if it's so old that it can't be
+ * in the middle of being written by some Hatari instance (i.e. that
+ * instance crashed or was killed before renaming it).
+ */
+static void DiskCache_RemoveStaleTmp(const char *pszPath)
+{
+	struct stat st;
+
+	if (stat(pszPath, &st) == 0 && time(NULL) - st.st_mtime > DISKCACHE_TMP_MAX_AGE
+	    && remove(pszPath) == 0)
+		Log_Printf(LOG_DEBUG, "Removed stale disk cache file '%s'.\n", pszPath);
+}
+
+/**
+ * Remove least recently used cache files until the cache size
+ * is within the configured limit.  Stale temporary files are
+ * removed too.
+ */
+static void DiskCache_Evict(void)
+{
+	const char *pszDir = ConfigureParams.DiskImage.szDiskCacheDirectory;
+	off_t nLimit = (off_t)ConfigureParams.DiskImage.nDiskCacheSize * 1024 * 1024;
+	DISKCACHE_FILE *files = NULL, *tmp;
+	int nFiles = 0, nMaxFiles = 0, i;
+	off_t nTotal = 0;
+	struct dirent *entry;
+	struct stat st;
+	char *pszPath;
+	DIR *dir;
+
+	dir = opendir(pszDir);
+	if (!dir)
+		return;
+	while ((entry = readdir(dir)))
+	{
+		if (File_DoesFileExtensionMatch(entry->d_name, DISKCACHE_TMP_EXT)
+		    && strstr(entry->d_name, DISKCACHE_EXT "."))
+		{
+			pszPath = File_MakePath(pszDir, entry->d_name, "");
+			if (!pszPath)
+				break;
+			DiskCache_RemoveStaleTmp(pszPath);
+			free(pszPath);
+			continue;
+		}
+		if (!File_DoesFileExtensionMatch(entry->d_name, DISKCACHE_EXT))
+			continue;
+		pszPath = File_MakePath(pszDir, entry->d_name, "");
+		if (!pszPath)
+			break;
+		if (stat(pszPath, &st) != 0)
+		{
+			free(pszPath);
+			continue;
+		}
+		if (nFiles == nMaxFiles)
+		{
+			nMaxFiles = nMaxFiles ? 2 * nMaxFiles : 64;
+			tmp = realloc(files, nMaxFiles * sizeof(*files));
+			if (!tmp)
+			{
+				free(pszPath);
+				break;
+			}
+			files = tmp;
+		}
+		files[nFiles].pszName = pszPath;
+		files[nFiles].nSize = st.st_size;
+		files[nFiles].nTime = st.st_mtime;
+		nTotal += st.st_size;
+		nFiles++;
+	}
+	closedir(dir);
+
+	if (nTotal > nLimit)
+	{
+		qsort(files, nFiles, sizeof(*files), DiskCache_CompareTime);
+		for (i = 0; i < nFiles && nTotal > nLimit; i++)
+		{
+			/* another Hatari instance may have removed it already */
+			if (remove(files[i].pszName) == 0 || errno == ENOENT)
+				nTotal -= files[i].nSize;
+			Log_Printf(LOG_DEBUG, "Removed disk cache file '%s'.\n", files[i].pszName);
+		}
+	}
+
+	for (i = 0; i < nFiles; i++)
+		free(files[i].pszName);
+	free(files);
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Save unpacked contents of given disk image (and file within a ZIP
+ * archive) to the cache.
+ */
+void DiskCache_Store(const char *pszFileName, const char *pszZipPath,
+                     const Uint8 *pBuffer, long nImageSize, int nImageType)
+{
+	char szKey[2*FILENAME_MAX + 64];
+	Uint8 header[DISKCACHE_HEADER_SIZE];
+	char *pszPath, *pszTmpPath;
+	size_t nKeyLen;
+	bool bOk;
+	FILE *fp;
+
+	if (!DiskCache_IsCacheable(pszFileName) || nImageSize <= 0
+	    || (off_t)nImageSize > (off_t)ConfigureParams.DiskImage.nDiskCacheSize * 1024 * 1024
+	    || !DiskCache_MakeKey(pszFileName, pszZipPath, szKey, sizeof(szKey)))
+		return;
+	pszPath = DiskCache_KeyToPath(szKey);
+	if (!pszPath)
+		return;
+	pszTmpPath = malloc(strlen(pszPath) + 32);
+	if (!pszTmpPath)
+	{
+		free(pszPath);
+		return;
+	}
+	/* unique name, in case other Hatari instances store the same image */
+	sprintf(pszTmpPath, "%s.%ld" DISKCACHE_TMP_EXT, pszPath, (long)getpid());
+
+	nKeyLen = strlen(szKey);
+	memset(header, 0, sizeof(header));
+	memcpy(header, DISKCACHE_MAGIC, 8);
+	DiskCache_PutLong(header + 8, DISKCACHE_VERSION);
+	DiskCache_PutLong(header + 12, nImageType);
+	DiskCache_PutLong(header + 16, nKeyLen);
+
+	fp = fopen(pszTmpPath, "wb");
+	bOk = fp
+	      && fwrite(header, sizeof(header), 1, fp) == 1
+	      && fwrite(szKey, nKeyLen, 1, fp) == 1
+	      && fwrite(pBuffer, nImageSize, 1, fp) == 1;
+	if (fp && fclose(fp) != 0)
+		bOk = false;
+
+	if (bOk && rename(pszTmpPath, pszPath) == 0)
+	{
+		Log_Printf(LOG_DEBUG, "Disk image '%s' saved to cache file '%s'.\n",
+		           pszFileName, pszPath);
+		DiskCache_Evict();
+	}
+	else
+	{
+		Log_Printf(LOG_WARN, "Failed to save disk image cache file '%s'.\n", pszPath);
+		remove(pszTmpPath);
+	}
+	free(pszTmpPath);
+	free(pszPath);
+}
@@ -90,6 +90,9 @@
 	Sampling frequency = selectable
 	Bass turnover = 118.276Hz    (8.2nF on LM1992 bass)
 	Treble turnover = 8438.756Hz (8.2nF on LM1992 treble)
+
+	The filter itself is in lmc1992.h ; it processes a whole block of
+	stereo samples at once, with both channels filtered in parallel.
 */
 
 
@@ -112,6 +115,7 @@ const char DmaSnd_fileid[] = "Hatari dmaSnd.c";
 #include "video.h"
 #include "m68000.h"
 #include "clocks_timings.h"
+#include "lmc1992.h"
 
 #define TONE_STEPS 13
 
@@ -123,8 +127,6 @@ const char DmaSnd_fileid[] = "Hatari dmaSnd.c";
 
 static void DmaSnd_Apply_LMC(int nMixBufIdx, int nSamplesToGenerate);
 static void DmaSnd_Set_Tone_Level(int set_bass, int set_treb);
-static float DmaSnd_IIRfilterL(float xn);
-static float DmaSnd_IIRfilterR(float xn);
 static struct first_order_s *DmaSnd_Treble_Shelf(float g, float fc, float Fs);
 static struct first_order_s *DmaSnd_Bass_Shelf(float g, float fc, float Fs);
 static Sint16 DmaSnd_LowPassFilterLeft(Sint16 in);
@@ -174,9 +176,7 @@ struct microwire_s {
 struct lmc1992_s {
 	struct first_order_s bass_table[TONE_STEPS];
 	struct first_order_s treb_table[TONE_STEPS];
-	float coef[5];			/* IIR coefficients */
-	float left_gain;
-	float right_gain;
+	struct lmc1992_biquad_s iir;	/* IIR coefficients, gains and state */
 };
 
 static struct dma_s dma;
@@ -522,7 +522,7 @@ static inline int DmaSnd_EndOfFrameReached(void)
  * DMA sound is 3/4 level of YM sound;
  * Divide by 4 to account for the STe YM volume table level;
  * ( STe sound at 1/2 amplitude to avoid overflow. )
- * ( lmc1992.right_gain and lmc1992.left_gain are  )
+ * ( lmc1992.iir.gain[] left and right values are )
  * ( doubled to compensate. )
  * Divide by 4 to account for DmaSnd_LowPassFilter;
  * Multiply DMA sound by -1 because the LMC1992 inverts the signal
@@ -675,6 +675,54 @@ void DmaSnd_GenerateSamples(int nMixBufIdx, int nSamplesToGenerate)
 }
 
 
+/*-----------------------------------------------------------------------*/
+/**
+ * Same as DmaSnd_GenerateSamples(), but without producing any output :
+ * only pull from the FIFO the bytes that would have been played during
+ * nSamplesToGenerate samples, so that frame counter, end of frame
+ * interrupts and XSINT line are exactly the same.
+ * Anti-alias and LMC1992 filters are not updated (their state will
+ * settle again within a few samples).
+ */
+void DmaSnd_SkipSamples(int nSamplesToGenerate)
+{
+	Sint8 LeftByte = 0, RightByte = 0;
+	Sint64 FreqRatio;
+	Sint64 nFrames;
+
+	/* DMA Audio OFF and FIFO empty : nothing to do */
+	if ( !(nDmaSoundControl & DMASNDCTRL_PLAY) && ( dma.FIFO_NbBytes == 0 ) )
+		return;
+
+	DmaSnd_LowPass = ( DmaSnd_DetectSampleRate() > nAudioFrequency );
+
+	/* Number of frames (mono or stereo bytes) to pull during these samples */
+	FreqRatio = ( ((Sint64)DmaSnd_DetectSampleRate()) << 32 ) / nAudioFrequency;
+	frameCounter_float += FreqRatio * nSamplesToGenerate;
+	nFrames = frameCounter_float >> 32;
+	frameCounter_float &= 0xffffffff;			/* only keep the fractional part */
+
+	if ( DmaInitSample )
+	{
+		nFrames++;
+		DmaInitSample = false;
+	}
+	if ( nFrames == 0 )
+		return;
+
+	while ( nFrames-- > 0 )
+	{
+		LeftByte = DmaSnd_FIFO_PullByte ();
+		if (dma.soundMode & DMASNDMODE_MONO)
+			RightByte = LeftByte;
+		else
+			RightByte = DmaSnd_FIFO_PullByte ();
+	}
+	dma.FrameLeft  = DmaSnd_LowPassFilterLeft( (Sint16)LeftByte );
+	dma.FrameRight = DmaSnd_LowPassFilterRight( (Sint16)RightByte );
+}
+
+
 /*-----------------------------------------------------------------------*/
 /**
  * Apply LMC1992 sound modifications (Bass and Treble)
@@ -684,27 +732,23 @@ void DmaSnd_GenerateSamples(int nMixBufIdx, int nSamplesToGenerate)
 static void DmaSnd_Apply_LMC(int nMixBufIdx, int nSamplesToGenerate)
 {
 	int nBufIdx;
-	int i;
-	Sint32 sample;
-
-	/* Apply LMC1992 sound modifications (Left, Right and Master Volume) */
-	for (i = 0; i < nSamplesToGenerate; i++) {
-		nBufIdx = (nMixBufIdx + i) & AUDIOMIXBUFFER_SIZE_MASK;
-
-		sample = DmaSnd_IIRfilterL( Subsonic_IIR_HPF_Left( AudioMixBuffer[nBufIdx][0]));
-		if (sample<-32767)						/* check for overflow to clip waveform */
-			sample = -32767;
-		else if (sample>32767)
-			sample = 32767;
-		AudioMixBuffer[nBufIdx][0] = sample;
-
-		sample = DmaSnd_IIRfilterR( Subsonic_IIR_HPF_Right(AudioMixBuffer[nBufIdx][1]));
-		if (sample<-32767)						/* check for overflow to clip waveform */
-			sample = -32767;
-		else if (sample>32767)
-			sample = 32767;
-		AudioMixBuffer[nBufIdx][1] = sample;
- 	}
+	int nLen;
+
+	/* Process the ring buffer in (at most 2) contiguous blocks */
+	nBufIdx = nMixBufIdx & AUDIOMIXBUFFER_SIZE_MASK;
+	while (nSamplesToGenerate > 0)
+	{
+		nLen = AUDIOMIXBUFFER_SIZE - nBufIdx;
+		if (nLen > nSamplesToGenerate)
+			nLen = nSamplesToGenerate;
+
+		Subsonic_IIR_HPF_Stereo(&AudioMixBuffer[nBufIdx], nLen);
+		/* Apply LMC1992 sound modifications (Left, Right and Master Volume) */
+		LMC1992_FilterBlock(&lmc1992.iir, &AudioMixBuffer[nBufIdx], nLen);
+
+		nSamplesToGenerate -= nLen;
+		nBufIdx = 0;
+	}
 }
 
 
@@ -1143,20 +1187,20 @@ void DmaSnd_InterruptHandler_Microwire(void)
 				/* Master volume command */
 				LOG_TRACE ( TRACE_DMASND, "Microwire new master volume=0x%x\n", cmd & 0x3f );
 				microwire.masterVolume = LMC1992_Master_Volume_Table[ cmd & 0x3f ];
-				lmc1992.left_gain = (microwire.leftVolume * (Uint32)microwire.masterVolume) * (2.0/(65536.0*65536.0));
-				lmc1992.right_gain = (microwire.rightVolume * (Uint32)microwire.masterVolume) * (2.0/(65536.0*65536.0));
+				lmc1992.iir.gain[0] = (microwire.leftVolume * (Uint32)microwire.masterVolume) * (2.0/(65536.0*65536.0));
+				lmc1992.iir.gain[1] = (microwire.rightVolume * (Uint32)microwire.masterVolume) * (2.0/(65536.0*65536.0));
 				break;
 			case 4:
 				/* Right channel volume */
 				LOG_TRACE ( TRACE_DMASND, "Microwire new right volume=0x%x\n", cmd & 0x1f );
 				microwire.rightVolume = LMC1992_LeftRight_Volume_Table[ cmd & 0x1f ];
-				lmc1992.right_gain = (microwire.rightVolume * (Uint32)microwire.masterVolume) * (2.0/(65536.0*65536.0));
+				lmc1992.iir.gain[1] = (microwire.rightVolume * (Uint32)microwire.masterVolume) * (2.0/(65536.0*65536.0));
 				break;
 			case 5:
 				/* Left channel volume */
 				LOG_TRACE ( TRACE_DMASND, "Microwire new left volume=0x%x\n", cmd & 0x1f );
 				microwire.leftVolume = LMC1992_LeftRight_Volume_Table[ cmd & 0x1f ];
-				lmc1992.left_gain = (microwire.leftVolume * (Uint32)microwire.masterVolume) * (2.0/(65536.0*65536.0));
+				lmc1992.iir.gain[0] = (microwire.leftVolume * (Uint32)microwire.masterVolume) * (2.0/(65536.0*65536.0));
 				break;
 			default:
 				/* Do nothing */
@@ -1250,59 +1294,6 @@ void DmaSnd_MicrowireMask_WriteWord(void)
 
 /*-------------------Bass / Treble filter ---------------------------*/
 
-/**
- * Left voice Filter for Bass/Treble.
- */
-static float DmaSnd_IIRfilterL(float xn)
-{
-	static float data[2] = { 0.0, 0.0 };
-	float a, yn;
-
-	/* Input coefficients */
-	/* biquad1  Note: 'a' coefficients are subtracted */
-	a  = lmc1992.left_gain * xn;		/* a=g*xn;               */
-	a -= lmc1992.coef[0] * data[0];		/* a1;  wn-1             */
-	a -= lmc1992.coef[1] * data[1];		/* a2;  wn-2             */
-						/* If coefficient scale  */
-						/* factor = 0.5 then     */
-						/* multiply by 2         */
-	/* Output coefficients */
-	yn  = lmc1992.coef[2] * a;		/* b0;                   */
-	yn += lmc1992.coef[3] * data[0];	/* b1;                   */
-	yn += lmc1992.coef[4] * data[1];	/* b2;                   */
-
-	data[1] = data[0];			/* wn-1 -> wn-2;         */
-	data[0] = a;				/* wn -> wn-1            */
-	return yn;
-}
-
-
-/**
- * Right voice Filter for Bass/Treble.
- */
-static float DmaSnd_IIRfilterR(float xn)
-{
-	static float data[2] = { 0.0, 0.0 };
-	float a, yn;
-
-	/* Input coefficients */
-	/* biquad1  Note: 'a' coefficients are subtracted */
-	a  = lmc1992.right_gain * xn;		/* a=g*xn;               */
-	a -= lmc1992.coef[0]*data[0];		/* a1;  wn-1             */
-	a -= lmc1992.coef[1]*data[1];		/* a2;  wn-2             */
-						/* If coefficient scale  */
-						/* factor = 0.5 then     */
-						/* multiply by 2         */
-	/* Output coefficients */
-	yn  = lmc1992.coef[2]*a;		/* b0;                   */
-	yn += lmc1992.coef[3]*data[0];		/* b1;                   */
-	yn += lmc1992.coef[4]*data[1];		/* b2;                   */
-
-	data[1] = data[0];			/* wn-1 -> wn-2;         */
-	data[0] = a;				/* wn -> wn-1            */
-	return yn;
-}
-
 /**
  * LowPass Filter Left
  */
@@ -1347,12 +1338,12 @@ static Sint16 DmaSnd_LowPassFilterRight(Sint16 in)
 static void DmaSnd_Set_Tone_Level(int set_bass, int set_treb)
 { 
 	/* 13 levels; 0 through 12 correspond with -12dB to 12dB in 2dB steps */
-	lmc1992.coef[0] = lmc1992.treb_table[set_treb].a1 + lmc1992.bass_table[set_bass].a1;
-	lmc1992.coef[1] = lmc1992.treb_table[set_treb].a1 * lmc1992.bass_table[set_bass].a1;
-	lmc1992.coef[2] = lmc1992.treb_table[set_treb].b0 * lmc1992.bass_table[set_bass].b0;
-	lmc1992.coef[3] = lmc1992.treb_table[set_treb].b0 * lmc1992.bass_table[set_bass].b1 +
+	lmc1992.iir.coef[0] = lmc1992.treb_table[set_treb].a1 + lmc1992.bass_table[set_bass].a1;
+	lmc1992.iir.coef[1] = lmc1992.treb_table[set_treb].a1 * lmc1992.bass_table[set_bass].a1;
+	lmc1992.iir.coef[2] = lmc1992.treb_table[set_treb].b0 * lmc1992.bass_table[set_bass].b0;
+	lmc1992.iir.coef[3] = lmc1992.treb_table[set_treb].b0 * lmc1992.bass_table[set_bass].b1 +
 			  lmc1992.treb_table[set_treb].b1 * lmc1992.bass_table[set_bass].b0;
-	lmc1992.coef[4] = lmc1992.treb_table[set_treb].b1 * lmc1992.bass_table[set_bass].b1;
+	lmc1992.iir.coef[4] = lmc1992.treb_table[set_treb].b1 * lmc1992.bass_table[set_bass].b1;
 }
 
 
@@ -1451,8 +1442,8 @@ void DmaSnd_Init_Bass_and_Treble_Tables(void)
 			      LMC1992_Bass_Treble_Table[microwire.treble & 0xf]);
 
 	/* Initialize IIR Filter Gain and use as a Volume Control */
-	lmc1992.left_gain = (microwire.leftVolume * (Uint32)microwire.masterVolume) * (2.0/(65536.0*65536.0));
-	lmc1992.right_gain = (microwire.rightVolume * (Uint32)microwire.masterVolume) * (2.0/(65536.0*65536.0));
+	lmc1992.iir.gain[0] = (microwire.leftVolume * (Uint32)microwire.masterVolume) * (2.0/(65536.0*65536.0));
+	lmc1992.iir.gain[1] = (microwire.rightVolume * (Uint32)microwire.masterVolume) * (2.0/(65536.0*65536.0));
 }
 
 
@@ -108,10 +108,12 @@ const char crossbar_fileid[] = "Hatari Crossbar.c";
 #include "stMemory.h"
 #include "dsp.h"
 #include "clocks_timings.h"
+#include "crossbarMix.h"
 
 
 
 #define DACBUFFER_SIZE    2048
+#define CROSSBAR_MIX_BLOCK 256		/* Number of samples mixed at once by Crossbar_GenerateSamples */
 #define DECIMAL_PRECISION 65536
 
 
@@ -1861,16 +1863,11 @@ static void Crossbar_SendDataToDAC(Sint16 value, Uint16 sample_pos)
  */
 void Crossbar_GenerateSamples(int nMixBufIdx, int nSamplesToGenerate)
 {
-	int i, nBufIdx;
-	int n;
-	Sint16 adc_leftData, adc_rightData, dac_LeftData, dac_RightData;
-	Sint16 dac_read_left, dac_read_right;
-
-//fprintf ( stderr , "gen %03x %03x %03x %03x\n" , dac.writePosition , dac.readPosition , (dac.writePosition-dac.readPosition)%DACBUFFER_SIZE , nSamplesToGenerate );
-//fprintf ( stderr,  "codecAdcInput %d wordCount %d codecInputSource %d\n" , crossbar.codecAdcInput, dac.wordCount, crossbar.codecInputSource);
-//Uint32 read_pos_in = dac.readPosition;
-//Uint64 read_pos_float_in = dac.readPosition_float;
-//fprintf ( stderr , "gen_in read_pos=%d read_pos_f=%lx ratio=%lx\n" , read_pos_in,read_pos_float_in,crossbar.frequence_ratio );
+	Sint16 adcBuf[CROSSBAR_MIX_BLOCK][2], dacBuf[CROSSBAR_MIX_BLOCK][2];
+	Sint16 (*pAdc)[2], (*pMix)[2];
+	Uint16 gain[2], attenuation[2];
+	bool bNeedAdc, bNeedMic, bNeedDac;
+	int i, nBufIdx, nLen;
 
 	if (crossbar.isDacMuted) {
 		/* Output sound = 0 */
@@ -1886,115 +1883,111 @@ void Crossbar_GenerateSamples(int nMixBufIdx, int nSamplesToGenerate)
 		return;
 	}
 
-	for (i = 0; i < nSamplesToGenerate; i++)
+	/* Resolve the crossbar routing once for all the samples */
+	bNeedAdc = crossbar.codecInputSource == CROSSBAR_CODEC_INPUT_ADC
+	        || crossbar.codecInputSource == CROSSBAR_CODEC_INPUT_BOTH;
+	bNeedMic = bNeedAdc && crossbar.codecAdcInput != 3;
+	/* If DAC didn't receive any data, we force left/right value to 0 */
+	bNeedDac = dac.wordCount != 0;
+	if (!bNeedDac)
+		memset(dacBuf, 0, sizeof(dacBuf));
+
+	gain[0] = crossbar.gainSettingLeft;
+	gain[1] = crossbar.gainSettingRight;
+	attenuation[0] = crossbar.attenuationSettingLeft;
+	attenuation[1] = crossbar.attenuationSettingRight;
+
+	while (nSamplesToGenerate > 0)
 	{
-		nBufIdx = (nMixBufIdx + i) & AUDIOMIXBUFFER_SIZE_MASK;
-
-		/* ADC mixing (PSG sound or microphone sound for left and right channels) */
-		switch (crossbar.codecAdcInput) {
-			case 0:
-			default: /* Just here to remove compiler's warnings */
-				/* Microphone sound for left and right channels */
-				adc_leftData = adc.buffer_left[crossbar.adc2dac_readBufferPosition];
-				adc_rightData = adc.buffer_right[crossbar.adc2dac_readBufferPosition];
-				break;
+		/* Process contiguous parts of AudioMixBuffer, in place */
+		nBufIdx = nMixBufIdx & AUDIOMIXBUFFER_SIZE_MASK;
+		nLen = nSamplesToGenerate;
+		if (nLen > CROSSBAR_MIX_BLOCK)
+			nLen = CROSSBAR_MIX_BLOCK;
+		if (nLen > AUDIOMIXBUFFER_SIZE - nBufIdx)
+			nLen = AUDIOMIXBUFFER_SIZE - nBufIdx;
+		pMix = &AudioMixBuffer[nBufIdx];
+
+		/* Crossbar DAC input, with update of dac's buffer read pointer */
+		Crossbar_ReadRingBlock(bNeedDac ? dacBuf : NULL,
+				       dac.buffer_left, dac.buffer_right, DACBUFFER_SIZE - 1,
+				       &dac.readPosition, &dac.readPosition_float,
+				       crossbar.frequence_ratio, nLen);
+
+		/* ADC input (microphone sound for left and/or right channels),
+		 * with update of adc->dac's buffer read pointer */
+		Crossbar_ReadRingBlock(bNeedMic ? adcBuf : NULL,
+				       adc.buffer_left, adc.buffer_right, DACBUFFER_SIZE - 1,
+				       &crossbar.adc2dac_readBufferPosition,
+				       &crossbar.adc2dac_readBufferPosition_float,
+				       crossbar.frequence_ratio, nLen);
+
+		/* ADC mixing (PSG sound replaces microphone sound in the selected channels) */
+		pAdc = adcBuf;
+		if (bNeedAdc) {
+			switch (crossbar.codecAdcInput) {
 			case 1:
 				/* Microphone sound for left channel, PSG sound for right channel */
-				adc_leftData = adc.buffer_left[crossbar.adc2dac_readBufferPosition];
-				adc_rightData = AudioMixBuffer[nBufIdx][1];
+				for (i = 0; i < nLen; i++)
+					adcBuf[i][1] = pMix[i][1];
 				break;
 			case 2:
 				/* PSG sound for left channel, microphone sound for right channel */
-				adc_leftData = AudioMixBuffer[nBufIdx][0];
-				adc_rightData = adc.buffer_right[crossbar.adc2dac_readBufferPosition];
+				for (i = 0; i < nLen; i++)
+					adcBuf[i][0] = pMix[i][0];
 				break;
 			case 3:
 				/* PSG sound for left and right channels */
-				adc_leftData = AudioMixBuffer[nBufIdx][0];
-				adc_rightData = AudioMixBuffer[nBufIdx][1];
-				break;
-		}
-
-		/* DAC mixing (direct ADC + crossbar) */
-		/* If DAC didn't receive any data, we force left/right value to 0 */
-		if ( dac.wordCount == 0 )			/* Nothing received */
-		{
-			dac_read_left = 0;
-			dac_read_right = 0;
-		}
-		else
-		{
-			dac_read_left = dac.buffer_left[dac.readPosition];
-			dac_read_right = dac.buffer_right[dac.readPosition];
-		}
-		switch (crossbar.codecInputSource) {
-			case 0:
-			default: /* Just here to remove compiler's warnings */
-				/* No sound */
-				dac_LeftData  = 0;
-				dac_RightData = 0;
+				pAdc = pMix;
 				break;
-			case 1:
-				/* direct ADC->DAC sound only ADC*4/65536 */
-				dac_LeftData = (adc_leftData * crossbar.gainSettingLeft) >> 14;
-				dac_RightData = (adc_rightData * crossbar.gainSettingRight) >> 14;
-				break;
-			case 2:
-				/* Crossbar->DAC sound only */
-				dac_LeftData = dac_read_left;
-				dac_RightData = dac_read_right;
-				break;
-			case 3:
-				/* Mixing Direct ADC sound with Crossbar->DMA sound */
-				dac_LeftData = ((adc_leftData * crossbar.gainSettingLeft) >> 14) +
-						dac_read_left;
-				dac_RightData = ((adc_rightData * crossbar.gainSettingRight) >> 14) +
-						dac_read_right;
-				break;
-		}
-
-		AudioMixBuffer[nBufIdx][0] = (dac_LeftData * crossbar.attenuationSettingLeft) >> 16;
-		AudioMixBuffer[nBufIdx][1] = (dac_RightData * crossbar.attenuationSettingRight) >> 16;
-
-		/* Upgrade dac's buffer read pointer */
-		dac.readPosition_float += crossbar.frequence_ratio;
-		n = dac.readPosition_float >> 32;				/* number of samples to skip */
-
-#if 0
-		if (n) {
-			// It becomes safe to zero old data if tail has moved
-			for (j=0; j<n; j++) {
-				dac.buffer_left[(dac.readPosition+j) % DACBUFFER_SIZE] = 0;
-				dac.buffer_right[(dac.readPosition+j) % DACBUFFER_SIZE] = 0;
 			}
 		}
-#endif
 
-		dac.readPosition = (dac.readPosition + n) % DACBUFFER_SIZE;
-		dac.readPosition_float &= 0xffffffff;			/* only keep the fractional part */
-//read_pos_float_in += crossbar.frequence_ratio;
-//fprintf ( stderr , "gen_one i=%d read_pos=%x read_pos_f=%lx ratio=%lx n=%d read_pos_f_total=%lx\n" , i, dac.readPosition,dac.readPosition_float,crossbar.frequence_ratio, n, read_pos_float_in );
+		/* DAC mixing (direct ADC + crossbar) and attenuation */
+		Crossbar_MixBlock(pMix, (const Sint16 (*)[2])pAdc, (const Sint16 (*)[2])dacBuf,
+				  nLen, crossbar.codecInputSource, gain, attenuation);
 
-		/* Upgrade adc->dac's buffer read pointer */
-		crossbar.adc2dac_readBufferPosition_float += crossbar.frequence_ratio;
-		n = crossbar.adc2dac_readBufferPosition_float >> 32;				/* number of samples to skip */
-		crossbar.adc2dac_readBufferPosition = (crossbar.adc2dac_readBufferPosition + n) % DACBUFFER_SIZE;
-		crossbar.adc2dac_readBufferPosition_float &= 0xffffffff;			/* only keep the fractional part */
+		nMixBufIdx += nLen;
+		nSamplesToGenerate -= nLen;
 	}
 
-//fprintf ( stderr , "gen_out read_pos_delta=%x\n" , dac.readPosition-read_pos_in );
-
 	/* If the DAC didn't receive any data since last call to Crossbar_GenerateSamples() */
 	/* then we need to adjust dac.writePosition to be always ahead of dac.readPosition */
 	if ( dac.wordCount == 0 )
 	{
-//		fprintf ( stderr , "fix writepos %x (readpos %x)\n" , (dac.readPosition+DACBUFFER_SIZE/2)%DACBUFFER_SIZE , dac.readPosition );
 		dac.writePosition = (dac.readPosition+DACBUFFER_SIZE/2)%DACBUFFER_SIZE;
 	}
 	dac.wordCount = 0;
 }
 
 
+/**
+ * Same as Crossbar_GenerateSamples(), but without producing any output :
+ * only update the DAC and ADC read positions for nSamplesToGenerate samples.
+ * (Called by sound.c when sound synthesis is skipped)
+ */
+void Crossbar_SkipSamples(int nSamplesToGenerate)
+{
+	if (crossbar.isDacMuted) {
+		dac.readPosition = (dac.writePosition-DACBUFFER_SIZE/2)%DACBUFFER_SIZE;
+		crossbar.adc2dac_readBufferPosition = adc.writePosition;
+		return;
+	}
+
+	Crossbar_ReadRingBlock(NULL, dac.buffer_left, dac.buffer_right, DACBUFFER_SIZE - 1,
+			       &dac.readPosition, &dac.readPosition_float,
+			       crossbar.frequence_ratio, nSamplesToGenerate);
+	Crossbar_ReadRingBlock(NULL, adc.buffer_left, adc.buffer_right, DACBUFFER_SIZE - 1,
+			       &crossbar.adc2dac_readBufferPosition,
+			       &crossbar.adc2dac_readBufferPosition_float,
+			       crossbar.frequence_ratio, nSamplesToGenerate);
+
+	if ( dac.wordCount == 0 )
+		dac.writePosition = (dac.readPosition+DACBUFFER_SIZE/2)%DACBUFFER_SIZE;
+	dac.wordCount = 0;
+}
+
+
 /**
  * display the Crossbar registers values (for debugger info command)
  */
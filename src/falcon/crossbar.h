@@ -27,6 +27,7 @@ void Crossbar_Compute_Ratio(void);
 
 /* Called by mfp.c */
 extern void Crossbar_GenerateSamples(int nMixBufIdx, int nSamplesToGenerate);
+extern void Crossbar_SkipSamples(int nSamplesToGenerate);
 
 /* Called by m68000.c */
 extern void Crossbar_Recalculate_Clocks_Cycles(void);
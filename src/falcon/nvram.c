@@ -60,6 +60,7 @@ const char NvRam_fileid[] = "Hatari nvram.c";
 #include "log.h"
 #include "nvram.h"
 #include "paths.h"
+#include "reverse.h"
 #include "tos.h"
 #include "vdi.h"
 
@@ -361,8 +362,8 @@ static struct tm* refreshFrozenTime(bool refresh)
 
 	if (refresh)
 	{
-		/* update frozen time */
-		time_t tim = time(NULL);
+		/* update frozen time (recorded for reverse debugging replay) */
+		time_t tim = Reverse_Sample(REVERSE_INPUT_TIME, time(NULL));
 		frozen_time = *localtime(&tim);
 	}
 	return &frozen_time;
@@ -2647,6 +2647,190 @@ static int FDC_UpdateStepCmd ( void )
 }
 
 
+/*-----------------------------------------------------------------------*/
+/**
+ * Return true if the current type II command can be done in "turbo" mode :
+ * all sectors are transferred at once using DMA without any of the usual
+ * delays (spin up, head settle, search for the ID field and per byte timings)
+ * and the command completes immediately.
+ * This is only possible with ST/MSA/DIM images, which have a standard track
+ * layout, else we use the accurate emulation (for STX images, and also in case
+ * of missing drive/floppy or density / head mismatch, which must wait or fail
+ * with the usual timings)
+ */
+static bool FDC_Turbo_Possible ( void )
+{
+	int	Drive = FDC.DriveSelSignal;
+
+	if ( !ConfigureParams.DiskImage.bTurboFloppy )
+		return false;
+
+	if ( ( Drive < 0 ) || ( !FDC_DRIVES[ Drive ].Enabled ) || ( !FDC_DRIVES[ Drive ].DiskInserted ) )
+		return false;
+
+	if ( ( EmulationDrives[ Drive ].ImageType != FLOPPY_IMAGE_TYPE_ST )
+	  && ( EmulationDrives[ Drive ].ImageType != FLOPPY_IMAGE_TYPE_MSA )
+	  && ( EmulationDrives[ Drive ].ImageType != FLOPPY_IMAGE_TYPE_DIM ) )
+		return false;
+
+	if ( ( FDC.SideSignal == 1 ) && ( FDC_DRIVES[ Drive ].NumberOfHeads == 1 ) )
+		return false;
+
+	if ( FDC_DRIVES[ Drive ].HeadTrack >= FDC_GetTracksPerDisk ( Drive ) )
+		return false;
+
+	return FDC_MachineHandleDensity ( Drive );
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Transfer 'Size' bytes read from disk to RAM in "turbo" mode.
+ * When the DMA FIFO is empty, data are copied directly to RAM by blocks
+ * of FDC_DMA_FIFO_SIZE bytes, updating DMA address and sector count in
+ * the same way as FDC_DMA_FIFO_Push() would do (but without stalling the CPU).
+ * Remaining bytes (if DMA sector count reaches 0) go through FDC_DMA_FIFO_Push().
+ */
+static void FDC_DMA_Turbo_Push ( const Uint8 *pData , int Size )
+{
+	Uint32	Address;
+	int	Chunk;
+
+	while ( ( FDC_DMA.FIFO_Size == 0 ) && ( FDC_DMA.SectorCount > 0 ) )
+	{
+		/* Copy up to the end of the current DMA sector */
+		Chunk = FDC_DMA.BytesInSector;
+		if ( Chunk > Size )
+			Chunk = Size & ~( FDC_DMA_FIFO_SIZE - 1 );
+		if ( Chunk < FDC_DMA_FIFO_SIZE )
+			break;
+
+		Address = FDC_GetDMAAddress();
+		STMemory_SafeCopy ( Address , pData , Chunk , "FDC DMA turbo push" );
+		FDC_WriteDMAAddress ( Address + Chunk );
+		FDC_SetDMAStatus ( false );				/* No DMA error (bit 0) */
+
+		/* Store the last word that was just transferred by the DMA */
+		FDC_DMA.ff8604_recent_val = ( pData[ Chunk-2 ] << 8 ) | pData[ Chunk-1 ];
+
+		/* Update Sector Count */
+		FDC_DMA.BytesInSector -= Chunk;
+		if ( FDC_DMA.BytesInSector <= 0 )
+		{
+			FDC_DMA.SectorCount--;
+			FDC_DMA.BytesInSector = FDC_DMA_SECTOR_SIZE;
+		}
+
+		pData += Chunk;
+		Size -= Chunk;
+	}
+
+	while ( Size-- > 0 )
+		FDC_DMA_FIFO_Push ( *pData++ );
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Run a complete 'READ SECTOR/S' command in "turbo" mode.
+ * As with the accurate emulation, a multi sector read stops with RNF
+ * when there's no more sector on the track.
+ */
+static int FDC_Turbo_ReadSectors ( void )
+{
+	int	FrameCycles, HblCounterVideo, LineCycles;
+	int	Drive = FDC.DriveSelSignal;
+	Uint8	Track = FDC_DRIVES[ Drive ].HeadTrack;
+	Uint8	*pSectorData;
+	int	SectorSize;
+
+	Video_GetPosition ( &FrameCycles , &HblCounterVideo , &LineCycles );
+
+	FDC_Set_MotorON ( FDC.CR );					/* No spin up / head settle delays */
+	FDC.ReplaceCommandPossible = false;
+	FDC_Update_STR ( FDC_STR_BIT_RECORD_TYPE , 0 );			/* Always 0 for ST/MSA */
+
+	while ( true )
+	{
+		/* ID field's track must match TR, and the sector must exist */
+		if ( ( FDC.TR != Track )
+		  || !Floppy_ReadSectors ( Drive , &pSectorData , FDC.SR , Track , FDC.SideSignal , 1 , NULL , &SectorSize ) )
+		{
+			LOG_TRACE(TRACE_FDC, "fdc type II read sector=%d track=0x%x side=%d drive=%d turbo RNF VBL=%d video_cyc=%d %d@%d pc=%x\n",
+				  FDC.SR , Track , FDC.SideSignal , Drive , nVBLs, FrameCycles, LineCycles, HblCounterVideo, M68000_GetPC());
+			FDC_Update_STR ( 0 , FDC_STR_BIT_RNF );
+			break;
+		}
+
+		LOG_TRACE(TRACE_FDC, "fdc read sector turbo addr=0x%x drive=%d track=%d sect=%d side=%d VBL=%d video_cyc=%d %d@%d pc=%x\n" ,
+			FDC_GetDMAAddress(), Drive, Track, FDC.SR, FDC.SideSignal,
+			nVBLs , FrameCycles, LineCycles, HblCounterVideo , M68000_GetPC() );
+
+		FDC_DMA_Turbo_Push ( pSectorData , SectorSize );
+
+		if ( ( FDC.CR & FDC_COMMAND_BIT_MULTIPLE_SECTOR ) == 0 )
+			break;
+		FDC.SR++;						/* Try to read next sector and set RNF if not possible */
+	}
+
+	return FDC_CmdCompleteCommon( true );
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Run a complete 'WRITE SECTOR/S' command in "turbo" mode.
+ * Write protection was already checked by the caller.
+ */
+static int FDC_Turbo_WriteSectors ( void )
+{
+	int	FrameCycles, HblCounterVideo, LineCycles;
+	int	Drive = FDC.DriveSelSignal;
+	Uint8	Track = FDC_DRIVES[ Drive ].HeadTrack;
+	Uint8	SectorData[ 1024 ];					/* max sector size for WD1772 */
+	Uint8	*pSectorData;
+	int	SectorSize;
+	int	i;
+
+	Video_GetPosition ( &FrameCycles , &HblCounterVideo , &LineCycles );
+
+	FDC_Set_MotorON ( FDC.CR );					/* No spin up / head settle delays */
+	FDC.ReplaceCommandPossible = false;
+
+	while ( true )
+	{
+		/* ID field's track must match TR, and the sector must exist */
+		if ( ( FDC.TR != Track )
+		  || !Floppy_ReadSectors ( Drive , &pSectorData , FDC.SR , Track , FDC.SideSignal , 1 , NULL , &SectorSize ) )
+		{
+			LOG_TRACE(TRACE_FDC, "fdc type II write sector=%d track=0x%x side=%d drive=%d turbo RNF VBL=%d video_cyc=%d %d@%d pc=%x\n",
+				  FDC.SR , Track , FDC.SideSignal , Drive , nVBLs, FrameCycles, LineCycles, HblCounterVideo, M68000_GetPC());
+			FDC_Update_STR ( 0 , FDC_STR_BIT_RNF );
+			break;
+		}
+
+		LOG_TRACE(TRACE_FDC, "fdc write sector turbo addr=0x%x drive=%d track=%d sect=%d side=%d VBL=%d video_cyc=%d %d@%d pc=%x\n" ,
+			FDC_GetDMAAddress(), Drive, Track, FDC.SR, FDC.SideSignal,
+			nVBLs , FrameCycles, LineCycles, HblCounterVideo , M68000_GetPC() );
+
+		for ( i=0 ; i<SectorSize ; i++ )
+			SectorData[ i ] = FDC_DMA_FIFO_Pull ();		/* Get 1 byte from the DMA FIFO */
+
+		if ( !Floppy_WriteSectors ( Drive , SectorData , FDC.SR , Track , FDC.SideSignal , 1 , NULL , NULL ) )
+		{
+			FDC_Update_STR ( 0 , FDC_STR_BIT_RNF );
+			break;
+		}
+
+		if ( ( FDC.CR & FDC_COMMAND_BIT_MULTIPLE_SECTOR ) == 0 )
+			break;
+		FDC.SR++;						/* Try to write next sector and set RNF if not possible */
+	}
+
+	return FDC_CmdCompleteCommon( true );
+}
+
+
 /*-----------------------------------------------------------------------*/
 /**
  * Run 'READ SECTOR/S' command
@@ -2667,6 +2851,11 @@ static int FDC_UpdateReadSectorsCmd ( void )
 	switch (FDC.CommandState)
 	{
 	 case FDCEMU_RUN_READSECTORS_READDATA:
+		if ( FDC_Turbo_Possible () )
+		{
+			FdcCycles = FDC_Turbo_ReadSectors ();
+			break;
+		}
 		if ( FDC_Set_MotorON ( FDC.CR ) )
 		{
 			FDC.CommandState = FDCEMU_RUN_READSECTORS_READDATA_SPIN_UP;
@@ -2879,6 +3068,11 @@ static int FDC_UpdateWriteSectorsCmd ( void )
 	switch (FDC.CommandState)
 	{
 	 case FDCEMU_RUN_WRITESECTORS_WRITEDATA:
+		if ( FDC_Turbo_Possible () )
+		{
+			FdcCycles = FDC_Turbo_WriteSectors ();
+			break;
+		}
 		if ( FDC_Set_MotorON ( FDC.CR ) )
 		{
 			FDC.CommandState = FDCEMU_RUN_WRITESECTORS_WRITEDATA_SPIN_UP;
@@ -8,6 +8,10 @@
   NOTE: these buffers are in memory so we only need to write routines for
   the .ST format. When the buffer is to be saved (ie eject disk) we save
   it back to the original file in the correct format (.ST or .MSA).
+  Changed sectors are tracked, so that for uncompressed .ST images only
+  those need to be written back. Compressed images (.MSA, .gz and .zip)
+  have to be rewritten completely, this is done in the file writer thread
+  so that the emulation isn't stalled by the compression.
 
   There are some important notes about image accessing - as we use TOS and the
   FDC to access the disk the boot-sector MUST be valid. Sometimes this is NOT
@@ -28,7 +32,9 @@ const char Floppy_fileid[] = "Hatari floppy.c";
 #include <SDL_endian.h>
 
 #include "main.h"
+#include "asyncWriter.h"
 #include "configuration.h"
+#include "diskCache.h"
 #include "file.h"
 #include "floppy.h"
 #include "gemdos.h"
@@ -69,6 +75,7 @@ static const char * const pszDiskImageNameExts[] =
 
 
 /* local functions */
+static bool	Floppy_EjectDrive(int Drive, bool bWriteBack);
 static bool	Floppy_EjectBothDrives(void);
 static void	Floppy_DriveTransitionSetState ( int Drive , int State );
 
@@ -127,9 +134,16 @@ void Floppy_MemorySnapShot_Capture(bool bSave)
 {
 	int i;
 
-	/* If restoring then eject old drives first! */
+	/* If restoring then eject old drives first!  In-memory restore
+	 * (debugger reverse execution) goes back in time, so current
+	 * contents aren't written back to image files, just discarded.
+	 */
 	if (!bSave)
-		Floppy_EjectBothDrives();
+	{
+		bool bWriteBack = !MemorySnapShot_InMemory();
+		for (i = 0; i < MAX_FLOPPYDRIVES; i++)
+			Floppy_EjectDrive(i, bWriteBack);
+	}
 
 	/* Save/Restore details */
 	for (i = 0; i < MAX_FLOPPYDRIVES; i++)
@@ -523,7 +537,9 @@ bool Floppy_InsertDiskIntoDrive(int Drive)
 {
 	long	nImageBytes = 0;
 	char	*filename;
+	const char *zippath;
 	int	ImageType = FLOPPY_IMAGE_TYPE_NONE;
+	bool	bCached = false;
 
 	/* Eject disk, if one is inserted (doesn't inform user) */
 	assert(Drive >= 0 && Drive < MAX_FLOPPYDRIVES);
@@ -534,14 +550,22 @@ bool Floppy_InsertDiskIntoDrive(int Drive)
 	{
 		return true; /* only do eject */
 	}
+	/* Image might still be saved in the background after an earlier eject */
+	AsyncWriter_WaitForFile(filename);
 	if (!File_Exists(filename))
 	{
 		Log_AlertDlg(LOG_INFO, "Image '%s' not found", filename);
 		return false;
 	}
 
+	/* Unpacked .zip/.gz images may be in the disk image cache */
+	zippath = ZIP_FileNameIsZIP(filename) ? ConfigureParams.DiskImage.szDiskZipPath[Drive] : NULL;
+	EmulationDrives[Drive].pBuffer = DiskCache_Load(filename, zippath, &nImageBytes, &ImageType);
+	if (EmulationDrives[Drive].pBuffer)
+		bCached = true;
+
 	/* Check disk image type and read the file: */
-	if (MSA_FileNameIsMSA(filename, true))
+	else if (MSA_FileNameIsMSA(filename, true))
 		EmulationDrives[Drive].pBuffer = MSA_ReadDisk(Drive, filename, &nImageBytes, &ImageType);
 	else if (ST_FileNameIsST(filename, true))
 		EmulationDrives[Drive].pBuffer = ST_ReadDisk(Drive, filename, &nImageBytes, &ImageType);
@@ -552,16 +576,15 @@ bool Floppy_InsertDiskIntoDrive(int Drive)
 	else if (STX_FileNameIsSTX(filename, true))
 		EmulationDrives[Drive].pBuffer = STX_ReadDisk(Drive, filename, &nImageBytes, &ImageType);
 	else if (ZIP_FileNameIsZIP(filename))
-	{
-		const char *zippath = ConfigureParams.DiskImage.szDiskZipPath[Drive];
 		EmulationDrives[Drive].pBuffer = ZIP_ReadDisk(Drive, filename, zippath, &nImageBytes, &ImageType);
-	}
 
 	if ( (EmulationDrives[Drive].pBuffer == NULL) || ( ImageType == FLOPPY_IMAGE_TYPE_NONE ) )
 	{
 		Log_AlertDlg(LOG_INFO, "Image '%s' filename extension, or content unrecognized", filename);
 		return false;
 	}
+	if (!bCached)
+		DiskCache_Store(filename, zippath, EmulationDrives[Drive].pBuffer, nImageBytes, ImageType);
 
 	/* For IPF, call specific function to handle the inserted image */
 	if ( ImageType == FLOPPY_IMAGE_TYPE_IPF )
@@ -596,6 +619,10 @@ bool Floppy_InsertDiskIntoDrive(int Drive)
 	EmulationDrives[Drive].bDiskInserted = true;
 	EmulationDrives[Drive].bContentsChanged = false;
 
+	/* Track changed sectors of uncompressed .ST images for saving them back */
+	if (ImageType == FLOPPY_IMAGE_TYPE_ST && File_DoesFileExtensionMatch(filename, ".st"))
+		EmulationDrives[Drive].pDirtyMap = calloc((nImageBytes / NUMBYTESPERSECTOR + 7) / 8, 1);
+
 	if ( ( ImageType == FLOPPY_IMAGE_TYPE_ST ) || ( ImageType == FLOPPY_IMAGE_TYPE_MSA )
 	  || ( ImageType == FLOPPY_IMAGE_TYPE_DIM ) )
 		EmulationDrives[Drive].bOKToSave = Floppy_IsBootSectorOK(Drive);
@@ -617,11 +644,41 @@ bool Floppy_InsertDiskIntoDrive(int Drive)
 
 /*-----------------------------------------------------------------------*/
 /**
- * Eject disk from floppy drive, save contents back to PCs hard-drive if
- * they have been changed.
+ * Tell user whether saving given floppy image succeeded, return 'bSaved'
+ */
+static bool Floppy_ReportSave(const char *pszFileName, bool bSaved)
+{
+	if (bSaved)
+		Log_Printf(LOG_INFO, "Updated the contents of floppy image '%s'.", pszFileName);
+	else
+		Log_Printf(LOG_INFO, "Writing of this format failed or not supported, discarded the contents\n of floppy image '%s'.", pszFileName);
+	return bSaved;
+}
+
+/**
+ * Save functions for the writer thread, used for images which have to be
+ * compressed again. Drive number isn't used by them.  As saving is done
+ * after ejecting has already returned, they report the result themselves.
+ */
+static bool Floppy_SaveMSA(const char *pszFileName, Uint8 *pBuffer, size_t nLen)
+{
+	return Floppy_ReportSave(pszFileName, MSA_WriteDisk(-1, pszFileName, pBuffer, nLen));
+}
+
+static bool Floppy_SaveST(const char *pszFileName, Uint8 *pBuffer, size_t nLen)
+{
+	return Floppy_ReportSave(pszFileName, ST_WriteDisk(-1, pszFileName, pBuffer, nLen));
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Eject disk from floppy drive.  If 'bWriteBack' is set, save contents
+ * back to PCs hard-drive if they have been changed, otherwise discard
+ * them silently.
  * Return true if there was something to eject.
  */
-bool Floppy_EjectDiskFromDrive(int Drive)
+static bool Floppy_EjectDrive(int Drive, bool bWriteBack)
 {
 	bool bEjected = false;
 
@@ -629,19 +686,31 @@ bool Floppy_EjectDiskFromDrive(int Drive)
 	if (EmulationDrives[Drive].bDiskInserted)
 	{
 		bool bSaved = false;
+		ASYNC_SAVE_FUNC saver = NULL;
 		char *psFileName = EmulationDrives[Drive].sFileName;
 
 		/* OK, has contents changed? If so, need to save */
-		if (EmulationDrives[Drive].bContentsChanged)
+		if (EmulationDrives[Drive].bContentsChanged && bWriteBack)
 		{
 			/* Is OK to save image (if boot-sector is bad, don't allow a save) */
 			if (EmulationDrives[Drive].bOKToSave)
 			{
-				/* Save as .MSA, .ST, .DIM, .IPF or .STX image? */
-				if (MSA_FileNameIsMSA(psFileName, true))
-					bSaved = MSA_WriteDisk(Drive, psFileName, EmulationDrives[Drive].pBuffer, EmulationDrives[Drive].nImageBytes);
+				/* Only changed sectors of plain .ST images need to be written */
+				if (EmulationDrives[Drive].pDirtyMap
+				    && ST_WriteDirtySectors(Drive, psFileName, EmulationDrives[Drive].pBuffer,
+				                            EmulationDrives[Drive].nImageBytes, EmulationDrives[Drive].pDirtyMap))
+					bSaved = true;
+				/* Compressed images are saved in the background */
+				else if (MSA_FileNameIsMSA(psFileName, true))
+					saver = Floppy_SaveMSA;
 				else if (ST_FileNameIsST(psFileName, true))
-					bSaved = ST_WriteDisk(Drive, psFileName, EmulationDrives[Drive].pBuffer, EmulationDrives[Drive].nImageBytes);
+				{
+					if (File_DoesFileExtensionMatch(psFileName, ".gz"))
+						saver = Floppy_SaveST;
+					else
+						bSaved = ST_WriteDisk(Drive, psFileName, EmulationDrives[Drive].pBuffer, EmulationDrives[Drive].nImageBytes);
+				}
+				/* Save as .DIM, .IPF or .STX image? */
 				else if (DIM_FileNameIsDIM(psFileName, true))
 					bSaved = DIM_WriteDisk(Drive, psFileName, EmulationDrives[Drive].pBuffer, EmulationDrives[Drive].nImageBytes);
 				else if (IPF_FileNameIsIPF(psFileName, true))
@@ -650,17 +719,27 @@ bool Floppy_EjectDiskFromDrive(int Drive)
 					bSaved = STX_WriteDisk(Drive, psFileName, EmulationDrives[Drive].pBuffer, EmulationDrives[Drive].nImageBytes);
 				else if (ZIP_FileNameIsZIP(psFileName))
 					bSaved = ZIP_WriteDisk(Drive, psFileName, EmulationDrives[Drive].pBuffer, EmulationDrives[Drive].nImageBytes);
-				if (bSaved)
-					Log_Printf(LOG_INFO, "Updated the contents of floppy image '%s'.", psFileName);
+
+				if (saver)
+				{
+					/* Writer thread takes over the image buffer, and saver reports the result */
+					if (AsyncWriter_SaveFileWith(psFileName, EmulationDrives[Drive].pBuffer,
+					                             EmulationDrives[Drive].nImageBytes, saver))
+						Log_Printf(LOG_INFO, "Queued saving of floppy image '%s'.", psFileName);
+					else
+						Floppy_ReportSave(psFileName, false);
+					EmulationDrives[Drive].pBuffer = NULL;
+				}
 				else
-					Log_Printf(LOG_INFO, "Writing of this format failed or not supported, discarded the contents\n of floppy image '%s'.", psFileName);
+					Floppy_ReportSave(psFileName, bSaved);
 			} else
 				Log_Printf(LOG_INFO, "Writing not possible, discarded the contents of floppy image\n '%s'.", psFileName);
 		}
 
 		/* Inform user that disk has been ejected! */
-		Log_Printf(LOG_INFO, "Floppy %c: has been removed from drive.",
-			   'A'+Drive);
+		if (bWriteBack)
+			Log_Printf(LOG_INFO, "Floppy %c: has been removed from drive.",
+				   'A'+Drive);
 
 		Floppy_DriveTransitionSetState ( Drive , FLOPPY_DRIVE_TRANSITION_STATE_EJECT );
 		FDC_EjectFloppy ( Drive );
@@ -681,6 +760,8 @@ bool Floppy_EjectDiskFromDrive(int Drive)
 		free(EmulationDrives[Drive].pBuffer);
 		EmulationDrives[Drive].pBuffer = NULL;
 	}
+	free(EmulationDrives[Drive].pDirtyMap);
+	EmulationDrives[Drive].pDirtyMap = NULL;
 
 	EmulationDrives[Drive].sFileName[0] = '\0';
 	EmulationDrives[Drive].ImageType = FLOPPY_IMAGE_TYPE_NONE;
@@ -692,6 +773,16 @@ bool Floppy_EjectDiskFromDrive(int Drive)
 	return bEjected;
 }
 
+/**
+ * Eject disk from floppy drive, save contents back to PCs hard-drive if
+ * they have been changed.
+ * Return true if there was something to eject.
+ */
+bool Floppy_EjectDiskFromDrive(int Drive)
+{
+	return Floppy_EjectDrive(Drive, true);
+}
+
 
 /*-----------------------------------------------------------------------*/
 /**
@@ -960,6 +1051,17 @@ bool Floppy_WriteSectors(int Drive, Uint8 *pBuffer, Uint16 Sector,
 		/* And set 'changed' flag */
 		EmulationDrives[Drive].bContentsChanged = true;
 
+		/* Remember changed sectors, so that only those need to be saved */
+		if (EmulationDrives[Drive].pDirtyMap)
+		{
+			int nSector = Offset / NUMBYTESPERSECTOR;
+			int nLast = nSector + Count;
+			if (nLast > EmulationDrives[Drive].nImageBytes / NUMBYTESPERSECTOR)
+				nLast = EmulationDrives[Drive].nImageBytes / NUMBYTESPERSECTOR;
+			for ( ; nSector < nLast; nSector++)
+				EmulationDrives[Drive].pDirtyMap[nSector / 8] |= 1 << (nSector & 7);
+		}
+
 		return true;
 	}
 
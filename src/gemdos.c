@@ -40,6 +40,10 @@ const char Gemdos_fileid[] = "Hatari gemdos.c";
 #include <unistd.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <stddef.h>
+#if HAVE_POSIX_FADVISE
+#include <fcntl.h>
+#endif
 
 #include "main.h"
 #include "cart.h"
@@ -64,6 +68,7 @@ const char Gemdos_fileid[] = "Hatari gemdos.c";
 #include "hatari-glue.h"
 #include "maccess.h"
 #include "symbols.h"
+#include "reverse.h"
 
 /* Maximum supported length of a GEMDOS path: */
 #define MAX_GEMDOS_PATH 256
@@ -136,17 +141,41 @@ typedef struct
 	char szMode[4];     /* enough for all used fopen() modes: rb/rb+/wb+ */
 	Uint32 Basepage;
 	FILE *FileHandle;
+	off_t nPos;         /* current file position, stdio position isn't used */
+	off_t nSize;        /* file size, updated on writes */
 	/* TODO: host path might not fit into this */
 	char szActualName[MAX_GEMDOS_PATH];        /* used by F_DATIME (0x57) */
 } FILE_HANDLE;
 
+/* Fsfirst() directory entry, with host file information */
+typedef struct
+{
+	char *name;
+	int err;                            /* stat() errno, or zero */
+	mode_t mode;
+	off_t size;
+	time_t mtime;
+} DIRSNAP_ENTRY;
+
+/* Sorted Fsfirst() matches for a directory and mask, shared between DTAs */
+typedef struct
+{
+	char *path;
+	char *mask;
+	time_t mtime;                       /* directory modification time when read */
+	time_t read_time;                   /* when the directory was read */
+	Uint32 last_use;
+	int refcount;                       /* DTAs + snapshot cache */
+	int nentries;
+	DIRSNAP_ENTRY *entries;
+} DIR_SNAPSHOT;
+
 typedef struct
 {
 	bool bUsed;
 	Uint32 addr;                        /* ST-RAM DTA address for matching reused entries */
-	int  nentries;                      /* number of entries in fs directory */
 	int  centry;                        /* current entry # */
-	struct dirent **found;              /* legal files */
+	DIR_SNAPSHOT *snap;                 /* legal files, or NULL */
 	char path[MAX_GEMDOS_PATH];                /* sfirst path */
 } INTERNAL_DTA;
 
@@ -298,50 +327,39 @@ static Uint8 GemDOS_ConvertAttribute(mode_t mode)
  * Populate the DTA buffer with file info.
  * @return   DTA_OK if entry is ok, DTA_SKIP if it should be skipped, DTA_ERR on errors
  */
-static dta_ret_t PopulateDTA(char *path, struct dirent *file, DTA *pDTA, Uint32 DTA_Gemdos)
+static dta_ret_t PopulateDTA(const char *path, const DIRSNAP_ENTRY *file, DTA *pDTA, Uint32 DTA_Gemdos)
 {
-	/* TODO: host file path can be longer than MAX_GEMDOS_PATH */
-	char tempstr[MAX_GEMDOS_PATH];
-	struct stat filestat;
 	DATETIME DateTime;
 	int nFileAttr, nAttrMask;
 
-	if (snprintf(tempstr, sizeof(tempstr), "%s%c%s",
-	             path, PATHSEP, file->d_name) >= (int)sizeof(tempstr))
-	{
-		Log_Printf(LOG_ERROR, "PopulateDTA: path is too long.\n");
-		return DTA_ERR;
-	}
-
-	if (stat(tempstr, &filestat) != 0)
+	if (file->err)
 	{
 		/* skip file if it doesn't exist, otherwise return an error */
-		dta_ret_t ret = (errno == ENOENT ? DTA_SKIP : DTA_ERR);
-		perror(tempstr);
-		return ret;
+		Log_Printf(LOG_WARN, "%s%c%s: %s\n", path, PATHSEP, file->name, strerror(file->err));
+		return (file->err == ENOENT ? DTA_SKIP : DTA_ERR);
 	}
 
 	if (!pDTA)
 		return DTA_ERR;   /* no DTA pointer set */
 
 	/* Check file attributes (check is done according to the Profibuch) */
-	nFileAttr = GemDOS_ConvertAttribute(filestat.st_mode);
+	nFileAttr = GemDOS_ConvertAttribute(file->mode);
 	nAttrMask = nAttrSFirst|GEMDOS_FILE_ATTRIB_WRITECLOSE|GEMDOS_FILE_ATTRIB_READONLY;
 	if (nFileAttr != 0 && !(nAttrMask & nFileAttr))
 		return DTA_SKIP;
 
-	GemDOS_DateTime2Tos(filestat.st_mtime, &DateTime, tempstr);
+	GemDOS_DateTime2Tos(file->mtime, &DateTime, file->name);
 
 	/* Atari memory modified directly through pDTA members -> flush the data cache */
 	M68000_Flush_Data_Cache(DTA_Gemdos, sizeof(DTA));
 
 	/* convert to atari-style uppercase */
-	Str_Filename2TOSname(file->d_name, pDTA->dta_name);
+	Str_Filename2TOSname(file->name, pDTA->dta_name);
 #if DEBUG_PATTERN_MATCH
 	fprintf(stderr, "DEBUG: GEMDOS: host: %s -> GEMDOS: %s\n",
-		file->d_name, pDTA->dta_name);
+		file->name, pDTA->dta_name);
 #endif
-	do_put_mem_long(pDTA->dta_size, filestat.st_size);
+	do_put_mem_long(pDTA->dta_size, file->size);
 	do_put_mem_word(pDTA->dta_time, DateTime.timeword);
 	do_put_mem_word(pDTA->dta_date, DateTime.dateword);
 	pDTA->dta_attrib = nFileAttr;
@@ -352,21 +370,31 @@ static dta_ret_t PopulateDTA(char *path, struct dirent *file, DTA *pDTA, Uint32
 
 /*-----------------------------------------------------------------------*/
 /**
- * Clear given DTA cache structure.
+ * Drop a reference to given directory snapshot, free it if it was the last one
  */
-static void ClearInternalDTA(int idx)
+static void DirSnap_Release(DIR_SNAPSHOT *snap)
 {
 	int i;
 
+	if (!snap || --snap->refcount > 0)
+		return;
+	for (i = 0; i < snap->nentries; i++)
+		free(snap->entries[i].name);
+	free(snap->entries);
+	free(snap->path);
+	free(snap->mask);
+	free(snap);
+}
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Clear given DTA cache structure.
+ */
+static void ClearInternalDTA(int idx)
+{
 	/* clear the old DTA structure */
-	if (InternalDTAs[idx].found != NULL)
-	{
-		for (i = 0; i < InternalDTAs[idx].nentries; i++)
-			free(InternalDTAs[idx].found[i]);
-		free(InternalDTAs[idx].found);
-		InternalDTAs[idx].found = NULL;
-	}
-	InternalDTAs[idx].nentries = 0;
+	DirSnap_Release(InternalDTAs[idx].snap);
+	InternalDTAs[idx].snap = NULL;
 	InternalDTAs[idx].bUsed = false;
 }
 
@@ -480,6 +508,381 @@ static const char* fsfirst_dirmask(const char *string)
 		return string;
 }
 
+/*-----------------------------------------------------------------------*/
+/*
+  Host directory name cache, used for matching TOS names to host names.
+
+  Path name matching is done for every component of every path given to
+  GEMDOS calls, so instead of reading the whole host directory each time,
+  names of the most recently used directories are kept in memory, with a
+  hash table of their case-folded names for the exact (case-insensitive)
+  matches. An entry is re-read when the directory modification time
+  changes, when it's modified through GEMDOS, or when its modification
+  time is too recent for a later change to be noticeable (same second).
+
+  Fsfirst() results are cached the same way: the sorted and stat()ed
+  matches for a directory and mask are shared by all DTAs using them,
+  so that re-listing a big directory (desktop windows, file selectors)
+  doesn't need to read and stat() it again.
+*/
+
+#define DIRCACHE_ENTRIES	16
+
+typedef struct
+{
+	char *path;		/* host directory path, without trailing separator */
+	time_t mtime;		/* directory modification time when read */
+	time_t read_time;	/* when the directory was read */
+	Uint32 last_use;
+	int nnames;
+	int *offsets;		/* offsets of the names in pool, in readdir() order */
+	char *pool;		/* precomposed names, nul terminated */
+	int *hash;		/* indexes into offsets[], -1 for unused slots */
+	int hashmask;
+} DIRCACHE_ENTRY;
+
+#define DIRSNAP_ENTRIES		8
+
+static DIRCACHE_ENTRY DirCache[DIRCACHE_ENTRIES];
+static DIR_SNAPSHOT *DirSnapCache[DIRSNAP_ENTRIES];
+static Uint32 DirCacheUseCount;
+
+
+/**
+ * Case-insensitive hash of given name, matching strcasecmp()
+ */
+static Uint32 DirCache_Hash(const char *name)
+{
+	Uint32 h = 2166136261u;
+
+	while (*name)
+	{
+		h ^= tolower((unsigned char)*name++);
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/**
+ * Free names of given cache entry
+ */
+static void DirCache_Free(DIRCACHE_ENTRY *ce)
+{
+	free(ce->path);
+	free(ce->offsets);
+	free(ce->pool);
+	free(ce->hash);
+	memset(ce, 0, sizeof(*ce));
+}
+
+/**
+ * Forget all cached directories
+ */
+static void DirCache_Clear(void)
+{
+	int i;
+
+	for (i = 0; i < DIRCACHE_ENTRIES; i++)
+		DirCache_Free(&DirCache[i]);
+	for (i = 0; i < DIRSNAP_ENTRIES; i++)
+	{
+		DirSnap_Release(DirSnapCache[i]);
+		DirSnapCache[i] = NULL;
+	}
+}
+
+/**
+ * Forget the cached contents of the directory containing given host file
+ * (because the file was created, removed, renamed or written through GEMDOS).
+ * DTAs which already use its Fsfirst() results keep them.
+ */
+static void DirCache_Invalidate(const char *filepath)
+{
+	const char *sep;
+	size_t len;
+	int i;
+
+	sep = strrchr(filepath, PATHSEP);
+	if (!sep)
+		return;
+	len = sep - filepath;
+	for (i = 0; i < DIRCACHE_ENTRIES; i++)
+	{
+		if (DirCache[i].path && strlen(DirCache[i].path) == len
+		    && strncmp(DirCache[i].path, filepath, len) == 0)
+			DirCache_Free(&DirCache[i]);
+	}
+	for (i = 0; i < DIRSNAP_ENTRIES; i++)
+	{
+		if (DirSnapCache[i] && strlen(DirSnapCache[i]->path) == len
+		    && strncmp(DirSnapCache[i]->path, filepath, len) == 0)
+		{
+			DirSnap_Release(DirSnapCache[i]);
+			DirSnapCache[i] = NULL;
+		}
+	}
+}
+
+/**
+ * Read names in given host directory into given cache entry.
+ * Return false on failure.
+ */
+static bool DirCache_Read(DIRCACHE_ENTRY *ce, const char *path, time_t mtime)
+{
+	struct dirent *entry;
+	size_t poolsize = 0, poolused = 0, len;
+	int maxnames = 0, i, slot;
+	int *offsets;
+	char *pool;
+	DIR *dir;
+
+	dir = opendir(path);
+	if (!dir)
+		return false;
+
+	ce->read_time = time(NULL);
+	ce->mtime = mtime;
+	while ((entry = readdir(dir)))
+	{
+		char *d_name = entry->d_name;
+		Str_DecomposedToPrecomposedUtf8(d_name, d_name);   /* for OSX */
+		len = strlen(d_name) + 1;
+		if (ce->nnames == maxnames)
+		{
+			maxnames = maxnames ? 2 * maxnames : 64;
+			offsets = realloc(ce->offsets, maxnames * sizeof(*ce->offsets));
+			if (!offsets)
+				break;
+			ce->offsets = offsets;
+		}
+		if (poolused + len > poolsize)
+		{
+			poolsize = 2 * (poolsize + len);
+			pool = realloc(ce->pool, poolsize);
+			if (!pool)
+				break;
+			ce->pool = pool;
+		}
+		memcpy(ce->pool + poolused, d_name, len);
+		ce->offsets[ce->nnames++] = poolused;
+		poolused += len;
+	}
+	closedir(dir);
+	if (entry)
+		return false;	/* out of memory */
+
+	/* hash table with at most 50% load, first name in readdir() order wins */
+	for (ce->hashmask = 15; ce->hashmask < 2 * ce->nnames; ce->hashmask = 2 * ce->hashmask + 1)
+		;
+	ce->hash = malloc((ce->hashmask + 1) * sizeof(*ce->hash));
+	if (!ce->hash)
+		return false;
+	memset(ce->hash, -1, (ce->hashmask + 1) * sizeof(*ce->hash));
+	for (i = 0; i < ce->nnames; i++)
+	{
+		slot = DirCache_Hash(ce->pool + ce->offsets[i]) & ce->hashmask;
+		while (ce->hash[slot] >= 0)
+			slot = (slot + 1) & ce->hashmask;
+		ce->hash[slot] = i;
+	}
+	return true;
+}
+
+/**
+ * Return up to date cache entry for given host directory,
+ * or NULL if directory can't be read.
+ */
+static DIRCACHE_ENTRY *DirCache_Get(const char *path)
+{
+	DIRCACHE_ENTRY *ce, *lru = &DirCache[0];
+	struct stat st;
+	size_t len;
+	int i;
+
+	if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+		return NULL;
+
+	/* drop trailing separator for the cache key */
+	len = strlen(path);
+	if (len > 1 && path[len-1] == PATHSEP)
+		len--;
+
+	for (i = 0; i < DIRCACHE_ENTRIES; i++)
+	{
+		ce = &DirCache[i];
+		if (!ce->path)
+		{
+			lru = ce;
+			continue;
+		}
+		if (strlen(ce->path) != len || strncmp(ce->path, path, len) != 0)
+		{
+			if (lru->path && ce->last_use < lru->last_use)
+				lru = ce;
+			continue;
+		}
+		/* changes in the same second as reading can't be detected */
+		if (ce->mtime == st.st_mtime && ce->mtime < ce->read_time)
+		{
+			ce->last_use = ++DirCacheUseCount;
+			return ce;
+		}
+		lru = ce;
+		break;
+	}
+
+	DirCache_Free(lru);
+	lru->path = malloc(len + 1);
+	if (!lru->path || !DirCache_Read(lru, path, st.st_mtime))
+	{
+		DirCache_Free(lru);
+		return NULL;
+	}
+	memcpy(lru->path, path, len);
+	lru->path[len] = '\0';
+	lru->last_use = ++DirCacheUseCount;
+	return lru;
+}
+
+
+/**
+ * Sort directory snapshot entries like scandir() with alphasort()
+ */
+static int DirSnap_Compare(const void *a, const void *b)
+{
+	return strcoll(((const DIRSNAP_ENTRY *)a)->name, ((const DIRSNAP_ENTRY *)b)->name);
+}
+
+/**
+ * Read and stat() entries matching given mask in given host directory.
+ * Return new snapshot, or NULL if directory can't be read.
+ */
+static DIR_SNAPSHOT *DirSnap_Read(const char *path, const char *mask, time_t mtime)
+{
+	/* TODO: host file path can be longer than MAX_GEMDOS_PATH */
+	char tempstr[MAX_GEMDOS_PATH];
+	DIRSNAP_ENTRY *entries, *e;
+	struct dirent *entry;
+	struct stat filestat;
+	DIR_SNAPSHOT *snap;
+	int maxentries = 0;
+	DIR *dir;
+
+	snap = calloc(1, sizeof(*snap));
+	if (!snap)
+		return NULL;
+	snap->refcount = 1;
+	snap->path = strdup(path);
+	snap->mask = strdup(mask);
+	snap->mtime = mtime;
+	snap->read_time = time(NULL);
+	dir = opendir(path);
+	if (!dir || !snap->path || !snap->mask)
+	{
+		if (dir)
+			closedir(dir);
+		DirSnap_Release(snap);
+		return NULL;
+	}
+
+	while ((entry = readdir(dir)))
+	{
+		char *d_name = entry->d_name;
+		Str_DecomposedToPrecomposedUtf8(d_name, d_name);   /* for OSX */
+		if (!fsfirst_match(mask, d_name))
+			continue;
+
+		if (snap->nentries == maxentries)
+		{
+			maxentries = maxentries ? 2 * maxentries : 64;
+			entries = realloc(snap->entries, maxentries * sizeof(*entries));
+			if (!entries)
+				break;
+			snap->entries = entries;
+		}
+		e = &snap->entries[snap->nentries];
+		memset(e, 0, sizeof(*e));
+		e->name = strdup(d_name);
+		if (!e->name)
+			break;
+		snap->nentries++;
+
+		if (snprintf(tempstr, sizeof(tempstr), "%s%c%s",
+		             path, PATHSEP, d_name) >= (int)sizeof(tempstr))
+			e->err = ENAMETOOLONG;
+		else if (stat(tempstr, &filestat) != 0)
+			e->err = errno;
+		else
+		{
+			e->mode = filestat.st_mode;
+			e->size = filestat.st_size;
+			e->mtime = filestat.st_mtime;
+		}
+	}
+	closedir(dir);
+	if (entry)
+	{
+		Log_Printf(LOG_WARN, "Out of memory while reading directory '%s'\n", path);
+		DirSnap_Release(snap);
+		return NULL;
+	}
+
+	if (snap->nentries > 1)
+		qsort(snap->entries, snap->nentries, sizeof(*snap->entries), DirSnap_Compare);
+	return snap;
+}
+
+/**
+ * Return Fsfirst() results for given host directory and mask, shared
+ * with earlier callers when the directory hasn't changed. Caller needs
+ * to release the returned snapshot with DirSnap_Release().
+ * Return NULL if directory can't be read.
+ */
+static DIR_SNAPSHOT *DirSnap_Get(const char *path, const char *mask)
+{
+	DIR_SNAPSHOT *snap;
+	struct stat st;
+	int i, lru = 0;
+
+	if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+		return NULL;
+
+	for (i = 0; i < DIRSNAP_ENTRIES; i++)
+	{
+		snap = DirSnapCache[i];
+		if (!snap)
+		{
+			lru = i;
+			continue;
+		}
+		if (strcmp(snap->path, path) != 0 || strcmp(snap->mask, mask) != 0)
+		{
+			if (DirSnapCache[lru] && snap->last_use < DirSnapCache[lru]->last_use)
+				lru = i;
+			continue;
+		}
+		/* changes in the same second as reading can't be detected */
+		if (snap->mtime == st.st_mtime && snap->mtime < snap->read_time)
+		{
+			snap->last_use = ++DirCacheUseCount;
+			snap->refcount++;
+			return snap;
+		}
+		lru = i;
+		break;
+	}
+
+	snap = DirSnap_Read(path, mask, st.st_mtime);
+	if (!snap)
+		return NULL;
+	DirSnap_Release(DirSnapCache[lru]);
+	DirSnapCache[lru] = snap;
+	snap->last_use = ++DirCacheUseCount;
+	snap->refcount++;
+	return snap;
+}
+
+
 /*-----------------------------------------------------------------------*/
 /**
  * Close given internal file handle if it's still in use
@@ -492,6 +895,284 @@ static void GemDOS_CloseFileHandle(int i)
 	FileHandles[i].FileHandle = NULL;
 	FileHandles[i].Basepage = 0;
 	FileHandles[i].bUsed = false;
+	FileHandles[i].nPos = FileHandles[i].nSize = 0;
+}
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Get current size of the file of given handle.
+ * Return false on error.
+ */
+static bool GemDOS_UpdateFileSize(FILE_HANDLE *fh)
+{
+	struct stat FileStat;
+	off_t pos;
+
+	if (fstat(fileno(fh->FileHandle), &FileStat) == 0)
+	{
+		fh->nSize = FileStat.st_size;
+		return true;
+	}
+	/* not a real file (e.g. virtual INF file on some systems) */
+	pos = ftello(fh->FileHandle);
+	if (pos < 0 || fseeko(fh->FileHandle, 0, SEEK_END) != 0)
+		return false;
+	fh->nSize = ftello(fh->FileHandle);
+	return fseeko(fh->FileHandle, pos, SEEK_SET) == 0 && fh->nSize >= 0;
+}
+
+/**
+ * Set up position and size tracking for newly opened file handle
+ */
+static void GemDOS_InitFileHandle(FILE_HANDLE *fh, off_t nPos)
+{
+	fh->nPos = nPos;
+	if (!GemDOS_UpdateFileSize(fh))
+		fh->nSize = 0;
+#if HAVE_POSIX_FADVISE
+	/* programs mostly read files from start to end, let host prefetch */
+	if (fh->szMode[0] == 'r')
+		posix_fadvise(fileno(fh->FileHandle), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+/**
+ * Read up to nLen bytes from current position of given handle.
+ * Return number of bytes read, or -1 on error (with errno set).
+ */
+static long GemDOS_ReadHostFile(FILE_HANDLE *fh, void *pData, size_t nLen)
+{
+	size_t nDone = 0;
+
+#if HAVE_PREAD
+	int fd = fileno(fh->FileHandle);
+	if (fd >= 0)
+	{
+		while (nDone < nLen)
+		{
+			ssize_t ret = pread(fd, (char *)pData + nDone, nLen - nDone, fh->nPos + nDone);
+			if (ret < 0 && errno == EINTR)
+				continue;
+			if (ret < 0)
+				return -1;
+			if (ret == 0)
+				break;
+			nDone += ret;
+		}
+		fh->nPos += nDone;
+		return nDone;
+	}
+#endif
+	if (fseeko(fh->FileHandle, fh->nPos, SEEK_SET) != 0)
+		return -1;
+	nDone = fread(pData, 1, nLen, fh->FileHandle);
+	if (ferror(fh->FileHandle))
+	{
+		clearerr(fh->FileHandle);
+		return -1;
+	}
+	fh->nPos += nDone;
+	return nDone;
+}
+
+/**
+ * Write nLen bytes to current position of given handle.
+ * Return number of bytes written, or -1 on error (with errno set).
+ */
+static long GemDOS_WriteHostFile(FILE_HANDLE *fh, const void *pData, size_t nLen)
+{
+	size_t nDone = 0;
+
+#if HAVE_PREAD
+	int fd = fileno(fh->FileHandle);
+	if (fd >= 0)
+	{
+		while (nDone < nLen)
+		{
+			ssize_t ret = pwrite(fd, (const char *)pData + nDone, nLen - nDone, fh->nPos + nDone);
+			if (ret < 0 && errno == EINTR)
+				continue;
+			if (ret <= 0)
+				return -1;
+			nDone += ret;
+		}
+	}
+	else
+#endif
+	{
+		if (fseeko(fh->FileHandle, fh->nPos, SEEK_SET) != 0)
+			return -1;
+		nDone = fwrite(pData, 1, nLen, fh->FileHandle);
+		if (ferror(fh->FileHandle) || fflush(fh->FileHandle) != 0)
+		{
+			clearerr(fh->FileHandle);
+			return -1;
+		}
+	}
+	fh->nPos += nDone;
+	if (fh->nPos > fh->nSize)
+		fh->nSize = fh->nPos;
+	return nDone;
+}
+
+/**
+ * Record file read/write result for reverse debugging
+ */
+static void GemDOS_RecordFileIO(reverse_input_t type, long nDone, const void *pData)
+{
+	int err = errno;
+
+	if (nDone < 0)
+		Reverse_RecordEvent(type, -err, NULL, 0);
+	else
+		Reverse_RecordEvent(type, nDone, pData, type == REVERSE_INPUT_FREAD ? nDone : 0);
+	errno = err;
+}
+
+/**
+ * Return recorded file read/write result when replaying for reverse
+ * debugging.  If there's none (replay diverged), return an access
+ * error instead of doing host file I/O.
+ */
+static long GemDOS_ReplayFileIO(reverse_input_t type, void *pData, size_t nLen)
+{
+	Sint64 nDone;
+
+	if (!Reverse_ReplayEvent(type, &nDone, pData, nLen))
+	{
+		errno = EACCES;
+		return -1;
+	}
+	if (nDone < 0)
+	{
+		errno = -nDone;
+		return -1;
+	}
+	return nDone;
+}
+
+/**
+ * Read from file with GemDOS_ReadHostFile(), or when replaying
+ * for reverse debugging, return the recorded result & data.
+ */
+static long GemDOS_ReadFile(FILE_HANDLE *fh, void *pData, size_t nLen)
+{
+	Sint64 nDone;
+
+	if (ReverseTracking && Reverse_IsReplaying())
+	{
+		nDone = GemDOS_ReplayFileIO(REVERSE_INPUT_FREAD, pData, nLen);
+		if (nDone < 0)
+			return -1;
+		fh->nPos += nDone;
+		return nDone;
+	}
+	nDone = GemDOS_ReadHostFile(fh, pData, nLen);
+	if (ReverseTracking)
+		GemDOS_RecordFileIO(REVERSE_INPUT_FREAD, nDone, pData);
+	return nDone;
+}
+
+/**
+ * Write to file with GemDOS_WriteHostFile(), or when replaying for
+ * reverse debugging, return the recorded result without writing
+ * (host file has already been written).
+ */
+static long GemDOS_WriteFile(FILE_HANDLE *fh, const void *pData, size_t nLen)
+{
+	Sint64 nDone;
+
+	if (ReverseTracking && Reverse_IsReplaying())
+	{
+		nDone = GemDOS_ReplayFileIO(REVERSE_INPUT_FWRITE, NULL, 0);
+		if (nDone < 0)
+			return -1;
+		fh->nPos += nDone;
+		if (fh->nPos > fh->nSize)
+			fh->nSize = fh->nPos;
+		return nDone;
+	}
+	nDone = GemDOS_WriteHostFile(fh, pData, nLen);
+	if (ReverseTracking)
+		GemDOS_RecordFileIO(REVERSE_INPUT_FWRITE, nDone, pData);
+	return nDone;
+}
+
+/**
+ * When replaying for reverse debugging, get the recorded GEMDOS
+ * result (and optional data) of a call that opens or modifies host
+ * files, which must not be done again.  Return false if not replaying.
+ */
+static bool GemDOS_ReplayHostOp(Sint32 *pResult, void *pData, Uint32 nLen)
+{
+	Sint64 nResult;
+
+	if (!(ReverseTracking && Reverse_IsReplaying()))
+		return false;
+	if (Reverse_ReplayEvent(REVERSE_INPUT_FHOST, &nResult, pData, nLen))
+		*pResult = nResult;
+	else
+	{
+		/* replay diverged, still don't touch host files */
+		*pResult = GEMDOS_EACCDN;
+	}
+	return true;
+}
+
+/**
+ * Record GEMDOS result (and optional data) of a call that
+ * opens or modifies host files, for reverse debugging
+ */
+static void GemDOS_RecordHostOp(Sint32 nResult, const void *pData, Uint32 nLen)
+{
+	if (ReverseTracking)
+		Reverse_RecordEvent(REVERSE_INPUT_FHOST, nResult, pData, nLen);
+}
+
+/**
+ * Record GEMDOS result and the given emulated memory area set by
+ * a call that only queries host file system state (Fsfirst, Dfree
+ * etc), for reverse debugging.  When replaying, replace them with
+ * the recorded ones so that later host file system changes aren't
+ * visible to the replayed code.
+ */
+static void GemDOS_SyncHostQuery(Uint32 nAddr, Uint32 nLen)
+{
+	Uint8 buf[sizeof(DTA)];
+	Sint64 nResult;
+	Uint32 i;
+
+	if (!ReverseTracking)
+		return;
+	assert(nLen <= sizeof(buf));
+	if (!STMemory_CheckAreaType(nAddr, nLen, ABFLAG_RAM))
+		nLen = 0;
+
+	if (Reverse_IsReplaying())
+	{
+		if (!Reverse_ReplayEvent(REVERSE_INPUT_FHOST, &nResult, buf, nLen))
+			return;
+		Regs[REG_D0] = nResult;
+		for (i = 0; i < nLen; i++)
+			STMemory_WriteByte(nAddr + i, buf[i]);
+		return;
+	}
+	for (i = 0; i < nLen; i++)
+		buf[i] = STMemory_ReadByte(nAddr + i);
+	Reverse_RecordEvent(REVERSE_INPUT_FHOST, Regs[REG_D0], buf, nLen);
+}
+
+/**
+ * Record / replay the TOS API part of the current DTA after
+ * Fsfirst() / Fsnext().  GEMDOS HD internal DTA fields are left
+ * alone, they refer to the directory snapshot of this session.
+ */
+static void GemDOS_SyncHostQueryDTA(void)
+{
+	Uint32 DTA_Gemdos = STMemory_ReadLong(STMemory_ReadLong(act_pd) + BASEPAGE_OFFSET_DTA);
+
+	GemDOS_SyncHostQuery(DTA_Gemdos + offsetof(DTA, dta_attrib),
+	                     sizeof(DTA) - offsetof(DTA, dta_attrib));
 }
 
 /**
@@ -792,6 +1473,7 @@ void GemDOS_UnInitDrives(void)
 	int i;
 
 	GemDOS_Reset();        /* Close all open files on emulated drive */
+	DirCache_Clear();
 
 	if (GEMDOS_EMU_ON)
 	{
@@ -828,7 +1510,7 @@ static void save_file_handle_info(FILE_HANDLE *handle)
 	MemorySnapShot_Store(&handle->szActualName, sizeof(handle->szActualName));
 	if (handle->bUsed)
 	{
-		offset = ftello(handle->FileHandle);
+		offset = handle->nPos;
 		stat(handle->szActualName, &fstat);
 		mtime = fstat.st_mtime; /* modification time */
 	}
@@ -884,7 +1566,8 @@ static void restore_file_handle_info(int i, FILE_HANDLE *handle)
 		Log_Printf(LOG_WARN, "restored GEMDOS handle %d points to a file that has been modified in meanwhile: %s\n",
 			   i, handle->szActualName);
 	}
-	fp = fopen(handle->szActualName, handle->szMode);
+	/* file was already created & truncated, reopening must not truncate it again */
+	fp = fopen(handle->szActualName, strcmp(handle->szMode, "wb+") ? handle->szMode : "rb+");
 	if (fp == NULL || fseeko(fp, offset, SEEK_SET) != 0)
 	{
 		handle->bUsed = false;
@@ -894,6 +1577,7 @@ static void restore_file_handle_info(int i, FILE_HANDLE *handle)
 		return;
 	}
 	handle->FileHandle = fp;
+	GemDOS_InitFileHandle(handle, offset);
 }
 
 /*-----------------------------------------------------------------------*/
@@ -1132,16 +1816,16 @@ static int GemDOS_FileName2HardDriveID(char *pszFileName)
 static char* match_host_dir_entry(const char *path, const char *name, bool pattern)
 {
 #define MAX_UTF8_NAME_LEN (3*(8+1+3)+1) /* UTF-8 can have up to 3 bytes per character */
-	struct dirent *entry;
-	char *match = NULL;
-	DIR *dir;
+	DIRCACHE_ENTRY *ce;
+	const char *match = NULL;
 	char nameHost[MAX_UTF8_NAME_LEN];
+	int i, slot, idx;
 
 	Str_AtariToHost(name, nameHost, MAX_UTF8_NAME_LEN, INVALID_CHAR);
 	name = nameHost;
-	
-	dir = opendir(path);
-	if (!dir)
+
+	ce = DirCache_Get(path);
+	if (!ce)
 		return NULL;
 
 #if DEBUG_PATTERN_MATCH
@@ -1149,35 +1833,32 @@ static char* match_host_dir_entry(const char *path, const char *name, bool patte
 #endif
 	if (pattern)
 	{
-		while ((entry = readdir(dir)))
+		for (i = 0; i < ce->nnames; i++)
 		{
-			char *d_name = entry->d_name;
-			Str_DecomposedToPrecomposedUtf8(d_name, d_name);   /* for OSX */
-			if (fsfirst_match(name, d_name))
+			if (fsfirst_match(name, ce->pool + ce->offsets[i]))
 			{
-				match = strdup(d_name);
+				match = ce->pool + ce->offsets[i];
 				break;
 			}
 		}
 	}
 	else
 	{
-		while ((entry = readdir(dir)))
+		/* several host names can differ only by case, use first one */
+		idx = ce->nnames;
+		slot = DirCache_Hash(name) & ce->hashmask;
+		for (; (i = ce->hash[slot]) >= 0; slot = (slot + 1) & ce->hashmask)
 		{
-			char *d_name = entry->d_name;
-			Str_DecomposedToPrecomposedUtf8(d_name, d_name);   /* for OSX */
-			if (strcasecmp(name, d_name) == 0)
-			{
-				match = strdup(d_name);
-				break;
-			}
+			if (i < idx && strcasecmp(name, ce->pool + ce->offsets[i]) == 0)
+				idx = i;
 		}
+		if (idx < ce->nnames)
+			match = ce->pool + ce->offsets[idx];
 	}
-	closedir(dir);
 #if DEBUG_PATTERN_MATCH
 	fprintf(stderr, "-> '%s'\n", match);
 #endif
-	return match;
+	return match ? strdup(match) : NULL;
 }
 
 
@@ -1724,6 +2405,7 @@ static bool GemDOS_MkDir(Uint32 Params)
 {
 	char *pDirName, *psDirPath;
 	int Drive;
+	Sint32 nResult;
 	uint32_t nStrAddr = STMemory_ReadLong(Params);
 
 	pDirName = STMemory_GetStringPointer(nStrAddr);
@@ -1765,10 +2447,17 @@ static bool GemDOS_MkDir(Uint32 Params)
 	GemDOS_CreateHardDriveFileName(Drive, pDirName, psDirPath, FILENAME_MAX);
 	
 	/* Attempt to make directory */
-	if (mkdir(psDirPath, 0755) == 0)
-		Regs[REG_D0] = GEMDOS_EOK;
+	if (GemDOS_ReplayHostOp(&nResult, NULL, 0))
+		Regs[REG_D0] = nResult;
 	else
-		Regs[REG_D0] = errno2gemdos(errno, ERROR_PATH);
+	{
+		DirCache_Invalidate(psDirPath);
+		if (mkdir(psDirPath, 0755) == 0)
+			Regs[REG_D0] = GEMDOS_EOK;
+		else
+			Regs[REG_D0] = errno2gemdos(errno, ERROR_PATH);
+		GemDOS_RecordHostOp(Regs[REG_D0], NULL, 0);
+	}
 	free(psDirPath);
 	return true;
 }
@@ -1782,6 +2471,7 @@ static bool GemDOS_RmDir(Uint32 Params)
 {
 	char *pDirName, *psDirPath;
 	int Drive;
+	Sint32 nResult;
 	uint32_t nStrAddr = STMemory_ReadLong(Params);
 
 	pDirName = STMemory_GetStringPointer(nStrAddr);
@@ -1823,10 +2513,17 @@ static bool GemDOS_RmDir(Uint32 Params)
 	GemDOS_CreateHardDriveFileName(Drive, pDirName, psDirPath, FILENAME_MAX);
 
 	/* Attempt to remove directory */
-	if (rmdir(psDirPath) == 0)
-		Regs[REG_D0] = GEMDOS_EOK;
+	if (GemDOS_ReplayHostOp(&nResult, NULL, 0))
+		Regs[REG_D0] = nResult;
 	else
-		Regs[REG_D0] = errno2gemdos(errno, ERROR_PATH);
+	{
+		DirCache_Invalidate(psDirPath);
+		if (rmdir(psDirPath) == 0)
+			Regs[REG_D0] = GEMDOS_EOK;
+		else
+			Regs[REG_D0] = errno2gemdos(errno, ERROR_PATH);
+		GemDOS_RecordHostOp(Regs[REG_D0], NULL, 0);
+	}
 	free(psDirPath);
 	return true;
 }
@@ -1942,6 +2639,48 @@ static inline bool redirect_to_TOS(void)
 	return false;
 }
 
+/*-----------------------------------------------------------------------*/
+/**
+ * Set up given file handle for Fcreate/Fopen result replayed for reverse
+ * debugging.  Host file is opened without truncating it, or if it's
+ * not there anymore, a temporary file is used instead (file contents
+ * and write results are replayed from the recorded ones).
+ */
+static bool GemDOS_ReplayOpen(int Index, Sint32 nResult, off_t nSize,
+                              const char *szActualFileName, const char *ModeStr)
+{
+	FILE *fp;
+
+	Regs[REG_D0] = nResult;
+	if (nResult < 0)
+		return true;
+
+	fp = fopen(szActualFileName, ModeStr[0] == 'r' ? ModeStr : "rb+");
+	if (!fp)
+		fp = fopen(szActualFileName, "rb");
+	if (!fp)
+		fp = tmpfile();
+	if (!fp)
+	{
+		Log_Printf(LOG_WARN, "GEMDOS failed to replay opening '%s'\n", szActualFileName);
+		Regs[REG_D0] = GEMDOS_EACCDN;
+		return true;
+	}
+	FileHandles[Index].FileHandle = fp;
+	FileHandles[Index].bUsed = true;
+	strcpy(FileHandles[Index].szMode, ModeStr);
+	GemDOS_InitFileHandle(&FileHandles[Index], 0);
+	FileHandles[Index].nSize = nSize;
+	FileHandles[Index].Basepage = STMemory_ReadLong(act_pd);
+	snprintf(FileHandles[Index].szActualName,
+		 sizeof(FileHandles[Index].szActualName),
+		 "%s", szActualFileName);
+
+	Regs[REG_D0] = Index+BASE_FILEHANDLE;
+	LOG_TRACE(TRACE_OS_GEMDOS|TRACE_OS_BASE, "-> FD %d (replayed)\n", Regs[REG_D0]);
+	return true;
+}
+
 /*-----------------------------------------------------------------------*/
 /**
  * GEMDOS Create file
@@ -1953,6 +2692,8 @@ static bool GemDOS_Create(Uint32 Params)
 	char szActualFileName[MAX_GEMDOS_PATH];
 	char *pszFileName;
 	int Drive, Index;
+	Sint32 nResult;
+	off_t nSize = 0;
 	uint32_t nStrAddr = STMemory_ReadLong(Params);
 	int Mode = STMemory_ReadWord(Params + SIZE_LONG);
 
@@ -2006,7 +2747,11 @@ static bool GemDOS_Create(Uint32 Params)
 		return true;
 	}
 	
+	if (GemDOS_ReplayHostOp(&nResult, &nSize, sizeof(nSize)))
+		return GemDOS_ReplayOpen(Index, nResult, nSize, szActualFileName, "wb+");
+
 	/* truncate and open for reading & writing */
+	DirCache_Invalidate(szActualFileName);
 	FileHandles[Index].FileHandle = fopen(szActualFileName, "wb+");
 
 	if (FileHandles[Index].FileHandle != NULL)
@@ -2029,6 +2774,7 @@ static bool GemDOS_Create(Uint32 Params)
 		/* Tag handle table entry as used in this process and return handle */
 		FileHandles[Index].bUsed = true;
 		strcpy(FileHandles[Index].szMode, "wb+");
+		GemDOS_InitFileHandle(&FileHandles[Index], 0);
 		FileHandles[Index].Basepage = STMemory_ReadLong(act_pd);
 		snprintf(FileHandles[Index].szActualName,
 			 sizeof(FileHandles[Index].szActualName),
@@ -2038,30 +2784,29 @@ static bool GemDOS_Create(Uint32 Params)
 		Regs[REG_D0] = Index+BASE_FILEHANDLE;
 		LOG_TRACE(TRACE_OS_GEMDOS|TRACE_OS_BASE, "-> FD %d (%s)\n", Regs[REG_D0],
 			  Mode & GEMDOS_FILE_ATTRIB_READONLY ? "read-only":"read/write");
-		return true;
+		nSize = FileHandles[Index].nSize;
 	}
-	LOG_TRACE(TRACE_OS_GEMDOS|TRACE_OS_BASE, "-> ERROR (errno = %d)\n", errno);
-
-	/* We failed to create the file, did we have required access rights? */
-	if (errno == EACCES || errno == EROFS ||
-	    errno == EPERM || errno == EISDIR)
+	else
 	{
-		Log_Printf(LOG_WARN, "GEMDOS failed to create/truncate '%s'\n",
-			   szActualFileName);
-		Regs[REG_D0] = GEMDOS_EACCDN;
-		return true;
-	}
+		LOG_TRACE(TRACE_OS_GEMDOS|TRACE_OS_BASE, "-> ERROR (errno = %d)\n", errno);
 
-	/* Or was path to file missing? (ST-Zip 2.6 relies on getting
-	 * correct error about that during extraction of ZIP files.)
-	 */
-	if (errno == ENOTDIR || GemDOS_FilePathMissing(szActualFileName))
-	{
-		Regs[REG_D0] = GEMDOS_EPTHNF; /* Path not found */
-		return true;
+		/* We failed to create the file, did we have required access rights? */
+		if (errno == EACCES || errno == EROFS ||
+		    errno == EPERM || errno == EISDIR)
+		{
+			Log_Printf(LOG_WARN, "GEMDOS failed to create/truncate '%s'\n",
+				   szActualFileName);
+			Regs[REG_D0] = GEMDOS_EACCDN;
+		}
+		/* Or was path to file missing? (ST-Zip 2.6 relies on getting
+		 * correct error about that during extraction of ZIP files.)
+		 */
+		else if (errno == ENOTDIR || GemDOS_FilePathMissing(szActualFileName))
+			Regs[REG_D0] = GEMDOS_EPTHNF; /* Path not found */
+		else
+			Regs[REG_D0] = GEMDOS_EFILNF; /* File not found */
 	}
-
-	Regs[REG_D0] = GEMDOS_EFILNF;         /* File not found */
+	GemDOS_RecordHostOp(Regs[REG_D0], &nSize, sizeof(nSize));
 	return true;
 }
 
@@ -2082,6 +2827,8 @@ static bool GemDOS_Open(Uint32 Params)
 	int Drive, Index;
 	FILE *OverrideHandle;
 	bool bToTos = false;
+	Sint32 nResult;
+	off_t nSize = 0;
 	uint32_t nStrAddr = STMemory_ReadLong(Params);
 	int Mode = STMemory_ReadWord(Params+SIZE_LONG) & 3;
 
@@ -2169,6 +2916,8 @@ static bool GemDOS_Open(Uint32 Params)
 			ModeStr = "rb+";
 			RealMode = "read+write";
 		}
+		if (GemDOS_ReplayHostOp(&nResult, &nSize, sizeof(nSize)))
+			return GemDOS_ReplayOpen(Index, nResult, nSize, szActualFileName, ModeStr);
 		FileHandles[Index].FileHandle = fopen(szActualFileName, ModeStr);
 	}
 
@@ -2177,6 +2926,8 @@ static bool GemDOS_Open(Uint32 Params)
 		/* Tag handle table entry as used in this process and return handle */
 		FileHandles[Index].bUsed = true;
 		strcpy(FileHandles[Index].szMode, ModeStr);
+		/* virtual INF file can be at non-zero position */
+		GemDOS_InitFileHandle(&FileHandles[Index], OverrideHandle ? ftello(OverrideHandle) : 0);
 		FileHandles[Index].Basepage = STMemory_ReadLong(act_pd);
 		snprintf(FileHandles[Index].szActualName,
 			 sizeof(FileHandles[Index].szActualName),
@@ -2186,6 +2937,8 @@ static bool GemDOS_Open(Uint32 Params)
 		Regs[REG_D0] = Index+BASE_FILEHANDLE;
 		LOG_TRACE(TRACE_OS_GEMDOS|TRACE_OS_BASE, "-> FD %d (%s -> %s)\n",
 			  Regs[REG_D0], Modes[Mode], RealMode);
+		if (!OverrideHandle)
+			GemDOS_RecordHostOp(Regs[REG_D0], &FileHandles[Index].nSize, sizeof(nSize));
 		return true;
 	}
 
@@ -2207,6 +2960,7 @@ static bool GemDOS_Open(Uint32 Params)
 		Regs[REG_D0] = GEMDOS_EFILNF;
 	}
 	LOG_TRACE(TRACE_OS_GEMDOS|TRACE_OS_BASE, "-> ERROR %d (errno = %d)\n", Regs[REG_D0], errno);
+	GemDOS_RecordHostOp(Regs[REG_D0], &nSize, sizeof(nSize));
 	return true;
 }
 
@@ -2238,6 +2992,11 @@ static bool GemDOS_Close(Uint32 Params)
 	{
 		FileHandles[Handle].bUsed = false;
 	}
+	else if (FileHandles[Handle].szMode[0] != 'r' || FileHandles[Handle].szMode[2] == '+')
+	{
+		/* size and time in cached Fsfirst() results may have changed */
+		DirCache_Invalidate(FileHandles[Handle].szActualName);
+	}
 	GemDOS_CloseFileHandle(Handle);
 
 	/* unalias handle */
@@ -2259,8 +3018,9 @@ static bool GemDOS_Close(Uint32 Params)
 static bool GemDOS_Read(Uint32 Params)
 {
 	char *pBuffer;
-	off_t CurrentPos, FileSize;
-	long nBytesRead, nBytesLeft;
+	FILE_HANDLE *fh;
+	long nBytesRead;
+	off_t nBytesLeft;
 	Uint32 Addr;
 	Uint32 Size;
 	int Handle;
@@ -2289,23 +3049,18 @@ static bool GemDOS_Read(Uint32 Params)
 		return true;
 	}
 	
-	/* To quick check to see where our file pointer is and how large the file is */
-	CurrentPos = ftello(FileHandles[Handle].FileHandle);
-	if (CurrentPos == -1L
-	    || fseeko(FileHandles[Handle].FileHandle, 0, SEEK_END) != 0)
-	{
-		Regs[REG_D0] = GEMDOS_E_SEEK;
-		return true;
-	}
-	FileSize = ftello(FileHandles[Handle].FileHandle);
-	if (FileSize == -1L
-	    || fseeko(FileHandles[Handle].FileHandle, CurrentPos, SEEK_SET) != 0)
+	/* Position and size are tracked by the handle. Size is checked
+	 * from the host only when read goes past it, in case the file
+	 * has grown in meanwhile.
+	 */
+	fh = &FileHandles[Handle];
+	nBytesLeft = fh->nSize - fh->nPos;
+	if (Size > nBytesLeft && !GemDOS_UpdateFileSize(fh))
 	{
 		Regs[REG_D0] = GEMDOS_E_SEEK;
 		return true;
 	}
-
-	nBytesLeft = FileSize-CurrentPos;
+	nBytesLeft = fh->nSize - fh->nPos;
 
 	/* Check for bad size and End Of File */
 	if (Size <= 0 || nBytesLeft <= 0)
@@ -2316,7 +3071,7 @@ static bool GemDOS_Read(Uint32 Params)
 	}
 
 	/* Limit to size of file to prevent errors */
-	if (Size > (Uint32)nBytesLeft)
+	if (Size > nBytesLeft)
 		Size = nBytesLeft;
 
 	/* Check that read is to valid memory area */
@@ -2327,20 +3082,19 @@ static bool GemDOS_Read(Uint32 Params)
 		return true;
 	}
 
-	/* Atari memory modified directly with fread() -> flush the instr/data caches */
+	/* Atari memory modified directly with pread() -> flush the instr/data caches */
 	M68000_Flush_All_Caches(Addr, Size);
 
 	/* And read data in */
 	pBuffer = (char *)STMemory_STAddrToPointer(Addr);
-	nBytesRead = fread(pBuffer, 1, Size, FileHandles[Handle].FileHandle);
-	
-	if (ferror(FileHandles[Handle].FileHandle))
+	nBytesRead = GemDOS_ReadFile(fh, pBuffer, Size);
+
+	if (nBytesRead < 0)
 	{
 		int errnum = errno;
 		Log_Printf(LOG_WARN, "GEMDOS failed to read from '%s': %s\n",
-			   FileHandles[Handle].szActualName, strerror(errno));
+			   fh->szActualName, strerror(errno));
 		Regs[REG_D0] = errno2gemdos(errnum, ERROR_FILE);
-		clearerr(FileHandles[Handle].FileHandle);
 	}
 	else
 		/* Return number of bytes read */
@@ -2404,20 +3158,24 @@ static bool GemDOS_Write(Uint32 Params)
 	}
 
 	pBuffer = (char *)STMemory_STAddrToPointer(Addr);
-	nBytesWritten = fwrite(pBuffer, 1, Size, fp);
-	if (fh_idx >= 0 && ferror(fp))
+	if (fh_idx >= 0)
 	{
-		int errnum = errno;
-		Log_Printf(LOG_WARN, "GEMDOS failed to write to '%s'\n",
-			   FileHandles[fh_idx].szActualName);
-		Regs[REG_D0] = errno2gemdos(errnum, ERROR_FILE);
-		clearerr(fp);
+		nBytesWritten = GemDOS_WriteFile(&FileHandles[fh_idx], pBuffer, Size);
+		if (nBytesWritten < 0)
+		{
+			int errnum = errno;
+			Log_Printf(LOG_WARN, "GEMDOS failed to write to '%s'\n",
+				   FileHandles[fh_idx].szActualName);
+			Regs[REG_D0] = errno2gemdos(errnum, ERROR_FILE);
+			return true;
+		}
 	}
 	else
 	{
+		nBytesWritten = fwrite(pBuffer, 1, Size, fp);
 		fflush(fp);
-		Regs[REG_D0] = nBytesWritten;      /* OK */
 	}
+	Regs[REG_D0] = nBytesWritten;      /* OK */
 	return true;
 }
 
@@ -2431,6 +3189,7 @@ static bool GemDOS_FDelete(Uint32 Params)
 {
 	char *pszFileName, *psActualFileName;
 	int Drive;
+	Sint32 nResult;
 	uint32_t nStrAddr = STMemory_ReadLong(Params);
 
 	pszFileName = STMemory_GetStringPointer(nStrAddr);
@@ -2472,10 +3231,17 @@ static bool GemDOS_FDelete(Uint32 Params)
 	GemDOS_CreateHardDriveFileName(Drive, pszFileName, psActualFileName, FILENAME_MAX);
 
 	/* Now delete file?? */
-	if (unlink(psActualFileName) == 0)
-		Regs[REG_D0] = GEMDOS_EOK;          /* OK */
+	if (GemDOS_ReplayHostOp(&nResult, NULL, 0))
+		Regs[REG_D0] = nResult;
 	else
-		Regs[REG_D0] = errno2gemdos(errno, ERROR_FILE);
+	{
+		DirCache_Invalidate(psActualFileName);
+		if (unlink(psActualFileName) == 0)
+			Regs[REG_D0] = GEMDOS_EOK;          /* OK */
+		else
+			Regs[REG_D0] = errno2gemdos(errno, ERROR_FILE);
+		GemDOS_RecordHostOp(Regs[REG_D0], NULL, 0);
+	}
 
 	free(psActualFileName);
 	return true;
@@ -2491,9 +3257,8 @@ static bool GemDOS_LSeek(Uint32 Params)
 {
 	long Offset;
 	int Handle, Mode;
-	long nFileSize;
-	long nOldPos, nDestPos;
-	FILE *fhndl;
+	off_t nDestPos;
+	FILE_HANDLE *fh;
 
 	/* Read details from stack */
 	Offset = (Sint32)STMemory_ReadLong(Params);
@@ -2510,45 +3275,106 @@ static bool GemDOS_LSeek(Uint32 Params)
 		return false;
 	}
 
-	fhndl = FileHandles[Handle].FileHandle;
-
-	/* Save old position in file */
-	nOldPos = ftell(fhndl);
+	fh = &FileHandles[Handle];
 
-	/* Determine the size of the file */
-	if (fseek(fhndl, 0L, SEEK_END) != 0 || nOldPos < 0)
+	/* File size is needed only for seeks relative to the end,
+	 * or past the size known by the handle
+	 */
+	if (Mode == 2 && !GemDOS_UpdateFileSize(fh))
 	{
 		Regs[REG_D0] = GEMDOS_E_SEEK;
 		return true;
 	}
-	nFileSize = ftell(fhndl);
 
 	switch (Mode)
 	{
 	 case 0: nDestPos = Offset; break; /* positive offset */
-	 case 1: nDestPos = nOldPos + Offset; break;
-	 case 2: nDestPos = nFileSize + Offset; break; /* negative offset */
+	 case 1: nDestPos = fh->nPos + Offset; break;
+	 case 2: nDestPos = fh->nSize + Offset; break; /* negative offset */
 	 default: nDestPos = -1;
 	}
 
-	if (nDestPos < 0 || nDestPos > nFileSize)
+	if (nDestPos > fh->nSize && !GemDOS_UpdateFileSize(fh))
+	{
+		Regs[REG_D0] = GEMDOS_E_SEEK;
+		return true;
+	}
+	if (nDestPos < 0 || nDestPos > fh->nSize)
 	{
-		/* Restore old position and return error */
-		if (fseek(fhndl, nOldPos, SEEK_SET) != 0)
-			perror("GemDOS_LSeek");
+		/* Keep old position and return error */
 		Regs[REG_D0] = GEMDOS_ERANGE;
 		return true;
 	}
 
-	/* Seek to new position and return offset from start of file */
-	if (fseek(fhndl, nDestPos, SEEK_SET) != 0)
-		perror("GemDOS_LSeek");
-	Regs[REG_D0] = ftell(fhndl);
+	/* Set new position and return offset from start of file */
+	fh->nPos = nDestPos;
+	Regs[REG_D0] = nDestPos;
 
 	return true;
 }
 
 
+/*-----------------------------------------------------------------------*/
+/**
+ * Set given host file or directory attributes for Fattrib().
+ * Return GEMDOS result.
+ */
+static Sint32 GemDOS_SetAttributes(const char *sActualFileName, const char *psFileName, int nAttrib)
+{
+	struct stat FileStat;
+	mode_t nMode;
+
+	if (stat(sActualFileName, &FileStat) != 0)
+		return GEMDOS_EFILNF;         /* File not found */
+
+	/* prevent modifying access rights both on write & auto-protected devices */
+	if (ConfigureParams.HardDisk.nWriteProtection != WRITEPROT_OFF)
+	{
+		Log_Printf(LOG_WARN, "PREVENTED: GEMDOS Fattrib(\"%s\",...)\n", psFileName);
+		return GEMDOS_EWRPRO;
+	}
+
+	if (nAttrib & GEMDOS_FILE_ATTRIB_SUBDIRECTORY)
+	{
+		if (!S_ISDIR(FileStat.st_mode))
+		{
+			/* file, not dir -> path not found */
+			return GEMDOS_EPTHNF;
+		}
+	}
+	else
+	{
+		if (S_ISDIR(FileStat.st_mode))
+		{
+			/* dir, not file -> file not found */
+			return GEMDOS_EFILNF;
+		}
+	}
+	
+	if (nAttrib & GEMDOS_FILE_ATTRIB_READONLY)
+	{
+		/* set read-only (readable by all) */
+		nMode = S_IRUSR|S_IRGRP|S_IROTH;
+	}
+	else
+	{
+		/* set writable (by user, readable by all) */
+		nMode = S_IWUSR|S_IRUSR|S_IRGRP|S_IROTH;
+	}
+	
+	/* FIXME: support hidden/system/archive flags?
+	 * System flag is from DOS, not used by TOS.
+	 * Archive bit is cleared by backup programs
+	 * and set whenever file is written to.
+	 */
+
+	if (chmod(sActualFileName, nMode) != 0)
+		return errno2gemdos(errno, (nAttrib & GEMDOS_FILE_ATTRIB_SUBDIRECTORY) ? ERROR_PATH : ERROR_FILE);
+	/* chmod() doesn't change directory mtime, so cached Fsfirst() results would stay */
+	DirCache_Invalidate(sActualFileName);
+	return nAttrib;
+}
+
 /*-----------------------------------------------------------------------*/
 /**
  * GEMDOS Fattrib() - get or set file and directory attributes
@@ -2561,6 +3387,7 @@ static bool GemDOS_Fattrib(Uint32 Params)
 	char *psFileName;
 	int nDrive;
 	struct stat FileStat;
+	Sint32 nResult;
 	uint32_t nStrAddr = STMemory_ReadLong(Params);
 	int nRwFlag = STMemory_ReadWord(Params + SIZE_LONG);
 	int nAttrib = STMemory_ReadWord(Params + SIZE_LONG + SIZE_WORD);
@@ -2595,71 +3422,23 @@ static bool GemDOS_Fattrib(Uint32 Params)
 		Regs[REG_D0] = GEMDOS_EFILNF;         /* File not found */
 		return true;
 	}
-	if (stat(sActualFileName, &FileStat) != 0)
-	{
-		Regs[REG_D0] = GEMDOS_EFILNF;         /* File not found */
-		return true;
-	}
 	if (nRwFlag == 0)
 	{
 		/* Read attributes */
-		Regs[REG_D0] = GemDOS_ConvertAttribute(FileStat.st_mode);
+		if (stat(sActualFileName, &FileStat) != 0)
+			Regs[REG_D0] = GEMDOS_EFILNF;         /* File not found */
+		else
+			Regs[REG_D0] = GemDOS_ConvertAttribute(FileStat.st_mode);
 		return true;
 	}
 
-	/* prevent modifying access rights both on write & auto-protected devices */
-	if (ConfigureParams.HardDisk.nWriteProtection != WRITEPROT_OFF)
+	if (GemDOS_ReplayHostOp(&nResult, NULL, 0))
 	{
-		Log_Printf(LOG_WARN, "PREVENTED: GEMDOS Fattrib(\"%s\",...)\n", psFileName);
-		Regs[REG_D0] = GEMDOS_EWRPRO;
+		Regs[REG_D0] = nResult;
 		return true;
 	}
-
-	if (nAttrib & GEMDOS_FILE_ATTRIB_SUBDIRECTORY)
-	{
-		if (!S_ISDIR(FileStat.st_mode))
-		{
-			/* file, not dir -> path not found */
-			Regs[REG_D0] = GEMDOS_EPTHNF;
-			return true;
-		}
-	}
-	else
-	{
-		if (S_ISDIR(FileStat.st_mode))
-		{
-			/* dir, not file -> file not found */
-			Regs[REG_D0] = GEMDOS_EFILNF;
-			return true;
-		}
-	}
-	
-	if (nAttrib & GEMDOS_FILE_ATTRIB_READONLY)
-	{
-		/* set read-only (readable by all) */
-		if (chmod(sActualFileName, S_IRUSR|S_IRGRP|S_IROTH) == 0)
-		{
-			Regs[REG_D0] = nAttrib;
-			return true;
-		}
-	}
-	else
-	{
-		/* set writable (by user, readable by all) */
-		if (chmod(sActualFileName, S_IWUSR|S_IRUSR|S_IRGRP|S_IROTH) == 0)
-		{
-			Regs[REG_D0] = nAttrib;
-			return true;
-		}
-	}
-	
-	/* FIXME: support hidden/system/archive flags?
-	 * System flag is from DOS, not used by TOS.
-	 * Archive bit is cleared by backup programs
-	 * and set whenever file is written to.
-	 */
-
-	Regs[REG_D0] = errno2gemdos(errno, (nAttrib & GEMDOS_FILE_ATTRIB_SUBDIRECTORY) ? ERROR_PATH : ERROR_FILE);
+	Regs[REG_D0] = GemDOS_SetAttributes(sActualFileName, psFileName, nAttrib);
+	GemDOS_RecordHostOp(Regs[REG_D0], NULL, 0);
 	return true;
 }
 
@@ -2869,7 +3648,7 @@ static int GemDOS_Pexec(Uint32 Params)
  */
 static bool GemDOS_SNext(void)
 {
-	struct dirent **temp;
+	DIR_SNAPSHOT *snap;
 	int ret;
 	DTA *pDTA;
 	Uint32 DTA_Gemdos;
@@ -2915,10 +3694,10 @@ static bool GemDOS_SNext(void)
 		return true;
 	}
 
-	temp = InternalDTAs[Index].found;
+	snap = InternalDTAs[Index].snap;
 	do
 	{
-		if (InternalDTAs[Index].centry >= InternalDTAs[Index].nentries)
+		if (!snap || InternalDTAs[Index].centry >= snap->nentries)
 		{
 			/* older TOS versions zero file name if there are no (further) matches */
 			if (TosVersion < 0x0400)
@@ -2928,7 +3707,7 @@ static bool GemDOS_SNext(void)
 		}
 
 		ret = PopulateDTA(InternalDTAs[Index].path,
-				  temp[InternalDTAs[Index].centry++],
+				  &snap->entries[InternalDTAs[Index].centry++],
 				  pDTA, DTA_Gemdos);
 	} while (ret == DTA_SKIP);
 
@@ -2954,11 +3733,8 @@ static bool GemDOS_SFirst(Uint32 Params)
 	/* TODO: host filenames might not fit into this */
 	char szActualFileName[MAX_GEMDOS_PATH];
 	char *pszFileName;
-	const char *dirmask;
-	struct dirent **files;
 	int Drive;
-	DIR *fsdir;
-	int i, j, count;
+	DIR_SNAPSHOT *snap;
 	DTA *pDTA;
 	Uint32 DTA_Gemdos;
 	Uint16 useidx;
@@ -3037,59 +3813,26 @@ static bool GemDOS_SFirst(Uint32 Params)
 		return true;
 	}
 
-	/* open directory
+	/* read directory, or use earlier results for it
 	 * TODO: host path may not fit into InternalDTA
 	 */
 	fsfirst_dirname(szActualFileName, InternalDTAs[useidx].path);
-	fsdir = opendir(InternalDTAs[useidx].path);
-
-	if (fsdir == NULL)
+	snap = DirSnap_Get(InternalDTAs[useidx].path, fsfirst_dirmask(szActualFileName));
+	if (!snap)
 	{
 		Regs[REG_D0] = GEMDOS_EPTHNF;        /* Path not found */
 		return true;
 	}
-	/* close directory */
-	closedir(fsdir);
-
-	count = scandir(InternalDTAs[useidx].path, &files, 0, alphasort);
-	/* File (directory actually) not found */
-	if (count < 0)
-	{
-		Regs[REG_D0] = GEMDOS_EFILNF;
-		return true;
-	}
-
 	InternalDTAs[useidx].centry = 0;          /* current entry is 0 */
-	dirmask = fsfirst_dirmask(szActualFileName);/* directory mask part */
-	InternalDTAs[useidx].found = files;       /* get files */
-
-	/* count & copy the entries that match our mask and discard the rest */
-	j = 0;
-	for (i=0; i < count; i++)
-	{
-		char *d_name = files[i]->d_name;
-		Str_DecomposedToPrecomposedUtf8(d_name, d_name);   /* for OSX */
-		if (fsfirst_match(dirmask, d_name))
-		{
-			InternalDTAs[useidx].found[j] = files[i];
-			j++;
-		}
-		else
-		{
-			free(files[i]);
-			files[i] = NULL;
-		}
-	}
-	InternalDTAs[useidx].nentries = j; /* set number of legal entries */
 
 	/* No files of that match, return error code */
-	if (j==0)
+	if (snap->nentries == 0)
 	{
-		free(files);
-		InternalDTAs[useidx].found = NULL;
+		DirSnap_Release(snap);
 		Regs[REG_D0] = GEMDOS_EFILNF;        /* File not found */
 		return true;
 	}
+	InternalDTAs[useidx].snap = snap;
 
 	/* Scan for first file (SNext uses no parameters) */
 	GemDOS_SNext();
@@ -3139,6 +3882,7 @@ static bool GemDOS_Rename(Uint32 Params)
 	char szNewActualFileName[MAX_GEMDOS_PATH];
 	char szOldActualFileName[MAX_GEMDOS_PATH];
 	int NewDrive, OldDrive;
+	Sint32 nResult;
 	uint32_t nOldStrAddr = STMemory_ReadLong(Params + SIZE_WORD);
 	uint32_t nNewStrAddr = STMemory_ReadLong(Params + SIZE_WORD + SIZE_LONG);
 
@@ -3178,10 +3922,18 @@ static bool GemDOS_Rename(Uint32 Params)
 		              szOldActualFileName, sizeof(szOldActualFileName));
 
 	/* Rename files */
+	if (GemDOS_ReplayHostOp(&nResult, NULL, 0))
+	{
+		Regs[REG_D0] = nResult;
+		return true;
+	}
+	DirCache_Invalidate(szOldActualFileName);
+	DirCache_Invalidate(szNewActualFileName);
 	if (rename(szOldActualFileName,szNewActualFileName) == 0)
 		Regs[REG_D0] = GEMDOS_EOK;
 	else
 		Regs[REG_D0] = errno2gemdos(errno, ERROR_FILE);
+	GemDOS_RecordHostOp(Regs[REG_D0], NULL, 0);
 	return true;
 }
 
@@ -3196,6 +3948,7 @@ static bool GemDOS_GSDToF(Uint32 Params)
 	DATETIME DateTime;
 	Uint32 pBuffer;
 	int Handle,Flag;
+	Sint32 nResult;
 
 	/* Read details from stack */
 	pBuffer = STMemory_ReadLong(Params);
@@ -3222,12 +3975,22 @@ static bool GemDOS_GSDToF(Uint32 Params)
 			Regs[REG_D0] = GEMDOS_EWRPRO;
 			return true;
 		}
+		if (GemDOS_ReplayHostOp(&nResult, NULL, 0))
+		{
+			Regs[REG_D0] = nResult;
+			return true;
+		}
 		DateTime.timeword = STMemory_ReadWord(pBuffer);
 		DateTime.dateword = STMemory_ReadWord(pBuffer+SIZE_WORD);
 		if (GemDOS_SetFileInformation(Handle, &DateTime) == true)
+		{
+			/* utime() doesn't change directory mtime, drop cached Fsfirst() results */
+			DirCache_Invalidate(FileHandles[Handle].szActualName);
 			Regs[REG_D0] = GEMDOS_EOK;
+		}
 		else
 			Regs[REG_D0] = GEMDOS_EACCDN;        /* Access denied */
+		GemDOS_RecordHostOp(Regs[REG_D0], NULL, 0);
 		return true;
 	}
 
@@ -3859,11 +4622,11 @@ void GemDOS_Info(FILE *fp, Uint32 bShowOpcodes)
 		fprintf(fp, "+ %d: %s\n", i, InternalDTAs[i].path);
 		
 		centry = InternalDTAs[i].centry;
-		entries = InternalDTAs[i].nentries;
+		entries = InternalDTAs[i].snap ? InternalDTAs[i].snap->nentries : 0;
 		for (j = 0; j < entries; j++)
 		{
 			fprintf(fp, "  - %d: %s%s\n",
-				j, InternalDTAs[i].found[j]->d_name,
+				j, InternalDTAs[i].snap->entries[j].name,
 				j == centry ? " *" : "");
 		}
 		fprintf(fp, "  Fsnext entry = %d.\n", centry);
@@ -3999,6 +4762,8 @@ int GemDOS_Trap(void)
 		break;
 	 case 0x36:
 		Finished = GemDOS_DFree(Params);
+		if (Finished)
+			GemDOS_SyncHostQuery(STMemory_ReadLong(Params), 4*SIZE_LONG);
 		break;
 	 case 0x39:
 		Finished = GemDOS_MkDir(Params);
@@ -4032,6 +4797,9 @@ int GemDOS_Trap(void)
 		break;
 	 case 0x43:
 		Finished = GemDOS_Fattrib(Params);
+		/* attribute setting is recorded by Fattrib() itself */
+		if (Finished && STMemory_ReadWord(Params + SIZE_LONG) == 0)
+			GemDOS_SyncHostQuery(0, 0);
 		break;
 	 case 0x46:
 		Finished = GemDOS_Force(Params);
@@ -4052,15 +4820,22 @@ int GemDOS_Trap(void)
 		break;
 	 case 0x4e:
 		Finished = GemDOS_SFirst(Params);
+		if (Finished)
+			GemDOS_SyncHostQueryDTA();
 		break;
 	 case 0x4f:
 		Finished = GemDOS_SNext();
+		if (Finished)
+			GemDOS_SyncHostQueryDTA();
 		break;
 	 case 0x56:
 		Finished = GemDOS_Rename(Params);
 		break;
 	 case 0x57:
 		Finished = GemDOS_GSDToF(Params);
+		/* date & time setting is recorded by Fdatime() itself */
+		if (Finished && STMemory_ReadWord(Params + SIZE_LONG + SIZE_WORD) == 0)
+			GemDOS_SyncHostQuery(STMemory_ReadLong(Params), 2*SIZE_WORD);
 		break;
 
 	/* print args for other calls */
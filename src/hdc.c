@@ -148,6 +148,7 @@ static Uint8 *HDC_PrepRespBuf(SCSI_CTRLR *ctr, int size)
 		ctr->buffer = realloc(ctr->buffer, size);
 	}
 
+	ctr->data = ctr->buffer;
 	return ctr->buffer;
 }
 
@@ -186,8 +187,7 @@ static void HDC_Cmd_Seek(SCSI_CTRLR *ctr)
 	LOG_TRACE(TRACE_SCSI_CMD, "HDC: SEEK (%s), LBA=%i",
 	          HDC_CmdInfoStr(ctr), dev->nLastBlockAddr);
 
-	if (dev->nLastBlockAddr < dev->hdSize &&
-	    fseeko(dev->image_file, (off_t)dev->nLastBlockAddr * dev->blockSize, SEEK_SET) == 0)
+	if (dev->nLastBlockAddr < dev->hdSize)
 	{
 		LOG_TRACE(TRACE_SCSI_CMD, " -> OK\n");
 		ctr->status = HD_STATUS_OK;
@@ -521,9 +521,7 @@ static void HDC_Cmd_WriteSector(SCSI_CTRLR *ctr)
 	LOG_TRACE(TRACE_SCSI_CMD, "HDC: WRITE SECTOR (%s) with LBA 0x%x",
 	          HDC_CmdInfoStr(ctr), dev->nLastBlockAddr);
 
-	/* seek to the position */
-	if (dev->nLastBlockAddr >= dev->hdSize ||
-	    fseeko(dev->image_file, (off_t)dev->nLastBlockAddr * dev->blockSize, SEEK_SET) != 0)
+	if (dev->nLastBlockAddr >= dev->hdSize)
 	{
 		ctr->status = HD_STATUS_ERROR;
 		dev->nLastError = HD_REQSENS_INVADDR;
@@ -534,7 +532,8 @@ static void HDC_Cmd_WriteSector(SCSI_CTRLR *ctr)
 		if (ctr->data_len)
 		{
 			HDC_PrepRespBuf(ctr, ctr->data_len);
-			ctr->dmawrite_to_fh = dev->image_file;
+			ctr->dmawrite_to_bd = &dev->bdev;
+			ctr->dmawrite_offset = (off_t)dev->nLastBlockAddr * dev->blockSize;
 			ctr->status = HD_STATUS_OK;
 			dev->nLastError = HD_REQSENS_OK;
 		}
@@ -558,26 +557,41 @@ static void HDC_Cmd_WriteSector(SCSI_CTRLR *ctr)
 static void HDC_Cmd_ReadSector(SCSI_CTRLR *ctr)
 {
 	SCSI_DEV *dev = &ctr->devs[ctr->target];
+	const Uint8 *mapped;
 	Uint8 *buf;
-	int n;
+	off_t offset;
+	int len;
+	bool ok;
 
 	dev->nLastBlockAddr = HDC_GetLBA(ctr);
 
 	LOG_TRACE(TRACE_SCSI_CMD, "HDC: READ SECTOR (%s) with LBA 0x%x",
 	          HDC_CmdInfoStr(ctr), dev->nLastBlockAddr);
 
-	/* seek to the position */
-	if (dev->nLastBlockAddr >= dev->hdSize ||
-	    fseeko(dev->image_file, (off_t)dev->nLastBlockAddr * dev->blockSize, SEEK_SET) != 0)
+	if (dev->nLastBlockAddr >= dev->hdSize)
 	{
 		ctr->status = HD_STATUS_ERROR;
 		dev->nLastError = HD_REQSENS_INVADDR;
 	}
 	else
 	{
-		buf = HDC_PrepRespBuf(ctr, dev->blockSize * HDC_GetCount(ctr));
-		n = fread(buf, dev->blockSize, HDC_GetCount(ctr), dev->image_file);
-		if (n == HDC_GetCount(ctr))
+		offset = (off_t)dev->nLastBlockAddr * dev->blockSize;
+		len = dev->blockSize * HDC_GetCount(ctr);
+		/* send the data straight from the image mapping if possible */
+		mapped = BlockDev_GetReadPtr(&dev->bdev, offset, len);
+		if (mapped)
+		{
+			ctr->data = mapped;
+			ctr->data_len = len;
+			ctr->offset = 0;
+			ok = true;
+		}
+		else
+		{
+			buf = HDC_PrepRespBuf(ctr, len);
+			ok = BlockDev_Read(&dev->bdev, offset, buf, len);
+		}
+		if (ok)
 		{
 			ctr->status = HD_STATUS_OK;
 			dev->nLastError = HD_REQSENS_OK;
@@ -881,7 +895,7 @@ off_t HDC_CheckAndGetSize(const char *hdtype, const char *filename, unsigned lon
 int HDC_InitDevice(const char *hdtype, SCSI_DEV *dev, char *filename, unsigned long blockSize)
 {
 	off_t filesize;
-	FILE *fp;
+	int ret;
 
 	dev->enabled = false;
 	Log_Printf(LOG_INFO, "Mounting %s HD image '%s'\n", hdtype, filename);
@@ -891,28 +905,12 @@ int HDC_InitDevice(const char *hdtype, SCSI_DEV *dev, char *filename, unsigned l
 	if (filesize < 0)
 		return filesize;
 
-	if (!(fp = fopen(filename, "rb+")))
-	{
-		if (!(fp = fopen(filename, "rb")))
-		{
-			Log_AlertDlg(LOG_ERROR, "Cannot open %s HD file for reading\n'%s'!\n",
-				     hdtype, filename);
-			return -ENOENT;
-		}
-		Log_AlertDlg(LOG_WARN, "%s HD file is read-only, no writes will go through\n'%s'.\n",
-			     hdtype, filename);
-	}
-	else if (!File_Lock(fp))
-	{
-		Log_AlertDlg(LOG_ERROR, "Locking %s HD file for writing failed\n'%s'!\n",
-			     hdtype, filename);
-		fclose(fp);
-		return -ENOLCK;
-	}
+	ret = BlockDev_Open(&dev->bdev, hdtype, filename, filesize);
+	if (ret < 0)
+		return ret;
 
 	dev->blockSize = blockSize;
 	dev->hdSize = filesize / dev->blockSize;
-	dev->image_file = fp;
 	dev->enabled = true;
 
 	return 0;
@@ -943,7 +941,7 @@ bool HDC_Init(void)
 			continue;
 		if (HDC_InitDevice("ACSI", &AcsiBus.devs[i], ConfigureParams.Acsi[i].sDeviceFile, ConfigureParams.Acsi[i].nBlockSize) == 0)
 		{
-			nAcsiPartitions += HDC_PartitionCount(AcsiBus.devs[i].image_file, TRACE_SCSI_CMD, NULL);
+			nAcsiPartitions += HDC_PartitionCount(AcsiBus.devs[i].bdev.fp, TRACE_SCSI_CMD, NULL);
 			bAcsiEmuOn = true;
 		}
 		else
@@ -968,9 +966,7 @@ void HDC_UnInit(void)
 	{
 		if (!AcsiBus.devs[i].enabled)
 			continue;
-		File_UnLock(AcsiBus.devs[i].image_file);
-		fclose(AcsiBus.devs[i].image_file);
-		AcsiBus.devs[i].image_file = NULL;
+		BlockDev_Close(&AcsiBus.devs[i].bdev);
 		AcsiBus.devs[i].enabled = false;
 	}
 	free(AcsiBus.buffer);
@@ -1081,21 +1077,21 @@ static void Acsi_DmaTransfer(void)
 	if ((nDmaMode & 0xc0) != 0x00 || AcsiBus.data_len == 0)
 		return;
 
-	if ((AcsiBus.dmawrite_to_fh && (nDmaMode & 0x100) == 0)
-	    || (!AcsiBus.dmawrite_to_fh && (nDmaMode & 0x100) != 0))
+	if ((AcsiBus.dmawrite_to_bd && (nDmaMode & 0x100) == 0)
+	    || (!AcsiBus.dmawrite_to_bd && (nDmaMode & 0x100) != 0))
 	{
 		Log_Printf(LOG_WARN, "DMA direction does not match SCSI command!\n");
 		return;
 	}
 
-	if (AcsiBus.dmawrite_to_fh)
+	if (AcsiBus.dmawrite_to_bd)
 	{
 		/* write - if allowed */
 		if (STMemory_CheckAreaType(nDmaAddr, AcsiBus.data_len, ABFLAG_RAM | ABFLAG_ROM))
 		{
 #ifndef DISALLOW_HDC_WRITE
-			int wlen = fwrite(&STRam[nDmaAddr], 1, AcsiBus.data_len, AcsiBus.dmawrite_to_fh);
-			if (wlen != AcsiBus.data_len)
+			if (!BlockDev_Write(AcsiBus.dmawrite_to_bd, AcsiBus.dmawrite_offset,
+			                    &STRam[nDmaAddr], AcsiBus.data_len))
 			{
 				Log_Printf(LOG_ERROR, "Could not write all bytes to ACSI HD image.\n");
 				AcsiBus.status = HD_STATUS_ERROR;
@@ -1108,9 +1104,9 @@ static void Acsi_DmaTransfer(void)
 				   nDmaAddr, AcsiBus.data_len);
 			AcsiBus.bDmaError = true;
 		}
-		AcsiBus.dmawrite_to_fh = NULL;
+		AcsiBus.dmawrite_to_bd = NULL;
 	}
-	else if (!STMemory_SafeCopy(nDmaAddr, AcsiBus.buffer, AcsiBus.data_len, "ACSI DMA"))
+	else if (!STMemory_SafeCopy(nDmaAddr, AcsiBus.data, AcsiBus.data_len, "ACSI DMA"))
 	{
 		AcsiBus.bDmaError = true;
 		AcsiBus.status = HD_STATUS_ERROR;
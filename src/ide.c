@@ -16,8 +16,8 @@
 #include <inttypes.h>
 
 #include "main.h"
+#include "blockDev.h"
 #include "configuration.h"
-#include "file.h"
 #include "ide.h"
 #include "hdc.h" /* for partition counting */
 #include "m68000.h"
@@ -394,18 +394,12 @@ struct BlockDriverState {
     void (*change_cb)(void *opaque);
     void *change_opaque;
 
-    FILE *fhndl;
+    BLOCK_DEV bdev; /* image file, including I/O stats */
     off_t file_size;
     int media_changed;
     int byteswap;
     int sector_size;
 
-    /* I/O stats (display with "info blockstats"). */
-    uint64_t rd_bytes;
-    uint64_t wr_bytes;
-    uint64_t rd_ops;
-    uint64_t wr_ops;
-
     /* NOTE: the following infos are only hints for real hardware
        drivers. They are not used by the block driver */
     int cyls, heads, secs, translation;
@@ -490,7 +484,7 @@ static void bdrv_set_change_cb(BlockDriverState *bs,
  */
 static int bdrv_is_inserted(BlockDriverState *bs)
 {
-	return (bs->fhndl != NULL);
+	return BlockDev_IsOpen(&bs->bdev);
 }
 
 
@@ -512,29 +506,35 @@ static void bdrv_set_locked(BlockDriverState *bs, int locked)
 static int bdrv_read(BlockDriverState *bs, int64_t sector_num,
                      uint8_t *buf, int nb_sectors)
 {
-	int ret, len;
+	const uint8_t *src;
+	int len, idx;
 
-	if (!bs->fhndl)
+	if (!bdrv_is_inserted(bs))
 		return -ENOMEDIUM;
 
 	len = nb_sectors * bs->sector_size;
 
-	if (fseeko(bs->fhndl, sector_num * bs->sector_size, SEEK_SET) != 0)
+	/* byte-swap straight from the image mapping if possible */
+	if (bs->byteswap)
 	{
-		perror("bdrv_read");
-		return -errno;
+		src = BlockDev_GetReadPtr(&bs->bdev, sector_num * bs->sector_size, len);
+		if (src)
+		{
+			for (idx = 0; idx < len; idx += 2)
+			{
+				*(uint16_t *)&buf[idx] = SDL_Swap16(*(const uint16_t *)&src[idx]);
+			}
+			return 0;
+		}
 	}
-	ret = fread(buf, 1, len, bs->fhndl);
-	if (ret != len)
+
+	if (!BlockDev_Read(&bs->bdev, sector_num * bs->sector_size, buf, len))
 	{
-		Log_Printf(LOG_ERROR, "IDE: bdrv_read error (%d != %d length) at sector %lu!\n",
-		           ret, len, (unsigned long)sector_num);
+		Log_Printf(LOG_ERROR, "IDE: bdrv_read error (%d bytes) at sector %lu!\n",
+		           len, (unsigned long)sector_num);
 		return -EINVAL;
 	}
 
-	bs->rd_bytes += (unsigned) len;
-	bs->rd_ops ++;
-
 	if (bs->byteswap)
 	{
 		uint16_t *buf16 = (uint16_t *)buf;
@@ -558,25 +558,20 @@ static int bdrv_read(BlockDriverState *bs, int64_t sector_num,
 static int bdrv_write(BlockDriverState *bs, int64_t sector_num,
                       const uint8_t *buf, int nb_sectors)
 {
-	int ret, len, idx;
+	int len, idx;
+	bool ok;
 	uint16_t *buf16;
 
-	if (!bs->fhndl)
+	if (!bdrv_is_inserted(bs))
 		return -ENOMEDIUM;
 	if (bs->read_only)
 		return -EACCES;
 
 	len = nb_sectors * bs->sector_size;
 
-	if (fseeko(bs->fhndl, sector_num * bs->sector_size, SEEK_SET) != 0)
-	{
-		perror("bdrv_write");
-		return -errno;
-	}
-
 	if (!bs->byteswap)
 	{
-		ret = fwrite(buf, 1, len, bs->fhndl);
+		ok = BlockDev_Write(&bs->bdev, sector_num * bs->sector_size, buf, len);
 	}
 	else
 	{
@@ -587,19 +582,16 @@ static int bdrv_write(BlockDriverState *bs, int64_t sector_num,
 		{
 			buf16[idx / 2] = SDL_Swap16(*(const uint16_t *)&buf[idx]);
 		}
-		ret = fwrite(buf16, 1, len, bs->fhndl);
+		ok = BlockDev_Write(&bs->bdev, sector_num * bs->sector_size, buf16, len);
 		free(buf16);
 	}
-	if (ret != len)
+	if (!ok)
 	{
-		Log_Printf(LOG_ERROR, "IDE: bdrv_write error (%d != %d length) at sector %lu!\n",
-		           ret, len,  (unsigned long)sector_num);
+		Log_Printf(LOG_ERROR, "IDE: bdrv_write error (%d bytes) at sector %lu!\n",
+		           len, (unsigned long)sector_num);
 		return -EIO;
 	}
 
-	bs->wr_bytes += (unsigned) len;
-	bs->wr_ops ++;
-
 	return 0;
 }
 
@@ -620,27 +612,9 @@ static int bdrv_open(BlockDriverState *bs, const char *filename, unsigned long b
 		return -1;
 	}
 
-	bs->fhndl = fopen(filename, "rb+");
-	if (!bs->fhndl) {
-		/* Maybe the file is read-only? */
-		bs->fhndl = fopen(filename, "rb");
-		if (!bs->fhndl)
-		{
-			perror("bdrv_open");
-			Log_AlertDlg(LOG_ERROR, "Cannot open IDE HD for reading\n'%s'.\n", filename);
-			return -1;
-		}
-		Log_AlertDlg(LOG_WARN, "IDE HD file is read-only, no writes will go through\n'%s'.\n",
-			     filename);
-		bs->read_only = 1;
-	}
-	else if (!File_Lock(bs->fhndl))
-	{
-		Log_AlertDlg(LOG_ERROR, "Locking IDE HD file for writing failed\n'%s'!\n", filename);
-		fclose(bs->fhndl);
-		bs->fhndl = NULL;
+	if (BlockDev_Open(&bs->bdev, "IDE", filename, bs->file_size) < 0)
 		return -1;
-	}
+	bs->read_only = bs->bdev.bReadOnly;
 
 	/* call the change callback */
 	bs->media_changed = 1;
@@ -652,14 +626,12 @@ static int bdrv_open(BlockDriverState *bs, const char *filename, unsigned long b
 
 static void bdrv_flush(BlockDriverState *bs)
 {
-	fflush(bs->fhndl);
+	BlockDev_Flush(&bs->bdev);
 }
 
 static void bdrv_close(BlockDriverState *bs)
 {
-	File_UnLock(bs->fhndl);
-	fclose(bs->fhndl);
-	bs->fhndl = NULL;
+	BlockDev_Close(&bs->bdev);
 }
 
 /**
@@ -2719,7 +2691,7 @@ void Ide_Init(void)
 				ConfigureParams.Ide[i].bUseDevice = false;
 				continue;
 			}
-			nIDEPartitions += HDC_PartitionCount(hd_table[i]->fhndl, TRACE_IDE, &is_byteswap);
+			nIDEPartitions += HDC_PartitionCount(hd_table[i]->bdev.fp, TRACE_IDE, &is_byteswap);
 			/* Our IDE implementation is little endian by default,
 			 * so we need to byteswap if the image is not swapped! */
 			if (ConfigureParams.Ide[i].nByteSwap == BYTESWAP_AUTO)
@@ -2730,6 +2702,8 @@ void Ide_Init(void)
 				  hd_table[i]->byteswap ? "enabled" : "disabled", i);
 			hd_table[i]->sector_size = ConfigureParams.Ide[i].nBlockSize;
 			hd_table[i]->type = ConfigureParams.Ide[i].nDeviceType;
+			if (ConfigureParams.Ide[i].nReadAhead > 0)
+				BlockDev_SetReadAhead(&hd_table[i]->bdev, ConfigureParams.Ide[i].nReadAhead * 1024);
 			ide_init_one(&ide_state[i], hd_table[i]);
 		}
 	}
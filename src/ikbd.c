@@ -92,6 +92,7 @@ const char IKBD_fileid[] = "Hatari ikbd.c";
 #include "utils.h"
 #include "acia.h"
 #include "clocks_timings.h"
+#include "reverse.h"
 
 
 #define DBL_CLICK_HISTORY  0x07     /* Number of frames since last click to see if need to send one or two clicks */
@@ -128,6 +129,13 @@ static bool bMouseDisabled, bJoystickDisabled;
 static bool bDuringResetCriticalTime, bBothMouseAndJoy;
 static bool bMouseEnabledDuringReset;
 
+/* Mouse state changed by host events, recorded for reverse debugging */
+typedef struct {
+	int dx, dy;
+	int LButtonDown, RButtonDown;		/* BUTTON_MOUSE bits */
+	int LButtonDblClk, RButtonDblClk;
+} IKBD_HOST_MOUSE;
+
 
 
 
@@ -176,6 +184,7 @@ static bool bMouseEnabledDuringReset;
 
 
 static void IKBD_RunKeyboardCommand(Uint8 aciabyte);
+static void IKBD_SendSTKey(Uint8 ScanCode, bool bPress);
 
 
 /* List of possible keyboard commands, others are seen as NOPs by keyboard processor */
@@ -1717,12 +1726,12 @@ static void IKBD_SendAutoKeyboardCommands(void)
 		/* As we simulating space bar? */
 		if (JoystickSpaceBar==JOYSTICK_SPACE_DOWN)
 		{
-			IKBD_PressSTKey(57, true);         /* Press */
+			IKBD_SendSTKey(57, true);          /* Press */
 			JoystickSpaceBar = JOYSTICK_SPACE_UP;
 		}
 		else   //if (JoystickSpaceBar==JOYSTICK_SPACE_UP) {
 		{
-			IKBD_PressSTKey(57, false);       /* Release */
+			IKBD_SendSTKey(57, false);        /* Release */
 			JoystickSpaceBar = false;         /* Complete */
 		}
 	}
@@ -1736,9 +1745,9 @@ static void IKBD_SendAutoKeyboardCommands(void)
 
 /*-----------------------------------------------------------------------*/
 /**
- * When press/release key under host OS, execute this function.
+ * Send key press/release to the emulated IKBD.
  */
-void IKBD_PressSTKey(Uint8 ScanCode, bool bPress)
+static void IKBD_SendSTKey(Uint8 ScanCode, bool bPress)
 {
 	/* If IKBD is monitoring only joysticks, don't report key */
 	if ( KeyboardProcessor.JoystickMode == AUTOMODE_JOYSTICK_MONITORING )
@@ -1762,6 +1771,101 @@ void IKBD_PressSTKey(Uint8 ScanCode, bool bPress)
 }
 
 
+/*-----------------------------------------------------------------------*/
+/**
+ * When press/release key under host OS, execute this function.
+ */
+void IKBD_PressSTKey(Uint8 ScanCode, bool bPress)
+{
+	if (ReverseTracking)
+	{
+		/* Host keys are ignored while replaying recorded ones */
+		if (Reverse_IsReplaying())
+			return;
+		Reverse_RecordEvent(REVERSE_INPUT_KEY, ScanCode | (bPress ? 0 : 0x80), NULL, 0);
+	}
+	IKBD_SendSTKey(ScanCode, bPress);
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * When replaying emulation for reverse debugging, send the host key
+ * presses/releases recorded up to the current emulation cycle.
+ */
+void IKBD_ReplayKeys(void)
+{
+	Sint64 Key;
+
+	if (!Reverse_IsReplaying())
+		return;
+	while (Reverse_ReplayEvent(REVERSE_INPUT_KEY, &Key, NULL, 0))
+		IKBD_SendSTKey(Key & 0x7f, !(Key & 0x80));
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Get mouse state changed by host events.
+ */
+static void IKBD_GetHostMouse(IKBD_HOST_MOUSE *pMouse)
+{
+	memset(pMouse, 0, sizeof(*pMouse));
+	pMouse->dx = KeyboardProcessor.Mouse.dx;
+	pMouse->dy = KeyboardProcessor.Mouse.dy;
+	pMouse->LButtonDown = Keyboard.bLButtonDown & BUTTON_MOUSE;
+	pMouse->RButtonDown = Keyboard.bRButtonDown & BUTTON_MOUSE;
+	pMouse->LButtonDblClk = Keyboard.LButtonDblClk;
+	pMouse->RButtonDblClk = Keyboard.RButtonDblClk;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Set mouse state changed by host events.
+ */
+static void IKBD_SetHostMouse(const IKBD_HOST_MOUSE *pMouse)
+{
+	KeyboardProcessor.Mouse.dx = pMouse->dx;
+	KeyboardProcessor.Mouse.dy = pMouse->dy;
+	Keyboard.bLButtonDown = (Keyboard.bLButtonDown & ~BUTTON_MOUSE) | pMouse->LButtonDown;
+	Keyboard.bRButtonDown = (Keyboard.bRButtonDown & ~BUTTON_MOUSE) | pMouse->RButtonDown;
+	Keyboard.LButtonDblClk = pMouse->LButtonDblClk;
+	Keyboard.RButtonDblClk = pMouse->RButtonDblClk;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Handle host events, and for reverse debugging, record their effect
+ * on mouse state, or when replaying, replace it with the recorded one.
+ */
+static void IKBD_HandleHostEvents(void)
+{
+	IKBD_HOST_MOUSE Before, After;
+
+	if (!ReverseTracking)
+	{
+		Main_EventHandler(false);
+		return;
+	}
+	IKBD_GetHostMouse(&Before);
+	Main_EventHandler(false);
+
+	if (Reverse_IsReplaying())
+	{
+		IKBD_SetHostMouse(&Before);
+		while (Reverse_ReplayEvent(REVERSE_INPUT_MOUSE, NULL, &After, sizeof(After)))
+			IKBD_SetHostMouse(&After);
+		IKBD_ReplayKeys();
+		return;
+	}
+	IKBD_GetHostMouse(&After);
+	if (memcmp(&Before, &After, sizeof(After)) != 0)
+		Reverse_RecordEvent(REVERSE_INPUT_MOUSE, 0, &After, sizeof(After));
+}
+
+
 /*-----------------------------------------------------------------------*/
 /**
  * Check if a key is pressed in the ScanCodeState array
@@ -1788,7 +1892,7 @@ static int IKBD_CheckPressedKey(void)
 void IKBD_InterruptHandler_AutoSend(void)
 {
 	/* Handle user events and other messages, (like quit message) */
-	Main_EventHandler(false);
+	IKBD_HandleHostEvents();
 
 	/* Remove this interrupt from list and re-order.
 	 * (needs to be done after UI event handling so
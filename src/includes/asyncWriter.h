@@ -0,0 +1,27 @@
+/*
+  Hatari - asyncWriter.h
+
+  This file is distributed under the GNU General Public License, version 2
+  or at your option any later version. Read the file gpl.txt for details.
+*/
+
+#ifndef HATARI_ASYNCWRITER_H
+#define HATARI_ASYNCWRITER_H
+
+#include <sys/types.h>		/* Needed for off_t */
+
+typedef struct asyncwriter_file_s ASYNC_FILE;
+typedef bool (*ASYNC_SAVE_FUNC)(const char *pszFileName, Uint8 *pData, size_t nLen);
+
+extern ASYNC_FILE *AsyncWriter_Open(const char *pszFileName);
+extern bool AsyncWriter_Write(ASYNC_FILE *af, const void *pData, size_t nLen);
+extern bool AsyncWriter_WriteAt(ASYNC_FILE *af, off_t nOffset, const void *pData, size_t nLen);
+extern off_t AsyncWriter_Tell(ASYNC_FILE *af);
+extern bool AsyncWriter_Close(ASYNC_FILE *af);
+extern bool AsyncWriter_SaveFile(const char *pszFileName, Uint8 *pData, size_t nLen);
+extern bool AsyncWriter_SaveFileWith(const char *pszFileName, Uint8 *pData, size_t nLen,
+                                     ASYNC_SAVE_FUNC saver);
+extern void AsyncWriter_WaitForFile(const char *pszFileName);
+extern void AsyncWriter_UnInit(void);
+
+#endif /* HATARI_ASYNCWRITER_H */
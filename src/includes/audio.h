@@ -12,7 +12,6 @@ extern int nAudioFrequency;
 extern bool bSoundWorking;
 extern int SoundBufferSize;
 extern int SdlAudioBufferSize;
-extern int pulse_swallowing_count;
 
 
 extern void Audio_Init(void);
@@ -22,5 +21,6 @@ extern void Audio_Unlock(void);
 extern void Audio_FreeSoundBuffer(void);
 extern void Audio_SetOutputAudioFreq(int Frequency);
 extern void Audio_EnableAudio(bool bEnable);
+extern void Audio_ResetSync(void);
 
 #endif  /* HATARI_AUDIO_H */
@@ -0,0 +1,56 @@
+/*
+  Hatari - blockDev.h
+
+  This file is distributed under the GNU General Public License, version 2
+  or at your option any later version. Read the file gpl.txt for details.
+*/
+
+#ifndef HATARI_BLOCKDEV_H
+#define HATARI_BLOCKDEV_H
+
+#include <sys/types.h>		/* Needed for off_t */
+
+/**
+ * Hard disk image file, used by the ACSI, SCSI and IDE emulation
+ */
+typedef struct blockdev_s {
+	FILE *fp;		/* image file, also used for locking */
+	Uint8 *map;		/* memory mapping of the whole image, or NULL */
+	off_t size;		/* image size in bytes */
+	bool bReadOnly;
+	const char *pszType;	/* "ACSI", "SCSI" or "IDE" */
+	char *pszName;		/* image file name */
+	struct blockdev_s *next;	/* list of open devices */
+	/* copy-on-write overlay, all writes go there when it's in use */
+	FILE *ovlfp;
+	Uint8 *ovlmap;		/* memory mapping of the overlay data area */
+	off_t ovldata;		/* file offset of the overlay data area */
+	Uint8 *ovlbitmap;	/* written blocks */
+	Uint32 nOvlDirty;	/* number of written blocks */
+	char *pszOvlName;
+	/* read-ahead buffer, used when the image isn't memory mapped */
+	Uint8 *rabuf;
+	size_t nRaSize;		/* buffer size, 0 = no read-ahead */
+	off_t nRaOffset;	/* image offset of the buffered data */
+	size_t nRaLen;		/* amount of buffered data */
+	Uint64 nRaHits;
+	Uint64 nRaMisses;
+	/* I/O statistics */
+	Uint64 nReadOps;
+	Uint64 nReadBytes;
+	Uint64 nWriteOps;
+	Uint64 nWriteBytes;
+} BLOCK_DEV;
+
+extern int BlockDev_Open(BLOCK_DEV *bd, const char *hdtype, const char *filename, off_t size);
+extern void BlockDev_Close(BLOCK_DEV *bd);
+extern bool BlockDev_IsOpen(BLOCK_DEV *bd);
+extern void BlockDev_SetReadAhead(BLOCK_DEV *bd, size_t nSize);
+extern bool BlockDev_Read(BLOCK_DEV *bd, off_t nOffset, void *pData, size_t nLen);
+extern bool BlockDev_Write(BLOCK_DEV *bd, off_t nOffset, const void *pData, size_t nLen);
+extern const Uint8 *BlockDev_GetReadPtr(BLOCK_DEV *bd, off_t nOffset, size_t nLen);
+extern void BlockDev_Flush(BLOCK_DEV *bd);
+extern int BlockDev_OverlayAction(bool bCommit);
+extern void BlockDev_Info(FILE *fp, Uint32 arg);
+
+#endif /* HATARI_BLOCKDEV_H */
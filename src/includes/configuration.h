@@ -70,6 +70,7 @@ typedef struct
   bool bEnableMicrophone;
   bool bEnableSound;
   bool bEnableSoundSync;
+  bool bSkipInFastForward;
   int nPlaybackFreq;
   int SdlAudioBufferSize;
   char szYMCaptureFileName[FILENAME_MAX];
@@ -204,11 +205,15 @@ typedef struct
 {
   bool bAutoInsertDiskB;
   bool FastFloppy;			/* true to speed up FDC emulation */
+  bool bTurboFloppy;			/* true to transfer ST/MSA/DIM sectors at once */
   bool EnableDriveA;
   bool EnableDriveB;
   int  DriveA_NumberOfHeads;
   int  DriveB_NumberOfHeads;
   WRITEPROTECTION nWriteProtection;
+  bool bUseDiskCache;			/* cache unpacked .zip/.gz images */
+  int  nDiskCacheSize;			/* cache size limit in MB */
+  char szDiskCacheDirectory[FILENAME_MAX];
   char szDiskZipPath[MAX_FLOPPYDRIVES][FILENAME_MAX];
   char szDiskFileName[MAX_FLOPPYDRIVES][FILENAME_MAX];
   char szDiskImageDirectory[FILENAME_MAX];
@@ -236,7 +241,9 @@ typedef struct
   bool bFilenameConversion;
   bool bGemdosHostTime;
   bool bBootFromHardDisk;
+  bool bUseOverlay;
   char szHardDiskDirectories[MAX_HARDDRIVES][FILENAME_MAX];
+  char szOverlayDirectory[FILENAME_MAX];
 } CNF_HARDDISK;
 
 /* SCSI/ACSI/IDE configuration */
@@ -265,6 +272,7 @@ typedef struct
   char sDeviceFile[FILENAME_MAX];
   int nBlockSize;
   int nDeviceType;
+  int nReadAhead;			/* read-ahead buffer size in KB, 0 = off */
 } CNF_IDEDEV;
 
 /* Falcon register $FFFF8006 bits 6 & 7 (mirrored in $FFFF82C0 bits 0 & 1):
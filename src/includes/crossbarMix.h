@@ -0,0 +1,117 @@
+/*
+  Hatari - crossbarMix.h
+
+  Falcon crossbar CODEC output stage, working on blocks of stereo
+  samples : resampling of the DAC/ADC ring buffers to the host audio
+  frequency and mixing according to the CODEC input routing. These are
+  inline functions so that they can also be used by the sound unit tests.
+
+  This file is distributed under the GNU General Public License, version 2
+  or at your option any later version. Read the file gpl.txt for details.
+*/
+
+#ifndef HATARI_CROSSBARMIX_H
+#define HATARI_CROSSBARMIX_H
+
+/* CODEC input source (register $ff8937) */
+#define CROSSBAR_CODEC_INPUT_NONE	0
+#define CROSSBAR_CODEC_INPUT_ADC	1
+#define CROSSBAR_CODEC_INPUT_DAC	2
+#define CROSSBAR_CODEC_INPUT_BOTH	3
+
+
+/**
+ * Read nLen stereo samples from the pLeft/pRight ring buffers (size nMask+1,
+ * a power of 2) into pBuf, stepping the read position by nRatio (32.32
+ * fixed point) after each sample. If pBuf is NULL, only the read position
+ * is updated, which gives the same result as reading the samples.
+ */
+static inline void Crossbar_ReadRingBlock(Sint16 (*pBuf)[2], const Sint16 *pLeft,
+                                          const Sint16 *pRight, Uint32 nMask,
+                                          Uint32 *pPos, Sint64 *pPosFloat,
+                                          Sint64 nRatio, int nLen)
+{
+	Uint32 pos = *pPos;
+	Sint64 posFloat = *pPosFloat;
+	int i;
+
+	if (pBuf == NULL)
+	{
+		posFloat += nRatio * nLen;
+		pos = (pos + (Uint32)(posFloat >> 32)) & nMask;
+		posFloat &= 0xffffffff;
+	}
+	else
+	{
+		for (i = 0; i < nLen; i++)
+		{
+			pBuf[i][0] = pLeft[pos];
+			pBuf[i][1] = pRight[pos];
+			posFloat += nRatio;
+			pos = (pos + (Uint32)(posFloat >> 32)) & nMask;
+			posFloat &= 0xffffffff;		/* only keep the fractional part */
+		}
+	}
+
+	*pPos = pos;
+	*pPosFloat = posFloat;
+}
+
+
+/**
+ * Mix nLen stereo samples of the ADC (pAdc) and of the crossbar DAC input
+ * (pDac) into pOut, depending on the CODEC input source nInputSource.
+ * ADC samples are amplified by gain[] (ADC*gain/16384) and the result is
+ * reduced by attenuation[] (x*attenuation/65536).
+ *
+ * The routing is resolved once for the whole block, so each case is a
+ * simple loop without branches. pOut may be the same buffer as pAdc.
+ * Intermediate values are truncated to 16 bits like on the real CODEC.
+ */
+static inline void Crossbar_MixBlock(Sint16 (*pOut)[2], const Sint16 (*pAdc)[2],
+                                     const Sint16 (*pDac)[2], int nLen, int nInputSource,
+                                     const Uint16 gain[2], const Uint16 attenuation[2])
+{
+	const int gainL = gain[0], gainR = gain[1];
+	const int attL = attenuation[0], attR = attenuation[1];
+	Sint16 left, right;
+	int i;
+
+	switch (nInputSource)
+	{
+	 case CROSSBAR_CODEC_INPUT_ADC:
+		/* direct ADC->DAC sound only ADC*4/65536 */
+		for (i = 0; i < nLen; i++)
+		{
+			left = (pAdc[i][0] * gainL) >> 14;
+			right = (pAdc[i][1] * gainR) >> 14;
+			pOut[i][0] = (left * attL) >> 16;
+			pOut[i][1] = (right * attR) >> 16;
+		}
+		break;
+	 case CROSSBAR_CODEC_INPUT_DAC:
+		/* Crossbar->DAC sound only */
+		for (i = 0; i < nLen; i++)
+		{
+			pOut[i][0] = (pDac[i][0] * attL) >> 16;
+			pOut[i][1] = (pDac[i][1] * attR) >> 16;
+		}
+		break;
+	 case CROSSBAR_CODEC_INPUT_BOTH:
+		/* Mixing Direct ADC sound with Crossbar->DMA sound */
+		for (i = 0; i < nLen; i++)
+		{
+			left = ((pAdc[i][0] * gainL) >> 14) + pDac[i][0];
+			right = ((pAdc[i][1] * gainR) >> 14) + pDac[i][1];
+			pOut[i][0] = (left * attL) >> 16;
+			pOut[i][1] = (right * attR) >> 16;
+		}
+		break;
+	 default:
+		/* No sound */
+		memset(pOut, 0, nLen * sizeof(pOut[0]));
+		break;
+	}
+}
+
+#endif /* HATARI_CROSSBARMIX_H */
@@ -34,6 +34,7 @@ typedef enum
   INTERRUPT_FDC,
   INTERRUPT_BLITTER,
   INTERRUPT_MIDI,
+  INTERRUPT_PROFILE_SAMPLE,
 
   MAX_INTERRUPTS
 } interrupt_id;
@@ -0,0 +1,17 @@
+/*
+  Hatari - diskCache.h
+
+  This file is distributed under the GNU General Public License, version 2
+  or at your option any later version. Read the file gpl.txt for details.
+*/
+
+#ifndef HATARI_DISKCACHE_H
+#define HATARI_DISKCACHE_H
+
+extern bool DiskCache_IsCacheable(const char *pszFileName);
+extern Uint8 *DiskCache_Load(const char *pszFileName, const char *pszZipPath,
+                             long *pImageSize, int *pImageType);
+extern void DiskCache_Store(const char *pszFileName, const char *pszZipPath,
+                            const Uint8 *pBuffer, long nImageSize, int nImageType);
+
+#endif /* HATARI_DISKCACHE_H */
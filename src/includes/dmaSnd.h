@@ -20,6 +20,7 @@ extern void DmaSnd_MemorySnapShot_Capture(bool bSave);
 extern Uint8 DmaSnd_Get_XSINT_Line(void);
 
 extern void DmaSnd_GenerateSamples(int nMixBufIdx, int nSamplesToGenerate);
+extern void DmaSnd_SkipSamples(int nSamplesToGenerate);
 extern void DmaSnd_STE_HBL_Update(void);
 
 extern void DmaSnd_SoundControl_ReadWord(void);
@@ -34,6 +34,7 @@ typedef struct
 {
 	int ImageType;
 	Uint8 *pBuffer;
+	Uint8 *pDirtyMap;		/* sectors changed since insertion, for .ST images */
 	char sFileName[FILENAME_MAX];
 	int nImageBytes;
 	bool bDiskInserted;
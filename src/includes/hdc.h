@@ -12,6 +12,7 @@
 #define HATARI_HDC_H
 
 #include <sys/types.h>  /* For off_t */
+#include "blockDev.h"
 
 /* Opcodes */
 /* The following are multi-sector transfers with seek implied */
@@ -54,7 +55,7 @@
  */
 typedef struct scsi_data {
 	bool enabled;
-	FILE *image_file;
+	BLOCK_DEV bdev;             /* The image file */
 	Uint32 nLastBlockAddr;      /* The specified sector number */
 	bool bSetLastBlockAddr;
 	Uint8 nLastError;
@@ -80,9 +81,11 @@ typedef struct {
 	short int status;           /* return code from the HDC operation */
 	Uint8 *buffer;              /* Response buffer */
 	int buffer_size;
+	const Uint8 *data;          /* Data to send: buffer or mapped image */
 	int data_len;
 	int offset;                 /* Current offset into data buffer */
-	FILE *dmawrite_to_fh;
+	BLOCK_DEV *dmawrite_to_bd;  /* Image for pending write, or NULL */
+	off_t dmawrite_offset;
 	SCSI_DEV devs[8];
 } SCSI_CTRLR;
 
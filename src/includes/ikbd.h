@@ -95,6 +95,7 @@ extern void IKBD_InterruptHandler_AutoSend(void);
 extern void IKBD_UpdateClockOnVBL ( void );
 
 extern void IKBD_PressSTKey(Uint8 ScanCode, bool bPress);
+extern void IKBD_ReplayKeys(void);
 
 extern void IKBD_Info(FILE *fp, Uint32 dummy);
 
@@ -0,0 +1,74 @@
+/*
+  Hatari - lmc1992.h
+
+  LMC1992 tone (bass/treble) and volume filter used by the STE/TT DMA
+  sound, processing blocks of stereo samples. It's an inline function
+  so that it can also be used by the sound unit tests.
+
+  This file is distributed under the GNU General Public License, version 2
+  or at your option any later version. Read the file gpl.txt for details.
+*/
+
+#ifndef HATARI_LMC1992_H
+#define HATARI_LMC1992_H
+
+struct lmc1992_biquad_s {
+	float coef[5];			/* IIR coefficients a1, a2, b0, b1, b2 */
+	float gain[2];			/* left/right gain, used as volume control */
+	float w1[2];			/* left/right state : wn-1 */
+	float w2[2];			/* left/right state : wn-2 */
+};
+
+
+/**
+ * Apply the second order IIR shelf filter (bass * treble) and the
+ * left/right volume to nLen stereo samples in pBuf, clipping the result.
+ *
+ * Both channels share the same coefficients, so the inner loop works on
+ * left/right pairs, which compilers can map to SIMD instructions. Filter
+ * state is kept in local variables during the whole block.
+ */
+static inline void LMC1992_FilterBlock(struct lmc1992_biquad_s *bq, Sint16 (*pBuf)[2], int nLen)
+{
+	const float a1 = bq->coef[0], a2 = bq->coef[1];
+	const float b0 = bq->coef[2], b1 = bq->coef[3], b2 = bq->coef[4];
+	float gain[2], w1[2], w2[2], a[2], yn[2];
+	Sint32 sample;
+	int i, c;
+
+	for (c = 0; c < 2; c++)
+	{
+		gain[c] = bq->gain[c];
+		w1[c] = bq->w1[c];
+		w2[c] = bq->w2[c];
+	}
+
+	for (i = 0; i < nLen; i++)
+	{
+		for (c = 0; c < 2; c++)
+		{
+			/* biquad1  Note: 'a' coefficients are subtracted */
+			a[c] = gain[c] * pBuf[i][c] - a1 * w1[c] - a2 * w2[c];
+			yn[c] = b0 * a[c] + b1 * w1[c] + b2 * w2[c];
+			w2[c] = w1[c];
+			w1[c] = a[c];
+		}
+		for (c = 0; c < 2; c++)
+		{
+			sample = yn[c];
+			if (sample < -32767)	/* check for overflow to clip waveform */
+				sample = -32767;
+			else if (sample > 32767)
+				sample = 32767;
+			pBuf[i][c] = sample;
+		}
+	}
+
+	for (c = 0; c < 2; c++)
+	{
+		bq->w1[c] = w1[c];
+		bq->w2[c] = w2[c];
+	}
+}
+
+#endif /* HATARI_LMC1992_H */
@@ -13,3 +13,6 @@ extern void MemorySnapShot_Capture_Immediate(const char *pszFileName, bool bConf
 extern void MemorySnapShot_Capture_Do(void);
 extern void MemorySnapShot_Restore(const char *pszFileName, bool bConfirm);
 extern void MemorySnapShot_Restore_Do(void);
+extern Uint8 *MemorySnapShot_CaptureMemory(size_t *pnSize);
+extern void MemorySnapShot_RestoreMemory(const Uint8 *pData, size_t nSize);
+extern bool MemorySnapShot_InMemory(void);
@@ -6,6 +6,7 @@
 */
 
 extern bool MSA_FileNameIsMSA(const char *pszFileName, bool bAllowGZ);
+extern void MSA_SetThreads(int nThreads);
 extern Uint8 *MSA_UnCompress(Uint8 *pMSAFile, long *pImageSize, long nBytesLeft);
 extern Uint8 *MSA_ReadDisk(int Drive, const char *pszFileName, long *pImageSize, int *pImageType);
 extern bool MSA_WriteDisk(int Drive, const char *pszFileName, Uint8 *pBuffer, int ImageSize);
@@ -9,10 +9,14 @@
 #define HATARI_SCREENSNAPSHOT_H
 
 #include <SDL_video.h>
+#include "asyncWriter.h"
 
 extern int ScreenSnapShot_SavePNG_ToFile(SDL_Surface *surface, int destw,
 		int desth, FILE *fp, int png_compression_level, int png_filter,
 		int CropLeft , int CropRight , int CropTop , int CropBottom );
+extern int ScreenSnapShot_SavePNG_ToAsyncFile(SDL_Surface *surface, int destw,
+		int desth, ASYNC_FILE *af, int png_compression_level, int png_filter,
+		int CropLeft , int CropRight , int CropTop , int CropBottom );
 extern void ScreenSnapShot_SaveScreen(void);
 extern void ScreenSnapShot_SaveToFile(const char *filename);
 
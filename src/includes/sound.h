@@ -81,6 +81,7 @@ extern bool Sound_AreWeRecording(void);
 extern void Sound_SetYmVolumeMixing(void);
 extern ymsample Subsonic_IIR_HPF_Left(ymsample x0);
 extern ymsample Subsonic_IIR_HPF_Right(ymsample x0);
+extern void Subsonic_IIR_HPF_Stereo(ymsample (*pBuf)[2], int nLen);
 
 
 #endif  /* HATARI_SOUND_H */
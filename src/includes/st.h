@@ -8,3 +8,4 @@
 extern bool ST_FileNameIsST(const char *pszFileName, bool bAllowGZ);
 extern Uint8 *ST_ReadDisk(int Drive, const char *pszFileName, long *pImageSize, int *pImageType);
 extern bool ST_WriteDisk(int Drive, const char *pszFileName, Uint8 *pBuffer, int ImageSize);
+extern bool ST_WriteDirtySectors(int Drive, const char *pszFileName, Uint8 *pBuffer, int ImageSize, const Uint8 *pDirtyMap);
@@ -45,7 +45,7 @@ extern void STMemory_Init ( int RAM_Size_Byte );
 extern void STMemory_Reset ( bool bCold );
 
 extern bool STMemory_SafeClear(Uint32 addr, unsigned int len);
-extern bool STMemory_SafeCopy(Uint32 addr, Uint8 *src, unsigned int len, const char *name);
+extern bool STMemory_SafeCopy(Uint32 addr, const Uint8 *src, unsigned int len, const char *name);
 extern void STMemory_MemorySnapShot_Capture(bool bSave);
 extern void STMemory_SetDefaultConfig(void);
 extern int  STMemory_CorrectSTRamSize(void);
@@ -62,6 +62,7 @@ extern Uint32	STMemory_Read ( Uint32 addr , int size );
 extern Uint32	STMemory_ReadLong ( Uint32 addr );
 extern Uint16	STMemory_ReadWord ( Uint32 addr );
 extern Uint8	STMemory_ReadByte ( Uint32 addr );
+extern void	STMemory_ReadBlock ( Uint32 addr , Uint8 *dst , Uint32 len );
 
 extern Uint16	STMemory_DMA_ReadWord ( Uint32 addr );
 extern void	STMemory_DMA_WriteWord ( Uint32 addr , Uint16 value );
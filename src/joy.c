@@ -21,6 +21,7 @@ const char Joy_fileid[] = "Hatari joy.c";
 #include "screen.h"
 #include "video.h"
 #include "statusbar.h"
+#include "reverse.h"
 
 #define JOY_DEBUG 0
 #if JOY_DEBUG
@@ -231,7 +232,7 @@ static bool Joy_ReadJoystick(int nSdlJoyID, JOYREADING *pJoyReading)
  * NOTE : ID 0 is Joystick 0/Mouse and ID 1 is Joystick 1 (default),
  *        ID 2 and 3 are STE joypads and ID 4 and 5 are parport joysticks.
  */
-Uint8 Joy_GetStickData(int nStJoyId)
+static Uint8 Joy_ReadStickData(int nStJoyId)
 {
 	Uint8 nData = 0;
 	JOYREADING JoyReading;
@@ -332,11 +333,36 @@ Uint8 Joy_GetStickData(int nStJoyId)
 
 /*-----------------------------------------------------------------------*/
 /**
- * Get the fire button states.
+ * Return joystick data for emulation, either from host, or when replaying
+ * for reverse debugging, the recorded one.  Bit 8 in the recorded value
+ * tells whether joystick button 2 started the space bar emulation.
+ */
+Uint8 Joy_GetStickData(int nStJoyId)
+{
+	int nSpaceBar = JoystickSpaceBar;
+	int nData = Joy_ReadStickData(nStJoyId);
+
+	if (!ReverseTracking)
+		return nData;
+
+	if (JoystickSpaceBar != nSpaceBar)
+		nData |= 0x100;
+	JoystickSpaceBar = nSpaceBar;
+
+	nData = Reverse_Sample(REVERSE_INPUT_JOY + nStJoyId, nData);
+	if ((nData & 0x100) && !JoystickSpaceBar)
+		JoystickSpaceBar = JOYSTICK_SPACE_DOWN;
+	return nData & 0xff;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Read the fire button states.
  * Note: More than one fire buttons are only supported for real joystick,
  * not for keyboard emulation!
  */
-static int Joy_GetFireButtons(int nStJoyId)
+static int Joy_ReadFireButtons(int nStJoyId)
 {
 	int nButtons = 0;
 	int nSdlJoyId;
@@ -372,6 +398,17 @@ static int Joy_GetFireButtons(int nStJoyId)
 }
 
 
+/*-----------------------------------------------------------------------*/
+/**
+ * Get the fire button states, recorded ones when replaying
+ * for reverse debugging.
+ */
+static int Joy_GetFireButtons(int nStJoyId)
+{
+	return Reverse_Sample(REVERSE_INPUT_FIRE + nStJoyId, Joy_ReadFireButtons(nStJoyId));
+}
+
+
 /*-----------------------------------------------------------------------*/
 /**
  * Set joystick cursor emulation for given port.  This assumes that
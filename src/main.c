@@ -18,6 +18,7 @@ const char Main_fileid[] = "Hatari main.c";
 #include "control.h"
 #include "options.h"
 #include "dialog.h"
+#include "asyncWriter.h"
 #include "audio.h"
 #include "joy.h"
 #include "file.h"
@@ -57,6 +58,7 @@ const char Main_fileid[] = "Hatari main.c";
 #include "video.h"
 #include "avi_record.h"
 #include "debugui.h"
+#include "profile.h"
 #include "remotedebug.h"
 #include "clocks_timings.h"
 
@@ -342,8 +344,6 @@ void Main_WaitOnVbl(void)
 		DestTicks = CurrentTicks + FrameDuration_micro;
 	}
 
-	DestTicks += pulse_swallowing_count;	/* audio.c - Audio_CallBack() */
-
 	nDelay = DestTicks - CurrentTicks;
 
 	/* Do not wait if we are in fast forward mode or if we are totally out of sync */
@@ -792,6 +792,7 @@ static void Main_Init(void)
  */
 static void Main_UnInit(void)
 {
+	Profile_SaveAtExit();
 	RemoteDebug_UnInit();
 	Screen_ReturnFromFullScreen();
 	Floppy_UnInit();
@@ -808,6 +809,7 @@ static void Main_UnInit(void)
 	Joy_UnInit();
 	if (Sound_AreWeRecording())
 		Sound_EndRecording();
+	AsyncWriter_UnInit();		/* after recordings have been closed */
 	Audio_UnInit();
 	SDLGui_UnInit();
 	DSP_UnInit();
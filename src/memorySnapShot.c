@@ -15,6 +15,8 @@
   save/restore all variables that are local to it. We use one function to
   reduce redundancy and the function 'MemorySnapShot_Store' decides if it
   should save or restore the data.
+  Besides files, snapshots can be saved to and restored from memory, which
+  is used by the debugger reverse execution checkpoints (see reverse.c).
 */
 const char MemorySnapShot_fileid[] = "Hatari memorySnapShot.c";
 
@@ -57,9 +59,10 @@ const char MemorySnapShot_fileid[] = "Hatari memorySnapShot.c";
 #include "falcon/videl.h"
 #include "statusbar.h"
 #include "hatari-glue.h"
+#include "reverse.h"
 
 
-#define VERSION_STRING      "2.4.0"   /* Version number of compatible memory snapshots - Always 6 bytes (inc' NULL) */
+#define VERSION_STRING      "2.5.0"   /* Version number of compatible memory snapshots - Always 6 bytes (inc' NULL) */
 #define SNAPSHOT_MAGIC      0xDeadBeef
 
 #if HAVE_LIBZ
@@ -87,6 +90,15 @@ static bool bCaptureSave, bCaptureError;
 static char Temp_FileName[FILENAME_MAX];
 static bool Temp_Confirm;
 
+/* in-memory snapshot, used instead of CaptureFile when 'active' */
+static struct {
+	bool active;
+	Uint8 *data;		/* for save */
+	const Uint8 *src;	/* for restore */
+	size_t size;	/* allocated (save) or snapshot (restore) size */
+	size_t pos;
+} CaptureMem;
+
 
 /*-----------------------------------------------------------------------*/
 /**
@@ -251,6 +263,44 @@ static void MemorySnapShot_CloseFile(void)
 }
 
 
+/*-----------------------------------------------------------------------*/
+/**
+ * Save/Restore data to/from in-memory snapshot, grow save buffer as needed.
+ */
+static void MemorySnapShot_StoreMemory(void *pData, int Size)
+{
+	if (bCaptureError)
+		return;
+
+	if (bCaptureSave)
+	{
+		if (CaptureMem.pos + Size > CaptureMem.size)
+		{
+			size_t size = 2 * CaptureMem.size + Size;
+			Uint8 *data = realloc(CaptureMem.data, size);
+			if (!data)
+			{
+				bCaptureError = true;
+				return;
+			}
+			CaptureMem.data = data;
+			CaptureMem.size = size;
+		}
+		memcpy(CaptureMem.data + CaptureMem.pos, pData, Size);
+	}
+	else
+	{
+		if (CaptureMem.pos + Size > CaptureMem.size)
+		{
+			bCaptureError = true;
+			return;
+		}
+		memcpy(pData, CaptureMem.src + CaptureMem.pos, Size);
+	}
+	CaptureMem.pos += Size;
+}
+
+
 /*-----------------------------------------------------------------------*/
 /**
  * Skip Nb bytes when reading from/writing to file.
@@ -259,6 +309,24 @@ void MemorySnapShot_Skip(int Nb)
 {
 	int res;
 
+	if (CaptureMem.active)
+	{
+		if (bCaptureSave)
+		{
+			Uint8 *zeroes = calloc(1, Nb);
+			if (zeroes)
+				MemorySnapShot_Store(zeroes, Nb);
+			else
+				bCaptureError = true;
+			free(zeroes);
+		}
+		else if (CaptureMem.pos + Nb <= CaptureMem.size)
+			CaptureMem.pos += Nb;
+		else
+			bCaptureError = true;
+		return;
+	}
+
 	/* Check no file errors */
 	if (CaptureFile != NULL)
 	{
@@ -279,6 +347,12 @@ void MemorySnapShot_Store(void *pData, int Size)
 {
 	long nBytes;
 
+	if (CaptureMem.active)
+	{
+		MemorySnapShot_StoreMemory(pData, Size);
+		return;
+	}
+
 	/* Check no file errors */
 	if (CaptureFile != NULL)
 	{
@@ -328,6 +402,39 @@ void MemorySnapShot_Capture_Immediate(const char *pszFileName, bool bConfirm)
 
 
 
+/*
+ * Save/restore the state of the emulated components, after
+ * configuration and TOS state have been handled
+ */
+static void MemorySnapShot_Components(bool bSave)
+{
+	STMemory_MemorySnapShot_Capture(bSave);
+	Cycles_MemorySnapShot_Capture(bSave);			/* Before fdc (for CyclesGlobalClockCounter) */
+	FDC_MemorySnapShot_Capture(bSave);
+	Floppy_MemorySnapShot_Capture(bSave);
+	IPF_MemorySnapShot_Capture(bSave);			/* After fdc/floppy, as IPF depends on them */
+	STX_MemorySnapShot_Capture(bSave);			/* After fdc/floppy, as STX depends on them */
+	GemDOS_MemorySnapShot_Capture(bSave);
+	ACIA_MemorySnapShot_Capture(bSave);
+	IKBD_MemorySnapShot_Capture(bSave);			/* After ACIA */
+	MIDI_MemorySnapShot_Capture(bSave);
+	CycInt_MemorySnapShot_Capture(bSave);
+	M68000_MemorySnapShot_Capture(bSave);
+	MFP_MemorySnapShot_Capture(bSave);
+	PSG_MemorySnapShot_Capture(bSave);
+	Sound_MemorySnapShot_Capture(bSave);
+	Video_MemorySnapShot_Capture(bSave);
+	Blitter_MemorySnapShot_Capture(bSave);
+	DmaSnd_MemorySnapShot_Capture(bSave);
+	Crossbar_MemorySnapShot_Capture(bSave);
+	VIDEL_MemorySnapShot_Capture(bSave);
+	DSP_MemorySnapShot_Capture(bSave);
+	IoMem_MemorySnapShot_Capture(bSave);
+	ScreenConv_MemorySnapShot_Capture(bSave);
+	SCC_MemorySnapShot_Capture(bSave);
+}
+
+
 /*
  * Do the real saving (called from newcpu.c / m68k_go()
  */
@@ -341,31 +448,9 @@ void MemorySnapShot_Capture_Do(void)
 		/* Capture each files details */
 		Configuration_MemorySnapShot_Capture(true);
 		TOS_MemorySnapShot_Capture(true);
-		STMemory_MemorySnapShot_Capture(true);
-		Cycles_MemorySnapShot_Capture(true);			/* Before fdc (for CyclesGlobalClockCounter) */
-		FDC_MemorySnapShot_Capture(true);
-		Floppy_MemorySnapShot_Capture(true);
-		IPF_MemorySnapShot_Capture(true);			/* After fdc/floppy are saved */
-		STX_MemorySnapShot_Capture(true);			/* After fdc/floppy are saved */
-		GemDOS_MemorySnapShot_Capture(true);
-		ACIA_MemorySnapShot_Capture(true);
-		IKBD_MemorySnapShot_Capture(true);
-		MIDI_MemorySnapShot_Capture(true);
-		CycInt_MemorySnapShot_Capture(true);
-		M68000_MemorySnapShot_Capture(true);
-		MFP_MemorySnapShot_Capture(true);
-		PSG_MemorySnapShot_Capture(true);
-		Sound_MemorySnapShot_Capture(true);
-		Video_MemorySnapShot_Capture(true);
-		Blitter_MemorySnapShot_Capture(true);
-		DmaSnd_MemorySnapShot_Capture(true);
-		Crossbar_MemorySnapShot_Capture(true);
-		VIDEL_MemorySnapShot_Capture(true);
-		DSP_MemorySnapShot_Capture(true);
+		MemorySnapShot_Components(true);
+		/* breakpoints go to a separate file */
 		DebugUI_MemorySnapShot_Capture(Temp_FileName, true);
-		IoMem_MemorySnapShot_Capture(true);
-		ScreenConv_MemorySnapShot_Capture(true);
-		SCC_MemorySnapShot_Capture(true);
 
 		/* end marker */
 		MemorySnapShot_Store(&magic, sizeof(magic));
@@ -387,6 +472,38 @@ void MemorySnapShot_Capture_Do(void)
 }
 
 
+/*
+ * Save snapshot to memory immediately (used by debugger reverse
+ * execution). Return allocated buffer with the snapshot and set
+ * its size to 'pnSize', or return NULL on error.
+ */
+Uint8 *MemorySnapShot_CaptureMemory(size_t *pnSize)
+{
+	Uint32 magic = SNAPSHOT_MAGIC;
+
+	CaptureMem.active = true;
+	CaptureMem.data = NULL;
+	CaptureMem.size = CaptureMem.pos = 0;
+	bCaptureSave = true;
+	bCaptureError = false;
+
+	Configuration_MemorySnapShot_Capture(true);
+	TOS_MemorySnapShot_Capture(true);
+	MemorySnapShot_Components(true);
+	MemorySnapShot_Store(&magic, sizeof(magic));
+
+	CaptureMem.active = false;
+	if (bCaptureError)
+	{
+		free(CaptureMem.data);
+		return NULL;
+	}
+	*pnSize = CaptureMem.pos;
+	/* drop unused part of the buffer */
+	return realloc(CaptureMem.data, CaptureMem.pos);
+}
+
+
 /*-----------------------------------------------------------------------*/
 /**
  * Restore 'snapshot' of memory/chips/emulation variables
@@ -406,6 +523,34 @@ void MemorySnapShot_Restore(const char *pszFileName, bool bConfirm)
 }
 
 
+/*
+ * Restore snapshot saved with MemorySnapShot_CaptureMemory().
+ * Like with files, restore is done from m68k_go(), but emulation
+ * exits the CPU loop before executing any further instructions.
+ * Data needs to stay valid until restore has been done.
+ */
+void MemorySnapShot_RestoreMemory(const Uint8 *pData, size_t nSize)
+{
+	CaptureMem.src = pData;
+	CaptureMem.size = nSize;
+	CaptureMem.pos = 0;
+	CaptureMem.active = true;
+
+	UAE_Set_State_Restore ();
+	UAE_Set_Quit_Reset ( false );
+	set_special(SPCFLAG_MODE_CHANGE | SPCFLAG_BRK);
+}
+
+
+/*
+ * Return true while snapshot is being saved to or restored from
+ * memory (for debugger reverse execution) instead of a file.
+ */
+bool MemorySnapShot_InMemory(void)
+{
+	return CaptureMem.active;
+}
+
 
 /*
  * Do the real restoring (called from newcpu.c / m68k_go()
@@ -413,10 +558,16 @@ void MemorySnapShot_Restore(const char *pszFileName, bool bConfirm)
 void MemorySnapShot_Restore_Do(void)
 {
 	Uint32 magic;
+	bool bMemory = CaptureMem.active;
 
 //fprintf ( stderr , "MemorySnapShot_Restore_Do in\n" );
 	/* Set to 'restore' */
-	if (MemorySnapShot_OpenFile(Temp_FileName, false, Temp_Confirm))
+	if (bMemory)
+	{
+		bCaptureSave = false;
+		bCaptureError = false;
+	}
+	if (bMemory || MemorySnapShot_OpenFile(Temp_FileName, false, Temp_Confirm))
 	{
 		Configuration_MemorySnapShot_Capture(false);
 		TOS_MemorySnapShot_Capture(false);
@@ -434,31 +585,9 @@ void MemorySnapShot_Restore_Do(void)
 		Reset_Cold();
 
 		/* Capture each files details */
-		STMemory_MemorySnapShot_Capture(false);
-		Cycles_MemorySnapShot_Capture(false);			/* Before fdc (for CyclesGlobalClockCounter) */
-		FDC_MemorySnapShot_Capture(false);
-		Floppy_MemorySnapShot_Capture(false);
-		IPF_MemorySnapShot_Capture(false);			/* After fdc/floppy are restored, as IPF depends on them */
-		STX_MemorySnapShot_Capture(false);			/* After fdc/floppy are restored, as STX depends on them */
-		GemDOS_MemorySnapShot_Capture(false);
-		ACIA_MemorySnapShot_Capture(false);
-		IKBD_MemorySnapShot_Capture(false);			/* After ACIA */
-		MIDI_MemorySnapShot_Capture(false);
-		CycInt_MemorySnapShot_Capture(false);
-		M68000_MemorySnapShot_Capture(false);
-		MFP_MemorySnapShot_Capture(false);
-		PSG_MemorySnapShot_Capture(false);
-		Sound_MemorySnapShot_Capture(false);
-		Video_MemorySnapShot_Capture(false);
-		Blitter_MemorySnapShot_Capture(false);
-		DmaSnd_MemorySnapShot_Capture(false);
-		Crossbar_MemorySnapShot_Capture(false);
-		VIDEL_MemorySnapShot_Capture(false);
-		DSP_MemorySnapShot_Capture(false);
-		DebugUI_MemorySnapShot_Capture(Temp_FileName, false);
-		IoMem_MemorySnapShot_Capture(false);
-		ScreenConv_MemorySnapShot_Capture(false);
-		SCC_MemorySnapShot_Capture(false);
+		MemorySnapShot_Components(false);
+		if (!bMemory)
+			DebugUI_MemorySnapShot_Capture(Temp_FileName, false);
 
 		/* version string check catches release-to-release
 		 * state changes, bCaptureError catches too short
@@ -469,11 +598,21 @@ void MemorySnapShot_Restore_Do(void)
 			bCaptureError = true;
 
 		/* And close */
-		MemorySnapShot_CloseFile();
+		if (bMemory)
+			CaptureMem.active = false;
+		else
+			MemorySnapShot_CloseFile();
 
 		/* changes may affect also info shown in statusbar */
 		Statusbar_UpdateInfo();
 
+		if (bMemory)
+		{
+			Reverse_Restored(!bCaptureError);
+			if (bCaptureError)
+				Log_AlertDlg(LOG_ERROR, "Reverse debugging checkpoint restore failed!\nPlease reboot emulation.");
+			return;
+		}
 		if (bCaptureError)
 		{
 			Log_AlertDlg(LOG_ERROR, "Full memory state restore failed!\nPlease reboot emulation.");
@@ -8,7 +8,9 @@
 */
 const char MSA_fileid[] = "Hatari msa.c";
 
+#include <SDL_atomic.h>
 #include <SDL_endian.h>
+#include <SDL_thread.h>
 
 #include "main.h"
 #include "file.h"
@@ -99,7 +101,34 @@ typedef struct
 	Uint16	EndingTrack;		/* Word : Ending track (0-based) */
 } MSAHEADERSTRUCT;
 
-#define MSA_WORKSPACE_SIZE  (1024*1024)  /* Size of workspace to use when saving MSA files */
+/* Space needed for compressing a track: data length word, and the
+ * last 4 byte run may go over the track size before compression
+ * is given up for the track
+ */
+#define MSA_TRACK_SPACE(bytes)  ((bytes) + 2 + 4)
+
+#define MSA_MAX_THREADS  64
+
+/* Track compression or uncompression job */
+typedef struct
+{
+	Uint8 *src;
+	Uint8 *dst;
+	long nSrcLen;		/* source bytes available (uncompression) */
+	long nUsed;		/* bytes consumed (uncompression) or stored (compression) */
+	int nBytesPerTrack;
+	bool bBadRun;		/* run length went over the track end */
+} MSA_TRACK;
+
+typedef struct
+{
+	void (*func)(MSA_TRACK *);
+	MSA_TRACK *track;
+	int count;
+	SDL_atomic_t next;	/* next unprocessed job */
+} MSA_JOBS;
+
+static int MsaThreads = 1;
 
 
 /*-----------------------------------------------------------------------*/
@@ -113,6 +142,132 @@ bool MSA_FileNameIsMSA(const char *pszFileName, bool bAllowGZ)
 }
 
 
+/*-----------------------------------------------------------------------*/
+/**
+ * Set number of threads used for compressing and uncompressing MSA
+ * tracks. With 1 (the default), tracks are handled in the calling thread.
+ */
+void MSA_SetThreads(int nThreads)
+{
+	MsaThreads = nThreads < 1 ? 1 : nThreads;
+}
+
+/**
+ * Worker thread, process jobs until there are none left
+ */
+static int MSA_JobThread(void *data)
+{
+	MSA_JOBS *jobs = data;
+	int i;
+
+	while ((i = SDL_AtomicAdd(&jobs->next, 1)) < jobs->count)
+		jobs->func(&jobs->track[i]);
+	return 0;
+}
+
+/**
+ * Call func for all given track jobs, in parallel if more than one
+ * thread is configured. Returns when all jobs have been processed.
+ */
+static void MSA_RunJobs(void (*func)(MSA_TRACK *), MSA_TRACK *track, int count)
+{
+	SDL_Thread *threads[MSA_MAX_THREADS];
+	MSA_JOBS jobs;
+	int i, nThreads;
+
+	jobs.func = func;
+	jobs.track = track;
+	jobs.count = count;
+	SDL_AtomicSet(&jobs.next, 0);
+
+	nThreads = MsaThreads;
+	if (nThreads > MSA_MAX_THREADS)
+		nThreads = MSA_MAX_THREADS;
+	if (nThreads > count)
+		nThreads = count;
+
+	/* calling thread is one of the workers */
+	for (i = 0; i < nThreads - 1; i++)
+	{
+		threads[i] = SDL_CreateThread(MSA_JobThread, "msa", &jobs);
+		if (!threads[i])
+			break;
+	}
+	nThreads = i;
+	MSA_JobThread(&jobs);
+	for (i = 0; i < nThreads; i++)
+		SDL_WaitThread(threads[i], NULL);
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Uncompress one MSA track (starting from its data length word) at
+ * track->src into track->dst. Sets track->nUsed to number of source
+ * bytes used, or to -1 if source data ended prematurely.
+ */
+static void MSA_UnCompressTrack(MSA_TRACK *track)
+{
+	Uint8 *pMSAImageBuffer = track->src;
+	Uint8 *pImageBuffer = track->dst;
+	long nBytesLeft = track->nSrcLen;
+	int nBytesPerTrack = track->nBytesPerTrack;
+	int i, DataLength, NumBytesUnCompressed, RunLength;
+	Uint8 Byte, Data;
+
+	track->nUsed = -1;
+	track->bBadRun = false;
+
+	nBytesLeft -= sizeof(Uint16);
+	if (nBytesLeft < 0)
+		return;
+	/* Uncompress MSA Track, first check if is not compressed */
+	DataLength = do_get_mem_word(pMSAImageBuffer);
+	pMSAImageBuffer += sizeof(Uint16);
+	if (DataLength == nBytesPerTrack)
+	{
+		if (nBytesLeft < DataLength)
+			return;
+		/* No compression on track, simply copy and continue */
+		memcpy(pImageBuffer, pMSAImageBuffer, nBytesPerTrack);
+		track->nUsed = sizeof(Uint16) + DataLength;
+		return;
+	}
+	/* Uncompress track */
+	NumBytesUnCompressed = 0;
+	while (NumBytesUnCompressed < nBytesPerTrack)
+	{
+		if (--nBytesLeft < 0)
+			return;
+		Byte = *pMSAImageBuffer++;
+		if (Byte != 0xE5)                   /* Compressed header? */
+		{
+			*pImageBuffer++ = Byte;     /* No, just copy byte */
+			NumBytesUnCompressed++;
+		}
+		else
+		{
+			nBytesLeft -= 3;
+			if (nBytesLeft < 0)
+				return;
+			Data = *pMSAImageBuffer++;  /* Byte to copy */
+			RunLength = do_get_mem_word(pMSAImageBuffer);  /* For length */
+			/* Limit length to size of track, incorrect images may overflow */
+			if (RunLength+NumBytesUnCompressed > nBytesPerTrack)
+			{
+				track->bBadRun = true;
+				RunLength = nBytesPerTrack - NumBytesUnCompressed;
+			}
+			pMSAImageBuffer += sizeof(Uint16);
+			for (i = 0; i < RunLength; i++)
+				*pImageBuffer++ = Data;   /* Copy byte */
+			NumBytesUnCompressed += RunLength;
+		}
+	}
+	track->nUsed = pMSAImageBuffer - track->src;
+}
+
+
 /*-----------------------------------------------------------------------*/
 /**
  * Uncompress .MSA data into a new buffer.
@@ -120,9 +275,11 @@ bool MSA_FileNameIsMSA(const char *pszFileName, bool bAllowGZ)
 Uint8 *MSA_UnCompress(Uint8 *pMSAFile, long *pImageSize, long nBytesLeft)
 {
 	MSAHEADERSTRUCT *pMSAHeader;
-	Uint8 *pMSAImageBuffer, *pImageBuffer;
-	Uint8 Byte,Data;
-	int i,Track,Side,DataLength,NumBytesUnCompressed,RunLength;
+	MSA_TRACK *tracks;
+	Uint8 *pMSAImageBuffer;
+	int i, nTracks, nBytesPerTrack;
+	long nOffset;
+	bool bParallel;
 	Uint8 *pBuffer = NULL;
 
 	*pImageSize = 0;
@@ -145,80 +302,81 @@ Uint8 *MSA_UnCompress(Uint8 *pMSAFile, long *pImageSize, long nBytesLeft)
 		return NULL;
 	}
 
-	/* Create buffer */
-	pBuffer = malloc((pMSAHeader->EndingTrack - pMSAHeader->StartingTrack + 1)
-	                 * pMSAHeader->SectorsPerTrack * (pMSAHeader->Sides + 1)
-	                 * NUMBYTESPERSECTOR);
-	if (!pBuffer)
+	/* Create buffers */
+	nTracks = (pMSAHeader->EndingTrack - pMSAHeader->StartingTrack + 1)
+	          * (pMSAHeader->Sides + 1);
+	nBytesPerTrack = NUMBYTESPERSECTOR * pMSAHeader->SectorsPerTrack;
+	pBuffer = malloc(nTracks * nBytesPerTrack);
+	tracks = malloc(nTracks * sizeof(MSA_TRACK));
+	if (!pBuffer || !tracks)
 	{
 		perror("MSA_UnCompress");
+		free(pBuffer);
+		free(tracks);
 		return NULL;
 	}
 
 	/* Set pointers */
-	pImageBuffer = (Uint8 *)pBuffer;
 	pMSAImageBuffer = pMSAFile + sizeof(MSAHEADERSTRUCT);
 	nBytesLeft -= sizeof(MSAHEADERSTRUCT);
 
-	/* Uncompress to memory as '.ST' disk image - NOTE: assumes 512 bytes
-	 * per sector (use NUMBYTESPERSECTOR define)!!! */
-	for (Track = pMSAHeader->StartingTrack; Track <= pMSAHeader->EndingTrack; Track++)
+	/* Tracks are stored one after another in alternating side order, so
+	 * the uncompressed '.ST' image has them at the same index.
+	 * NOTE - assumes 512 bytes per sector (use NUMBYTESPERSECTOR define)!!!
+	 *
+	 * With threads, track start offsets are taken from the track data
+	 * lengths. If they don't match the data, images are uncompressed
+	 * sequentially, which doesn't rely on them.
+	 */
+	bParallel = MsaThreads > 1;
+	nOffset = 0;
+	for (i = 0; i < nTracks; i++)
 	{
-		for (Side = 0; Side < (pMSAHeader->Sides+1); Side++)
+		tracks[i].src = pMSAImageBuffer + nOffset;
+		tracks[i].dst = pBuffer + i * nBytesPerTrack;
+		tracks[i].nBytesPerTrack = nBytesPerTrack;
+		if (bParallel && nOffset + (long)sizeof(Uint16) <= nBytesLeft)
 		{
-			int nBytesPerTrack = NUMBYTESPERSECTOR*pMSAHeader->SectorsPerTrack;
-
-			nBytesLeft -= sizeof(Uint16);
-			if (nBytesLeft  < 0)
-				goto out;
-			/* Uncompress MSA Track, first check if is not compressed */
-			DataLength = do_get_mem_word(pMSAImageBuffer);
-			pMSAImageBuffer += sizeof(Uint16);
-			if (DataLength == nBytesPerTrack)
-			{
-				nBytesLeft -= DataLength;
-				if (nBytesLeft  < 0)
-					goto out;
-				/* No compression on track, simply copy and continue */
-				memcpy(pImageBuffer, pMSAImageBuffer, nBytesPerTrack);
-				pImageBuffer += nBytesPerTrack;
-				pMSAImageBuffer += DataLength;
-				continue;
-			}
-			/* Uncompress track */
-			NumBytesUnCompressed = 0;
-			while (NumBytesUnCompressed < nBytesPerTrack)
+			tracks[i].nSrcLen = sizeof(Uint16) + do_get_mem_word(tracks[i].src);
+			nOffset += tracks[i].nSrcLen;
+			if (nOffset > nBytesLeft)
+				bParallel = false;
+		}
+		else
+			bParallel = false;
+	}
+	if (bParallel)
+	{
+		MSA_RunJobs(MSA_UnCompressTrack, tracks, nTracks);
+		for (i = 0; i < nTracks; i++)
+		{
+			if (tracks[i].nUsed != tracks[i].nSrcLen)
+				bParallel = false;
+		}
+	}
+	if (!bParallel)
+	{
+		for (i = 0; i < nTracks; i++)
+		{
+			tracks[i].src = pMSAImageBuffer;
+			tracks[i].nSrcLen = nBytesLeft;
+			MSA_UnCompressTrack(&tracks[i]);
+			if (tracks[i].nUsed < 0)
 			{
-				if (--nBytesLeft  < 0)
-					goto out;
-				Byte = *pMSAImageBuffer++;
-				if (Byte != 0xE5)                   /* Compressed header? */
-				{
-					*pImageBuffer++ = Byte;     /* No, just copy byte */
-					NumBytesUnCompressed++;
-				}
-				else
-				{
-					nBytesLeft -= 3;
-					if (nBytesLeft  < 0)
-						goto out;
-					Data = *pMSAImageBuffer++;  /* Byte to copy */
-					RunLength = do_get_mem_word(pMSAImageBuffer);  /* For length */
-					/* Limit length to size of track, incorrect images may overflow */
-					if (RunLength+NumBytesUnCompressed > nBytesPerTrack)
-					{
-						fprintf(stderr, "MSA_UnCompress: Illegal run length -> corrupted disk image?\n");
-						RunLength = nBytesPerTrack - NumBytesUnCompressed;
-					}
-					pMSAImageBuffer += sizeof(Uint16);
-					for (i = 0; i < RunLength; i++)
-						*pImageBuffer++ = Data;   /* Copy byte */
-					NumBytesUnCompressed += RunLength;
-				}
+				nBytesLeft = -1;
+				break;
 			}
+			pMSAImageBuffer += tracks[i].nUsed;
+			nBytesLeft -= tracks[i].nUsed;
 		}
 	}
-out:
+	for (i = 0; i < nTracks && nBytesLeft >= 0; i++)
+	{
+		if (tracks[i].bBadRun)
+			fprintf(stderr, "MSA_UnCompress: Illegal run length -> corrupted disk image?\n");
+	}
+	free(tracks);
+
 	if (nBytesLeft < 0)
 	{
 		fprintf(stderr, "MSA error: Premature end of file!\n");
@@ -228,7 +386,7 @@ out:
 	else
 	{
 		/* Set size of loaded image */
-		*pImageSize = pImageBuffer-pBuffer;
+		*pImageSize = (long)nTracks * nBytesPerTrack;
 	}
 
 	/* Return pointer to buffer, NULL if failed */
@@ -274,7 +432,7 @@ Uint8 *MSA_ReadDisk(int Drive, const char *pszFileName, long *pImageSize, int *p
  * Return number of bytes of the same byte in the passed buffer
  * If we return '0' this means no run (or end of buffer)
  */
-static int MSA_FindRunOfBytes(Uint8 *pBuffer, int nBytesInBuffer)
+static int MSA_FindRunOfBytes(const Uint8 *pBuffer, int nBytesInBuffer)
 {
 	Uint8 ScannedByte;
 	int nTotalRun;
@@ -313,6 +471,64 @@ static int MSA_FindRunOfBytes(Uint8 *pBuffer, int nBytesInBuffer)
 }
 
 
+/*-----------------------------------------------------------------------*/
+/**
+ * Compress one track of track->nBytesPerTrack bytes at track->src into
+ * track->dst, preceded by its data length word. Tracks that don't get
+ * smaller are stored uncompressed. Sets track->nUsed to the number of
+ * bytes stored, destination needs room for MSA_TRACK_SPACE() bytes.
+ */
+static void MSA_CompressTrack(MSA_TRACK *track)
+{
+	const Uint8 *pImageBuffer = track->src;
+	Uint8 *pMSABuffer = track->dst + sizeof(Uint16);
+	int nBytesPerTrack = track->nBytesPerTrack;
+	int nBytesToGo, nBytesRun, nCompressedBytes;
+
+	/* Compress track */
+	nBytesToGo = nBytesPerTrack;
+	nCompressedBytes = 0;
+	/* once compressed track isn't smaller, it will be stored uncompressed */
+	while (nBytesToGo > 0 && nCompressedBytes < nBytesPerTrack)
+	{
+		nBytesRun = MSA_FindRunOfBytes(pImageBuffer,nBytesToGo);
+		if (nBytesRun == 0)
+		{
+			/* Just copy byte */
+			*pMSABuffer++ = *pImageBuffer++;
+			nCompressedBytes++;
+			nBytesRun = 1;
+		}
+		else
+		{
+			/* Store run! */
+			*pMSABuffer++ = 0xE5;               /* Marker */
+			*pMSABuffer++ = *pImageBuffer;      /* Byte, and follow with 16-bit length */
+			do_put_mem_word(pMSABuffer, nBytesRun);
+			pMSABuffer += sizeof(Uint16);
+			pImageBuffer += nBytesRun;
+			nCompressedBytes += 4;
+		}
+		nBytesToGo -= nBytesRun;
+	}
+
+	/* Is compressed track smaller than the original? */
+	if (nCompressedBytes < nBytesPerTrack)
+	{
+		/* Yes, store size */
+		do_put_mem_word(track->dst, nCompressedBytes);
+	}
+	else
+	{
+		/* No, just store uncompressed track */
+		do_put_mem_word(track->dst, nBytesPerTrack);
+		memcpy(track->dst + sizeof(Uint16), track->src, nBytesPerTrack);
+		nCompressedBytes = nBytesPerTrack;
+	}
+	track->nUsed = sizeof(Uint16) + nCompressedBytes;
+}
+
+
 /*-----------------------------------------------------------------------*/
 /**
  * Save compressed .MSA file from memory buffer. Returns true is all OK
@@ -322,88 +538,56 @@ bool MSA_WriteDisk(int Drive, const char *pszFileName, Uint8 *pBuffer, int Image
 #ifdef SAVE_TO_MSA_IMAGES
 
 	MSAHEADERSTRUCT *pMSAHeader;
-	Uint16 *pMSADataLength;
-	Uint8 *pMSAImageBuffer, *pMSABuffer, *pImageBuffer;
-	Uint16 nSectorsPerTrack, nSides, nCompressedBytes, nBytesPerTrack;
+	MSA_TRACK *tracks;
+	Uint8 *pMSAImageBuffer, *pMSABuffer;
+	Uint16 nSectorsPerTrack, nSides;
 	bool nRet;
-	int nTracks,nBytesToGo,nBytesRun;
-	int Track,Side;
+	int nTracks, nBytesPerTrack, i;
 
-	/* Allocate workspace for compressed image */
-	pMSAImageBuffer = (Uint8 *)malloc(MSA_WORKSPACE_SIZE);
-	if (!pMSAImageBuffer)
+	Floppy_FindDiskDetails(pBuffer,ImageSize, &nSectorsPerTrack, &nSides);
+	nTracks = ((ImageSize / NUMBYTESPERSECTOR) / nSectorsPerTrack) / nSides;
+	nBytesPerTrack = NUMBYTESPERSECTOR*nSectorsPerTrack;
+
+	/* Allocate workspace for compressed image, each track is first
+	 * compressed into its own slot, and then moved after the previous one
+	 */
+	pMSAImageBuffer = malloc(sizeof(MSAHEADERSTRUCT)
+	                         + nTracks * nSides * MSA_TRACK_SPACE(nBytesPerTrack));
+	tracks = malloc(nTracks * nSides * sizeof(MSA_TRACK));
+	if (!pMSAImageBuffer || !tracks)
 	{
 		perror("MSA_WriteDisk");
+		free(pMSAImageBuffer);
+		free(tracks);
 		return false;
 	}
 
 	/* Store header */
 	pMSAHeader = (MSAHEADERSTRUCT *)pMSAImageBuffer;
 	pMSAHeader->ID = SDL_SwapBE16(0x0E0F);
-	Floppy_FindDiskDetails(pBuffer,ImageSize, &nSectorsPerTrack, &nSides);
 	pMSAHeader->SectorsPerTrack = SDL_SwapBE16(nSectorsPerTrack);
 	pMSAHeader->Sides = SDL_SwapBE16(nSides-1);
 	pMSAHeader->StartingTrack = SDL_SwapBE16(0);
-	nTracks = ((ImageSize / NUMBYTESPERSECTOR) / nSectorsPerTrack) / nSides;
 	pMSAHeader->EndingTrack = SDL_SwapBE16(nTracks-1);
 
-	/* Compress image */
+	/* Compress image, tracks are in the same alternating side
+	 * order both in .ST and .MSA images
+	 */
 	pMSABuffer = pMSAImageBuffer + sizeof(MSAHEADERSTRUCT);
-	for (Track = 0; Track < nTracks; Track++)
+	for (i = 0; i < nTracks * nSides; i++)
 	{
-		for (Side = 0; Side < nSides; Side++)
-		{
-			/* Get track data pointer */
-			nBytesPerTrack = NUMBYTESPERSECTOR*nSectorsPerTrack;
-			pImageBuffer = pBuffer + (nBytesPerTrack*Side) + ((nBytesPerTrack*nSides)*Track);
-
-			/* Skip data length (fill in later) */
-			pMSADataLength = (Uint16 *)pMSABuffer;
-			pMSABuffer += sizeof(Uint16);
-
-			/* Compress track */
-			nBytesToGo = nBytesPerTrack;
-			nCompressedBytes = 0;
-			while (nBytesToGo > 0)
-			{
-				nBytesRun = MSA_FindRunOfBytes(pImageBuffer,nBytesToGo);
-				if (nBytesRun == 0)
-				{
-					/* Just copy byte */
-					*pMSABuffer++ = *pImageBuffer++;
-					nCompressedBytes++;
-					nBytesRun = 1;
-				}
-				else
-				{
-					/* Store run! */
-					*pMSABuffer++ = 0xE5;               /* Marker */
-					*pMSABuffer++ = *pImageBuffer;      /* Byte, and follow with 16-bit length */
-					do_put_mem_word(pMSABuffer, nBytesRun);
-					pMSABuffer += sizeof(Uint16);
-					pImageBuffer += nBytesRun;
-					nCompressedBytes += 4;
-				}
-				nBytesToGo -= nBytesRun;
-			}
+		tracks[i].src = pBuffer + i * nBytesPerTrack;
+		tracks[i].dst = pMSABuffer + i * MSA_TRACK_SPACE(nBytesPerTrack);
+		tracks[i].nBytesPerTrack = nBytesPerTrack;
+	}
+	MSA_RunJobs(MSA_CompressTrack, tracks, nTracks * nSides);
 
-			/* Is compressed track smaller than the original? */
-			if (nCompressedBytes < nBytesPerTrack)
-			{
-				/* Yes, store size */
-				do_put_mem_word(pMSADataLength, nCompressedBytes);
-			}
-			else
-			{
-				/* No, just store uncompressed track */
-				do_put_mem_word(pMSADataLength, nBytesPerTrack);
-				pMSABuffer = ((Uint8 *)pMSADataLength) + 2;
-				pImageBuffer = pBuffer + (nBytesPerTrack*Side) + ((nBytesPerTrack*nSides)*Track);
-				memcpy(pMSABuffer,pImageBuffer, nBytesPerTrack);
-				pMSABuffer += nBytesPerTrack;
-			}
-		}
+	for (i = 0; i < nTracks * nSides; i++)
+	{
+		memmove(pMSABuffer, tracks[i].dst, tracks[i].nUsed);
+		pMSABuffer += tracks[i].nUsed;
 	}
+	free(tracks);
 
 	/* And save to file! */
 	nRet = File_Save(pszFileName,pMSAImageBuffer, pMSABuffer-pMSAImageBuffer, false);
@@ -137,7 +137,9 @@ enum {
 	OPT_DISKA,
 	OPT_DISKB,
 	OPT_FASTFLOPPY,
+	OPT_TURBOFLOPPY,
 	OPT_WRITEPROT_FLOPPY,
+	OPT_DISKCACHE,
 
 	OPT_HARDDRIVE,		/* HD options */
 	OPT_WRITEPROT_HD,
@@ -150,6 +152,8 @@ enum {
 	OPT_IDEMASTERHDIMAGE,
 	OPT_IDESLAVEHDIMAGE,
 	OPT_IDEBYTESWAP,
+	OPT_IDEREADAHEAD,
+	OPT_HDOVERLAY,
 
 	OPT_MEMSIZE,		/* memory options */
 	OPT_TT_RAM,
@@ -180,6 +184,7 @@ enum {
 	OPT_SOUND,
 	OPT_SOUNDBUFFERSIZE,
 	OPT_SOUNDSYNC,
+	OPT_SOUNDFFSKIP,
 	OPT_YM_MIXING,
 
 #ifdef WIN32
@@ -375,8 +380,12 @@ static const opt_t HatariOptions[] = {
 	  "<file>", "Set disk image for floppy drive B" },
 	{ OPT_FASTFLOPPY,   NULL, "--fastfdc",
 	  "<bool>", "Speed up floppy disk access emulation (can break some programs)" },
+	{ OPT_TURBOFLOPPY,  NULL, "--turbofdc",
+	  "<bool>", "Transfer .st/.msa/.dim sectors without FDC delays (breaks some programs)" },
 	{ OPT_WRITEPROT_FLOPPY, NULL, "--protect-floppy",
 	  "<x>", "Write protect floppy image contents (on/off/auto)" },
+	{ OPT_DISKCACHE, NULL, "--disk-cache",
+	  "<dir>", "Cache unpacked .zip/.gz floppy images in <dir>" },
 
 	{ OPT_HEADER, NULL, NULL, NULL, "Hard drive" },
 	{ OPT_HARDDRIVE, "-d", "--harddrive",
@@ -401,6 +410,10 @@ static const opt_t HatariOptions[] = {
 	  "<file>", "Emulate an IDE 1 (slave) harddrive with an image <file>" },
 	{ OPT_IDEBYTESWAP,   NULL, "--ide-swap",
 	  "<id>=<x>", "Set IDE (0/1) byte-swap option (off/on/auto)" },
+	{ OPT_IDEREADAHEAD,   NULL, "--ide-readahead",
+	  "<id>=<x>", "Set IDE (0/1) read-ahead buffer size in KB (0-4096, 0=off)" },
+	{ OPT_HDOVERLAY,   NULL, "--hd-overlay",
+	  "<dir>", "Write ACSI/SCSI/IDE image changes to overlay files in <dir> (one dir per Hatari instance)" },
 
 	{ OPT_HEADER, NULL, NULL, NULL, "Memory" },
 	{ OPT_MEMSIZE,   "-s", "--memsize",
@@ -461,6 +474,8 @@ static const opt_t HatariOptions[] = {
 	  "<x>", "Sound buffer size in ms (x=0/10-100, 0=SDL default)" },
 	{ OPT_SOUNDSYNC,   NULL, "--sound-sync",
 	  "<bool>", "Sound synchronized emulation (on|off, off=default)" },
+	{ OPT_SOUNDFFSKIP,   NULL, "--sound-ff-skip",
+	  "<bool>", "Skip sound synthesis in fast forward/benchmark mode" },
 	{ OPT_YM_MIXING,   NULL, "--ym-mixing",
 	  "<x>", "YM sound mixing method (x=linear/table/model)" },
 
@@ -1541,6 +1556,10 @@ bool Opt_ParseParameters(int argc, const char * const argv[])
 			ok = Opt_Bool(argv[++i], OPT_FASTFLOPPY, &ConfigureParams.DiskImage.FastFloppy);
 			break;
 
+		case OPT_TURBOFLOPPY:
+			ok = Opt_Bool(argv[++i], OPT_TURBOFLOPPY, &ConfigureParams.DiskImage.bTurboFloppy);
+			break;
+
 		case OPT_WRITEPROT_FLOPPY:
 			i += 1;
 			if (strcasecmp(argv[i], "off") == 0)
@@ -1553,6 +1572,15 @@ bool Opt_ParseParameters(int argc, const char * const argv[])
 				return Opt_ShowError(OPT_WRITEPROT_FLOPPY, argv[i], "Unknown option value");
 			break;
 
+		case OPT_DISKCACHE:
+			i += 1;
+			if (strcasecmp(argv[i], "none") != 0 && !File_DirExists(argv[i]))
+				return Opt_ShowError(OPT_DISKCACHE, argv[i], "Given directory doesn't exist");
+			ok = Opt_StrCpy(OPT_DISKCACHE, false, ConfigureParams.DiskImage.szDiskCacheDirectory,
+					argv[i], sizeof(ConfigureParams.DiskImage.szDiskCacheDirectory),
+					&ConfigureParams.DiskImage.bUseDiskCache);
+			break;
+
 		case OPT_WRITEPROT_HD:
 			i += 1;
 			if (strcasecmp(argv[i], "off") == 0)
@@ -1720,6 +1748,35 @@ bool Opt_ParseParameters(int argc, const char * const argv[])
 				return Opt_ShowError(OPT_IDEBYTESWAP, argv[i], "Invalid byte-swap setting");
 			break;
 
+		case OPT_IDEREADAHEAD:
+			i += 1;
+			str = argv[i];
+			if (strlen(str) > 2 && isdigit((unsigned char)str[0]) && str[1] == '=')
+			{
+				drive = str[0] - '0';
+				if (drive < 0 || drive > 1)
+					return Opt_ShowError(OPT_IDEREADAHEAD, str, "Invalid IDE drive <id>, must be 0/1");
+				str += 2;
+			}
+			else
+			{
+				drive = 0;
+			}
+			val = atoi(str);
+			if (!isdigit((unsigned char)str[0]) || val > 4096)
+				return Opt_ShowError(OPT_IDEREADAHEAD, argv[i], "Invalid read-ahead size");
+			ConfigureParams.Ide[drive].nReadAhead = val;
+			break;
+
+		case OPT_HDOVERLAY:
+			i += 1;
+			if (strcasecmp(argv[i], "none") != 0 && !File_DirExists(argv[i]))
+				return Opt_ShowError(OPT_HDOVERLAY, argv[i], "Given directory doesn't exist");
+			ok = Opt_StrCpy(OPT_HDOVERLAY, false, ConfigureParams.HardDisk.szOverlayDirectory,
+					argv[i], sizeof(ConfigureParams.HardDisk.szOverlayDirectory),
+					&ConfigureParams.HardDisk.bUseOverlay);
+			break;
+
 			/* Memory options */
 		case OPT_MEMSIZE:
 			memsize = atoi(argv[++i]);
@@ -2034,6 +2091,10 @@ bool Opt_ParseParameters(int argc, const char * const argv[])
 			ok = Opt_Bool(argv[++i], OPT_SOUNDSYNC, &ConfigureParams.Sound.bEnableSoundSync);
 			break;
 
+		case OPT_SOUNDFFSKIP:
+			ok = Opt_Bool(argv[++i], OPT_SOUNDFFSKIP, &ConfigureParams.Sound.bSkipInFastForward);
+			break;
+
 		case OPT_MICROPHONE:
 			ok = Opt_Bool(argv[++i], OPT_MICROPHONE, &ConfigureParams.Sound.bEnableMicrophone);
 			break;
@@ -62,7 +62,9 @@ const char Rtc_fileid[] = "Hatari rtc.c";
 #include <time.h>
 
 #include "main.h"
+#include "configuration.h"
 #include "ioMem.h"
+#include "reverse.h"
 #include "rtc.h"
 
 
@@ -70,6 +72,16 @@ static bool rtc_bank;           /* RTC bank select (0=normal, 1=configuration(?)
 static Sint8 fake_am, fake_amz;
 
 
+/*-----------------------------------------------------------------------*/
+/**
+ * Get host time, or the recorded one when replaying for reverse debugging.
+ */
+static time_t Rtc_GetTime(void)
+{
+	return Reverse_Sample(REVERSE_INPUT_TIME, time(NULL));
+}
+
+
 /*-----------------------------------------------------------------------*/
 /**
  * Read seconds units.
@@ -80,7 +92,7 @@ void Rtc_SecondsUnits_ReadByte(void)
 	time_t nTimeTicks;
 
 	/* Get system time */
-	nTimeTicks = time(NULL);
+	nTimeTicks = Rtc_GetTime();
 	SystemTime = localtime(&nTimeTicks);
 	IoMem[0xfffc21] = SystemTime->tm_sec % 10;
 }
@@ -96,7 +108,7 @@ void Rtc_SecondsTens_ReadByte(void)
 	time_t nTimeTicks;
 
 	/* Get system time */
-	nTimeTicks = time(NULL);
+	nTimeTicks = Rtc_GetTime();
 	SystemTime = localtime(&nTimeTicks);
 	IoMem[0xfffc23] = SystemTime->tm_sec / 10;
 }
@@ -118,7 +130,7 @@ void Rtc_MinutesUnits_ReadByte(void)
 		time_t nTimeTicks;
 
 		/* Get system time */
-		nTimeTicks = time(NULL);
+		nTimeTicks = Rtc_GetTime();
 		SystemTime = localtime(&nTimeTicks);
 		IoMem[0xfffc25] = SystemTime->tm_min % 10;
 	}
@@ -154,7 +166,7 @@ void Rtc_MinutesTens_ReadByte(void)
 		time_t nTimeTicks;
 
 		/* Get system time */
-		nTimeTicks = time(NULL);
+		nTimeTicks = Rtc_GetTime();
 		SystemTime = localtime(&nTimeTicks);
 		IoMem[0xfffc27] = SystemTime->tm_min / 10;
 	}
@@ -184,7 +196,7 @@ void Rtc_HoursUnits_ReadByte(void)
 	time_t nTimeTicks;
 
 	/* Get system time */
-	nTimeTicks = time(NULL);
+	nTimeTicks = Rtc_GetTime();
 	SystemTime = localtime(&nTimeTicks);
 	IoMem[0xfffc29] = SystemTime->tm_hour % 10;
 }
@@ -200,7 +212,7 @@ void Rtc_HoursTens_ReadByte(void)
 	time_t nTimeTicks;
 
 	/* Get system time */
-	nTimeTicks = time(NULL);
+	nTimeTicks = Rtc_GetTime();
 	SystemTime = localtime(&nTimeTicks);
 	IoMem[0xfffc2b] = SystemTime->tm_hour / 10;
 }
@@ -216,7 +228,7 @@ void Rtc_Weekday_ReadByte(void)
 	time_t nTimeTicks;
 
 	/* Get system time */
-	nTimeTicks = time(NULL);
+	nTimeTicks = Rtc_GetTime();
 	SystemTime = localtime(&nTimeTicks);
 	IoMem[0xfffc2d] = SystemTime->tm_wday;
 }
@@ -232,7 +244,7 @@ void Rtc_DayUnits_ReadByte(void)
 	time_t nTimeTicks;
 
 	/* Get system time */
-	nTimeTicks = time(NULL);
+	nTimeTicks = Rtc_GetTime();
 	SystemTime = localtime(&nTimeTicks);
 	IoMem[0xfffc2f] = SystemTime->tm_mday % 10;
 }
@@ -248,7 +260,7 @@ void Rtc_DayTens_ReadByte(void)
 	time_t nTimeTicks;
 
 	/* Get system time */
-	nTimeTicks = time(NULL);
+	nTimeTicks = Rtc_GetTime();
 	SystemTime = localtime(&nTimeTicks);
 	IoMem[0xfffc31] = SystemTime->tm_mday / 10;
 }
@@ -264,7 +276,7 @@ void Rtc_MonthUnits_ReadByte(void)
 	time_t nTimeTicks;
 
 	/* Get system time */
-	nTimeTicks = time(NULL);
+	nTimeTicks = Rtc_GetTime();
 	SystemTime = localtime(&nTimeTicks);
 	IoMem[0xfffc33] = (SystemTime->tm_mon + 1) % 10;
 }
@@ -280,7 +292,7 @@ void Rtc_MonthTens_ReadByte(void)
 	time_t nTimeTicks;
 
 	/* Get system time */
-	nTimeTicks = time(NULL);
+	nTimeTicks = Rtc_GetTime();
 	SystemTime = localtime(&nTimeTicks);
 	IoMem[0xfffc35] = (SystemTime->tm_mon + 1) / 10;
 }
@@ -296,7 +308,7 @@ void Rtc_YearUnits_ReadByte(void)
 	time_t nTimeTicks;
 
 	/* Get system time */
-	nTimeTicks = time(NULL);
+	nTimeTicks = Rtc_GetTime();
 	SystemTime = localtime(&nTimeTicks);
 	IoMem[0xfffc37] = SystemTime->tm_year % 10;
 }
@@ -312,7 +324,7 @@ void Rtc_YearTens_ReadByte(void)
 	time_t nTimeTicks;
 
 	/* Get system time */
-	nTimeTicks = time(NULL);
+	nTimeTicks = Rtc_GetTime();
 	SystemTime = localtime(&nTimeTicks);
 	IoMem[0xfffc39] = (SystemTime->tm_year - 80) / 10;
 }
@@ -12,6 +12,7 @@ const char ScreenSnapShot_fileid[] = "Hatari screenSnapShot.c";
 #include <dirent.h>
 #include <string.h>
 #include "main.h"
+#include "asyncWriter.h"
 #include "configuration.h"
 #include "file.h"
 #include "log.h"
@@ -98,12 +99,27 @@ static int ScreenSnapShot_SavePNG(SDL_Surface *surface, const char *filename)
 
 
 /**
- * Save given SDL surface as PNG in an already opened FILE, eventually cropping some borders.
+ * libpng write callback for ScreenSnapShot_SavePNG_ToAsyncFile()
+ */
+static void ScreenSnapShot_PngWriteAsync(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+	if (!AsyncWriter_Write(png_get_io_ptr(png_ptr), data, length))
+		png_error(png_ptr, "write failed");
+}
+
+static void ScreenSnapShot_PngFlushAsync(png_structp png_ptr)
+{
+	/* nothing to do, writer thread handles flushing */
+}
+
+
+/**
+ * Save given SDL surface as PNG either in an already opened FILE (fp)
+ * or through the asynchronous writer (af), eventually cropping some borders.
  * Return png file size > 0 for success.
- * This function is also used by avi_record.c to save individual frames as png images.
  */
-int ScreenSnapShot_SavePNG_ToFile(SDL_Surface *surface, int dw, int dh,
-		FILE *fp, int png_compression_level, int png_filter,
+static int ScreenSnapShot_SavePNG_Common(SDL_Surface *surface, int dw, int dh,
+		FILE *fp, ASYNC_FILE *af, int png_compression_level, int png_filter,
 		int CropLeft , int CropRight , int CropTop , int CropBottom )
 {
 	bool do_lock;
@@ -150,11 +166,19 @@ int ScreenSnapShot_SavePNG_ToFile(SDL_Surface *surface, int dw, int dh,
 		goto png_cleanup;
 	}
 
-	/* store current pos in fp (could be != 0 for avi recording) */
-	start = ftello ( fp );
-
-	/* initialize the png structure */
-	png_init_io(png_ptr, fp);
+	/* store current pos in file (could be != 0 for avi recording) */
+	if (fp)
+	{
+		start = ftello ( fp );
+		/* initialize the png structure */
+		png_init_io(png_ptr, fp);
+	}
+	else
+	{
+		start = AsyncWriter_Tell ( af );
+		png_set_write_fn(png_ptr, af, ScreenSnapShot_PngWriteAsync,
+		                 ScreenSnapShot_PngFlushAsync);
+	}
 
 	/* image data properties */
 	png_set_IHDR(png_ptr, info_ptr, dw, dh, 8, PNG_COLOR_TYPE_RGB,
@@ -213,13 +237,46 @@ int ScreenSnapShot_SavePNG_ToFile(SDL_Surface *surface, int dw, int dh,
 	/* write the additional chunks to the PNG file */
 	png_write_end(png_ptr, info_ptr);
 
-	ret = (int)( ftello ( fp ) - start );			/* size of the png image */
+	/* size of the png image */
+	if (fp)
+		ret = (int)( ftello ( fp ) - start );
+	else
+		ret = (int)( AsyncWriter_Tell ( af ) - start );
 png_cleanup:
 	if (png_ptr)
 		/* handles info_ptr being NULL */
 		png_destroy_write_struct(&png_ptr, &info_ptr);
 	return ret;
 }
+
+
+/**
+ * Save given SDL surface as PNG in an already opened FILE, eventually cropping some borders.
+ * Return png file size > 0 for success.
+ */
+int ScreenSnapShot_SavePNG_ToFile(SDL_Surface *surface, int dw, int dh,
+		FILE *fp, int png_compression_level, int png_filter,
+		int CropLeft , int CropRight , int CropTop , int CropBottom )
+{
+	return ScreenSnapShot_SavePNG_Common(surface, dw, dh, fp, NULL,
+			png_compression_level, png_filter,
+			CropLeft, CropRight, CropTop, CropBottom);
+}
+
+
+/**
+ * Same as ScreenSnapShot_SavePNG_ToFile(), but writing through the asynchronous
+ * writer. This function is used by avi_record.c to save individual frames as
+ * png images.
+ */
+int ScreenSnapShot_SavePNG_ToAsyncFile(SDL_Surface *surface, int dw, int dh,
+		ASYNC_FILE *af, int png_compression_level, int png_filter,
+		int CropLeft , int CropRight , int CropTop , int CropBottom )
+{
+	return ScreenSnapShot_SavePNG_Common(surface, dw, dh, NULL, af,
+			png_compression_level, png_filter,
+			CropLeft, CropRight, CropTop, CropBottom);
+}
 #endif
 
 
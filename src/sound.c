@@ -148,6 +148,7 @@ const char Sound_fileid[] = "Hatari sound.c";
 #include "ymFormat.h"
 #include "avi_record.h"
 #include "clocks_timings.h"
+#include "options.h"
 
 
 
@@ -266,6 +267,7 @@ static ymu16	ToneA_per , ToneA_count , ToneA_val;
 static ymu16	ToneB_per , ToneB_count , ToneB_val;
 static ymu16	ToneC_per , ToneC_count , ToneC_val;
 static ymu16	Noise_per , Noise_count , Noise_val;
+static ymu16	Freq_div_2 = 0;				/* noise counter is increased at 125 kHz */
 static ymu16	Env_per , Env_count;
 static ymu32	Env_pos;
 static int	Env_shape;
@@ -357,6 +359,10 @@ static ymu16	YM2149_NoisePer		(ymu8 rNoise);
 static ymu16	YM2149_EnvPer		(ymu8 rHigh , ymu8 rLow);
 
 static void	YM2149_Run		( Uint64 CPU_Clock );
+static ymu32	YM2149_CounterSkip	( ymu16 *pCount , ymu16 Per , ymu32 Nb );
+static void	YM2149_NoiseSkip	( ymu32 Nb );
+static void	YM2149_Skip		( Uint64 CPU_Clock );
+static bool	Sound_SkipSynthesis	( void );
 static int	Sound_GenerateSamples	( Uint64 CPU_Clock);
 static void	YM2149_DoSamples_250	( int SamplesToGenerate_250 );
 #ifdef YM_250_DEBUG
@@ -374,33 +380,50 @@ static void	YM2149_DoSamples_250_Debug ( int SamplesToGenerate , int pos );
  * a = (int32_t)(32768.0*(1.0 - pole)) :       a = 64 !!!
  * Input range: -32768 to 32767  Maximum step: +65536 or -65472
  */
-ymsample	Subsonic_IIR_HPF_Left(ymsample x0)
+static struct { yms32 x1, y1, y0; } Subsonic_HPF[2];	/* left/right filter state */
+
+static inline ymsample	Subsonic_IIR_HPF(int chan, ymsample x0)
 {
-	static	yms32	x1 = 0, y1 = 0, y0 = 0;
+	Subsonic_HPF[chan].y1 += ((x0 - Subsonic_HPF[chan].x1)<<15) - (Subsonic_HPF[chan].y0<<6);  /*  64*y0  */
+	Subsonic_HPF[chan].y0 = Subsonic_HPF[chan].y1>>15;
+	Subsonic_HPF[chan].x1 = x0;
+
+	return Subsonic_HPF[chan].y0;
+}
 
+ymsample	Subsonic_IIR_HPF_Left(ymsample x0)
+{
 	if ( YM2149_HPF_Filter == YM2149_HPF_FILTER_NONE )
 		return x0;
 
-	y1 += ((x0 - x1)<<15) - (y0<<6);  /*  64*y0  */
-	y0 = y1>>15;
-	x1 = x0;
-
-	return y0;
+	return Subsonic_IIR_HPF(0, x0);
 }
 
 
 ymsample	Subsonic_IIR_HPF_Right(ymsample x0)
 {
-	static	yms32	x1 = 0, y1 = 0, y0 = 0;
-
 	if ( YM2149_HPF_Filter == YM2149_HPF_FILTER_NONE )
 		return x0;
 
-	y1 += ((x0 - x1)<<15) - (y0<<6);  /*  64*y0  */
-	y0 = y1>>15;
-	x1 = x0;
+	return Subsonic_IIR_HPF(1, x0);
+}
 
-	return y0;
+
+/**
+ * Same as Subsonic_IIR_HPF_Left/Right, for a block of nLen stereo samples
+ */
+void	Subsonic_IIR_HPF_Stereo(ymsample (*pBuf)[2], int nLen)
+{
+	int	i;
+
+	if ( YM2149_HPF_Filter == YM2149_HPF_FILTER_NONE )
+		return;
+
+	for ( i = 0 ; i < nLen ; i++ )
+	{
+		pBuf[i][0] = Subsonic_IIR_HPF(0, pBuf[i][0]);
+		pBuf[i][1] = Subsonic_IIR_HPF(1, pBuf[i][1]);
+	}
 }
 
 
@@ -1020,7 +1043,6 @@ static void	YM2149_DoSamples_250 ( int SamplesToGenerate_250 )
 	ymu32		bt;
 	ymu16		Env3Voices;			/* 0x00CCBBAA */
 	ymu16		Tone3Voices;			/* 0x00CCBBAA */
-	static ymu16	Freq_div_2 = 0;
 	int		pos;
 	int		n;
 
@@ -1254,6 +1276,120 @@ static void	YM2149_Run ( Uint64 CPU_Clock )
 
 
 
+/*-----------------------------------------------------------------------*/
+/**
+ * Update a tone/envelope counter as if 'Nb' internal YM cycles were emulated
+ * by YM2149_DoSamples_250() and return how many times the counter reached
+ * its period (as in YM2149_DoSamples_250(), per==0 is the same as per==1)
+ */
+static ymu32	YM2149_CounterSkip ( ymu16 *pCount , ymu16 Per , ymu32 Nb )
+{
+	ymu32	per = Per ? Per : 1;
+	ymu32	first;
+
+	/* Cycles needed to reach the period for the first time */
+	first = ( *pCount + 1u >= per ) ? 1 : per - *pCount;
+	if ( Nb < first )
+	{
+		*pCount += Nb;
+		return 0;
+	}
+
+	Nb -= first;
+	*pCount = Nb % per;
+	return 1 + Nb / per;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Update the noise counter and the noise generator as if 'Nb' internal
+ * YM cycles were emulated by YM2149_DoSamples_250().
+ * The noise counter is increased only every 2 cycles, but compared to
+ * its period on every cycle. This loops once per noise period, not per cycle.
+ */
+static void	YM2149_NoiseSkip ( ymu32 Nb )
+{
+	ymu32	inc , cycles;
+
+	while ( Nb > 0 )
+	{
+		if ( Noise_count >= Noise_per )
+		{
+			/* Period already reached : new noise value on next cycle */
+			Freq_div_2 ^= 1;
+			Noise_count = 0;
+			Noise_val = YM2149_RndCompute();
+			Nb--;
+			continue;
+		}
+
+		/* Cycles needed to increase the counter up to the period */
+		inc = Noise_per - Noise_count;
+		cycles = Freq_div_2 ? 2*inc - 1 : 2*inc;
+		if ( Nb < cycles )
+		{
+			Noise_count += Freq_div_2 ? ( Nb + 1 ) / 2 : Nb / 2;
+			Freq_div_2 ^= Nb & 1;
+			return;
+		}
+
+		Nb -= cycles;
+		Freq_div_2 = 0;				/* last cycle increased the counter */
+		Noise_count = 0;
+		Noise_val = YM2149_RndCompute();
+	}
+}
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Same as YM2149_Run(), but without computing the output of the internal
+ * YM cycles : tone, noise and envelope counters/positions are directly
+ * updated to their values at CPU_Clock.
+ * Only the last cycle is fully emulated, skipped samples in YM_Buffer_250[]
+ * are not updated (this only affects the first output sample when going
+ * back to normal sound synthesis).
+ */
+static void	YM2149_Skip ( Uint64 CPU_Clock )
+{
+	Uint64		YM2149_Clock_250_prev;
+	ymu32		Nb , wraps;
+
+
+	YM2149_Clock_250_prev = YM2149_Clock_250;
+	YM2149_UpdateClock_250 ( CPU_Clock );
+
+	if ( YM2149_Clock_250 <= YM2149_Clock_250_prev )
+		return;
+
+	Nb = YM2149_Clock_250 - YM2149_Clock_250_prev - 1;
+
+	if ( Nb > 0 )
+	{
+		YM2149_NoiseSkip ( Nb );
+
+		if ( YM2149_CounterSkip ( &ToneA_count , ToneA_per , Nb ) & 1 )
+			ToneA_val ^= YM_SQUARE_UP;
+		if ( YM2149_CounterSkip ( &ToneB_count , ToneB_per , Nb ) & 1 )
+			ToneB_val ^= YM_SQUARE_UP;
+		if ( YM2149_CounterSkip ( &ToneC_count , ToneC_per , Nb ) & 1 )
+			ToneC_val ^= YM_SQUARE_UP;
+
+		wraps = YM2149_CounterSkip ( &Env_count , Env_per , Nb );
+		Env_pos += wraps;
+		if ( Env_pos >= 3*32 )			/* loop on blocks 1 and 2 (Env_pos 32 to 95) */
+			Env_pos = 32 + ( Env_pos - 32 ) % ( 2*32 );
+
+		YM_Buffer_250_pos_write = ( YM_Buffer_250_pos_write + Nb ) & YM_BUFFER_250_SIZE_MASK;
+	}
+
+	YM2149_DoSamples_250 ( 1 );
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /**
  * Downsample the YM2149 samples data from 250 KHz to YM_REPLAY_FREQ and
@@ -1552,6 +1688,7 @@ void Sound_Reset(void)
 	nGeneratedSamples = SoundBufferSize + SAMPLES_PER_FRAME;
 	AudioMixBuffer_pos_write = nGeneratedSamples & AUDIOMIXBUFFER_SIZE_MASK;
 	AudioMixBuffer_pos_write_avi = AudioMixBuffer_pos_write;
+	Audio_ResetSync();
 //fprintf ( stderr , "Sound_Reset SoundBufferSize %d SAMPLES_PER_FRAME %d nGeneratedSamples %d , AudioMixBuffer_pos_write %d\n" ,
 //	SoundBufferSize , SAMPLES_PER_FRAME, nGeneratedSamples , AudioMixBuffer_pos_write );
 
@@ -1573,6 +1710,7 @@ void Sound_ResetBufferIndex(void)
 	nGeneratedSamples = SoundBufferSize + SAMPLES_PER_FRAME;
 	AudioMixBuffer_pos_write =  (AudioMixBuffer_pos_read + nGeneratedSamples) & AUDIOMIXBUFFER_SIZE_MASK;
 	AudioMixBuffer_pos_write_avi = AudioMixBuffer_pos_write;
+	Audio_ResetSync();
 //fprintf ( stderr , "Sound_ResetBufferIndex SoundBufferSize %d SAMPLES_PER_FRAME %d nGeneratedSamples %d , AudioMixBuffer_pos_write %d\n" ,
 //	SoundBufferSize , SAMPLES_PER_FRAME, nGeneratedSamples , AudioMixBuffer_pos_write );
 	Audio_Unlock();
@@ -1686,6 +1824,22 @@ void Sound_Stats_Show ( void )
 
 
 
+/*-----------------------------------------------------------------------*/
+/**
+ * Return true if samples don't need to be synthesized because nobody will
+ * listen to them : fast forward or benchmark mode with --sound-ff-skip
+ * enabled and no sound/video recording.
+ */
+static bool	Sound_SkipSynthesis ( void )
+{
+	if ( !ConfigureParams.Sound.bSkipInFastForward )
+		return false;
+	if ( !ConfigureParams.System.bFastForward && !BenchmarkMode )
+		return false;
+	return !bRecordingWav && !bRecordingAvi;
+}
+
+
 /*-----------------------------------------------------------------------*/
 /**
  * Generate output samples for all channels (YM2149, DMA or crossbar) during this time-frame
@@ -1698,6 +1852,37 @@ static int Sound_GenerateSamples(Uint64 CPU_Clock)
 
 //fprintf ( stderr , "sound_gen in ym_pos_rd=%d ym_pos_wr=%d clock=%ld\n" , YM_Buffer_250_pos_read , YM_Buffer_250_pos_write , CPU_Clock );
 
+	Sample_Nbr = 0;
+	idx = AudioMixBuffer_pos_write & AUDIOMIXBUFFER_SIZE_MASK;
+
+	if ( Sound_SkipSynthesis() )
+	{
+		/* Only update the state of the YM2149 and of the DMA sound, */
+		/* output silence */
+		YM2149_Skip ( CPU_Clock );
+
+		ym_margin = ceil ( ((double)YM_ATARI_CLOCK_COUNTER) / nAudioFrequency ) + 2;
+		while ( ( ( YM_Buffer_250_pos_write - YM_Buffer_250_pos_read ) & YM_BUFFER_250_SIZE_MASK ) >= ym_margin )
+		{
+			YM2149_NextSample_250();		/* update resampling position */
+			AudioMixBuffer[idx][0] = AudioMixBuffer[idx][1] = 0;
+			idx = ( idx+1 ) & AUDIOMIXBUFFER_SIZE_MASK;
+			Sample_Nbr++;
+		}
+
+		if ( Sample_Nbr > 0 )
+		{
+			if (Config_IsMachineFalcon())
+				Crossbar_SkipSamples(Sample_Nbr);
+			else if (!Config_IsMachineST())
+				DmaSnd_SkipSamples(Sample_Nbr);
+		}
+
+		AudioMixBuffer_pos_write = (AudioMixBuffer_pos_write + Sample_Nbr) & AUDIOMIXBUFFER_SIZE_MASK;
+		nGeneratedSamples += Sample_Nbr;
+		return Sample_Nbr;
+	}
+
 	/* Run YM2149 emulation at 250 kHz to reach CPU_Clock counter value */
 	/* This fills YM_Buffer_250[] and update YM_Buffer_250_pos_write */
 	YM2149_Run ( CPU_Clock );
@@ -1705,9 +1890,6 @@ static int Sound_GenerateSamples(Uint64 CPU_Clock)
 	ym_margin = ceil ( ((double)YM_ATARI_CLOCK_COUNTER) / nAudioFrequency ) + 2;
 //fprintf ( stderr , "sound_gen margin=%d read_max=%d\n" , ym_margin , ( YM_Buffer_250_pos_write - ym_margin ) & YM_BUFFER_250_SIZE_MASK );
 
-	Sample_Nbr = 0;
-	idx = AudioMixBuffer_pos_write & AUDIOMIXBUFFER_SIZE_MASK;
-
 	if (Config_IsMachineFalcon())
 	{
 		while ( ( ( YM_Buffer_250_pos_write - YM_Buffer_250_pos_read ) & YM_BUFFER_250_SIZE_MASK ) >= ym_margin )
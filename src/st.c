@@ -26,6 +26,7 @@ const char ST_fileid[] = "Hatari st.c";
 #include "main.h"
 #include "file.h"
 #include "floppy.h"
+#include "log.h"
 #include "st.h"
 
 #define SAVE_TO_ST_IMAGES
@@ -92,3 +93,61 @@ bool ST_WriteDisk(int Drive, const char *pszFileName, Uint8 *pBuffer, int ImageS
 
 #endif  /*SAVE_TO_ST_IMAGES*/
 }
+
+
+/*-----------------------------------------------------------------------*/
+/**
+ * Write only the sectors marked in 'pDirtyMap' (one bit per sector)
+ * from the buffer back to the existing .ST image file.
+ * Return false if that's not possible, then the whole image needs
+ * to be saved instead.
+ */
+bool ST_WriteDirtySectors(int Drive, const char *pszFileName, Uint8 *pBuffer, int ImageSize,
+                          const Uint8 *pDirtyMap)
+{
+#ifdef SAVE_TO_ST_IMAGES
+
+	int nSectors = ImageSize / NUMBYTESPERSECTOR;
+	int nStart, nEnd, nRuns = 0;
+	bool bOk = true;
+	FILE *fp;
+
+	if (File_Length(pszFileName) != ImageSize)
+		return false;
+	fp = fopen(pszFileName, "rb+");
+	if (!fp)
+		return false;
+
+	for (nStart = 0; nStart < nSectors && bOk; nStart = nEnd)
+	{
+		/* Find next run of contiguous changed sectors */
+		if (!(pDirtyMap[nStart / 8] & (1 << (nStart & 7))))
+		{
+			nEnd = nStart + 1;
+			continue;
+		}
+		for (nEnd = nStart + 1; nEnd < nSectors; nEnd++)
+		{
+			if (!(pDirtyMap[nEnd / 8] & (1 << (nEnd & 7))))
+				break;
+		}
+		bOk = fseeko(fp, (off_t)nStart * NUMBYTESPERSECTOR, SEEK_SET) == 0
+		      && fwrite(pBuffer + nStart * NUMBYTESPERSECTOR,
+		                NUMBYTESPERSECTOR, nEnd - nStart, fp) == (size_t)(nEnd - nStart);
+		nRuns++;
+	}
+	if (fclose(fp) != 0)
+		bOk = false;
+
+	if (bOk)
+		LOG_TRACE(TRACE_FDC, "floppy %c: wrote %d runs of changed sectors to '%s'\n",
+		          'A'+Drive, nRuns, pszFileName);
+	return bOk;
+
+#else   /*SAVE_TO_ST_IMAGES*/
+
+	/* Oops, cannot save */
+	return false;
+
+#endif  /*SAVE_TO_ST_IMAGES*/
+}
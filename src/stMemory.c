@@ -16,6 +16,7 @@ const char STMemory_fileid[] = "Hatari stMemory.c";
 #include "log.h"
 #include "memory.h"
 #include "memorySnapShot.h"
+#include "memwatch.h"
 #include "tos.h"
 #include "vdi.h"
 #include "m68000.h"
@@ -122,6 +123,7 @@ bool STMemory_SafeClear(Uint32 addr, unsigned int len)
 
 	if (STMemory_CheckAreaType(addr, len, ABFLAG_RAM))
 	{
+		MemWatch_AccessRange(addr, len, true);
 		if (addr + len < 0x1000000)
 		{
 			memset(&STRam[addr], 0, len);
@@ -155,12 +157,13 @@ bool STMemory_SafeClear(Uint32 addr, unsigned int len)
  * 
  * Return true if whole copy was safe / valid.
  */
-bool STMemory_SafeCopy(Uint32 addr, Uint8 *src, unsigned int len, const char *name)
+bool STMemory_SafeCopy(Uint32 addr, const Uint8 *src, unsigned int len, const char *name)
 {
 	Uint32 end;
 
 	if ( STMemory_CheckAreaType ( addr, len, ABFLAG_RAM ) )
 	{
+		MemWatch_AccessRange(addr, len, true);
 		if (addr + len < 0x1000000)
 		{
 			memcpy(&STRam[addr], src, len);
@@ -688,6 +691,44 @@ Uint8	STMemory_ReadByte ( Uint32 addr )
 	return (Uint8)STMemory_Read ( addr , 1 );
 }
 
+/**
+ * Copy <len> bytes of memory starting at <addr> to the host buffer <dst>,
+ * with the same semantics as STMemory_ReadByte() for each byte: memory
+ * is accessed directly through its bank, and areas without real memory
+ * read as 0. Contiguous parts of each bank are copied with memcpy().
+ */
+void	STMemory_ReadBlock ( Uint32 addr , Uint8 *dst , Uint32 len )
+{
+	addrbank	*pBank;
+	Uint32		offset, chunk;
+
+	while ( len > 0 )
+	{
+		pBank = &get_mem_bank ( addr );
+
+		/* Never cross a bank boundary */
+		chunk = 0x10000 - ( addr & 0xffff );
+		if ( chunk > len )
+			chunk = len;
+
+		if ( pBank->baseaddr == NULL )
+		{
+			memset ( dst , 0 , chunk );	/* No real memory, read 0 */
+		}
+		else
+		{
+			offset = ( addr - ( pBank->start & pBank->mask ) ) & pBank->mask;
+			/* Nor the point where the bank offset wraps around */
+			if ( pBank->mask - offset < chunk - 1 )
+				chunk = pBank->mask - offset + 1;
+			memcpy ( dst , pBank->baseaddr + offset , chunk );
+		}
+		addr += chunk;
+		dst += chunk;
+		len -= chunk;
+	}
+}
+
 
 
 /**
@@ -458,6 +458,7 @@ const char Video_fileid[] = "Hatari video.c";
 #include "statusbar.h"
 #include "clocks_timings.h"
 #include "remotedebug.h"
+#include "reverse.h"
 
 /* The border's mask allows to keep track of all the border tricks		*/
 /* applied to one video line. The masks for all lines are stored in the array	*/
@@ -4574,6 +4575,13 @@ void Video_InterruptHandler_VBL ( void )
 	/* Clear any key presses which are due to be de-bounced (held for one ST frame) */
 	Keymap_DebounceAllKeys();
 
+	/* Replay recorded keys / request checkpoint for reverse debugging */
+	if (ReverseTracking)
+	{
+		IKBD_ReplayKeys();
+		Reverse_Vbl();
+	}
+
 	Video_DrawScreen();
 
 	/* Check printer status */
@@ -4596,6 +4604,9 @@ void Video_InterruptHandler_VBL ( void )
 	/* Process shortcut keys */
 	ShortCut_ActKey();
 
+	/* Send subscribed notifications to remote debug clients */
+	RemoteDebug_Vbl();
+
 	/* Check if remote debug requested a break.
 	 * Ideally it would be good to move this check somewhere else. Living here means
 	 * that single-stepping after break immediately jumps into the VBL routine
@@ -11,6 +11,8 @@
   We simply save out the WAVE format headers and then write the sample data
   (at the current rate of playback) as we build it up each frame. When we stop
   recording we complete the size information in the headers and close up.
+  All file output goes through the asynchronous writer (asyncWriter.c), so
+  a slow disk doesn't stall the emulation.
 
 
   RIFF Chunk (12 bytes in length total) Byte Number
@@ -38,6 +40,7 @@ const char WAVFormat_fileid[] = "Hatari wavFormat.c";
 #include <SDL_endian.h>
 
 #include "main.h"
+#include "asyncWriter.h"
 #include "audio.h"
 #include "configuration.h"
 #include "file.h"
@@ -46,7 +49,7 @@ const char WAVFormat_fileid[] = "Hatari wavFormat.c";
 #include "wavFormat.h"
 
 
-static FILE *WavFileHndl;
+static ASYNC_FILE *WavFileHndl;
 static int nWavOutputBytes;             /* Number of samples bytes saved */
 bool bRecordingWav = false;             /* Is a WAV file open and recording? */
 
@@ -89,7 +92,7 @@ bool WAVFormat_OpenFile(char *pszWavFileName)
 	nBytesPerSec = nSampleFreq * 4;
 
 	/* Create our file */
-	WavFileHndl = fopen(pszWavFileName, "wb");
+	WavFileHndl = AsyncWriter_Open(pszWavFileName);
 	if (!WavFileHndl)
 	{
 		perror("WAVFormat_OpenFile");
@@ -110,14 +113,15 @@ bool WAVFormat_OpenFile(char *pszWavFileName)
 	WavHeader[31] = (Uint8)(nBytesPerSec >> 24);
 
 	/* Write header to file */
-	if (fwrite(&WavHeader, sizeof(WavHeader), 1, WavFileHndl) == 1)
+	if (AsyncWriter_Write(WavFileHndl, WavHeader, sizeof(WavHeader)))
 	{
 		bRecordingWav = true;
 		Log_AlertDlg(LOG_INFO, "WAV sound data recording has been started.");
 	}
 	else
 	{
-		perror("WAVFormat_OpenFile");
+		AsyncWriter_Close(WavFileHndl);
+		WavFileHndl = NULL;
 		Log_AlertDlg(LOG_ERROR, "WAV recording: Failed to write header!");
 	}
 
@@ -140,27 +144,15 @@ void WAVFormat_CloseFile(void)
 
 		/* Update headers with sizes */
 		nWavFileBytes = SDL_SwapLE32((12+24+8+nWavOutputBytes)-8);  /* File length, less 8 bytes for 'RIFF' and length */
-		/* Seek to 'Total Length Of Package' element and
-		 * write total length of package in 'RIFF' chunk */
-		if (fseek(WavFileHndl, 4, SEEK_SET) != 0 ||
-		    fwrite(&nWavFileBytes, sizeof(Uint32), 1, WavFileHndl) != 1)
-		{
-			perror("WAVFormat_CloseFile");
-			fclose(WavFileHndl);
-			WavFileHndl = NULL;
-			return;
-		}
-
 		nWavLEOutBytes = SDL_SwapLE32(nWavOutputBytes);
-		/* Seek to 'Length' element and write length of data in 'DATA' chunk */
-		if (fseek(WavFileHndl, 12+24+4, SEEK_SET) != 0
-		    || fwrite(&nWavLEOutBytes, sizeof(Uint32), 1, WavFileHndl) != 1)
+		/* Write total length of package in 'RIFF' chunk and
+		 * length of data in 'DATA' chunk, then close file */
+		AsyncWriter_WriteAt(WavFileHndl, 4, &nWavFileBytes, sizeof(Uint32));
+		AsyncWriter_WriteAt(WavFileHndl, 12+24+4, &nWavLEOutBytes, sizeof(Uint32));
+		if (!AsyncWriter_Close(WavFileHndl))
 		{
-			perror("WAVFormat_CloseFile");
+			Log_Printf(LOG_ERROR, "WAVFormat_CloseFile: failed to write WAV file!\n");
 		}
-
-		/* Close file */
-		fclose(WavFileHndl);
 		WavFileHndl = NULL;
 
 		/* And inform user */
@@ -174,24 +166,26 @@ void WAVFormat_CloseFile(void)
  */
 void WAVFormat_Update(Sint16 pSamples[][2], int Index, int Length)
 {
-	Sint16 sample[2];
-	int i;
+	Sint16 samples[256][2];
+	int i, n;
 	int idx;
 
 	if (bRecordingWav)
 	{
-		/* Output, better if did in two section if wrap */
+		/* Output, converted to little endian in blocks of 'samples' size */
 		idx = Index & AUDIOMIXBUFFER_SIZE_MASK;
-		for(i = 0; i < Length; i++)
+		for (i = 0; i < Length; i += n)
 		{
-			/* Convert sample to little endian */
-			sample[0] = SDL_SwapLE16(pSamples[idx][0]);
-			sample[1] = SDL_SwapLE16(pSamples[idx][1]);
-			idx = ( idx+1 ) & AUDIOMIXBUFFER_SIZE_MASK;
+			for (n = 0; n < ARRAY_SIZE(samples) && i + n < Length; n++)
+			{
+				samples[n][0] = SDL_SwapLE16(pSamples[idx][0]);
+				samples[n][1] = SDL_SwapLE16(pSamples[idx][1]);
+				idx = ( idx+1 ) & AUDIOMIXBUFFER_SIZE_MASK;
+			}
 			/* And store */
-			if (fwrite(&sample, sizeof(sample), 1, WavFileHndl) != 1)
+			if (!AsyncWriter_Write(WavFileHndl, samples, n * sizeof(samples[0])))
 			{
-				perror("WAVFormat_Update");
+				Log_Printf(LOG_ERROR, "WAVFormat_Update: failed to write samples!\n");
 				WAVFormat_CloseFile();
 				return;
 			}
@@ -9,6 +9,7 @@
 const char YMFormat_fileid[] = "Hatari ymFormat.c";
 
 #include "main.h"
+#include "asyncWriter.h"
 #include "configuration.h"
 #include "file.h"
 #include "log.h"
@@ -142,8 +143,9 @@ void YMFormat_EndRecording(void)
 		/* Convert YM to correct format(list of register 1, then register 2...) */
 		if (YMFormat_ConvertToStreams())
 		{
-			/* Save YM File */
-			File_Save(pszYMFileName, pYMWorkspace,(size_t)(nYMVBLS*NUM_PSG_SOUND_REGISTERS)+4, false);
+			/* Save YM File in the writer thread, which also frees the workspace */
+			AsyncWriter_SaveFile(pszYMFileName, pYMWorkspace, (size_t)(nYMVBLS*NUM_PSG_SOUND_REGISTERS)+4);
+			pYMWorkspace = NULL;
 			/* And inform user */
 			Log_AlertDlg(LOG_INFO, "YM sound data recording has been stopped.");
 		}
@@ -117,6 +117,10 @@ int main(int argc, const char *argv[])
 		"pc < $50000 && pc > $60000",
 		"pc > $50000 && pc < $54000",
 		"d0 = a0",
+		"$58000 ! pc",     /* constant on left side */
+		"pc = $58002",     /* address breakpoints */
+		"d0 = 4 && pc = $50000",
+		"(d0).l & $ff = 1",
 		"a0 = pc :trace",  /* matches, but :trace should hide that */
 		"a0 = pc :3",      /* matches, but not yet */
 		NULL
@@ -127,6 +131,10 @@ int main(int argc, const char *argv[])
 		"pc > $50000 && pc < $60000",
 		"d0 = d1 :once :quiet",
 		"a0 = pc",	   /* tested alone */
+		"$50000 < pc && (d0).b = 0",
+		"(a0).w = (d1).w && d0 & 6 = 4",
+		"pc = $58000",
+		"d0 = 4 && $58000 = pc",
 		NULL
 	};
 	const char *test;
@@ -149,6 +149,25 @@ Uint32 DSP_ReadMemory(Uint16 addr, char space, const char **mem_str)
 	return 0;
 }
 
+/* fake memwatch.c */
+#include "memwatch.h"
+const char MemWatch_Description[] = "";
+int MemWatch_Command(int nArgc, char *psArgs[]) { return DEBUGGER_CMDDONE; }
+bool MemWatch_CheckHit(void) { return false; }
+bool MemWatch_TrackWrites(bool bEnable) { return true; }
+
+/* fake reverse.c */
+#include "reverse.h"
+bool ReverseTracking;
+bool Reverse_Check(void) { return false; }
+const char Reverse_Description[] = "";
+const char Reverse_StepDescription[] = "";
+const char Reverse_ContinueDescription[] = "";
+char *Reverse_Match(const char *text, int state) { return NULL; }
+int Reverse_Command(int nArgc, char *psArgs[]) { return DEBUGGER_CMDDONE; }
+int Reverse_Step(int nArgc, char *psArgs[]) { return DEBUGGER_CMDDONE; }
+int Reverse_Continue(int nArgc, char *psArgs[]) { return DEBUGGER_CMDDONE; }
+
 /* fake console redirection */
 #include "console.h"
 int ConOutDevices;
@@ -0,0 +1,279 @@
+/*
+ * Code to test the block based Falcon crossbar CODEC mixing in
+ * src/includes/crossbarMix.h against the original per sample
+ * implementation of Crossbar_GenerateSamples() in src/falcon/crossbar.c,
+ * and to benchmark both of them with typical Falcon audio configurations.
+ */
+#include <time.h>
+#include "main.h"
+#include "crossbarMix.h"
+
+#define RING_SIZE	2048		/* same as DACBUFFER_SIZE */
+#define MIX_SIZE	16384		/* same as AUDIOMIXBUFFER_SIZE */
+#define MIX_BLOCK	256		/* same as CROSSBAR_MIX_BLOCK */
+#define CALLS		64		/* calls to generate samples per test */
+#define BENCH_LOOPS	200
+
+struct codec_state_s {
+	Uint32 dacPos, adcPos;
+	Sint64 dacPosFloat, adcPosFloat;
+};
+
+struct config_s {
+	const char *name;
+	int inputSource;		/* $ff8937 */
+	int adcInput;			/* $ff8938 */
+	int dacWords;			/* DAC received data ? */
+	int dacFreq, hostFreq;
+};
+
+static const struct config_s configs[] = {
+	{ "DMA play -> DAC, 49170 Hz",		2, 3, 1, 49170, 44100 },
+	{ "DMA play -> DAC + PSG (TOS default)",3, 3, 1, 49170, 48000 },
+	{ "DSP xmit -> DAC + PSG, 32780 Hz",	3, 3, 1, 32780, 44100 },
+	{ "DAC + microphone, 24585 Hz",		3, 0, 1, 24585, 44100 },
+	{ "PSG L + microphone R only",		1, 2, 0, 49170, 44100 },
+	{ "microphone L + PSG R + DAC",		3, 1, 1, 12292, 22050 },
+	{ "PSG only, no DAC data",		3, 3, 0, 50066, 44100 },
+	{ "CODEC input off",			0, 3, 1, 49170, 44100 },
+};
+
+static Sint16 dacLeft[RING_SIZE], dacRight[RING_SIZE];
+static Sint16 adcLeft[RING_SIZE], adcRight[RING_SIZE];
+static Sint16 psg[MIX_SIZE][2];
+static Sint16 mixRef[MIX_SIZE][2], mixBlock[MIX_SIZE][2];
+static const Uint16 gain[2] = { 3276, 11363 };
+static const Uint16 attenuation[2] = { 65535, 41285 };
+
+
+/* per sample mixing, as done originally by Crossbar_GenerateSamples() */
+static void ref_Generate(const struct config_s *cfg, struct codec_state_s *st,
+                         Sint16 (*mix)[2], int idx, int len, Sint64 ratio)
+{
+	Sint16 adc_leftData, adc_rightData, dac_LeftData, dac_RightData;
+	Sint16 dac_read_left, dac_read_right;
+	int i, n, nBufIdx;
+
+	for (i = 0; i < len; i++)
+	{
+		nBufIdx = (idx + i) & (MIX_SIZE - 1);
+
+		switch (cfg->adcInput) {
+		 case 0:
+		 default:
+			adc_leftData = adcLeft[st->adcPos];
+			adc_rightData = adcRight[st->adcPos];
+			break;
+		 case 1:
+			adc_leftData = adcLeft[st->adcPos];
+			adc_rightData = mix[nBufIdx][1];
+			break;
+		 case 2:
+			adc_leftData = mix[nBufIdx][0];
+			adc_rightData = adcRight[st->adcPos];
+			break;
+		 case 3:
+			adc_leftData = mix[nBufIdx][0];
+			adc_rightData = mix[nBufIdx][1];
+			break;
+		}
+
+		if (cfg->dacWords == 0) {
+			dac_read_left = 0;
+			dac_read_right = 0;
+		} else {
+			dac_read_left = dacLeft[st->dacPos];
+			dac_read_right = dacRight[st->dacPos];
+		}
+		switch (cfg->inputSource) {
+		 case 0:
+		 default:
+			dac_LeftData = 0;
+			dac_RightData = 0;
+			break;
+		 case 1:
+			dac_LeftData = (adc_leftData * gain[0]) >> 14;
+			dac_RightData = (adc_rightData * gain[1]) >> 14;
+			break;
+		 case 2:
+			dac_LeftData = dac_read_left;
+			dac_RightData = dac_read_right;
+			break;
+		 case 3:
+			dac_LeftData = ((adc_leftData * gain[0]) >> 14) + dac_read_left;
+			dac_RightData = ((adc_rightData * gain[1]) >> 14) + dac_read_right;
+			break;
+		}
+
+		mix[nBufIdx][0] = (dac_LeftData * attenuation[0]) >> 16;
+		mix[nBufIdx][1] = (dac_RightData * attenuation[1]) >> 16;
+
+		st->dacPosFloat += ratio;
+		n = st->dacPosFloat >> 32;
+		st->dacPos = (st->dacPos + n) % RING_SIZE;
+		st->dacPosFloat &= 0xffffffff;
+
+		st->adcPosFloat += ratio;
+		n = st->adcPosFloat >> 32;
+		st->adcPos = (st->adcPos + n) % RING_SIZE;
+		st->adcPosFloat &= 0xffffffff;
+	}
+}
+
+/* block mixing, same as the new Crossbar_GenerateSamples() */
+static void block_Generate(const struct config_s *cfg, struct codec_state_s *st,
+                           Sint16 (*mix)[2], int idx, int len, Sint64 ratio)
+{
+	Sint16 adcBuf[MIX_BLOCK][2], dacBuf[MIX_BLOCK][2];
+	Sint16 (*pAdc)[2], (*pMix)[2];
+	bool bNeedAdc, bNeedMic, bNeedDac;
+	int i, nBufIdx, nLen;
+
+	bNeedAdc = cfg->inputSource == CROSSBAR_CODEC_INPUT_ADC
+	        || cfg->inputSource == CROSSBAR_CODEC_INPUT_BOTH;
+	bNeedMic = bNeedAdc && cfg->adcInput != 3;
+	bNeedDac = cfg->dacWords != 0;
+	if (!bNeedDac)
+		memset(dacBuf, 0, sizeof(dacBuf));
+
+	while (len > 0)
+	{
+		nBufIdx = idx & (MIX_SIZE - 1);
+		nLen = len;
+		if (nLen > MIX_BLOCK)
+			nLen = MIX_BLOCK;
+		if (nLen > MIX_SIZE - nBufIdx)
+			nLen = MIX_SIZE - nBufIdx;
+		pMix = &mix[nBufIdx];
+
+		Crossbar_ReadRingBlock(bNeedDac ? dacBuf : NULL, dacLeft, dacRight,
+				       RING_SIZE - 1, &st->dacPos, &st->dacPosFloat,
+				       ratio, nLen);
+		Crossbar_ReadRingBlock(bNeedMic ? adcBuf : NULL, adcLeft, adcRight,
+				       RING_SIZE - 1, &st->adcPos, &st->adcPosFloat,
+				       ratio, nLen);
+
+		pAdc = adcBuf;
+		if (bNeedAdc) {
+			switch (cfg->adcInput) {
+			 case 1:
+				for (i = 0; i < nLen; i++)
+					adcBuf[i][1] = pMix[i][1];
+				break;
+			 case 2:
+				for (i = 0; i < nLen; i++)
+					adcBuf[i][0] = pMix[i][0];
+				break;
+			 case 3:
+				pAdc = pMix;
+				break;
+			}
+		}
+
+		Crossbar_MixBlock(pMix, (const Sint16 (*)[2])pAdc, (const Sint16 (*)[2])dacBuf,
+				  nLen, cfg->inputSource, gain, attenuation);
+
+		idx += nLen;
+		len -= nLen;
+	}
+}
+
+/* generate CALLS buffers of various sizes, wrapping around the mix buffer,
+ * return the number of generated samples */
+static int run(const struct config_s *cfg, struct codec_state_s *st, Sint16 (*mix)[2],
+	       void (*generate)(const struct config_s *, struct codec_state_s *,
+				Sint16 (*)[2], int, int, Sint64))
+{
+	Sint64 ratio = (((Sint64)cfg->dacFreq) << 32) / cfg->hostFreq;
+	int call, idx = MIX_SIZE - 1000, len, total = 0;
+
+	memset(st, 0, sizeof(*st));
+	st->dacPos = 5;
+	st->adcPos = RING_SIZE - 7;
+	memcpy(mix, psg, sizeof(psg));
+
+	for (call = 0; call < CALLS; call++)
+	{
+		len = 1 + (call * 337) % 1200;	/* 882 = 1 VBL at 44.1 kHz */
+		generate(cfg, st, mix, idx, len, ratio);
+		idx = (idx + len) & (MIX_SIZE - 1);
+		total += len;
+	}
+	return total;
+}
+
+static double bench(const struct config_s *cfg, Sint16 (*mix)[2],
+		    void (*generate)(const struct config_s *, struct codec_state_s *,
+				     Sint16 (*)[2], int, int, Sint64))
+{
+	struct codec_state_s st;
+	clock_t start;
+	double secs, samples = 0;
+	int loop;
+
+	start = clock();
+	for (loop = 0; loop < BENCH_LOOPS; loop++)
+		samples += run(cfg, &st, mix, generate);
+	secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+	return secs > 0 ? samples / secs / 1e6 : 0;
+}
+
+int main(int argc, const char *argv[])
+{
+	struct codec_state_s stRef, stBlock;
+	bool benchmark = (argc > 1 && strcmp(argv[1], "--bench") == 0);
+	unsigned int seed = 1;
+	int c, i, tests = 0, errors = 0;
+
+	/* DAC : full scale square + sine, microphone : noise, PSG : positive square */
+	for (i = 0; i < RING_SIZE; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		dacLeft[i] = (i / 20) & 1 ? 32767 : -32768;
+		dacRight[i] = 32767 * sinf(i * 0.03);
+		adcLeft[i] = (Sint16)(seed >> 16);
+		adcRight[i] = (Sint16)(seed >> 8);
+	}
+	for (i = 0; i < MIX_SIZE; i++)
+	{
+		psg[i][0] = (i / 30) & 1 ? 32767 : 0;
+		psg[i][1] = ((i * 97) & 0x7fff);
+	}
+
+	for (c = 0; c < ARRAY_SIZE(configs); c++)
+	{
+		run(&configs[c], &stRef, mixRef, ref_Generate);
+		run(&configs[c], &stBlock, mixBlock, block_Generate);
+		tests++;
+
+		if (memcmp(mixRef, mixBlock, sizeof(mixRef)) != 0
+		    || stRef.dacPos != stBlock.dacPos || stRef.dacPosFloat != stBlock.dacPosFloat
+		    || stRef.adcPos != stBlock.adcPos || stRef.adcPosFloat != stBlock.adcPosFloat)
+		{
+			fprintf(stderr, "ERROR: '%s': block mixing differs from per sample mixing\n",
+				configs[c].name);
+			errors++;
+		}
+	}
+
+	if (errors)
+	{
+		fprintf(stderr, "\n***Detected %d ERRORs in %d automated crossbar mixing tests!***\n\n",
+			errors, tests);
+		return 1;
+	}
+
+	if (benchmark)
+	{
+		fprintf(stderr, "%-40s %12s %12s\n", "Configuration (Msamples/s)", "per sample", "block");
+		for (c = 0; c < ARRAY_SIZE(configs); c++)
+		{
+			fprintf(stderr, "%-40s %12.1f %12.1f\n", configs[c].name,
+				bench(&configs[c], mixRef, ref_Generate),
+				bench(&configs[c], mixBlock, block_Generate));
+		}
+	}
+
+	fprintf(stderr, "\nFinished without any errors!\n\n");
+	return 0;
+}
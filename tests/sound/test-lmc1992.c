@@ -0,0 +1,162 @@
+/*
+ * Code to test the block based LMC1992 tone/volume filter in
+ * src/includes/lmc1992.h against the original per sample
+ * implementation of src/dmaSnd.c
+ */
+#include "main.h"
+#include "lmc1992.h"
+
+#define TONE_STEPS 13
+#define NUM_SAMPLES 4096
+#define MAX_DIFF 1		/* allowed difference due to float rounding */
+
+struct first_order_s  { float a1, b0, b1; };
+
+/* reference filter state and coefficients */
+static float ref_coef[5];
+static float ref_gain[2];
+static float ref_data[2][2];
+
+/* per sample filter, as done originally by DmaSnd_IIRfilterL/R() */
+static float ref_IIRfilter(int chan, float xn)
+{
+	float *data = ref_data[chan];
+	float a, yn;
+
+	a  = ref_gain[chan] * xn;
+	a -= ref_coef[0] * data[0];
+	a -= ref_coef[1] * data[1];
+
+	yn  = ref_coef[2] * a;
+	yn += ref_coef[3] * data[0];
+	yn += ref_coef[4] * data[1];
+
+	data[1] = data[0];
+	data[0] = a;
+	return yn;
+}
+
+static void ref_Apply_LMC(Sint16 (*buf)[2], int len)
+{
+	Sint32 sample;
+	int i, c;
+
+	for (i = 0; i < len; i++)
+	{
+		for (c = 0; c < 2; c++)
+		{
+			sample = ref_IIRfilter(c, buf[i][c]);
+			if (sample < -32767)
+				sample = -32767;
+			else if (sample > 32767)
+				sample = 32767;
+			buf[i][c] = sample;
+		}
+	}
+}
+
+/* shelf filters, same as in dmaSnd.c */
+static struct first_order_s bass_shelf(float g, float fc, float Fs)
+{
+	struct first_order_s bass;
+	float t = tanf(M_PI*fc/Fs);
+
+	bass.a1 = g < 1.0 ? (t - g) / (t + g) : (t - 1.0) / (t + 1.0);
+	bass.b0 = (1.0 + bass.a1) * (g - 1.0) / 2.0 + 1.0;
+	bass.b1 = (1.0 + bass.a1) * (g - 1.0) / 2.0 + bass.a1;
+	return bass;
+}
+
+static struct first_order_s treble_shelf(float g, float fc, float Fs)
+{
+	struct first_order_s treb;
+	float t = tanf(M_PI*fc/Fs);
+
+	treb.a1 = g < 1.0 ? (g*t - 1.0) / (g*t + 1.0) : (t - 1.0) / (t + 1.0);
+	treb.b0 = 1.0 + (1.0 - treb.a1) * (g - 1.0) / 2.0;
+	treb.b1 = treb.a1 + (treb.a1 - 1.0) * (g - 1.0) / 2.0;
+	return treb;
+}
+
+static void set_coefs(struct lmc1992_biquad_s *bq, int bass_lvl, int treb_lvl, float Fs)
+{
+	struct first_order_s bass, treb;
+
+	bass = bass_shelf(powf(10.0, (2*bass_lvl - 12)/20.0), 118.2763, Fs);
+	treb = treble_shelf(powf(10.0, (2*treb_lvl - 12)/20.0), 8438.756, Fs);
+
+	bq->coef[0] = treb.a1 + bass.a1;
+	bq->coef[1] = treb.a1 * bass.a1;
+	bq->coef[2] = treb.b0 * bass.b0;
+	bq->coef[3] = treb.b0 * bass.b1 + treb.b1 * bass.b0;
+	bq->coef[4] = treb.b1 * bass.b1;
+	memcpy(ref_coef, bq->coef, sizeof(ref_coef));
+}
+
+int main(int argc, const char *argv[])
+{
+	static Sint16 input[NUM_SAMPLES][2], ref[NUM_SAMPLES][2], out[NUM_SAMPLES][2];
+	const float rates[] = { 22050.0, 44100.0, 50066.0 };
+	const float gains[] = { 2.0, 0.5, 0.03 };
+	struct lmc1992_biquad_s bq;
+	int r, g, bass, treb, i, c, pos, len, diff, maxdiff = 0, tests = 0, errors = 0;
+	unsigned int seed = 1;
+
+	/* mix of square wave, noise and sine, with some clipping */
+	for (i = 0; i < NUM_SAMPLES; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		input[i][0] = ((i / 50) & 1 ? 20000 : -20000) + (Sint16)(seed >> 16) / 4;
+		input[i][1] = 32767 * sinf(i * 0.05);
+	}
+
+	for (r = 0; r < ARRAY_SIZE(rates); r++)
+	for (g = 0; g < ARRAY_SIZE(gains); g++)
+	for (bass = 0; bass < TONE_STEPS; bass++)
+	for (treb = 0; treb < TONE_STEPS; treb++)
+	{
+		memset(&bq, 0, sizeof(bq));
+		memset(ref_data, 0, sizeof(ref_data));
+		set_coefs(&bq, bass, treb, rates[r]);
+		bq.gain[0] = ref_gain[0] = gains[g];
+		bq.gain[1] = ref_gain[1] = gains[g] * 0.75;
+
+		memcpy(ref, input, sizeof(ref));
+		memcpy(out, input, sizeof(out));
+		ref_Apply_LMC(ref, NUM_SAMPLES);
+
+		/* process in blocks of varying size, state must carry over */
+		for (pos = 0, len = 1; pos < NUM_SAMPLES; pos += len, len = len * 3 + 1)
+		{
+			if (pos + len > NUM_SAMPLES)
+				len = NUM_SAMPLES - pos;
+			LMC1992_FilterBlock(&bq, &out[pos], len);
+		}
+
+		tests++;
+		for (i = 0; i < NUM_SAMPLES; i++)
+		{
+			for (c = 0; c < 2; c++)
+			{
+				diff = abs(out[i][c] - ref[i][c]);
+				if (diff > maxdiff)
+					maxdiff = diff;
+			}
+		}
+		if (maxdiff > MAX_DIFF)
+		{
+			fprintf(stderr, "ERROR: rate %g, gain %g, bass %d, treble %d: difference %d\n",
+				rates[r], gains[g], bass, treb, maxdiff);
+			errors++;
+		}
+	}
+
+	if (errors)
+	{
+		fprintf(stderr, "\n***Detected %d ERRORs in %d automated LMC1992 filter tests!***\n\n",
+			errors, tests);
+		return 1;
+	}
+	fprintf(stderr, "\nFinished without any errors (max difference %d)!\n\n", maxdiff);
+	return 0;
+}
@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+#
+# Hatari detailed CPU history dumper
+#
+# Licensed under GPL v2+
+#
+"""
+A tool for outputting Hatari detailed CPU history in text form.
+
+In Hatari debugger you get detailed CPU history with:
+	history detail [<MB>]
+	continue
+	...
+	history export <file name>
+
+For each executed instruction, the output lists its address and
+opcode, the registers and SR it changed, and the memory writes
+it (or DMA at the same time) did.
+
+Usage: hatari_history [options] <history file>
+
+Options:
+	-r		show all registers for every instruction
+	-l <count>	show only last <count> instructions
+	-s		show only statistics
+"""
+
+import getopt
+import os
+import struct
+import sys
+
+MAGIC = b"HHIS"
+VERSION = 1
+
+TAG_KEYFRAME = 0x80
+TAG_SR = 0x40
+TAG_LOST = 0x20
+TAG_WRITES = 0x1f
+
+REGNAMES = ["D%d" % i for i in range(8)] + ["A%d" % i for i in range(8)]
+SIZES = {1: "b", 2: "w", 4: "l"}
+
+
+class HistoryItem:
+    "decoded history item, contains full state after the instruction"
+    def __init__(self):
+        self.pc = 0
+        self.opcode = 0
+        self.sr = 0
+        self.regs = [0] * 16
+        self.changed = 0
+        self.tag = 0
+        self.writes = []
+
+
+def getvar(data, pos):
+    "return variable length value & new position"
+    value = shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7f) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def unzigzag(value):
+    "return 32-bit unsigned delta for zigzag encoded value"
+    return ((value >> 1) ^ -(value & 1)) & 0xffffffff
+
+
+def decode_item(data, pos, item):
+    "decode item at given position to 'item', return new position"
+    item.tag = tag = data[pos]
+    pos += 1
+    if tag & TAG_KEYFRAME:
+        oldregs, oldsr = item.regs, item.sr
+        item.pc, item.opcode, item.sr = struct.unpack_from(">IHH", data, pos)
+        pos += 8
+        item.regs = list(struct.unpack_from(">16I", data, pos))
+        pos += 64
+        item.changed = 0
+        for i in range(16):
+            if item.regs[i] != oldregs[i]:
+                item.changed |= 1 << i
+        if item.sr != oldsr:
+            item.tag |= TAG_SR
+    else:
+        delta, pos = getvar(data, pos)
+        item.pc = (item.pc + unzigzag(delta)) & 0xffffffff
+        item.opcode = struct.unpack_from(">H", data, pos)[0]
+        pos += 2
+        if tag & TAG_SR:
+            item.sr = struct.unpack_from(">H", data, pos)[0]
+            pos += 2
+        item.changed = mask = struct.unpack_from(">H", data, pos)[0]
+        pos += 2
+        for i in range(16):
+            if mask & (1 << i):
+                delta, pos = getvar(data, pos)
+                item.regs[i] = (item.regs[i] + unzigzag(delta)) & 0xffffffff
+    item.writes = []
+    waddr = item.pc
+    for _ in range(tag & TAG_WRITES):
+        code, pos = getvar(data, pos)
+        waddr = (waddr + unzigzag(code >> 2)) & 0xffffffff
+        size = 1 << (code & 3)
+        value = int.from_bytes(data[pos:pos+size], "big")
+        pos += size
+        item.writes.append((waddr, size, value))
+    return pos
+
+
+def read_history(fobj):
+    "generator for history items in given file"
+    header = fobj.read(16)
+    if len(header) != 16 or header[:4] != MAGIC:
+        raise ValueError("not a Hatari history file")
+    version, chunks, _ = struct.unpack(">III", header[4:])
+    if version != VERSION:
+        raise ValueError("unsupported history file version %d" % version)
+    item = HistoryItem()
+    for _ in range(chunks):
+        _, used, _ = struct.unpack(">III", fobj.read(12))
+        data = fobj.read(used - 12)
+        pos = 0
+        while pos < len(data):
+            pos = decode_item(data, pos, item)
+            yield item
+
+
+def item_str(item, allregs):
+    "return text output for given history item"
+    out = ["$%08x  %04x  " % (item.pc, item.opcode)]
+    for i in range(16):
+        if allregs or item.changed & (1 << i):
+            out.append(" %s=$%08x" % (REGNAMES[i], item.regs[i]))
+    if allregs or item.tag & TAG_SR:
+        out.append(" SR=$%04x" % item.sr)
+    for addr, size, value in item.writes:
+        out.append(" ($%x).%s=$%x" % (addr, SIZES[size], value))
+    if item.tag & TAG_LOST:
+        out.append(" (more writes)")
+    return "".join(out).rstrip()
+
+
+def dump(fname, allregs, last, statsonly):
+    "output given history file"
+    items = writes = keyframes = 0
+    size = os.path.getsize(fname)
+    with open(fname, "rb") as fobj:
+        if last:
+            total = sum(1 for _ in read_history(fobj))
+            fobj.seek(0)
+        for item in read_history(fobj):
+            items += 1
+            writes += len(item.writes)
+            if item.tag & TAG_KEYFRAME:
+                keyframes += 1
+            if statsonly or (last and items <= total - last):
+                continue
+            print(item_str(item, allregs))
+    if statsonly:
+        print("%s: %d instructions, %d memory writes, %d keyframes, %.1f bytes / instruction" %
+              (fname, items, writes, keyframes, float(size) / max(items, 1)))
+
+
+def usage(msg):
+    "show usage and given error message, then exit"
+    name = os.path.basename(sys.argv[0])
+    print(__doc__.replace("hatari_history", name))
+    if msg:
+        print("ERROR: %s!\n" % msg)
+    sys.exit(1)
+
+
+def main():
+    "parse arguments & dump given history file"
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "rl:sh", ["regs", "last=", "stats", "help"])
+    except getopt.GetoptError as err:
+        usage(err)
+    allregs = statsonly = False
+    last = 0
+    for opt, arg in opts:
+        if opt in ("-r", "--regs"):
+            allregs = True
+        elif opt in ("-l", "--last"):
+            try:
+                last = int(arg)
+            except ValueError:
+                usage("invalid count '%s'" % arg)
+        elif opt in ("-s", "--stats"):
+            statsonly = True
+        else:
+            usage(None)
+    if len(args) != 1:
+        usage("history file name missing")
+    try:
+        dump(args[0], allregs, last, statsonly)
+    except (IOError, ValueError, struct.error) as err:
+        usage(err)
+
+
+if __name__ == "__main__":
+    main()
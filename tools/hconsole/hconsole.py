@@ -351,7 +351,9 @@ class Tokens:
     "--disk-a",
     "--disk-b",
     "--fastfdc",
+    "--turbofdc",
     "--protect-floppy",
+    "--disk-cache",
     "--harddrive",
     "--protect-hd",
     "--gemdos-case",
@@ -363,6 +365,7 @@ class Tokens:
     "--ide-master",
     "--ide-slave",
     "--ide-swap",
+    "--hd-overlay",
     "--memsize",
     "--ttram",
     "--memstate",
@@ -386,6 +389,7 @@ class Tokens:
     "--sound",
     "--sound-buffer-size",
     "--sound-sync",
+    "--sound-ff-skip",
     "--ym-mixing",
     "--debug",
     "--debug-except",
@@ -9,6 +9,12 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <SDL_atomic.h>
+#include <SDL_cpuinfo.h>
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
 
 #include "hmsa.h"
 #include "main.h"	/* bool etc. */
@@ -131,15 +137,237 @@ static const char* create_image(const char *filename, const char *sizeid)
 	return "ERROR: Disk creation failed.\n";
 }
 
+/**
+ * Return allocated name for given disk image file in the other
+ * image format, or NULL if it could not be allocated.
+ */
+static char *convert_name(const char *srcfile, bool isMsa)
+{
+	char *dstfile, *dstdot;
+
+	dstfile = malloc(strlen(srcfile) + 6);
+	if (dstfile == NULL) {
+		fprintf(stderr, "ERROR: No memory for new disk name!\n");
+		return NULL;
+	}
+	strcpy(dstfile, srcfile);
+	dstdot = strrchr(dstfile, '.');
+	if (isMsa) {
+		/* Convert MSA to ST disk image */
+		strcpy(dstdot, ".st");
+	} else {
+		/* Convert ST to MSA disk image */
+		strcpy(dstdot, ".msa");
+	}
+	return dstfile;
+}
+
+/**
+ * Convert given MSA disk image to ST one, or the other way round.
+ * Return true for success.
+ */
+static bool convert_image(const char *srcfile, const char *dstfile, bool isMsa, bool verbose)
+{
+	long disksize;
+	unsigned char *diskbuf;
+	int ImageType;
+	int drive;
+	bool ok = false;
+
+	drive = 0;                              /* drive is not used for ST/MSA/DIM, set it to 0 */
+
+	if (isMsa) {
+		/* Read the source disk image */
+		diskbuf = MSA_ReadDisk(drive, srcfile, &disksize, &ImageType);
+		if (!diskbuf || disksize < 512*8) {
+			fprintf(stderr, "ERROR: could not read MSA disk %s!\n", srcfile);
+		} else {
+			if (verbose)
+				printf("Converting %s to %s (%li Bytes).\n", srcfile, dstfile, disksize);
+			ok = File_Save(dstfile, diskbuf, disksize, FALSE);
+		}
+	} else {
+		/* Just read disk image directly into buffer */
+		disksize = 0;
+		diskbuf = File_Read(srcfile, &disksize, NULL);
+		if (!diskbuf || disksize < 512*8) {
+			fprintf(stderr, "ERROR: could not read ST disk %s!\n", srcfile);
+		} else {
+			if (verbose)
+				printf("Converting %s to %s (%li Bytes).\n", srcfile, dstfile, disksize);
+			ok = MSA_WriteDisk(drive, dstfile, diskbuf, disksize);
+		}
+	}
+
+	if (diskbuf) {
+		free(diskbuf);
+	}
+	return ok;
+}
+
+
+/* batch conversion state, shared by the worker threads */
+static struct {
+	char **files;		/* source images */
+	int count;
+	bool toMsa;		/* convert ST images to MSA, or MSA to ST */
+	SDL_atomic_t next;	/* next unconverted image */
+	SDL_mutex *lock;	/* for counters & output */
+	int done, converted, skipped, failed;
+} batch;
+
+/**
+ * Add images with the given extension from given directory and its
+ * subdirectories to the batch conversion list. Return false on error.
+ */
+static bool batch_scan(const char *dirname, const char *ext)
+{
+	struct dirent *entry;
+	struct stat st;
+	char *path, **files;
+	DIR *dir;
+	bool ok = true;
+
+	dir = opendir(dirname);
+	if (!dir) {
+		fprintf(stderr, "ERROR: could not open directory %s!\n", dirname);
+		return false;
+	}
+	while (ok && (entry = readdir(dir))) {
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+			continue;
+		path = File_MakePath(dirname, entry->d_name, "");
+		if (!path || stat(path, &st) != 0) {
+			free(path);
+			continue;
+		}
+		if (S_ISDIR(st.st_mode)) {
+			ok = batch_scan(path, ext);
+			free(path);
+			continue;
+		}
+		if (!S_ISREG(st.st_mode) || !File_DoesFileExtensionMatch(path, ext)) {
+			free(path);
+			continue;
+		}
+		if ((batch.count & 255) == 0) {
+			files = realloc(batch.files, (batch.count + 256) * sizeof(char*));
+			if (!files) {
+				fprintf(stderr, "ERROR: No memory for disk image list!\n");
+				free(path);
+				ok = false;
+				break;
+			}
+			batch.files = files;
+		}
+		batch.files[batch.count++] = path;
+	}
+	closedir(dir);
+	return ok;
+}
+
+/**
+ * Batch conversion worker thread, converts images until all are done
+ */
+static int batch_thread(void *data)
+{
+	const char *srcfile, *status;
+	char *dstfile;
+	int i;
+
+	while ((i = SDL_AtomicAdd(&batch.next, 1)) < batch.count) {
+		srcfile = batch.files[i];
+		dstfile = convert_name(srcfile, !batch.toMsa);
+		if (!dstfile) {
+			status = "FAILED";
+		} else if (File_Exists(dstfile)) {
+			status = "exists, skipped";
+		} else if (convert_image(srcfile, dstfile, !batch.toMsa, false)) {
+			status = "OK";
+		} else {
+			status = "FAILED";
+			/* remove partially written image */
+			remove(dstfile);
+		}
+
+		SDL_LockMutex(batch.lock);
+		batch.done++;
+		if (status[0] == 'O')
+			batch.converted++;
+		else if (status[0] == 'e')
+			batch.skipped++;
+		else
+			batch.failed++;
+		printf("[%d/%d] %s -> %s: %s\n", batch.done, batch.count,
+		       srcfile, dstfile ? dstfile : "?", status);
+		SDL_UnlockMutex(batch.lock);
+
+		free(dstfile);
+	}
+	return 0;
+}
+
+/**
+ * Convert all ST (or MSA) images in given directory trees to the
+ * other format, using given number of threads. Return exit value.
+ */
+static int batch_convert(char *dirs[], int ndirs, bool toMsa, int jobs)
+{
+	SDL_Thread **threads;
+	int i, started;
+
+	batch.toMsa = toMsa;
+	for (i = 0; i < ndirs; i++) {
+		if (!batch_scan(dirs[i], toMsa ? ".st" : ".msa"))
+			return -1;
+	}
+	if (!batch.count) {
+		printf("No %s disk images found.\n", toMsa ? "ST" : "MSA");
+		return 0;
+	}
+	if (jobs > batch.count)
+		jobs = batch.count;
+	printf("Converting %d disk images to %s format with %d threads.\n",
+	       batch.count, toMsa ? "MSA" : "ST", jobs);
+
+	batch.lock = SDL_CreateMutex();
+	threads = malloc(jobs * sizeof(*threads));
+	if (!batch.lock || !threads) {
+		fprintf(stderr, "ERROR: No memory for conversion threads!\n");
+		return -1;
+	}
+	SDL_AtomicSet(&batch.next, 0);
+	/* main thread is one of the workers */
+	for (started = 0; started < jobs - 1; started++) {
+		threads[started] = SDL_CreateThread(batch_thread, "hmsa", NULL);
+		if (!threads[started])
+			break;
+	}
+	batch_thread(NULL);
+	for (i = 0; i < started; i++)
+		SDL_WaitThread(threads[i], NULL);
+	free(threads);
+	SDL_DestroyMutex(batch.lock);
+
+	printf("%d converted, %d skipped, %d failed.\n",
+	       batch.converted, batch.skipped, batch.failed);
+	for (i = 0; i < batch.count; i++)
+		free(batch.files[i]);
+	free(batch.files);
+	return batch.failed ? -1 : 0;
+}
+
+
 /**
  * Print program usage
  */
 static void usage(const char *name)
 {
 		printf("\n\
-Hatari MSA (Magic Shadow Archiver) / ST disk image creator & converter v0.3.\n\
+Hatari MSA (Magic Shadow Archiver) / ST disk image creator & converter v0.4.\n\
 \n\
-Usage:  %s FILENAME [DISK SIZE]\n\
+Usage:  %s [-j THREADS] FILENAME [DISK SIZE]\n\
+        %s [-j THREADS] -b <msa|st> DIRECTORY [DIRECTORY...]\n\
 \n\
 If you give only one parameter - the file name of an existing MSA\n\
 or ST disk image, this image will be converted to the other disk image\n\
@@ -149,10 +377,15 @@ based on the file name extension (.msa or .st).\n\
 If the given file doesn't exist and you give also a disk size\n\
 (SS, DS, HD, ED), an empty disk of the given size will be created.\n\
 \n\
+With the -b option, all ST (or MSA) disk images in the given directories\n\
+and their subdirectories are converted to the given format.  Images whose\n\
+converted version exists already are skipped.  Conversions are done in\n\
+parallel, by default with as many threads as there are CPUs.\n\
+\n\
 This software is distributed under the GNU General Public License, version 2\n\
 or at your option any later version. Please read the file gpl.txt for details.\n\
 \n",
-		       name);
+		       name, name);
 }
 
 /**
@@ -161,24 +394,59 @@ or at your option any later version. Please read the file gpl.txt for details.\n
 int main(int argc, char *argv[])
 {
 	bool isMsa;
-	int retval;
-	long disksize;
-	unsigned char *diskbuf;
 	const char *srcfile, *srcdot;
-	char *dstfile, *dstdot;
-	int ImageType;
-	int drive;
+	const char *batchfmt = NULL;
+	char *dstfile;
+	int jobs, i;
+	bool ok;
+
+	jobs = SDL_GetCPUCount();
+	for (i = 1; i < argc && argv[i][0] == '-'; i += 2) {
+		if (i + 1 >= argc) {
+			usage(argv[0]);
+			return 0;
+		}
+		if (strcmp(argv[i], "-b") == 0) {
+			batchfmt = argv[i+1];
+		} else if (strcmp(argv[i], "-j") == 0) {
+			jobs = atoi(argv[i+1]);
+			if (jobs < 1) {
+				usage(argv[0]);
+				fprintf(stderr, "ERROR: invalid number of threads %s!\n", argv[i+1]);
+				return -1;
+			}
+		} else {
+			usage(argv[0]);
+			return 0;
+		}
+	}
 
-	if(argc < 2 || argv[1][0] == '-') {
+	if (batchfmt) {
+		if (i >= argc) {
+			usage(argv[0]);
+			fprintf(stderr, "ERROR: no directories given for batch conversion!\n");
+			return -1;
+		}
+		if (strcasecmp(batchfmt, "msa") == 0) {
+			return batch_convert(&argv[i], argc - i, true, jobs);
+		} else if (strcasecmp(batchfmt, "st") == 0) {
+			return batch_convert(&argv[i], argc - i, false, jobs);
+		}
+		usage(argv[0]);
+		fprintf(stderr, "ERROR: unrecognized batch conversion format %s (not msa or st)!\n", batchfmt);
+		return -1;
+	}
+	/* file name and optional disk size follow the options */
+	if (i >= argc || argc - i > 2) {
 		usage(argv[0]);
 		return 0;
 	}
 
-	srcfile = argv[1];
+	srcfile = argv[i];
 	srcdot = strrchr(srcfile, '.');
 	if(srcdot == NULL) {
 		usage(argv[0]);
-		fprintf(stderr, "ERROR: extension missing for file name %s!\n", argv[1]);
+		fprintf(stderr, "ERROR: extension missing for file name %s!\n", srcfile);
 		return -1;
 	}
 
@@ -194,12 +462,12 @@ int main(int argc, char *argv[])
 
 	if (!File_Exists(srcfile)) {
 		const char *errstr;
-		if (argc != 3) {
+		if (argc - i != 2) {
 			usage(argv[0]);
 			fprintf(stderr, "ERROR: disk size for the new disk image not given!\n");
 			return -1;
 		}
-		errstr = create_image(srcfile, argv[2]);
+		errstr = create_image(srcfile, argv[i+1]);
 		if (errstr) {
 			usage(argv[0]);
 			fputs(errstr, stderr);
@@ -208,57 +476,21 @@ int main(int argc, char *argv[])
 		return 0;
 	}
 
-	dstfile = malloc(strlen(srcfile) + 6);
+	dstfile = convert_name(srcfile, isMsa);
 	if (dstfile == NULL) {
-		fprintf(stderr, "ERROR: No memory for new disk name!\n");
 		return -1;
 	}
 
-	strcpy(dstfile, srcfile);
-	dstdot = strrchr(dstfile, '.');
-	if (isMsa) {
-		/* Convert MSA to ST disk image */
-		strcpy(dstdot, ".st");
-	} else {
-		/* Convert ST to MSA disk image */
-		strcpy(dstdot, ".msa");
-	}
-
 	if (File_Exists(dstfile)) {
 		fprintf(stderr, "ERROR: Destination disk image %s exists already!\n", dstfile);
 		free(dstfile);
 		return -1;
 	}
 
-	drive = 0;                              /* drive is not used for ST/MSA/DIM, set it to 0 */
-
-	if (isMsa) {
-		/* Read the source disk image */
-		diskbuf = MSA_ReadDisk(drive, srcfile, &disksize, &ImageType);
-		if (!diskbuf || disksize < 512*8) {
-			fprintf(stderr, "ERROR: could not read MSA disk %s!\n", srcfile);
-			retval = -1;
-		} else {
-			printf("Converting %s to %s (%li Bytes).\n", srcfile, dstfile, disksize);
-			retval = File_Save(dstfile, diskbuf, disksize, FALSE);
-		}
-	} else {
-		/* Just read disk image directly into buffer */
-		disksize = 0;
-		diskbuf = File_Read(srcfile, &disksize, NULL);
-		if (!diskbuf || disksize < 512*8) {
-			fprintf(stderr, "ERROR: could not read ST disk %s!\n", srcfile);
-			retval = -1;
-		} else {
-			printf("Converting %s to %s (%li Bytes).\n", srcfile, dstfile, disksize);
-			retval = MSA_WriteDisk(drive, dstfile, diskbuf, disksize);
-		}
-	}
-
-	if (diskbuf) {
-		free(diskbuf);
-	}
+	/* single image, use threads for its tracks instead */
+	MSA_SetThreads(jobs);
+	ok = convert_image(srcfile, dstfile, isMsa, true);
 	free(dstfile);
 
-	return retval;
+	return ok ? 0 : -1;
 }
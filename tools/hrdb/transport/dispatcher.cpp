@@ -3,6 +3,7 @@
 #include <QtNetwork>
 
 #include <iostream>
+#include <algorithm>
 
 #include "../models/targetmodel.h"
 #include "../models/stringsplitter.h"
@@ -15,6 +16,13 @@
 // Character value for the separator in responses/notifications from the target
 static const char SEP_CHAR = 1;
 
+// Options and payload encodings of the binary "memb" command
+static const uint32_t MEMB_OPT_COMPRESS = 1;
+static const uint32_t MEMB_ENCODING_ZLIB = 1;
+
+// Number of separators in a "memb" response before its binary payload
+static const int MEMB_HEADER_SEPS = 5;
+
 //-----------------------------------------------------------------------------
 int RegNameToEnum(const char* name)
 {
@@ -35,6 +43,7 @@ Dispatcher::Dispatcher(QTcpSocket* tcpSocket, TargetModel* pTargetModel) :
     m_pTcpSocket(tcpSocket),
     m_pTargetModel(pTargetModel),
     m_responseUid(100),
+    m_binaryRemaining(0),
     m_portConnected(false),
     m_waitingConnectionAck(false)
 {
@@ -62,7 +71,8 @@ uint64_t Dispatcher::InsertFlush()
 
 uint64_t Dispatcher::ReadMemory(MemorySlot slot, uint32_t address, uint32_t size, uint32_t flags)
 {
-    std::string command = std::string("mem ") + std::to_string(address) + " " + std::to_string(size) + " " + std::to_string(flags);
+    std::string command = std::string("memb ") + std::to_string(address) + " " + std::to_string(size) + " " + std::to_string(flags)
+            + " " + std::to_string(MEMB_OPT_COMPRESS);
     return SendCommandShared(slot, command);
 }
 
@@ -199,10 +209,9 @@ uint64_t Dispatcher::DebugSendRawPacket(const char *command)
     return SendCommandPacket(command);
 }
 
-void Dispatcher::ReceivePacket(const char* response)
+void Dispatcher::ReceivePacket(const std::string& new_resp)
 {
     // THIS HAPPENS ON THE EVENT LOOP
-    std::string new_resp(response);
 
     // Any flushes to handle?
     while (1)
@@ -306,6 +315,8 @@ void Dispatcher::connected()
 void Dispatcher::disconnected()
 {
     m_pTargetModel->SetConnected(0);
+    m_binaryRemaining = 0;
+    m_active_resp.clear();
 
     // Clear pending commands so that incoming responses are not confused with the first connection
     DeletePending();
@@ -326,20 +337,47 @@ void Dispatcher::readyRead()
     // Read completed commands from this and process in turn
     for (int i = 0; i < byteCount; ++i)
     {
-        if (data[i] == 0)
+        if (m_binaryRemaining)
+        {
+            // Binary payload, can contain any values
+            m_active_resp += data[i];
+            --m_binaryRemaining;
+        }
+        else if (data[i] == 0)
         {
             // End of response
-            this->ReceivePacket(m_active_resp.c_str());
+            this->ReceivePacket(m_active_resp);
             m_active_resp = std::string();
         }
         else
         {
             m_active_resp += data[i];
+            if (data[i] == SEP_CHAR)
+                CheckBinaryPayload();
         }
     }
     delete[] data;
 }
 
+// Binary "memb" responses have their payload size as the last header field,
+// so once it's complete, collect the payload without checking terminators.
+void Dispatcher::CheckBinaryPayload()
+{
+    if (m_waitingConnectionAck || m_sentCommands.size() == 0 ||
+        m_sentCommands.back()->m_cmd.compare(0, 5, "memb ") != 0 ||
+        m_active_resp.compare(0, 3, "OK\x01") != 0)
+        return;
+
+    if (std::count(m_active_resp.begin(), m_active_resp.end(), SEP_CHAR) != MEMB_HEADER_SEPS)
+        return;
+
+    size_t sizeStart = m_active_resp.find_last_of(SEP_CHAR, m_active_resp.size() - 2) + 1;
+    std::string sizeStr = m_active_resp.substr(sizeStart, m_active_resp.size() - 1 - sizeStart);
+    uint32_t payloadSize;
+    if (StringParsers::ParseHexString(sizeStr.c_str(), payloadSize))
+        m_binaryRemaining = payloadSize;
+}
+
 uint64_t Dispatcher::SendCommandPacket(const char *command)
 {
     return SendCommandShared(MemorySlot::kNone, command);
@@ -450,6 +488,53 @@ void Dispatcher::ReceiveResponsePacket(const RemoteCommand& cmd)
 
         m_pTargetModel->SetMemory(cmd.m_memorySlot, pMem, cmd.m_uid);
     }
+    else if (type == "memb")
+    {
+        std::string addrStr = splitResp.Split(SEP_CHAR);
+        std::string sizeStr = splitResp.Split(SEP_CHAR);
+        std::string encodingStr = splitResp.Split(SEP_CHAR);
+        std::string payloadSizeStr = splitResp.Split(SEP_CHAR);
+        uint32_t addr;
+        uint32_t size;
+        uint32_t encoding;
+        uint32_t payloadSize;
+        if (!StringParsers::ParseHexString(addrStr.c_str(), addr))
+            return;
+        if (!StringParsers::ParseHexString(sizeStr.c_str(), size))
+            return;
+        if (!StringParsers::ParseHexString(encodingStr.c_str(), encoding))
+            return;
+        if (!StringParsers::ParseHexString(payloadSizeStr.c_str(), payloadSize))
+            return;
+        if (payloadSize > cmd.m_response.size())
+            return;
+
+        // Payload is at the end. Don't use the splitter position, since
+        // it skips payload bytes that happen to match the separator.
+        QByteArray payload(cmd.m_response.data() + cmd.m_response.size() - payloadSize, payloadSize);
+        if (encoding == MEMB_ENCODING_ZLIB)
+        {
+            // qUncompress() expects the uncompressed size as a big-endian prefix
+            QByteArray packed;
+            packed.append(static_cast<char>(size >> 24));
+            packed.append(static_cast<char>(size >> 16));
+            packed.append(static_cast<char>(size >> 8));
+            packed.append(static_cast<char>(size));
+            packed.append(payload);
+            payload = qUncompress(packed);
+        }
+        if (static_cast<uint32_t>(payload.size()) != size)
+        {
+            std::cout << "Invalid memb payload for " << cmd.m_cmd << std::endl;
+            return;
+        }
+
+        Memory* pMem = new Memory(addr, size);
+        for (uint32_t i = 0; i < size; ++i)
+            pMem->Set(i, static_cast<uint8_t>(payload[i]));
+
+        m_pTargetModel->SetMemory(cmd.m_memorySlot, pMem, cmd.m_uid);
+    }
     else if (type == "bplist")
     {
         // Breakpoints
@@ -85,7 +85,8 @@ private:
 
     void ReceiveResponsePacket(const RemoteCommand& command);
     void ReceiveNotification(const RemoteNotification& notification);
-    void ReceivePacket(const char* response);
+    void ReceivePacket(const std::string& response);
+    void CheckBinaryPayload();
 
     void DeletePending();
 
@@ -96,6 +97,9 @@ private:
     std::string                     m_active_resp;
     uint64_t                        m_responseUid;
 
+    /* Bytes left in the binary payload of the current response */
+    uint32_t                        m_binaryRemaining;
+
     /* If true, drop incoming packets since they are assumed to be
      * from a previous connection. */
     bool                            m_portConnected;